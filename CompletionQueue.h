@@ -0,0 +1,94 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Lock-free multiple producer / single consumer queue of intrusive items.
+ * Producers push with a single compare-and-swap; the consumer takes every
+ * pushed item at once, so no item is ever popped concurrently (no ABA).
+ * The item type needs a "T* next" member.
+ */
+template <class T>
+class CCompletionQueue
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Most recently pushed item, items are linked newest first
+	std::atomic<T*> m_Head;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CCompletionQueue() : m_Head(NULL) {}
+
+	/// Push an item, can be called from any thread
+	void Push(T* inItem)
+	{
+		T* theHead = m_Head.load(std::memory_order_relaxed);
+		do
+		{
+			inItem->next = theHead;
+		} while (!m_Head.compare_exchange_weak(theHead, inItem, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/**
+	 * Take all pushed items, only called from the consumer thread
+	 * @return the first item in push order, the others are linked through "next"
+	 */
+	T* PopAll()
+	{
+		T* theItem = m_Head.exchange(NULL, std::memory_order_acquire);
+
+		// reverse the list to get the push order
+		T* theResult = NULL;
+		while (theItem != NULL)
+		{
+			T* theNext = theItem->next;
+			theItem->next = theResult;
+			theResult = theItem;
+			theItem = theNext;
+		}
+		return theResult;
+	}
+
+private:
+	/// Not copyable
+	CCompletionQueue(const CCompletionQueue&);
+	CCompletionQueue& operator=(const CCompletionQueue&);
+
+}; // end class CCompletionQueue
+
+#endif
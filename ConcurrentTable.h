@@ -0,0 +1,258 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef CONCURRENT_TABLE_H
+#define CONCURRENT_TABLE_H
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Append-only array readable without locks while one writer appends.
+ * Elements live in fixed-size blocks which never move, so a reader holding
+ * an index below GetCount() can use it while the array grows. Appending
+ * must be serialized by the caller.
+ */
+template <class T>
+class CConcurrentArray
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	enum
+	{
+		BLOCK_SHIFT = 8,
+		BLOCK_SIZE = 1 << BLOCK_SHIFT,
+		MAX_BLOCKS = 4096,
+	};
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	std::atomic<T*> m_Blocks[MAX_BLOCKS];
+	std::atomic<unsigned int> m_Count;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CConcurrentArray() : m_Count(0)
+	{
+		for (int i = 0; i < MAX_BLOCKS; ++i)
+			m_Blocks[i].store(NULL, std::memory_order_relaxed);
+	}
+
+	/// Destructor
+	~CConcurrentArray()
+	{
+		for (int i = 0; i < MAX_BLOCKS; ++i)
+			delete[] m_Blocks[i].load(std::memory_order_relaxed);
+	}
+
+	/// Number of published elements, can be called from any thread
+	inline unsigned int GetCount() const { return m_Count.load(std::memory_order_acquire); }
+
+	/// Get a published element, can be called from any thread
+	inline T& operator[](unsigned int inIndex) const
+	{
+		return m_Blocks[inIndex >> BLOCK_SHIFT].load(std::memory_order_acquire)[inIndex & (BLOCK_SIZE - 1)];
+	}
+
+	/**
+	 * Get the next element to fill, serialized by the caller; it is visible to
+	 * readers once Publish() is called
+	 * @return NULL if the array is full
+	 */
+	T* Reserve(unsigned int& outIndex)
+	{
+		outIndex = m_Count.load(std::memory_order_relaxed);
+		unsigned int theBlock = outIndex >> BLOCK_SHIFT;
+		if (theBlock >= MAX_BLOCKS)
+			return NULL;
+
+		T* theElements = m_Blocks[theBlock].load(std::memory_order_relaxed);
+		if (theElements == NULL)
+		{
+			theElements = new T[BLOCK_SIZE];
+			m_Blocks[theBlock].store(theElements, std::memory_order_release);
+		}
+		return &theElements[outIndex & (BLOCK_SIZE - 1)];
+	}
+
+	/// Publish the element returned by Reserve()
+	inline void Publish() { m_Count.store(m_Count.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+	/// Not copyable
+	CConcurrentArray(const CConcurrentArray&);
+	CConcurrentArray& operator=(const CConcurrentArray&);
+
+}; // end class CConcurrentArray
+
+/**
+ * Open addressing index from 64-bit hashes to non-zero ids, with linear
+ * probing. Lookups take no lock: a slot's hash is written before its id is
+ * published, and a full table is replaced by a larger copy which readers
+ * pick up atomically. Replaced tables are kept until destruction, so a
+ * reader still probing one never touches freed memory; they add up to less
+ * than the current table. Inserts must be serialized by the caller.
+ */
+class CConcurrentHashIndex
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+protected:
+	struct SSlot
+	{
+		std::atomic<uint64_t> hash;
+		std::atomic<unsigned int> id;	// 0 marks an empty slot
+	};
+
+	struct STable
+	{
+		size_t mask;
+		size_t count;
+		SSlot* slots;
+	};
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	std::atomic<STable*> m_Table;
+	std::vector<STable*> m_RetiredTables;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CConcurrentHashIndex() : m_Table(NULL) {}
+
+	/// Destructor
+	~CConcurrentHashIndex()
+	{
+		m_RetiredTables.push_back(m_Table.load(std::memory_order_relaxed));
+		for (size_t i = 0; i < m_RetiredTables.size(); ++i)
+			DeleteTable(m_RetiredTables[i]);
+	}
+
+	/**
+	 * Find the id of a hash, can be called from any thread
+	 * @param inIsMatch functor telling whether an id with the same hash is the one looked for
+	 * @return the id, 0 if none matches
+	 */
+	template <class TMatch>
+	unsigned int Find(uint64_t inHash, const TMatch& inIsMatch) const
+	{
+		const STable* theTable = m_Table.load(std::memory_order_acquire);
+		if (theTable == NULL)
+			return 0;
+
+		for (size_t i = (size_t)inHash & theTable->mask; ; i = (i + 1) & theTable->mask)
+		{
+			const SSlot& theSlot = theTable->slots[i];
+			unsigned int theId = theSlot.id.load(std::memory_order_acquire);
+			if (theId == 0)
+				return 0;
+			if (theSlot.hash.load(std::memory_order_relaxed) == inHash && inIsMatch(theId))
+				return theId;
+		}
+	}
+
+	/// Insert an id, serialized by the caller; the table grows to stay at most half full
+	void Insert(uint64_t inHash, unsigned int inId)
+	{
+		STable* theTable = m_Table.load(std::memory_order_relaxed);
+		if (theTable == NULL || (theTable->count + 1) * 2 > theTable->mask + 1)
+		{
+			// readers keep probing the old table until the new one is published
+			STable* theNewTable = NewTable((theTable == NULL) ? 16 : (theTable->mask + 1) * 2);
+			if (theTable != NULL)
+			{
+				for (size_t i = 0; i <= theTable->mask; ++i)
+				{
+					unsigned int theId = theTable->slots[i].id.load(std::memory_order_relaxed);
+					if (theId != 0)
+						Store(theNewTable, theTable->slots[i].hash.load(std::memory_order_relaxed), theId);
+				}
+				m_RetiredTables.push_back(theTable);
+			}
+			m_Table.store(theNewTable, std::memory_order_release);
+			theTable = theNewTable;
+		}
+		Store(theTable, inHash, inId);
+	}
+
+protected:
+	/// Write a slot, its id is published after its hash
+	static void Store(STable* ioTable, uint64_t inHash, unsigned int inId)
+	{
+		size_t i = (size_t)inHash & ioTable->mask;
+		while (ioTable->slots[i].id.load(std::memory_order_relaxed) != 0)
+			i = (i + 1) & ioTable->mask;
+		ioTable->slots[i].hash.store(inHash, std::memory_order_relaxed);
+		ioTable->slots[i].id.store(inId, std::memory_order_release);
+		++ioTable->count;
+	}
+
+	static STable* NewTable(size_t inSize)
+	{
+		STable* theTable = new STable;
+		theTable->mask = inSize - 1;
+		theTable->count = 0;
+		theTable->slots = new SSlot[inSize];
+		for (size_t i = 0; i < inSize; ++i)
+		{
+			theTable->slots[i].hash.store(0, std::memory_order_relaxed);
+			theTable->slots[i].id.store(0, std::memory_order_relaxed);
+		}
+		return theTable;
+	}
+
+	static void DeleteTable(STable* inTable)
+	{
+		if (inTable == NULL)
+			return;
+		delete[] inTable->slots;
+		delete inTable;
+	}
+
+private:
+	/// Not copyable
+	CConcurrentHashIndex(const CConcurrentHashIndex&);
+	CConcurrentHashIndex& operator=(const CConcurrentHashIndex&);
+
+}; // end class CConcurrentHashIndex
+
+#endif
@@ -0,0 +1,132 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "EGLHeadlessContext.h"
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <string.h>
+
+CEGLHeadlessContext::CEGLHeadlessContext()
+: m_Display(EGL_NO_DISPLAY),
+m_Surface(EGL_NO_SURFACE),
+m_Context(EGL_NO_CONTEXT),
+m_Width(0),
+m_Height(0)
+{
+}
+
+CEGLHeadlessContext::~CEGLHeadlessContext()
+{
+	Destroy();
+}
+
+bool CEGLHeadlessContext::Create(int inWidth, int inHeight)
+{
+	Destroy();
+
+	// client extensions are queried without a display
+	const char* theClientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (theClientExtensions != NULL && strstr(theClientExtensions, "EGL_MESA_platform_surfaceless") != NULL)
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (eglGetPlatformDisplayEXT != NULL)
+			m_Display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (m_Display == EGL_NO_DISPLAY)
+		m_Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint theMajor = 0, theMinor = 0;
+	if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &theMajor, &theMinor)) {
+		printf("Cannot initialize EGL, error: 0x%x\n", eglGetError());
+		m_Display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		printf("Cannot bind the OpenGL API, error: 0x%x\n", eglGetError());
+		Destroy();
+		return false;
+	}
+
+	const EGLint theConfigAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_NONE };
+	EGLConfig theConfig = NULL;
+	EGLint theConfigCount = 0;
+	if (!eglChooseConfig(m_Display, theConfigAttribs, &theConfig, 1, &theConfigCount) || theConfigCount == 0) {
+		printf("Cannot find an RGBA8 pbuffer config, error: 0x%x\n", eglGetError());
+		Destroy();
+		return false;
+	}
+
+	const EGLint theSurfaceAttribs[] = { EGL_WIDTH, inWidth, EGL_HEIGHT, inHeight, EGL_NONE };
+	m_Surface = eglCreatePbufferSurface(m_Display, theConfig, theSurfaceAttribs);
+	if (m_Surface == EGL_NO_SURFACE) {
+		printf("Cannot create a %dx%d pbuffer, error: 0x%x\n", inWidth, inHeight, eglGetError());
+		Destroy();
+		return false;
+	}
+
+	// a compatibility context, the demo's fallback paths use the fixed function texture enable
+	m_Context = eglCreateContext(m_Display, theConfig, EGL_NO_CONTEXT, NULL);
+	if (m_Context == EGL_NO_CONTEXT || !eglMakeCurrent(m_Display, m_Surface, m_Surface, m_Context)) {
+		printf("Cannot create the headless context, error: 0x%x\n", eglGetError());
+		Destroy();
+		return false;
+	}
+
+	m_Width = inWidth;
+	m_Height = inHeight;
+	printf("Headless EGL %d.%d context, %dx%d pbuffer\n", theMajor, theMinor, inWidth, inHeight);
+	return true;
+}
+
+void CEGLHeadlessContext::Destroy()
+{
+	if (m_Display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (m_Context != EGL_NO_CONTEXT)
+		eglDestroyContext(m_Display, m_Context);
+	if (m_Surface != EGL_NO_SURFACE)
+		eglDestroySurface(m_Display, m_Surface);
+	eglTerminate(m_Display);
+
+	m_Display = EGL_NO_DISPLAY;
+	m_Surface = EGL_NO_SURFACE;
+	m_Context = EGL_NO_CONTEXT;
+	m_Width = 0;
+	m_Height = 0;
+}
+
+void CEGLHeadlessContext::SwapBuffers()
+{
+	// no-op for a pbuffer, but ends the frame like a window's swap would
+	if (m_Surface != EGL_NO_SURFACE)
+		eglSwapBuffers(m_Display, m_Surface);
+}
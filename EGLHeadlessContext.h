@@ -0,0 +1,86 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef EGL_HEADLESS_CONTEXT_H
+#define EGL_HEADLESS_CONTEXT_H
+
+#include <EGL/egl.h>
+
+/**
+ * OpenGL rendering context without a window, for running the demo on machines
+ * without a display or GPU. The display comes from Mesa's surfaceless platform
+ * (EGL_MESA_platform_surfaceless) when available, the default display otherwise,
+ * and the context renders to a pbuffer surface, so with Mesa's llvmpipe this needs
+ * no X server and no device. Worker contexts can then be created with
+ * CEGLSharedContextFactory.
+ */
+class CEGLHeadlessContext
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	EGLDisplay m_Display;
+	EGLSurface m_Surface;
+	EGLContext m_Context;
+
+	/// Size of the pbuffer
+	int m_Width;
+	int m_Height;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CEGLHeadlessContext();
+
+	/// Destructor
+	~CEGLHeadlessContext();
+
+	/**
+	 * Create the context and its pbuffer, and make it current on the calling thread
+	 * @return true if successful, false otherwise
+	 */
+	bool Create(int inWidth, int inHeight);
+
+	/// Release the context and the display
+	void Destroy();
+
+	/// Whether the context has been created
+	inline bool IsCreated() const { return m_Context != EGL_NO_CONTEXT; }
+
+	/// Finish the frame, the pbuffer keeps its content
+	void SwapBuffers();
+
+	/// Size of the pbuffer
+	inline int GetWidth() const { return m_Width; }
+	inline int GetHeight() const { return m_Height; }
+
+}; // end class CEGLHeadlessContext
+
+#endif
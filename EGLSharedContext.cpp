@@ -0,0 +1,104 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "EGLSharedContext.h"
+#include <stdio.h>
+#include <string.h>
+
+CEGLSharedContextFactory::CEGLSharedContextFactory()
+: m_Display(EGL_NO_DISPLAY),
+m_API(EGL_OPENGL_API)
+{
+}
+
+CEGLSharedContextFactory::~CEGLSharedContextFactory()
+{
+	Destroy();
+}
+
+bool CEGLSharedContextFactory::Create(int inCount)
+{
+	Destroy();
+
+	EGLContext theShareContext = eglGetCurrentContext();
+	m_Display = eglGetCurrentDisplay();
+	m_API = eglQueryAPI();
+	if (theShareContext == EGL_NO_CONTEXT || m_Display == EGL_NO_DISPLAY) {
+		printf("Cannot create shared contexts: no current EGL context.\n");
+		return false;
+	}
+
+	const char* theExtensions = eglQueryString(m_Display, EGL_EXTENSIONS);
+	if (theExtensions == NULL || strstr(theExtensions, "EGL_KHR_surfaceless_context") == NULL) {
+		printf("Cannot create shared contexts: EGL_KHR_surfaceless_context is not supported.\n");
+		return false;
+	}
+
+	// the worker contexts use the configuration of the rendering context
+	EGLint theConfigId = 0;
+	EGLint theConfigCount = 0;
+	EGLConfig theConfig = NULL;
+	eglQueryContext(m_Display, theShareContext, EGL_CONFIG_ID, &theConfigId);
+	const EGLint theConfigAttribs[] = { EGL_CONFIG_ID, theConfigId, EGL_NONE };
+	if (!eglChooseConfig(m_Display, theConfigAttribs, &theConfig, 1, &theConfigCount) || theConfigCount == 0) {
+		printf("Cannot create shared contexts: config %d not found.\n", theConfigId);
+		return false;
+	}
+
+	for (int i = 0; i < inCount; ++i)
+	{
+		EGLContext theContext = eglCreateContext(m_Display, theConfig, theShareContext, NULL);
+		if (theContext == EGL_NO_CONTEXT) {
+			printf("Cannot create shared context, error: 0x%x\n", eglGetError());
+			Destroy();
+			return false;
+		}
+		m_Contexts.push_back(theContext);
+	}
+
+	return true;
+}
+
+void CEGLSharedContextFactory::Destroy()
+{
+	for (size_t i = 0; i < m_Contexts.size(); ++i)
+		eglDestroyContext(m_Display, m_Contexts[i]);
+	m_Contexts.clear();
+}
+
+bool CEGLSharedContextFactory::MakeCurrent(int inIndex)
+{
+	if (inIndex < 0 || inIndex >= (int)m_Contexts.size())
+		return false;
+
+	// the bound API is per thread
+	eglBindAPI(m_API);
+	return eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Contexts[inIndex]) == EGL_TRUE;
+}
+
+void CEGLSharedContextFactory::ReleaseCurrent()
+{
+	eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
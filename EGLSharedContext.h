@@ -0,0 +1,72 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef EGL_SHARED_CONTEXT_H
+#define EGL_SHARED_CONTEXT_H
+
+#include <vector>
+#include <EGL/egl.h>
+#include "SharedContext.h"
+
+/**
+ * Shared contexts on the current EGL display. The worker contexts are made
+ * current without a surface (EGL_KHR_surfaceless_context), so this works
+ * headless, e.g. with Mesa's surfaceless platform and llvmpipe.
+ */
+class CEGLSharedContextFactory : public CSharedContextFactory
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Display of the rendering context
+	EGLDisplay m_Display;
+
+	/// Client API of the rendering context, bound on each worker thread
+	EGLenum m_API;
+
+	/// Worker contexts
+	std::vector<EGLContext> m_Contexts;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CEGLSharedContextFactory();
+
+	/// Destructor
+	virtual ~CEGLSharedContextFactory();
+
+	virtual bool Create(int inCount);
+	virtual void Destroy();
+	virtual bool MakeCurrent(int inIndex);
+	virtual void ReleaseCurrent();
+
+}; // end class CEGLSharedContextFactory
+
+#endif
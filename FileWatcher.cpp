@@ -0,0 +1,197 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FileWatcher.h"
+#include <stdio.h>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+CFileWatcher::CFileWatcher()
+: m_Inotify(-1),
+m_ChangeFunction(NULL),
+m_ChangeUserData(NULL)
+{
+	m_WakePipe[0] = -1;
+	m_WakePipe[1] = -1;
+}
+
+CFileWatcher::~CFileWatcher()
+{
+	Stop();
+}
+
+bool CFileWatcher::Start(TChangeFunction inFunction, void* inUserData)
+{
+	Stop();
+
+#ifdef __linux__
+	int theInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (theInotify < 0) {
+		printf("Cannot watch shader files: inotify is not available.\n");
+		return false;
+	}
+	if (pipe(m_WakePipe) != 0) {
+		printf("Cannot watch shader files: cannot create a pipe.\n");
+		close(theInotify);
+		return false;
+	}
+
+	m_ChangeFunction = inFunction;
+	m_ChangeUserData = inUserData;
+
+	// the files given to Watch() so far
+	{
+		std::lock_guard<std::mutex> theLock(m_Mutex);
+		m_Inotify = theInotify;
+		for (std::set<std::string>::const_iterator iter = m_Files.begin(); iter != m_Files.end(); ++iter)
+		{
+			size_t theSlash = iter->find_last_of('/');
+			AddDirectory((theSlash != std::string::npos) ? iter->substr(0, theSlash + 1) : std::string());
+		}
+	}
+
+	m_Thread = std::thread(&CFileWatcher::ThreadMain, this);
+	return true;
+#else
+	(void)inFunction;
+	(void)inUserData;
+	printf("Cannot watch shader files: not supported on this platform.\n");
+	return false;
+#endif
+}
+
+void CFileWatcher::Stop()
+{
+#ifdef __linux__
+	if (m_Inotify < 0)
+		return;
+
+	// any byte on the pipe stops the thread
+	char theByte = 0;
+	if (write(m_WakePipe[1], &theByte, 1) == 1)
+		m_Thread.join();
+	else
+		m_Thread.detach();
+
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	close(m_Inotify);
+	close(m_WakePipe[0]);
+	close(m_WakePipe[1]);
+	m_Inotify = -1;
+	m_WakePipe[0] = -1;
+	m_WakePipe[1] = -1;
+	m_Directories.clear();
+	m_Prefixes.clear();
+#endif
+}
+
+void CFileWatcher::Watch(const char* inFileName)
+{
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	if (!m_Files.insert(inFileName).second)
+		return;
+
+	if (m_Inotify >= 0)
+	{
+		std::string theFileName(inFileName);
+		size_t theSlash = theFileName.find_last_of('/');
+		AddDirectory((theSlash != std::string::npos) ? theFileName.substr(0, theSlash + 1) : std::string());
+	}
+}
+
+void CFileWatcher::AddDirectory(const std::string& inPrefix)
+{
+#ifdef __linux__
+	if (m_Directories.find(inPrefix) != m_Directories.end())
+		return;
+
+	// saves either close a written file or rename a new one over it
+	int theWatch = inotify_add_watch(m_Inotify, inPrefix.empty() ? "." : inPrefix.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (theWatch < 0) {
+		printf("Cannot watch directory: %s\n", inPrefix.empty() ? "." : inPrefix.c_str());
+		return;
+	}
+	m_Directories[inPrefix] = theWatch;
+	m_Prefixes[theWatch] = inPrefix;
+#else
+	(void)inPrefix;
+#endif
+}
+
+void CFileWatcher::ThreadMain()
+{
+#ifdef __linux__
+	// aligned for struct inotify_event, large enough for several events
+	alignas(struct inotify_event) char theBuffer[4096];
+	std::vector<std::string> theChanges;
+
+	for (;;)
+	{
+		struct pollfd theDescriptors[2] = { { m_Inotify, POLLIN, 0 }, { m_WakePipe[0], POLLIN, 0 } };
+		if (poll(theDescriptors, 2, -1) < 0)
+			continue;
+		if (theDescriptors[1].revents != 0)
+			break;
+
+		theChanges.clear();
+		{
+			std::lock_guard<std::mutex> theLock(m_Mutex);
+			ssize_t theLength;
+			while ((theLength = read(m_Inotify, theBuffer, sizeof(theBuffer))) > 0)
+			{
+				for (ssize_t i = 0; i < theLength; )
+				{
+					const struct inotify_event* theEvent = (const struct inotify_event*)(theBuffer + i);
+					i += sizeof(struct inotify_event) + theEvent->len;
+
+					std::map<int, std::string>::const_iterator thePrefix = m_Prefixes.find(theEvent->wd);
+					if (theEvent->len == 0 || thePrefix == m_Prefixes.end())
+						continue;
+
+					// a file written several times in one read is reported once
+					std::string theFileName = thePrefix->second + theEvent->name;
+					if (m_Files.find(theFileName) != m_Files.end())
+					{
+						bool isReported = false;
+						for (size_t j = 0; j < theChanges.size() && !isReported; ++j)
+							isReported = (theChanges[j] == theFileName);
+						if (!isReported)
+							theChanges.push_back(theFileName);
+					}
+				}
+			}
+		}
+
+		// reported without the lock, the function may watch more files
+		for (size_t i = 0; i < theChanges.size(); ++i)
+			m_ChangeFunction(theChanges[i].c_str(), m_ChangeUserData);
+	}
+#endif
+}
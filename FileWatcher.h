@@ -0,0 +1,116 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+#include <set>
+#include <map>
+#include <thread>
+#include <mutex>
+
+/**
+ * Reports files which were written on disk, from a background thread (inotify, Linux only).
+ * The directories of the files are watched rather than the files, so editors which save by
+ * writing a new file and renaming it over the old one are seen too.
+ */
+class CFileWatcher
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	/// Called on the watcher thread with the name of a changed file, as given to Watch()
+	typedef void (*TChangeFunction)(const char* inFileName, void* inUserData);
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Names of the watched files
+	std::set<std::string> m_Files;
+
+	/// Watch descriptors by directory prefix of the files, e.g. "" or "shaders/"
+	std::map<std::string, int> m_Directories;
+
+	/// Directory prefixes by watch descriptor
+	std::map<int, std::string> m_Prefixes;
+
+	/// Guards the files and directories, Watch() is called from the shader worker threads too
+	std::mutex m_Mutex;
+
+	/// inotify instance, and a pipe which wakes the thread up to stop it
+	int m_Inotify;
+	int m_WakePipe[2];
+
+	/// Thread reading the changes, and the function it reports them to
+	std::thread m_Thread;
+	TChangeFunction m_ChangeFunction;
+	void* m_ChangeUserData;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CFileWatcher();
+
+	/// Destructor, stops the thread
+	~CFileWatcher();
+
+	/**
+	 * Start watching the files given to Watch(), before and after this call
+	 * @param inFunction called on the watcher thread for every written file
+	 * @return false if file notifications are not available
+	 */
+	bool Start(TChangeFunction inFunction, void* inUserData);
+
+	/// Stop the watcher thread
+	void Stop();
+
+	/// Whether the watcher thread runs
+	inline bool IsRunning() const { return m_Inotify >= 0; }
+
+	/// Add a file to watch, watching the same file again does nothing
+	void Watch(const char* inFileName);
+
+protected:
+	/// Watch the directory of a prefix; with m_Mutex locked
+	void AddDirectory(const std::string& inPrefix);
+
+	/// Main function of the watcher thread
+	void ThreadMain();
+
+private:
+	/// Not copyable, the thread and descriptors are owned
+	CFileWatcher(const CFileWatcher&);
+	CFileWatcher& operator=(const CFileWatcher&);
+
+}; // end class CFileWatcher
+
+#endif
@@ -0,0 +1,292 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "GLStateCache.h"
+#include <GL/glew.h>
+
+CGLStateCache* CGLStateCache::s_Instance = NULL;
+
+/// Shadowed name of a binding in an unknown state, never a valid GL name
+const unsigned int UNKNOWN_NAME = 0xFFFFFFFF;
+
+CGLStateCache::CGLStateCache()
+: m_IssuedCount(0)
+, m_FilteredCount(0)
+, m_FrameIssuedCount(0)
+, m_FrameFilteredCount(0)
+{
+	Invalidate();
+}
+
+CGLStateCache* CGLStateCache::GetInstance()
+{
+	if (s_Instance == NULL)
+		s_Instance = new CGLStateCache;
+	return (s_Instance);
+}
+
+void CGLStateCache::Invalidate()
+{
+	m_Program = UNKNOWN_NAME;
+	m_VertexArray = UNKNOWN_NAME;
+	for (int i = 0; i < BUFFER_TARGET_COUNT; ++i)
+		m_Buffers[i] = UNKNOWN_NAME;
+	for (int i = 0; i < MAX_UNIFORM_BUFFER_BINDINGS; ++i)
+		m_UniformBufferRanges[i].buffer = UNKNOWN_NAME;
+
+	m_ActiveTexture = UNKNOWN_NAME;
+	for (int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+	{
+		for (int j = 0; j < TEXTURE_TARGET_COUNT; ++j)
+			m_Textures[i][j] = UNKNOWN_NAME;
+		m_Texture2DEnables[i] = -1;
+	}
+	for (int i = 0; i < CAPABILITY_COUNT; ++i)
+		m_Capabilities[i] = -1;
+}
+
+void CGLStateCache::UseProgram(unsigned int inProgram)
+{
+	if (!Filter(m_Program == inProgram))
+		return;
+
+	glUseProgram(inProgram);
+	m_Program = inProgram;
+}
+
+void CGLStateCache::BindVertexArray(unsigned int inVertexArray)
+{
+	if (!Filter(m_VertexArray == inVertexArray))
+		return;
+
+	glBindVertexArray(inVertexArray);
+	m_VertexArray = inVertexArray;
+
+	// the element array binding is part of the vertex array, it is not tracked per VAO
+	m_Buffers[BUFFER_ELEMENT_ARRAY] = UNKNOWN_NAME;
+}
+
+void CGLStateCache::BindBuffer(unsigned int inTarget, unsigned int inBuffer)
+{
+	int theIndex = GetBufferTargetIndex(inTarget);
+	if (theIndex == BUFFER_TARGET_COUNT)
+	{
+		Filter(false);
+		glBindBuffer(inTarget, inBuffer);
+		return;
+	}
+
+	if (!Filter(m_Buffers[theIndex] == inBuffer))
+		return;
+
+	glBindBuffer(inTarget, inBuffer);
+	m_Buffers[theIndex] = inBuffer;
+}
+
+void CGLStateCache::BindBufferRange(unsigned int inTarget, unsigned int inIndex, unsigned int inBuffer, long long inOffset, long long inSize)
+{
+	if (inTarget != GL_UNIFORM_BUFFER || inIndex >= MAX_UNIFORM_BUFFER_BINDINGS)
+	{
+		Filter(false);
+		glBindBufferRange(inTarget, inIndex, inBuffer, (GLintptr)inOffset, (GLsizeiptr)inSize);
+		int theTarget = GetBufferTargetIndex(inTarget);
+		if (theTarget != BUFFER_TARGET_COUNT)
+			m_Buffers[theTarget] = inBuffer;
+		return;
+	}
+
+	SBufferRange& theRange = m_UniformBufferRanges[inIndex];
+	if (!Filter(theRange.buffer == inBuffer && theRange.offset == inOffset && theRange.size == inSize))
+		return;
+
+	glBindBufferRange(inTarget, inIndex, inBuffer, (GLintptr)inOffset, (GLsizeiptr)inSize);
+	theRange.buffer = inBuffer;
+	theRange.offset = inOffset;
+	theRange.size = inSize;
+	m_Buffers[BUFFER_UNIFORM] = inBuffer;
+}
+
+void CGLStateCache::ActiveTexture(unsigned int inUnit)
+{
+	if (!Filter(m_ActiveTexture == inUnit))
+		return;
+
+	glActiveTexture(GL_TEXTURE0 + inUnit);
+	m_ActiveTexture = inUnit;
+}
+
+void CGLStateCache::BindTexture(unsigned int inUnit, unsigned int inTarget, unsigned int inTexture)
+{
+	int theIndex = GetTextureTargetIndex(inTarget);
+	if (theIndex == TEXTURE_TARGET_COUNT || inUnit >= MAX_TEXTURE_UNITS)
+	{
+		ActiveTexture(inUnit);
+		Filter(false);
+		glBindTexture(inTarget, inTexture);
+		return;
+	}
+
+	// the unit is left active for a filtered bind too, GL_TEXTURE_2D enables go to it
+	ActiveTexture(inUnit);
+	if (!Filter(m_Textures[inUnit][theIndex] == inTexture))
+		return;
+
+	glBindTexture(inTarget, inTexture);
+	m_Textures[inUnit][theIndex] = inTexture;
+}
+
+void CGLStateCache::SetEnabled(unsigned int inCapability, bool inIsEnabled)
+{
+	signed char* theEnable = NULL;
+	if (inCapability == GL_TEXTURE_2D)
+	{
+		// fixed function texturing is enabled per texture unit
+		if (m_ActiveTexture < MAX_TEXTURE_UNITS)
+			theEnable = &m_Texture2DEnables[m_ActiveTexture];
+	}
+	else
+	{
+		int theIndex = GetCapabilityIndex(inCapability);
+		if (theIndex != CAPABILITY_COUNT)
+			theEnable = &m_Capabilities[theIndex];
+	}
+
+	if (!Filter(theEnable != NULL && *theEnable == (inIsEnabled ? 1 : 0)))
+		return;
+
+	if (inIsEnabled)
+		glEnable(inCapability);
+	else
+		glDisable(inCapability);
+	if (theEnable != NULL)
+		*theEnable = inIsEnabled ? 1 : 0;
+}
+
+void CGLStateCache::OnDeleteProgram(unsigned int inProgram)
+{
+	// a deleted program in use stays in use, the next UseProgram has to be issued
+	if (m_Program == inProgram)
+		m_Program = UNKNOWN_NAME;
+}
+
+void CGLStateCache::OnDeleteVertexArray(unsigned int inVertexArray)
+{
+	if (m_VertexArray == inVertexArray)
+	{
+		m_VertexArray = 0;
+		m_Buffers[BUFFER_ELEMENT_ARRAY] = UNKNOWN_NAME;
+	}
+}
+
+void CGLStateCache::OnDeleteBuffer(unsigned int inBuffer)
+{
+	for (int i = 0; i < BUFFER_TARGET_COUNT; ++i)
+	{
+		if (m_Buffers[i] == inBuffer)
+			m_Buffers[i] = 0;
+	}
+	for (int i = 0; i < MAX_UNIFORM_BUFFER_BINDINGS; ++i)
+	{
+		if (m_UniformBufferRanges[i].buffer == inBuffer)
+			m_UniformBufferRanges[i].buffer = UNKNOWN_NAME;
+	}
+}
+
+void CGLStateCache::OnDeleteTexture(unsigned int inTexture)
+{
+	for (int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+	{
+		for (int j = 0; j < TEXTURE_TARGET_COUNT; ++j)
+		{
+			if (m_Textures[i][j] == inTexture)
+				m_Textures[i][j] = 0;
+		}
+	}
+}
+
+void CGLStateCache::EndFrame()
+{
+	m_FrameIssuedCount = m_IssuedCount;
+	m_FrameFilteredCount = m_FilteredCount;
+	m_IssuedCount = 0;
+	m_FilteredCount = 0;
+}
+
+unsigned int CGLStateCache::GetFrameIssuedCount() const
+{
+	return m_FrameIssuedCount;
+}
+
+unsigned int CGLStateCache::GetFrameFilteredCount() const
+{
+	return m_FrameFilteredCount;
+}
+
+int CGLStateCache::GetBufferTargetIndex(unsigned int inTarget)
+{
+	switch (inTarget)
+	{
+	case GL_ARRAY_BUFFER:			return BUFFER_ARRAY;
+	case GL_ELEMENT_ARRAY_BUFFER:	return BUFFER_ELEMENT_ARRAY;
+	case GL_UNIFORM_BUFFER:			return BUFFER_UNIFORM;
+	case GL_DRAW_INDIRECT_BUFFER:	return BUFFER_DRAW_INDIRECT;
+	case GL_SHADER_STORAGE_BUFFER:	return BUFFER_SHADER_STORAGE;
+	default:						return BUFFER_TARGET_COUNT;
+	}
+}
+
+int CGLStateCache::GetTextureTargetIndex(unsigned int inTarget)
+{
+	switch (inTarget)
+	{
+	case GL_TEXTURE_2D:			return TEXTURE_2D;
+	case GL_TEXTURE_CUBE_MAP:	return TEXTURE_CUBE_MAP;
+	default:					return TEXTURE_TARGET_COUNT;
+	}
+}
+
+int CGLStateCache::GetCapabilityIndex(unsigned int inCapability)
+{
+	switch (inCapability)
+	{
+	case GL_DEPTH_TEST:		return CAPABILITY_DEPTH_TEST;
+	case GL_BLEND:			return CAPABILITY_BLEND;
+	case GL_CULL_FACE:		return CAPABILITY_CULL_FACE;
+	case GL_SCISSOR_TEST:	return CAPABILITY_SCISSOR_TEST;
+	case GL_STENCIL_TEST:	return CAPABILITY_STENCIL_TEST;
+	default:				return CAPABILITY_COUNT;
+	}
+}
+
+bool CGLStateCache::Filter(bool inIsRedundant)
+{
+	if (inIsRedundant)
+	{
+		++m_FilteredCount;
+		return false;
+	}
+	++m_IssuedCount;
+	return true;
+}
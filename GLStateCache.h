@@ -0,0 +1,198 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+/**
+ * Shadow of the GL binding state of the main context. Program, buffer,
+ * vertex array and texture binds and capability enables go through here,
+ * a call setting the state it is already in is dropped. Code drawing on the
+ * main context must not change these states behind the cache's back, or
+ * must call Invalidate() afterwards.
+ */
+class CGLStateCache
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	enum
+	{
+		MAX_TEXTURE_UNITS = 16,
+		MAX_UNIFORM_BUFFER_BINDINGS = 16,
+	};
+
+protected:
+	/// Buffer targets with a shadowed binding
+	enum EBufferTarget
+	{
+		BUFFER_ARRAY,
+		BUFFER_ELEMENT_ARRAY,
+		BUFFER_UNIFORM,
+		BUFFER_DRAW_INDIRECT,
+		BUFFER_SHADER_STORAGE,
+		BUFFER_TARGET_COUNT,
+	};
+
+	/// Texture targets with a shadowed binding per unit
+	enum ETextureTarget
+	{
+		TEXTURE_2D,
+		TEXTURE_CUBE_MAP,
+		TEXTURE_TARGET_COUNT,
+	};
+
+	/// Capabilities with a shadowed enable, GL_TEXTURE_2D is per texture unit
+	enum ECapability
+	{
+		CAPABILITY_DEPTH_TEST,
+		CAPABILITY_BLEND,
+		CAPABILITY_CULL_FACE,
+		CAPABILITY_SCISSOR_TEST,
+		CAPABILITY_STENCIL_TEST,
+		CAPABILITY_COUNT,
+	};
+
+	/// Range bound to an indexed uniform buffer binding point
+	struct SBufferRange
+	{
+		unsigned int buffer;
+		long long offset;
+		long long size;
+	};
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Program in use
+	unsigned int m_Program;
+
+	/// Bound vertex array
+	unsigned int m_VertexArray;
+
+	/// Bound buffer of each target, the element array binding belongs to the bound vertex array
+	unsigned int m_Buffers[BUFFER_TARGET_COUNT];
+
+	/// Ranges bound to the uniform buffer binding points
+	SBufferRange m_UniformBufferRanges[MAX_UNIFORM_BUFFER_BINDINGS];
+
+	/// Active texture unit
+	unsigned int m_ActiveTexture;
+
+	/// Bound textures of each unit
+	unsigned int m_Textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+
+	/// Enables of the capabilities, -1 if unknown
+	signed char m_Capabilities[CAPABILITY_COUNT];
+
+	/// GL_TEXTURE_2D enable of each texture unit, -1 if unknown
+	signed char m_Texture2DEnables[MAX_TEXTURE_UNITS];
+
+	/// Calls issued and dropped in the current frame
+	unsigned int m_IssuedCount;
+	unsigned int m_FilteredCount;
+
+	/// Calls issued and dropped in the last completed frame
+	unsigned int m_FrameIssuedCount;
+	unsigned int m_FrameFilteredCount;
+
+	/// The unique instance of this class
+	static CGLStateCache* s_Instance;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	// Get the unique instance of this class
+	static CGLStateCache* GetInstance();
+
+	/// Forget the shadowed state, the next call of each kind is issued
+	void Invalidate();
+
+	/// glUseProgram
+	void UseProgram(unsigned int inProgram);
+
+	/// glBindVertexArray
+	void BindVertexArray(unsigned int inVertexArray);
+
+	/// glBindBuffer, targets without a shadow are passed through
+	void BindBuffer(unsigned int inTarget, unsigned int inBuffer);
+
+	/// glBindBufferRange on a uniform buffer binding point, also sets the generic binding
+	void BindBufferRange(unsigned int inTarget, unsigned int inIndex, unsigned int inBuffer, long long inOffset, long long inSize);
+
+	/// glActiveTexture with the unit index (not GL_TEXTURE0 + unit)
+	void ActiveTexture(unsigned int inUnit);
+
+	/// Bind a texture to a unit, the unit is left active even if the binding is filtered
+	void BindTexture(unsigned int inUnit, unsigned int inTarget, unsigned int inTexture);
+
+	/// glEnable/glDisable, capabilities without a shadow are passed through
+	void SetEnabled(unsigned int inCapability, bool inIsEnabled);
+
+	/// Drop a deleted program, deleting the program in use unbinds it
+	void OnDeleteProgram(unsigned int inProgram);
+
+	/// Drop a deleted vertex array
+	void OnDeleteVertexArray(unsigned int inVertexArray);
+
+	/// Drop a deleted buffer from all targets
+	void OnDeleteBuffer(unsigned int inBuffer);
+
+	/// Drop a deleted texture from all units
+	void OnDeleteTexture(unsigned int inTexture);
+
+	/// Latch the counters of the frame and restart them, call once per frame
+	void EndFrame();
+
+	/// State changes issued to GL in the last completed frame
+	unsigned int GetFrameIssuedCount() const;
+
+	/// Redundant state changes dropped in the last completed frame
+	unsigned int GetFrameFilteredCount() const;
+
+protected:
+	/// Default constructor (protected)
+	CGLStateCache();
+
+	/// Index of a shadowed buffer target, BUFFER_TARGET_COUNT if not shadowed
+	static int GetBufferTargetIndex(unsigned int inTarget);
+
+	/// Index of a shadowed texture target, TEXTURE_TARGET_COUNT if not shadowed
+	static int GetTextureTargetIndex(unsigned int inTarget);
+
+	/// Index of a shadowed capability, CAPABILITY_COUNT if not shadowed
+	static int GetCapabilityIndex(unsigned int inCapability);
+
+	/// Count a call, return true if it has to be issued
+	bool Filter(bool inIsRedundant);
+
+}; // end class CGLStateCache
+
+#endif
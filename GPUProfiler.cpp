@@ -0,0 +1,288 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "GPUProfiler.h"
+#include "Shader.h"
+#include <GL/glew.h>
+#include <algorithm>
+
+CGPUProfiler* CGPUProfiler::s_Instance = NULL;
+
+CGPUProfiler::CGPUProfiler()
+: m_FrameIndex(0),
+m_IsInFrame(false),
+m_BatchShader(NULL),
+m_NextFrameSample(0),
+m_FrameCount(0),
+m_TotalFrameTime(0.0),
+m_DroppedFrameCount(0)
+{
+}
+
+CGPUProfiler::~CGPUProfiler()
+{
+}
+
+CGPUProfiler* CGPUProfiler::GetInstance()
+{
+	if (s_Instance == NULL)
+		s_Instance = new CGPUProfiler;
+	return (s_Instance);
+}
+
+bool CGPUProfiler::Initialize(int inFrameCount)
+{
+	if (IsInitialized())
+		return true;
+
+	if (!GLEW_ARB_timer_query && !GLEW_VERSION_3_3) {
+		printf("GPU profiler disabled: timer queries are not supported.\n");
+		return false;
+	}
+
+	// a driver may expose the extension with a timestamp counter of no bits
+	GLint theBits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &theBits);
+	if (theBits == 0) {
+		printf("GPU profiler disabled: timestamps are not supported.\n");
+		return false;
+	}
+
+	m_Frames.resize((inFrameCount > 1) ? inFrameCount : 2);
+	for (size_t i = 0; i < m_Frames.size(); ++i)
+	{
+		m_Frames[i].queryCount = 0;
+		m_Frames[i].isPending = false;
+	}
+	m_FrameIndex = 0;
+	return true;
+}
+
+void CGPUProfiler::Dispose()
+{
+	for (size_t i = 0; i < m_Frames.size(); ++i)
+	{
+		if (!m_Frames[i].queries.empty())
+			glDeleteQueries((GLsizei)m_Frames[i].queries.size(), &m_Frames[i].queries[0]);
+	}
+	m_Frames.clear();
+	m_IsInFrame = false;
+	m_BatchShader = NULL;
+}
+
+void CGPUProfiler::BeginFrame()
+{
+	if (!IsInitialized())
+		return;
+
+	m_FrameIndex = (m_FrameIndex + 1) % (int)m_Frames.size();
+	SFrame& theFrame = m_Frames[m_FrameIndex];
+	CollectFrame(theFrame);
+
+	theFrame.queryCount = 0;
+	theFrame.batches.clear();
+	m_IsInFrame = true;
+	AddTimestamp();
+}
+
+void CGPUProfiler::EndFrame()
+{
+	if (!m_IsInFrame)
+		return;
+
+	EndBatch();
+	AddTimestamp();
+	m_Frames[m_FrameIndex].isPending = true;
+	m_IsInFrame = false;
+}
+
+void CGPUProfiler::Reset()
+{
+	m_FrameSamples.clear();
+	m_NextFrameSample = 0;
+	m_FrameCount = 0;
+	m_TotalFrameTime = 0.0;
+	m_DroppedFrameCount = 0;
+	m_ShaderStats.clear();
+}
+
+double CGPUProfiler::GetFramePercentile(double inPercentile) const
+{
+	return GetPercentile(m_FrameSamples, inPercentile);
+}
+
+const CGPUProfiler::SShaderStats* CGPUProfiler::GetShaderStats(CShader* inShader) const
+{
+	TShaderStatsMap::const_iterator iter = m_ShaderStats.find(inShader);
+	return (iter != m_ShaderStats.end()) ? &iter->second : NULL;
+}
+
+double CGPUProfiler::GetShaderPercentile(CShader* inShader, double inPercentile) const
+{
+	const SShaderStats* theStats = GetShaderStats(inShader);
+	return (theStats != NULL) ? GetPercentile(theStats->samples, inPercentile) : 0.0;
+}
+
+/// Orders programs by decreasing total time
+static bool IsMoreExpensive(const CGPUProfiler::SShaderStats* inStats, const CGPUProfiler::SShaderStats* inOther)
+{
+	return inStats->totalTime > inOther->totalTime;
+}
+
+void CGPUProfiler::PrintReport() const
+{
+	if (!IsInitialized() && m_FrameCount == 0)
+		return;
+
+	printf("GPU time: %u frames, %u dropped, mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n"
+		, m_FrameCount, m_DroppedFrameCount, GetMeanFrameTime() * 1000.0
+		, GetFramePercentile(50.0) * 1000.0, GetFramePercentile(95.0) * 1000.0, GetFramePercentile(99.0) * 1000.0);
+
+	std::vector<const SShaderStats*> thePrograms;
+	for (TShaderStatsMap::const_iterator iter = m_ShaderStats.begin(); iter != m_ShaderStats.end(); ++iter)
+		thePrograms.push_back(&iter->second);
+	std::sort(thePrograms.begin(), thePrograms.end(), IsMoreExpensive);
+
+	// times per frame the program was drawn in
+	for (size_t i = 0; i < thePrograms.size(); ++i)
+	{
+		const SShaderStats& theStats = *thePrograms[i];
+		printf("  program %4u: %6u frames %7u batches, mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n"
+			, theStats.program, theStats.frameCount, theStats.batchCount, theStats.totalTime / theStats.frameCount * 1000.0
+			, GetPercentile(theStats.samples, 50.0) * 1000.0, GetPercentile(theStats.samples, 95.0) * 1000.0
+			, GetPercentile(theStats.samples, 99.0) * 1000.0);
+	}
+}
+
+void CGPUProfiler::AddBatch(CShader* inShader)
+{
+	EndBatch();
+
+	SBatch theBatch;
+	theBatch.shader = inShader;
+	theBatch.program = inShader->GetProgram();
+	theBatch.beginQuery = AddTimestamp();
+	theBatch.endQuery = theBatch.beginQuery;
+	m_Frames[m_FrameIndex].batches.push_back(theBatch);
+	m_BatchShader = inShader;
+}
+
+void CGPUProfiler::CloseBatch()
+{
+	m_Frames[m_FrameIndex].batches.back().endQuery = AddTimestamp();
+	m_BatchShader = NULL;
+}
+
+unsigned int CGPUProfiler::AddTimestamp()
+{
+	SFrame& theFrame = m_Frames[m_FrameIndex];
+	if (theFrame.queryCount == theFrame.queries.size())
+	{
+		// grow the pool by doubling, queries are created outside the steady state only
+		size_t theSize = theFrame.queries.size();
+		theFrame.queries.resize((theSize != 0) ? theSize * 2 : 16);
+		glGenQueries((GLsizei)(theFrame.queries.size() - theSize), &theFrame.queries[theSize]);
+	}
+
+	unsigned int theIndex = theFrame.queryCount++;
+	glQueryCounter(theFrame.queries[theIndex], GL_TIMESTAMP);
+	return theIndex;
+}
+
+void CGPUProfiler::CollectFrame(SFrame& ioFrame)
+{
+	if (!ioFrame.isPending)
+		return;
+	ioFrame.isPending = false;
+
+	// results become available in order, the last query of the frame stands for all
+	GLint isAvailable = 0;
+	glGetQueryObjectiv(ioFrame.queries[ioFrame.queryCount - 1], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+	if (!isAvailable) {
+		++m_DroppedFrameCount;
+		return;
+	}
+
+	std::vector<GLuint64> theTimes(ioFrame.queryCount);
+	for (unsigned int i = 0; i < ioFrame.queryCount; ++i)
+		glGetQueryObjectui64v(ioFrame.queries[i], GL_QUERY_RESULT, &theTimes[i]);
+
+	double theFrameTime = (double)(theTimes[ioFrame.queryCount - 1] - theTimes[0]) * 1e-9;
+	AddSample(m_FrameSamples, m_NextFrameSample, theFrameTime);
+	m_TotalFrameTime += theFrameTime;
+	++m_FrameCount;
+
+	// sum the batches of each program, a sample is the program's time in this frame
+	std::map<CShader*, double> theFrameShaderTimes;
+	for (size_t i = 0; i < ioFrame.batches.size(); ++i)
+	{
+		const SBatch& theBatch = ioFrame.batches[i];
+		double theTime = (double)(theTimes[theBatch.endQuery] - theTimes[theBatch.beginQuery]) * 1e-9;
+		theFrameShaderTimes[theBatch.shader] += theTime;
+
+		std::pair<TShaderStatsMap::iterator, bool> theInsert = m_ShaderStats.insert(std::make_pair(theBatch.shader, SShaderStats()));
+		SShaderStats& theStats = theInsert.first->second;
+		if (theInsert.second)
+		{
+			theStats.frameCount = 0;
+			theStats.batchCount = 0;
+			theStats.totalTime = 0.0;
+			theStats.nextSample = 0;
+		}
+		theStats.program = theBatch.program;
+		++theStats.batchCount;
+		theStats.totalTime += theTime;
+	}
+
+	for (std::map<CShader*, double>::const_iterator iter = theFrameShaderTimes.begin(); iter != theFrameShaderTimes.end(); ++iter)
+	{
+		SShaderStats& theStats = m_ShaderStats[iter->first];
+		++theStats.frameCount;
+		AddSample(theStats.samples, theStats.nextSample, iter->second);
+	}
+}
+
+void CGPUProfiler::AddSample(std::vector<double>& ioSamples, size_t& ioNext, double inSample)
+{
+	if (ioSamples.size() < MAX_SAMPLES)
+		ioSamples.push_back(inSample);
+	else
+		ioSamples[ioNext] = inSample;
+	ioNext = (ioNext + 1) % MAX_SAMPLES;
+}
+
+double CGPUProfiler::GetPercentile(const std::vector<double>& inSamples, double inPercentile)
+{
+	if (inSamples.empty())
+		return 0.0;
+
+	// nearest rank on a copy, the ring keeps its order
+	std::vector<double> theSamples(inSamples);
+	size_t theRank = (size_t)(inPercentile / 100.0 * (theSamples.size() - 1) + 0.5);
+	if (theRank >= theSamples.size())
+		theRank = theSamples.size() - 1;
+	std::nth_element(theSamples.begin(), theSamples.begin() + theRank, theSamples.end());
+	return theSamples[theRank];
+}
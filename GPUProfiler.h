@@ -0,0 +1,213 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <cstddef>
+
+class CShader;
+
+/**
+ * GPU time of the draw batches, by program and by frame, from timestamp queries.
+ * Each batch is enclosed in two glQueryCounter(GL_TIMESTAMP) queries taken from a
+ * pool per frame in flight; the results of a frame are read when its pool is reused,
+ * frames later, and only if they are available, so reading never stalls the pipeline.
+ * A frame whose results are late is dropped from the stats and counted.
+ *
+ * Timestamps are used rather than GL_TIME_ELAPSED so batches can be timed within
+ * a frame timed as a whole, and any other code may still use GL_TIME_ELAPSED.
+ * Use from the rendering thread only.
+ */
+class CGPUProfiler
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	enum
+	{
+		/// Number of samples kept for the percentiles, by frame and by program
+		MAX_SAMPLES = 1024,
+	};
+
+	/// GPU time of a program's batches, per frame the program was drawn in
+	struct SShaderStats
+	{
+		unsigned int program;		// GL handle of the program when it was last drawn
+		unsigned int frameCount;	// frames the program was drawn in
+		unsigned int batchCount;	// batches drawn
+		double totalTime;			// seconds
+		std::vector<double> samples;	// last MAX_SAMPLES times per frame, in seconds
+		size_t nextSample;
+	};
+
+protected:
+	/// A timed batch, its queries index the frame's pool
+	struct SBatch
+	{
+		CShader* shader;
+		unsigned int program;
+		unsigned int beginQuery;
+		unsigned int endQuery;
+	};
+
+	/// Queries of a frame in flight
+	struct SFrame
+	{
+		std::vector<unsigned int> queries;	// pool, grown on demand and never shrunk
+		unsigned int queryCount;			// queries used this frame
+		std::vector<SBatch> batches;
+		bool isPending;						// whether results are still to be read
+	};
+
+	typedef std::map<CShader*, SShaderStats> TShaderStatsMap;
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Query pools, one per frame in flight, and the frame being recorded
+	std::vector<SFrame> m_Frames;
+	int m_FrameIndex;
+	bool m_IsInFrame;
+
+	/// The frame's open batch, NULL between batches
+	CShader* m_BatchShader;
+
+	/// GPU time of the frames, last MAX_SAMPLES, in seconds
+	std::vector<double> m_FrameSamples;
+	size_t m_NextFrameSample;
+	unsigned int m_FrameCount;
+	double m_TotalFrameTime;
+
+	/// Frames whose results were not available when their pool was reused
+	unsigned int m_DroppedFrameCount;
+
+	/// GPU time by program
+	TShaderStatsMap m_ShaderStats;
+
+	/// The unique instance of this class
+	static CGPUProfiler* s_Instance;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Destructor
+	~CGPUProfiler();
+
+	// Get the unique instance of this class
+	static CGPUProfiler* GetInstance();
+
+	/**
+	 * Enable the profiler, requires a current OpenGL context
+	 * @param inFrameCount number of frames in flight, results are read this many frames late
+	 * @return true if timer queries are supported, false otherwise
+	 */
+	bool Initialize(int inFrameCount);
+
+	/// Whether the profiler has been enabled
+	inline bool IsInitialized() const { return !m_Frames.empty(); }
+
+	/// Release the queries, requires a current OpenGL context
+	void Dispose();
+
+	/// Start a frame, reads the results of the frame which used its pool last
+	void BeginFrame();
+
+	/// End a frame
+	void EndFrame();
+
+	/// Start timing a batch drawn with a program, before its UseProgram; nothing outside a frame
+	inline void BeginBatch(CShader* inShader)
+	{
+		if (m_IsInFrame)
+			AddBatch(inShader);
+	}
+
+	/// End timing the batch, after its draw calls
+	inline void EndBatch()
+	{
+		if (m_BatchShader != NULL)
+			CloseBatch();
+	}
+
+	/// Clear the stats, queries in flight are still read
+	void Reset();
+
+	/// Number of frames measured and dropped
+	inline unsigned int GetFrameCount() const { return m_FrameCount; }
+	inline unsigned int GetDroppedFrameCount() const { return m_DroppedFrameCount; }
+
+	/// Mean GPU time of the measured frames in seconds
+	inline double GetMeanFrameTime() const { return (m_FrameCount != 0) ? m_TotalFrameTime / m_FrameCount : 0.0; }
+
+	/**
+	 * Percentile of the GPU time of the last MAX_SAMPLES frames
+	 * @param inPercentile from 0 to 100, e.g. 95
+	 * @return the time in seconds, 0 if no frame was measured
+	 */
+	double GetFramePercentile(double inPercentile) const;
+
+	/// GPU time of a program's batches, NULL if the program was not measured
+	const SShaderStats* GetShaderStats(CShader* inShader) const;
+
+	/// Percentile of the GPU time per frame of a program's batches in seconds, 0 if not measured
+	double GetShaderPercentile(CShader* inShader, double inPercentile) const;
+
+	/// Print the frame times and the time of each program, most expensive first
+	void PrintReport() const;
+
+protected:
+	/// Default constructor (protected)
+	CGPUProfiler();
+
+	/// Open a batch in the current frame
+	void AddBatch(CShader* inShader);
+
+	/// Close the open batch
+	void CloseBatch();
+
+	/// Issue a timestamp query from the current frame's pool, returns its index in the pool
+	unsigned int AddTimestamp();
+
+	/// Read the results of a frame if they are available, drop the frame otherwise
+	void CollectFrame(SFrame& ioFrame);
+
+	/// Add a sample to a ring of at most MAX_SAMPLES
+	static void AddSample(std::vector<double>& ioSamples, size_t& ioNext, double inSample);
+
+	/// Percentile of a ring of samples
+	static double GetPercentile(const std::vector<double>& inSamples, double inPercentile);
+
+}; // end class CGPUProfiler
+
+#endif
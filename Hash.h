@@ -0,0 +1,71 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Seed of the 64-bit FNV-1a hash
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+/**
+ * Accumulate bytes into a 64-bit FNV-1a hash
+ * @param inData the bytes to hash
+ * @param inLength number of bytes
+ * @param inHash the hash to continue from, HASH_SEED to start a new one
+ */
+inline uint64_t HashBytes(const void* inData, size_t inLength, uint64_t inHash = HASH_SEED)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(inData);
+	for (size_t i = 0; i < inLength; ++i)
+	{
+		inHash ^= p[i];
+		inHash *= 1099511628211ULL;
+	}
+	return inHash;
+}
+
+/**
+ * Accumulate a null terminated string into a 64-bit FNV-1a hash.
+ * The terminator is hashed too, so ("ab", "c") and ("a", "bc") differ.
+ */
+inline uint64_t HashString(const char* inString, uint64_t inHash = HASH_SEED)
+{
+	if (inString != NULL)
+	{
+		while (*inString != '\0')
+		{
+			inHash ^= static_cast<unsigned char>(*inString++);
+			inHash *= 1099511628211ULL;
+		}
+	}
+	return inHash * 1099511628211ULL;
+}
+
+#endif
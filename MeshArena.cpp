@@ -0,0 +1,113 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MeshArena.h"
+#include "VertexLayout.h"
+#include "VertexArrayCache.h"
+#include "GLStateCache.h"
+#include <GL/glew.h>
+
+CMeshArena::CMeshArena()
+: m_Layout(NULL)
+, m_VBO(0)
+, m_IBO(0)
+, m_VertexCount(0)
+, m_VertexCapacity(0)
+, m_IndexCount(0)
+, m_IndexCapacity(0)
+{
+}
+
+CMeshArena::~CMeshArena()
+{
+	Dispose();
+}
+
+bool CMeshArena::Initialize(const SVertexLayout* inLayout, unsigned int inVertexCapacity, unsigned int inIndexCapacity)
+{
+	Dispose();
+
+	m_Layout = inLayout;
+	m_VertexCapacity = inVertexCapacity;
+	m_IndexCapacity = inIndexCapacity;
+
+	// the element array binding belongs to the bound VAO, fill the buffers with none bound
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	if (GLEW_ARB_vertex_array_object)
+		theStateCache->BindVertexArray(0);
+
+	glGenBuffers(1, &m_VBO);
+	theStateCache->BindBuffer(GL_ARRAY_BUFFER, m_VBO);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)m_VertexCapacity * inLayout->stride, NULL, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_IBO);
+	theStateCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)m_IndexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+
+	return (m_VBO != 0 && m_IBO != 0);
+}
+
+void CMeshArena::Dispose()
+{
+	unsigned int theBuffers[2] = { m_VBO, m_IBO };
+	for (int i = 0; i < 2; ++i)
+	{
+		if (theBuffers[i] == 0)
+			continue;
+
+		CVertexArrayCache::GetInstance()->RemoveBuffer(theBuffers[i]);
+		CGLStateCache::GetInstance()->OnDeleteBuffer(theBuffers[i]);
+		glDeleteBuffers(1, &theBuffers[i]);
+	}
+	m_VBO = 0;
+	m_IBO = 0;
+	m_VertexCount = 0;
+	m_IndexCount = 0;
+}
+
+bool CMeshArena::AddMesh(const void* inVertices, unsigned int inVertexCount, const unsigned int* inIndices, unsigned int inIndexCount, SArenaMesh& outMesh)
+{
+	if (m_VBO == 0 || m_VertexCount + inVertexCount > m_VertexCapacity || m_IndexCount + inIndexCount > m_IndexCapacity) {
+		printf("Mesh arena is full, %u vertices and %u indices.\n", m_VertexCapacity, m_IndexCapacity);
+		return false;
+	}
+
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	if (GLEW_ARB_vertex_array_object)
+		theStateCache->BindVertexArray(0);
+
+	theStateCache->BindBuffer(GL_ARRAY_BUFFER, m_VBO);
+	glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)m_VertexCount * m_Layout->stride, (GLsizeiptr)inVertexCount * m_Layout->stride, inVertices);
+	theStateCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)m_IndexCount * sizeof(GLuint), (GLsizeiptr)inIndexCount * sizeof(GLuint), inIndices);
+
+	outMesh.baseVertex = (int)m_VertexCount;
+	outMesh.firstIndex = m_IndexCount;
+	outMesh.indexCount = inIndexCount;
+
+	m_VertexCount += inVertexCount;
+	m_IndexCount += inIndexCount;
+	return true;
+}
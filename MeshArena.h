@@ -0,0 +1,103 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+// Forward declaration
+struct SVertexLayout;
+
+/// A mesh sub-allocated from a mesh arena
+struct SArenaMesh
+{
+	int baseVertex;				// first vertex of the mesh in the arena's vertex buffer
+	unsigned int firstIndex;	// first index of the mesh in the arena's index buffer
+	unsigned int indexCount;
+};
+
+/**
+ * A vertex and an index buffer shared by many meshes of one vertex layout,
+ * so their draws need no buffer change and can go into one multi-draw.
+ * Meshes are appended and live as long as the arena. Indices are
+ * GL_UNSIGNED_INT and relative to the mesh's first vertex.
+ */
+class CMeshArena
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	const SVertexLayout* m_Layout;
+
+	unsigned int m_VBO;
+	unsigned int m_IBO;
+
+	/// Vertices and indices allocated, and the capacities of the buffers
+	unsigned int m_VertexCount;
+	unsigned int m_VertexCapacity;
+	unsigned int m_IndexCount;
+	unsigned int m_IndexCapacity;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Default constructor
+	CMeshArena();
+
+	/// Destructor
+	~CMeshArena();
+
+	/**
+	 * Create the buffers, requires a current OpenGL context
+	 * @param inVertexCapacity number of vertices of the layout the arena holds
+	 * @param inIndexCapacity number of indices the arena holds
+	 * @return true if the buffers were created, false otherwise
+	 */
+	bool Initialize(const SVertexLayout* inLayout, unsigned int inVertexCapacity, unsigned int inIndexCapacity);
+
+	/// Delete the buffers, requires a current OpenGL context
+	void Dispose();
+
+	/**
+	 * Copy a mesh into the arena
+	 * @return true if the arena had room for the mesh, false otherwise
+	 */
+	bool AddMesh(const void* inVertices, unsigned int inVertexCount, const unsigned int* inIndices, unsigned int inIndexCount, SArenaMesh& outMesh);
+
+	inline const SVertexLayout* GetLayout() const { return m_Layout; }
+	inline unsigned int GetVBO() const { return m_VBO; }
+	inline unsigned int GetIBO() const { return m_IBO; }
+
+private:
+	/// Not copyable, the arena owns its buffers
+	CMeshArena(const CMeshArena&);
+	CMeshArena& operator=(const CMeshArena&);
+
+}; // end class CMeshArena
+
+#endif
@@ -0,0 +1,304 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MultiDrawRenderer.h"
+#include "Shader.h"
+#include "VertexLayout.h"
+#include "VertexArrayCache.h"
+#include "GLStateCache.h"
+#include "GPUProfiler.h"
+#include <GL/glew.h>
+#include <string.h>
+#include <algorithm>
+
+/// Floats of a transform in the per-draw storage buffer
+const unsigned int MATRIX_FLOAT_COUNT = 16;
+
+CMultiDrawRenderer::CMultiDrawRenderer()
+: m_IsMultiDraw(false)
+, m_CommandBuffer(0)
+, m_DataBuffer(0)
+, m_MappedCommands(NULL)
+, m_MappedData(NULL)
+, m_FrameDrawCount(0)
+, m_FrameCount(0)
+, m_FrameIndex(0)
+, m_DrawAlignment(1)
+, m_DrawSetup(NULL)
+, m_DrawSetupData(NULL)
+, m_ItemCount(0)
+, m_CallCount(0)
+{
+}
+
+CMultiDrawRenderer::~CMultiDrawRenderer()
+{
+	Dispose();
+}
+
+bool CMultiDrawRenderer::Initialize(unsigned int inFrameDrawCount, int inFrameCount)
+{
+	Dispose();
+
+	m_IsMultiDraw = GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters
+		&& GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_buffer_storage;
+	if (!m_IsMultiDraw) {
+		printf("Multi-draw indirect is not supported, draws are issued one by one.\n");
+		return false;
+	}
+
+	// each group binds its transforms at an aligned offset of the storage buffer
+	GLint theAlignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &theAlignment);
+	unsigned int theMatrixSize = MATRIX_FLOAT_COUNT * sizeof(float);
+	m_DrawAlignment = ((unsigned int)theAlignment > theMatrixSize) ? theAlignment / theMatrixSize : 1;
+
+	m_FrameDrawCount = (inFrameDrawCount + m_DrawAlignment - 1) / m_DrawAlignment * m_DrawAlignment;
+	m_FrameCount = (inFrameCount > 0) ? inFrameCount : 1;
+	m_FrameIndex = 0;
+	m_FrameFences.assign(m_FrameCount, (void*)NULL);
+
+	// written through persistent mappings, the fences keep the GPU and CPU apart
+	GLbitfield theFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr theDrawCount = (GLsizeiptr)m_FrameDrawCount * m_FrameCount;
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+
+	glGenBuffers(1, &m_CommandBuffer);
+	theStateCache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+	glBufferStorage(GL_DRAW_INDIRECT_BUFFER, theDrawCount * sizeof(SDrawCommand), NULL, theFlags);
+	m_MappedCommands = (SDrawCommand*)glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, theDrawCount * sizeof(SDrawCommand), theFlags);
+
+	glGenBuffers(1, &m_DataBuffer);
+	theStateCache->BindBuffer(GL_SHADER_STORAGE_BUFFER, m_DataBuffer);
+	glBufferStorage(GL_SHADER_STORAGE_BUFFER, theDrawCount * theMatrixSize, NULL, theFlags);
+	m_MappedData = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, theDrawCount * theMatrixSize, theFlags);
+
+	if (m_MappedCommands == NULL || m_MappedData == NULL) {
+		printf("Cannot map the multi-draw buffers, draws are issued one by one.\n");
+		Dispose();
+		return false;
+	}
+	return true;
+}
+
+void CMultiDrawRenderer::Dispose()
+{
+	for (size_t i = 0; i < m_FrameFences.size(); ++i)
+	{
+		if (m_FrameFences[i] != NULL)
+			glDeleteSync((GLsync)m_FrameFences[i]);
+	}
+	m_FrameFences.clear();
+
+	// deleting the buffers unmaps them
+	unsigned int theBuffers[2] = { m_CommandBuffer, m_DataBuffer };
+	for (int i = 0; i < 2; ++i)
+	{
+		if (theBuffers[i] == 0)
+			continue;
+
+		CGLStateCache::GetInstance()->OnDeleteBuffer(theBuffers[i]);
+		glDeleteBuffers(1, &theBuffers[i]);
+	}
+	m_CommandBuffer = 0;
+	m_DataBuffer = 0;
+	m_MappedCommands = NULL;
+	m_MappedData = NULL;
+	m_IsMultiDraw = false;
+}
+
+void CMultiDrawRenderer::SetDrawSetup(TDrawSetupFunction inFunction, void* inUserData)
+{
+	m_DrawSetup = inFunction;
+	m_DrawSetupData = inUserData;
+}
+
+void CMultiDrawRenderer::Submit(const SMultiDrawItem& inItem)
+{
+	// the single-draw shader is needed whenever the item does not fit a multi-draw
+	if (inItem.shader == NULL || inItem.shader->GetProgram() == 0 || inItem.mesh.indexCount == 0)
+		return;
+
+	m_Items.push_back(inItem);
+}
+
+void CMultiDrawRenderer::Flush()
+{
+	m_ItemCount = (unsigned int)m_Items.size();
+	m_CallCount = 0;
+
+	// order the items by the program drawing them, then texture and arena
+	m_Order.resize(m_Items.size());
+	for (size_t i = 0; i < m_Items.size(); ++i)
+	{
+		const SMultiDrawItem& theItem = m_Items[i];
+		bool isMultiDraw = m_IsMultiDraw && theItem.multiDrawShader != NULL && theItem.multiDrawShader->GetProgram() != 0;
+		unsigned int theProgram = isMultiDraw ? theItem.multiDrawShader->GetProgram() : theItem.shader->GetProgram();
+		m_Order[i].first = ((uint64_t)(theProgram & 0xFFFF) << 48)
+			| ((uint64_t)(theItem.texture & 0xFFFF) << 32)
+			| ((uint64_t)(theItem.arena->GetVBO() & 0xFFFF) << 16);
+		m_Order[i].second = (unsigned int)i;
+	}
+	std::sort(m_Order.begin(), m_Order.end());
+
+	if (!m_IsMultiDraw)
+	{
+		DrawEach(0, m_Order.size());
+		m_Items.clear();
+		return;
+	}
+
+	// wait until the GPU is done with the frame which used this segment last
+	void*& theFence = m_FrameFences[m_FrameIndex];
+	if (theFence != NULL)
+	{
+		GLbitfield theFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync((GLsync)theFence, theFlags, 1000000000) == GL_TIMEOUT_EXPIRED)
+			theFlags = 0;
+		glDeleteSync((GLsync)theFence);
+		theFence = NULL;
+	}
+
+	unsigned int theDraw = 0;
+	size_t theBegin = 0;
+	while (theBegin < m_Order.size())
+	{
+		const SMultiDrawItem& theFirst = m_Items[m_Order[theBegin].second];
+		size_t theEnd = theBegin + 1;
+		while (theEnd < m_Order.size() && IsSameGroup(theFirst, m_Items[m_Order[theEnd].second]))
+			++theEnd;
+
+		if (theFirst.multiDrawShader == NULL || theFirst.multiDrawShader->GetProgram() == 0)
+			DrawEach(theBegin, theEnd);
+		else
+		{
+			// groups start at an aligned draw, what does not fit the segment is drawn one by one
+			theDraw = (theDraw + m_DrawAlignment - 1) / m_DrawAlignment * m_DrawAlignment;
+			size_t theFitCount = (theDraw < m_FrameDrawCount) ? m_FrameDrawCount - theDraw : 0;
+			size_t theSplit = std::min(theEnd, theBegin + theFitCount);
+			if (theSplit > theBegin)
+			{
+				MultiDraw(theBegin, theSplit, theDraw);
+				theDraw += (unsigned int)(theSplit - theBegin);
+			}
+			if (theSplit < theEnd)
+				DrawEach(theSplit, theEnd);
+		}
+		theBegin = theEnd;
+	}
+
+	m_FrameFences[m_FrameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_FrameIndex = (m_FrameIndex + 1) % m_FrameCount;
+	m_Items.clear();
+}
+
+void CMultiDrawRenderer::MultiDraw(size_t inBegin, size_t inEnd, unsigned int inFirstDraw)
+{
+	const SMultiDrawItem& theFirst = m_Items[m_Order[inBegin].second];
+	CShader* theShader = theFirst.multiDrawShader;
+
+	// write the commands and transforms into this frame's segment
+	size_t theBase = (size_t)m_FrameIndex * m_FrameDrawCount + inFirstDraw;
+	GLsizei theCount = (GLsizei)(inEnd - inBegin);
+	for (size_t i = inBegin; i < inEnd; ++i)
+	{
+		const SMultiDrawItem& theItem = m_Items[m_Order[i].second];
+		size_t theDraw = theBase + (i - inBegin);
+
+		SDrawCommand& theCommand = m_MappedCommands[theDraw];
+		theCommand.count = theItem.mesh.indexCount;
+		theCommand.instanceCount = 1;
+		theCommand.firstIndex = theItem.mesh.firstIndex;
+		theCommand.baseVertex = theItem.mesh.baseVertex;
+		theCommand.baseInstance = 0;
+		memcpy(m_MappedData + theDraw * MATRIX_FLOAT_COUNT, theItem.modelViewMatrix, MATRIX_FLOAT_COUNT * sizeof(float));
+	}
+
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	CGPUProfiler* theProfiler = CGPUProfiler::GetInstance();
+	theProfiler->BeginBatch(theShader);
+	theStateCache->UseProgram(theShader->GetProgram());
+	if (theFirst.texture != 0)
+	{
+		theStateCache->BindTexture(0, GL_TEXTURE_2D, theFirst.texture);
+		theStateCache->SetEnabled(GL_TEXTURE_2D, true);
+	}
+
+	if (m_DrawSetup != NULL)
+		m_DrawSetup(theFirst, theShader, m_DrawSetupData);
+	theShader->ApplyUniforms();
+
+	// gl_DrawIDARB indexes the transforms bound from the group's first draw
+	const CMeshArena* theArena = theFirst.arena;
+	CVertexArrayCache::GetInstance()->Bind(theShader, theArena->GetLayout(), theArena->GetVBO(), theArena->GetIBO());
+	theStateCache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+	GLsizeiptr theMatrixSize = MATRIX_FLOAT_COUNT * sizeof(float);
+	theStateCache->BindBufferRange(GL_SHADER_STORAGE_BUFFER, PER_DRAW_STORAGE_BINDING, m_DataBuffer, theBase * theMatrixSize, theCount * theMatrixSize);
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)(theBase * sizeof(SDrawCommand)), theCount, 0);
+	theProfiler->EndBatch();
+	++m_CallCount;
+}
+
+void CMultiDrawRenderer::DrawEach(size_t inBegin, size_t inEnd)
+{
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	CGPUProfiler* theProfiler = CGPUProfiler::GetInstance();
+	for (size_t i = inBegin; i < inEnd; ++i)
+	{
+		const SMultiDrawItem& theItem = m_Items[m_Order[i].second];
+		CShader* theShader = theItem.shader;
+
+		theProfiler->BeginBatch(theShader);
+		theStateCache->UseProgram(theShader->GetProgram());
+		if (theItem.texture != 0)
+		{
+			theStateCache->BindTexture(0, GL_TEXTURE_2D, theItem.texture);
+			theStateCache->SetEnabled(GL_TEXTURE_2D, true);
+		}
+
+		if (m_DrawSetup != NULL)
+			m_DrawSetup(theItem, theShader, m_DrawSetupData);
+		theShader->ApplyUniforms();
+
+		const CMeshArena* theArena = theItem.arena;
+		CVertexArrayCache::GetInstance()->Bind(theShader, theArena->GetLayout(), theArena->GetVBO(), theArena->GetIBO());
+		glDrawElementsBaseVertex(GL_TRIANGLES, theItem.mesh.indexCount, GL_UNSIGNED_INT
+			, (const GLvoid*)(theItem.mesh.firstIndex * sizeof(GLuint)), theItem.mesh.baseVertex);
+		theProfiler->EndBatch();
+		++m_CallCount;
+	}
+}
+
+bool CMultiDrawRenderer::IsSameGroup(const SMultiDrawItem& inItem, const SMultiDrawItem& inOther)
+{
+	if (inItem.multiDrawShader != inOther.multiDrawShader || inItem.texture != inOther.texture || inItem.arena != inOther.arena)
+		return false;
+
+	// the items are sorted by the program drawing them, a multi-draw does not use the
+	// single-draw shaders, so items of different ones are only split without it
+	bool isMultiDraw = inItem.multiDrawShader != NULL && inItem.multiDrawShader->GetProgram() != 0;
+	return isMultiDraw || inItem.shader == inOther.shader;
+}
@@ -0,0 +1,177 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef MULTI_DRAW_RENDERER_H
+#define MULTI_DRAW_RENDERER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <utility>
+#include "MeshArena.h"
+
+// Forward declaration
+class CShader;
+
+/// A draw of an arena mesh submitted to the multi-draw renderer
+struct SMultiDrawItem
+{
+	CShader* shader;				// draws the item alone, with a per-draw ModelViewMatrix
+	CShader* multiDrawShader;		// reads ModelViewMatrices[gl_DrawIDARB] from the per-draw storage buffer
+	const CMeshArena* arena;
+	SArenaMesh mesh;
+	unsigned int texture;			// GL_TEXTURE_2D bound to unit 0, 0 for none
+	const float* modelViewMatrix;	// must stay valid until the renderer is flushed
+};
+
+/**
+ * Submits the draws of a frame with one glMultiDrawElementsIndirect per
+ * (program, texture, arena). The draw commands are written to a persistently
+ * mapped GL_DRAW_INDIRECT_BUFFER and the transforms to a persistently mapped
+ * shader storage buffer, both rings with one fenced segment per frame in
+ * flight. Without ARB_multi_draw_indirect, ARB_shader_draw_parameters or
+ * persistent mapping, the same commands are issued one by one with the
+ * single-draw shader.
+ */
+class CMultiDrawRenderer
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	enum
+	{
+		/// Binding of the PerDrawData storage block in the multi-draw shaders
+		PER_DRAW_STORAGE_BINDING = 2,
+	};
+
+	/// Set up the uniforms of a draw call, with the shader drawing it; called once per multi-draw or per single draw
+	typedef void (*TDrawSetupFunction)(const SMultiDrawItem& inItem, CShader* inShader, void* inUserData);
+
+protected:
+	/// Layout of a command of glMultiDrawElementsIndirect
+	struct SDrawCommand
+	{
+		unsigned int count;
+		unsigned int instanceCount;
+		unsigned int firstIndex;
+		int baseVertex;
+		unsigned int baseInstance;
+	};
+
+	/// Sort key of an item and its index
+	typedef std::pair<uint64_t, unsigned int> TSortEntry;
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Submitted items and their draw order
+	std::vector<SMultiDrawItem> m_Items;
+	std::vector<TSortEntry> m_Order;
+
+	/// Whether the multi-draw path is used, decided by Initialize()
+	bool m_IsMultiDraw;
+
+	/// Command and transform rings, persistently mapped
+	unsigned int m_CommandBuffer;
+	unsigned int m_DataBuffer;
+	SDrawCommand* m_MappedCommands;
+	float* m_MappedData;
+
+	/// Ring segments, one per frame in flight, of m_FrameDrawCount draws each
+	unsigned int m_FrameDrawCount;
+	int m_FrameCount;
+	int m_FrameIndex;
+	std::vector<void*> m_FrameFences;
+
+	/// Draws per storage buffer offset alignment, groups start at a multiple of it
+	unsigned int m_DrawAlignment;
+
+	/// Per-draw setup
+	TDrawSetupFunction m_DrawSetup;
+	void* m_DrawSetupData;
+
+	/// Items drawn and draw calls issued in the last Flush()
+	unsigned int m_ItemCount;
+	unsigned int m_CallCount;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Default constructor
+	CMultiDrawRenderer();
+
+	/// Destructor
+	~CMultiDrawRenderer();
+
+	/**
+	 * Create the command and transform rings, requires a current OpenGL context
+	 * @param inFrameDrawCount number of draws per frame, further draws use the single-draw path
+	 * @param inFrameCount number of frames in flight
+	 * @return true if the multi-draw path is supported, false if the fallback loop is used
+	 */
+	bool Initialize(unsigned int inFrameDrawCount, int inFrameCount);
+
+	/// Release the rings, requires a current OpenGL context
+	void Dispose();
+
+	/// Whether the draws are submitted with glMultiDrawElementsIndirect
+	inline bool IsMultiDraw() const { return m_IsMultiDraw; }
+
+	/// Set the function setting up the uniforms of the draw calls
+	void SetDrawSetup(TDrawSetupFunction inFunction, void* inUserData);
+
+	/// Add a draw, items of shaders still loading are dropped
+	void Submit(const SMultiDrawItem& inItem);
+
+	/// Issue the draws of the frame and clear the submitted items
+	void Flush();
+
+	/// Statistics of the last Flush()
+	inline unsigned int GetItemCount() const { return m_ItemCount; }
+	inline unsigned int GetCallCount() const { return m_CallCount; }
+
+protected:
+	/// Issue the draws of a range of sorted items with one glMultiDrawElementsIndirect
+	void MultiDraw(size_t inBegin, size_t inEnd, unsigned int inFirstDraw);
+
+	/// Issue the draws of a range of sorted items one by one
+	void DrawEach(size_t inBegin, size_t inEnd);
+
+	/// Whether two items can go into the same multi-draw
+	static bool IsSameGroup(const SMultiDrawItem& inItem, const SMultiDrawItem& inOther);
+
+private:
+	/// Not copyable, the renderer owns its buffers
+	CMultiDrawRenderer(const CMultiDrawRenderer&);
+	CMultiDrawRenderer& operator=(const CMultiDrawRenderer&);
+
+}; // end class CMultiDrawRenderer
+
+#endif
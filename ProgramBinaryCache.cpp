@@ -0,0 +1,202 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ProgramBinaryCache.h"
+#include "Hash.h"
+#include <GL/glew.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include <atomic>
+
+/// Magic number at the start of a cached binary file ("GLPB")
+const uint32_t BINARY_CACHE_MAGIC = 0x42504C47;
+
+/// Number of the last temporary file, unique with the process id for every writer thread
+static std::atomic<unsigned int> s_TempFileCount(0);
+
+/// Header of a cached binary file
+struct SBinaryHeader
+{
+	uint32_t magic;
+	uint32_t format;
+	uint32_t length;
+	uint32_t reserved;
+	uint64_t key;
+};
+
+CProgramBinaryCache::CProgramBinaryCache()
+: m_DriverHash(HASH_SEED),
+m_Hits(0),
+m_Misses(0)
+{
+}
+
+CProgramBinaryCache::~CProgramBinaryCache()
+{
+}
+
+bool CProgramBinaryCache::Initialize(const char* inDirectory)
+{
+	m_Directory.clear();
+
+	if (inDirectory == NULL || *inDirectory == '\0')
+		return false;
+
+	if (!GLEW_ARB_get_program_binary) {
+		printf("Program binary cache disabled: ARB_get_program_binary is not supported.\n");
+		return false;
+	}
+
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	if (formatCount <= 0) {
+		printf("Program binary cache disabled: the driver exposes no binary formats.\n");
+		return false;
+	}
+
+	// binaries are only valid for the driver which produced them
+	m_DriverHash = HashString((const char*)glGetString(GL_VENDOR));
+	m_DriverHash = HashString((const char*)glGetString(GL_RENDERER), m_DriverHash);
+	m_DriverHash = HashString((const char*)glGetString(GL_VERSION), m_DriverHash);
+
+#ifdef _WIN32
+	_mkdir(inDirectory);
+#else
+	mkdir(inDirectory, 0755);
+#endif
+
+	m_Directory = inDirectory;
+	return true;
+}
+
+bool CProgramBinaryCache::Load(uint64_t inKey, unsigned int inProgram)
+{
+	if (!IsEnabled())
+		return false;
+
+	FILE* pFile = fopen(GetFileName(inKey).c_str(), "rb");
+	if (pFile == NULL) {
+		++m_Misses;
+		return false;
+	}
+
+	SBinaryHeader header;
+	bool isLoaded = false;
+	if (fread(&header, sizeof(header), 1, pFile) == 1
+		&& header.magic == BINARY_CACHE_MAGIC
+		&& header.key == inKey
+		&& header.length > 0)
+	{
+		void* pBinary = malloc(header.length);
+		if (pBinary != NULL && fread(pBinary, header.length, 1, pFile) == 1)
+		{
+			glProgramBinary(inProgram, header.format, pBinary, header.length);
+
+			// the driver rejects binaries it can no longer use
+			GLint status = GL_FALSE;
+			glGetProgramiv(inProgram, GL_LINK_STATUS, &status);
+			isLoaded = (status == GL_TRUE);
+		}
+		free(pBinary);
+	}
+	fclose(pFile);
+
+	if (isLoaded)
+		++m_Hits;
+	else
+		++m_Misses;
+
+	return isLoaded;
+}
+
+void CProgramBinaryCache::Store(uint64_t inKey, unsigned int inProgram)
+{
+	if (!IsEnabled())
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(inProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	void* pBinary = malloc(length);
+	if (pBinary == NULL) {
+		printf("Out of memory!\n");
+		return;
+	}
+
+	SBinaryHeader header;
+	GLenum format = 0;
+	glGetProgramBinary(inProgram, length, &length, &format, pBinary);
+
+	header.magic = BINARY_CACHE_MAGIC;
+	header.format = format;
+	header.length = length;
+	header.reserved = 0;
+	header.key = inKey;
+
+	// write next to the target and rename it over, so that a crash, a second
+	// process or a second thread never leaves a truncated binary under the final name
+	std::string theFileName = GetFileName(inKey);
+	char theSuffix[48];
+	sprintf(theSuffix, ".%d.%u.tmp", (int)getpid(), ++s_TempFileCount);
+	std::string theTempName = theFileName + theSuffix;
+
+	FILE* pFile = fopen(theTempName.c_str(), "wb");
+	if (pFile != NULL)
+	{
+		bool isWritten = fwrite(&header, sizeof(header), 1, pFile) == 1
+			&& fwrite(pBinary, length, 1, pFile) == 1;
+		isWritten = (fclose(pFile) == 0) && isWritten;
+
+#ifdef _WIN32
+		// rename does not replace an existing file on Windows
+		if (isWritten)
+			remove(theFileName.c_str());
+#endif
+		if (!isWritten || rename(theTempName.c_str(), theFileName.c_str()) != 0)
+		{
+			printf("Cannot write program binary: %s\n", theFileName.c_str());
+			remove(theTempName.c_str());
+		}
+	}
+	else
+		printf("Cannot open file: %s\n", theTempName.c_str());
+
+	free(pBinary);
+}
+
+std::string CProgramBinaryCache::GetFileName(uint64_t inKey) const
+{
+	char theName[32];
+	sprintf(theName, "/%016llx.bin", (unsigned long long)inKey);
+	return m_Directory + theName;
+}
@@ -0,0 +1,107 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Persistent on-disk cache of linked program binaries (ARB_get_program_binary).
+ * Entries are keyed by a hash of the stage sources and the driver's vendor,
+ * renderer and version strings, so a driver update never loads stale binaries.
+ * Load and Store can be called from several threads once Initialize returned.
+ */
+class CProgramBinaryCache
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Directory the binaries are stored in, empty if the cache is disabled
+	std::string m_Directory;
+
+	/// Hash of the driver vendor, renderer and version strings
+	uint64_t m_DriverHash;
+
+	/// Statistics, updated from the shader worker threads too
+	std::atomic<unsigned int> m_Hits;
+	std::atomic<unsigned int> m_Misses;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CProgramBinaryCache();
+
+	/// Destructor
+	~CProgramBinaryCache();
+
+	/**
+	 * Enable the cache. Requires a current OpenGL context.
+	 * @param inDirectory directory the binaries are stored in, created if missing
+	 * @return true if the driver supports program binaries, false otherwise
+	 */
+	bool Initialize(const char* inDirectory);
+
+	/// Whether the cache is enabled
+	inline bool IsEnabled() const { return !m_Directory.empty(); }
+
+	/// Getters of cache statistics
+	inline unsigned int GetHits() const { return m_Hits; }
+	inline unsigned int GetMisses() const { return m_Misses; }
+
+	/**
+	 * Compute the cache key of a program
+	 * @param inSourceHash hash of the program's stage types and sources
+	 */
+	inline uint64_t GetKey(uint64_t inSourceHash) const { return inSourceHash ^ m_DriverHash; }
+
+	/**
+	 * Load a cached binary into a program object
+	 * @param inKey the program's cache key
+	 * @param inProgram a newly created program object
+	 * @return true if the binary was found and accepted by the driver, false otherwise
+	 */
+	bool Load(uint64_t inKey, unsigned int inProgram);
+
+	/**
+	 * Store the binary of a linked program. The program should have been linked
+	 * with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+	 */
+	void Store(uint64_t inKey, unsigned int inProgram);
+
+protected:
+	/// Get the file name of a cache entry
+	std::string GetFileName(uint64_t inKey) const;
+
+}; // end class CProgramBinaryCache
+
+#endif
@@ -0,0 +1,317 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "RenderQueue.h"
+#include "Shader.h"
+#include "GLStateCache.h"
+#include "GPUProfiler.h"
+#include "VertexArrayCache.h"
+#include "VertexLayout.h"
+#include <GL/glew.h>
+#include <string.h>
+
+/// Per-instance transform read by the instanced shaders
+const SVertexAttribute INSTANCE_ATTRIBUTES[] = {
+	{ "in_InstanceMatrix", 16, GL_FLOAT, false, 0 } };
+const SVertexLayout INSTANCE_LAYOUT = { INSTANCE_ATTRIBUTES, 1, 16 * sizeof(float), 1 };
+
+CRenderQueue::CRenderQueue()
+: m_InstanceBuffer(0)
+, m_DrawSetup(NULL)
+, m_DrawSetupData(NULL)
+, m_ItemCount(0)
+, m_DrawCount(0)
+, m_MergedCount(0)
+, m_InstancedCount(0)
+{
+}
+
+void CRenderQueue::Dispose()
+{
+	if (m_InstanceBuffer != 0)
+	{
+		CVertexArrayCache::GetInstance()->RemoveBuffer(m_InstanceBuffer);
+		CGLStateCache::GetInstance()->OnDeleteBuffer(m_InstanceBuffer);
+		glDeleteBuffers(1, &m_InstanceBuffer);
+		m_InstanceBuffer = 0;
+	}
+}
+
+void CRenderQueue::SetDrawSetup(TDrawSetupFunction inFunction, void* inUserData)
+{
+	m_DrawSetup = inFunction;
+	m_DrawSetupData = inUserData;
+}
+
+void CRenderQueue::Reserve(unsigned int inItemCount)
+{
+	m_Items.reserve(inItemCount);
+	m_Entries.reserve(inItemCount);
+	m_SortBuffer.reserve(inItemCount);
+	m_Batches.reserve(inItemCount);
+}
+
+void CRenderQueue::Submit(const SRenderItem& inItem)
+{
+	if (inItem.shader == NULL || inItem.shader->GetProgram() == 0 || inItem.indexCount == 0)
+		return;
+
+	SSortEntry theEntry;
+	theEntry.key = GetSortKey(inItem);
+	theEntry.item = (unsigned int)m_Items.size();
+	m_Entries.push_back(theEntry);
+	m_Items.push_back(inItem);
+}
+
+void CRenderQueue::Sort()
+{
+	size_t theCount = m_Entries.size();
+	if (theCount < 2)
+		return;
+	m_SortBuffer.resize(theCount);
+
+	// LSD radix sort, 8 bits per pass; stable, so equal keys keep the submission order
+	SSortEntry* theSource = &m_Entries[0];
+	SSortEntry* theTarget = &m_SortBuffer[0];
+	for (int theShift = 0; theShift < 64; theShift += 8)
+	{
+		size_t theOffsets[256];
+		memset(theOffsets, 0, sizeof(theOffsets));
+		for (size_t i = 0; i < theCount; ++i)
+			++theOffsets[(theSource[i].key >> theShift) & 0xFF];
+
+		// all keys share this byte, the pass would not move anything
+		if (theOffsets[(theSource[0].key >> theShift) & 0xFF] == theCount)
+			continue;
+
+		size_t theTotal = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			size_t theBucketCount = theOffsets[i];
+			theOffsets[i] = theTotal;
+			theTotal += theBucketCount;
+		}
+		for (size_t i = 0; i < theCount; ++i)
+			theTarget[theOffsets[(theSource[i].key >> theShift) & 0xFF]++] = theSource[i];
+
+		SSortEntry* theSwap = theSource;
+		theSource = theTarget;
+		theTarget = theSwap;
+	}
+
+	if (theSource != &m_Entries[0])
+		m_Entries.swap(m_SortBuffer);
+}
+
+void CRenderQueue::Flush()
+{
+	Sort();
+
+	m_ItemCount = (unsigned int)m_Entries.size();
+	m_DrawCount = 0;
+	m_MergedCount = 0;
+	m_InstancedCount = 0;
+
+	bool isInstancing = GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced;
+
+	// group the sorted items into draws
+	m_Batches.clear();
+	m_InstanceData.clear();
+	for (size_t i = 0; i < m_Entries.size(); ++i)
+	{
+		const SRenderItem& theItem = m_Items[m_Entries[i].item];
+		if (!m_Batches.empty())
+		{
+			SBatch& theBatch = m_Batches.back();
+			if (theBatch.instanceCount == 0 && CanMerge(theBatch, theItem))
+			{
+				theBatch.indexCount += theItem.indexCount;
+				++m_MergedCount;
+				continue;
+			}
+			if (isInstancing && CanInstance(theBatch, theItem))
+			{
+				// the first item becomes an instance as well
+				if (theBatch.instanceCount == 0)
+				{
+					theBatch.firstInstance = (unsigned int)(m_InstanceData.size() / 16);
+					theBatch.instanceCount = 1;
+					m_InstanceData.insert(m_InstanceData.end(), theBatch.item->modelViewMatrix, theBatch.item->modelViewMatrix + 16);
+				}
+				m_InstanceData.insert(m_InstanceData.end(), theItem.modelViewMatrix, theItem.modelViewMatrix + 16);
+				++theBatch.instanceCount;
+				++m_InstancedCount;
+				continue;
+			}
+		}
+
+		SBatch theBatch;
+		theBatch.item = &theItem;
+		theBatch.indexCount = theItem.indexCount;
+		theBatch.firstInstance = 0;
+		theBatch.instanceCount = 0;
+		m_Batches.push_back(theBatch);
+	}
+
+	UploadInstances();
+	for (size_t i = 0; i < m_Batches.size(); ++i)
+		Draw(m_Batches[i]);
+
+	Clear();
+}
+
+void CRenderQueue::Clear()
+{
+	m_Items.clear();
+	m_Entries.clear();
+}
+
+unsigned int CRenderQueue::GetSubmittedCount() const
+{
+	return (unsigned int)m_Items.size();
+}
+
+unsigned int CRenderQueue::GetItemCount() const
+{
+	return m_ItemCount;
+}
+
+unsigned int CRenderQueue::GetDrawCount() const
+{
+	return m_DrawCount;
+}
+
+unsigned int CRenderQueue::GetMergedCount() const
+{
+	return m_MergedCount;
+}
+
+unsigned int CRenderQueue::GetInstancedCount() const
+{
+	return m_InstancedCount;
+}
+
+uint64_t CRenderQueue::GetSortKey(const SRenderItem& inItem)
+{
+	// map the float bits to an unsigned order, negative depths first
+	uint32_t theDepth;
+	memcpy(&theDepth, &inItem.depth, sizeof(theDepth));
+	theDepth = (theDepth & 0x80000000u) ? ~theDepth : (theDepth | 0x80000000u);
+
+	uint64_t theMesh = (inItem.vbo ^ (inItem.ibo << 8)) & 0xFFFF;
+	return ((uint64_t)(inItem.shader->GetProgram() & 0xFFFF) << 48)
+		| ((uint64_t)(inItem.texture & 0xFFFF) << 32)
+		| (theMesh << 16)
+		| (theDepth >> 16);
+}
+
+bool CRenderQueue::CanMerge(const SBatch& inBatch, const SRenderItem& inItem)
+{
+	const SRenderItem& theBatchItem = *inBatch.item;
+	return inItem.shader == theBatchItem.shader
+		&& inItem.layout == theBatchItem.layout
+		&& inItem.vbo == theBatchItem.vbo
+		&& inItem.ibo == theBatchItem.ibo
+		&& inItem.texture == theBatchItem.texture
+		&& inItem.modelViewMatrix == theBatchItem.modelViewMatrix
+		&& inItem.firstIndex == theBatchItem.firstIndex + inBatch.indexCount;
+}
+
+bool CRenderQueue::CanInstance(const SBatch& inBatch, const SRenderItem& inItem)
+{
+	// a merged batch draws a larger range than its item, it cannot be instanced
+	const SRenderItem& theBatchItem = *inBatch.item;
+	return inItem.instancedShader != NULL
+		&& inItem.instancedShader->GetProgram() != 0
+		&& inItem.instancedShader == theBatchItem.instancedShader
+		&& inItem.shader == theBatchItem.shader
+		&& inItem.layout == theBatchItem.layout
+		&& inItem.vbo == theBatchItem.vbo
+		&& inItem.ibo == theBatchItem.ibo
+		&& inItem.texture == theBatchItem.texture
+		&& inItem.firstIndex == theBatchItem.firstIndex
+		&& inItem.indexCount == theBatchItem.indexCount
+		&& inBatch.indexCount == theBatchItem.indexCount;
+}
+
+void CRenderQueue::UploadInstances()
+{
+	if (m_InstanceData.empty())
+		return;
+
+	if (m_InstanceBuffer == 0)
+		glGenBuffers(1, &m_InstanceBuffer);
+
+	// orphan the storage of the last frame, the driver does not wait for its draws
+	GLsizeiptr theSize = (GLsizeiptr)(m_InstanceData.size() * sizeof(float));
+	CGLStateCache::GetInstance()->BindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, theSize, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, theSize, &m_InstanceData[0]);
+}
+
+void CRenderQueue::Draw(const SBatch& inBatch)
+{
+	const SRenderItem& theItem = *inBatch.item;
+	bool isInstanced = (inBatch.instanceCount != 0);
+	CShader* theShader = isInstanced ? theItem.instancedShader : theItem.shader;
+
+	// sorted draws repeat most of the previous state, the state cache drops those binds
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	CGPUProfiler* theProfiler = CGPUProfiler::GetInstance();
+	theProfiler->BeginBatch(theShader);
+	theStateCache->UseProgram(theShader->GetProgram());
+	if (theItem.texture != 0)
+	{
+		theStateCache->BindTexture(0, GL_TEXTURE_2D, theItem.texture);
+		theStateCache->SetEnabled(GL_TEXTURE_2D, true);
+	}
+
+	if (m_DrawSetup != NULL)
+		m_DrawSetup(theItem, theShader, m_DrawSetupData);
+	theShader->ApplyUniforms();
+
+	const GLvoid* theIndices = (const GLvoid*)(theItem.firstIndex * sizeof(GLuint));
+	CVertexArrayCache* theVertexArrays = CVertexArrayCache::GetInstance();
+	if (!isInstanced)
+	{
+		theVertexArrays->Bind(theShader, theItem.layout, theItem.vbo, theItem.ibo);
+		glDrawElements(GL_TRIANGLES, inBatch.indexCount, GL_UNSIGNED_INT, theIndices);
+	}
+	else
+	{
+		theVertexArrays->Bind(theShader, theItem.layout, theItem.vbo, theItem.ibo, &INSTANCE_LAYOUT, m_InstanceBuffer);
+		if (GLEW_ARB_base_instance)
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, inBatch.indexCount, GL_UNSIGNED_INT, theIndices
+				, inBatch.instanceCount, inBatch.firstInstance);
+		else
+		{
+			// select the batch's transforms by moving the instance attributes
+			theVertexArrays->PointAttributes(theShader, &INSTANCE_LAYOUT, m_InstanceBuffer, inBatch.firstInstance * INSTANCE_LAYOUT.stride);
+			glDrawElementsInstanced(GL_TRIANGLES, inBatch.indexCount, GL_UNSIGNED_INT, theIndices, inBatch.instanceCount);
+		}
+	}
+	theProfiler->EndBatch();
+	++m_DrawCount;
+}
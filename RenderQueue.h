@@ -0,0 +1,174 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+
+// Forward declaration
+class CShader;
+struct SVertexLayout;
+
+/// A draw submitted to a render queue
+struct SRenderItem
+{
+	CShader* shader;
+	CShader* instancedShader;		// variant reading the transform from in_InstanceMatrix, NULL if none
+	const SVertexLayout* layout;
+	unsigned int vbo;
+	unsigned int ibo;				// GL_UNSIGNED_INT indices
+	unsigned int firstIndex;		// first index of the draw in the index buffer
+	unsigned int indexCount;
+	unsigned int texture;			// GL_TEXTURE_2D bound to unit 0, 0 for none
+	const float* modelViewMatrix;	// must stay valid until the queue is flushed
+	float depth;					// view depth, nearer draws first within a state group
+};
+
+/**
+ * Collects the draws of a frame and issues them sorted by a 64-bit key so
+ * draws sharing a program, texture and mesh are adjacent:
+ *   bits 63-48 program, 47-32 texture, 31-16 vertex/index buffers, 15-0 depth.
+ * The key only orders the draws, the state itself is compared when batching.
+ * Adjacent draws of consecutive index ranges of the same mesh and transform
+ * are merged into a single glDrawElements. Adjacent draws of the same mesh
+ * range with an instanced shader are grouped, their transforms are packed
+ * into an instance buffer and drawn with a single glDrawElementsInstanced.
+ */
+class CRenderQueue
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	/// Set up the per-draw uniforms of an item, called once per issued draw with the shader drawing it
+	typedef void (*TDrawSetupFunction)(const SRenderItem& inItem, CShader* inShader, void* inUserData);
+
+protected:
+	/// Entry of the sort, the key and the index of its item
+	struct SSortEntry
+	{
+		uint64_t key;
+		unsigned int item;
+	};
+	typedef std::vector<SSortEntry> TSortEntryList;
+
+	/// Items drawn with a single call, either a merged index range or a group of instances
+	struct SBatch
+	{
+		const SRenderItem* item;
+		unsigned int indexCount;
+		unsigned int firstInstance;
+		unsigned int instanceCount;
+	};
+	typedef std::vector<SBatch> TBatchList;
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Submitted items, in submission order
+	std::vector<SRenderItem> m_Items;
+
+	/// Sort entries and the scratch buffer of the radix sort
+	TSortEntryList m_Entries;
+	TSortEntryList m_SortBuffer;
+
+	/// Draws of the frame, built by Flush()
+	TBatchList m_Batches;
+
+	/// Transforms of the instanced batches, and the buffer they are streamed to
+	std::vector<float> m_InstanceData;
+	unsigned int m_InstanceBuffer;
+
+	/// Per-draw setup
+	TDrawSetupFunction m_DrawSetup;
+	void* m_DrawSetupData;
+
+	/// Items submitted, draws issued and items merged into a previous draw in the last Flush()
+	unsigned int m_ItemCount;
+	unsigned int m_DrawCount;
+	unsigned int m_MergedCount;
+	unsigned int m_InstancedCount;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Default constructor
+	CRenderQueue();
+
+	/// Delete the instance buffer
+	void Dispose();
+
+	/// Set the function setting up the per-draw uniforms
+	void SetDrawSetup(TDrawSetupFunction inFunction, void* inUserData);
+
+	/// Reserve room for a number of items per frame
+	void Reserve(unsigned int inItemCount);
+
+	/// Add a draw, items of shaders still loading are dropped
+	void Submit(const SRenderItem& inItem);
+
+	/// Sort the submitted items by key, done by Flush()
+	void Sort();
+
+	/// Issue the sorted draws and clear the queue
+	void Flush();
+
+	/// Drop the submitted items without drawing them
+	void Clear();
+
+	/// Number of items submitted to the queue
+	unsigned int GetSubmittedCount() const;
+
+	/// Statistics of the last Flush()
+	unsigned int GetItemCount() const;
+	unsigned int GetDrawCount() const;
+	unsigned int GetMergedCount() const;
+	unsigned int GetInstancedCount() const;	// items drawn as instances of a previous draw
+
+	/// Build the sort key of an item
+	static uint64_t GetSortKey(const SRenderItem& inItem);
+
+protected:
+	/// Return true if an item continues the index range of a batch of draws
+	static bool CanMerge(const SBatch& inBatch, const SRenderItem& inItem);
+
+	/// Return true if an item can be drawn as another instance of a batch
+	static bool CanInstance(const SBatch& inBatch, const SRenderItem& inItem);
+
+	/// Upload the instance transforms of the frame
+	void UploadInstances();
+
+	/// Issue the draw of a batch
+	void Draw(const SBatch& inBatch);
+
+}; // end class CRenderQueue
+
+#endif
@@ -24,50 +24,388 @@ OTHER DEALINGS IN THE SOFTWARE.
  */
 
 #include "Shader.h"
+#include "Hash.h"
+#include "ShaderStats.h"
 #include <GL/glew.h>
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+std::atomic<unsigned int> CShader::s_IssuedUniformCount(0);
+std::atomic<unsigned int> CShader::s_SkippedUniformCount(0);
+
+/**
+ * Get the number of 4-byte components of a uniform type
+ * @param outIsFloat whether the components are floats, ints otherwise
+ */
+static int GetUniformComponents(GLenum inType, bool& outIsFloat)
+{
+	outIsFloat = true;
+	switch (inType)
+	{
+	case GL_FLOAT:			return 1;
+	case GL_FLOAT_VEC2:		return 2;
+	case GL_FLOAT_VEC3:		return 3;
+	case GL_FLOAT_VEC4:		return 4;
+	case GL_FLOAT_MAT2:		return 4;
+	case GL_FLOAT_MAT3:		return 9;
+	case GL_FLOAT_MAT4:		return 16;
+	case GL_FLOAT_MAT2x3:	return 6;
+	case GL_FLOAT_MAT2x4:	return 8;
+	case GL_FLOAT_MAT3x2:	return 6;
+	case GL_FLOAT_MAT3x4:	return 12;
+	case GL_FLOAT_MAT4x2:	return 8;
+	case GL_FLOAT_MAT4x3:	return 12;
+	}
+
+	outIsFloat = false;
+	switch (inType)
+	{
+	case GL_INT_VEC2: case GL_BOOL_VEC2: case GL_UNSIGNED_INT_VEC2:	return 2;
+	case GL_INT_VEC3: case GL_BOOL_VEC3: case GL_UNSIGNED_INT_VEC3:	return 3;
+	case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_UNSIGNED_INT_VEC4:	return 4;
+	case GL_DOUBLE: case GL_DOUBLE_VEC2: case GL_DOUBLE_VEC3: case GL_DOUBLE_VEC4:
+	case GL_DOUBLE_MAT2: case GL_DOUBLE_MAT3: case GL_DOUBLE_MAT4:	return 0;
+	}
+
+	// int, bool, unsigned int and the sampler/image types
+	return 1;
+}
+
+/// Upload a uniform value with the glUniform* call of its type
+static void UploadUniform(int inLocation, GLenum inType, int inCount, const void* inValues)
+{
+	const GLfloat* f = static_cast<const GLfloat*>(inValues);
+	const GLint* i = static_cast<const GLint*>(inValues);
+	const GLuint* u = static_cast<const GLuint*>(inValues);
+
+	switch (inType)
+	{
+	case GL_FLOAT:			glUniform1fv(inLocation, inCount, f); break;
+	case GL_FLOAT_VEC2:		glUniform2fv(inLocation, inCount, f); break;
+	case GL_FLOAT_VEC3:		glUniform3fv(inLocation, inCount, f); break;
+	case GL_FLOAT_VEC4:		glUniform4fv(inLocation, inCount, f); break;
+	case GL_FLOAT_MAT2:		glUniformMatrix2fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT3:		glUniformMatrix3fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT4:		glUniformMatrix4fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT2x3:	glUniformMatrix2x3fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT2x4:	glUniformMatrix2x4fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT3x2:	glUniformMatrix3x2fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT3x4:	glUniformMatrix3x4fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT4x2:	glUniformMatrix4x2fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_FLOAT_MAT4x3:	glUniformMatrix4x3fv(inLocation, inCount, GL_FALSE, f); break;
+	case GL_INT_VEC2: case GL_BOOL_VEC2:	glUniform2iv(inLocation, inCount, i); break;
+	case GL_INT_VEC3: case GL_BOOL_VEC3:	glUniform3iv(inLocation, inCount, i); break;
+	case GL_INT_VEC4: case GL_BOOL_VEC4:	glUniform4iv(inLocation, inCount, i); break;
+	case GL_UNSIGNED_INT:		glUniform1uiv(inLocation, inCount, u); break;
+	case GL_UNSIGNED_INT_VEC2:	glUniform2uiv(inLocation, inCount, u); break;
+	case GL_UNSIGNED_INT_VEC3:	glUniform3uiv(inLocation, inCount, u); break;
+	case GL_UNSIGNED_INT_VEC4:	glUniform4uiv(inLocation, inCount, u); break;
+	default:				glUniform1iv(inLocation, inCount, i); break;
+	}
+}
 
 CShader::CShader()
-: m_VertexShader(0),
-m_GeometricShader(0),
-m_FragmentShader(0),
-m_Program(0)
+: m_BoundUniformNames(NULL),
+m_BoundAttributeNames(NULL),
+m_BoundUniformCount(0),
+m_BoundAttributeCount(0),
+m_IsPending(false)
 {
+	// no program until one is set or swapped in
+	SProgramData* theData = new SProgramData;
+	theData->vertexShader = 0;
+	theData->geometricShader = 0;
+	theData->fragmentShader = 0;
+	theData->program = 0;
+	ResolveBindings(*theData);
+	m_Data.store(theData, std::memory_order_relaxed);
 }
 
 CShader::~CShader()
 {
+	delete m_Data.load(std::memory_order_relaxed);
 }
 
 int CShader::GetUniformIndex(const char* inVarName)
 {
-	return GetVariableIndex(inVarName, true);;
+	CShaderStats::Count(CShaderStats::COUNTER_UNIFORM_LOOKUPS);
+	const SProgramData& theData = GetData();
+	int theHandle = FindVariable(theData, theData.uniforms, inVarName);
+	if (theHandle != -1 || inVarName == NULL)
+		return GetLocation(theData.uniforms, theHandle);
+
+	// an element of an array: the locations of the elements past the first one
+	// are not required to follow each other, they were queried by Reflect()
+	size_t theLength;
+	int theElement;
+	if (!ParseArrayElement(inVarName, theLength, theElement))
+		return -1;
+
+	theHandle = FindVariable(theData, theData.uniforms, inVarName, theLength);
+	if (theHandle == -1 || theElement >= theData.uniforms[theHandle].size)
+		return -1;
+	if (theElement == 0)
+		return theData.uniforms[theHandle].location;
+	return theData.elementLocations[theData.uniforms[theHandle].elementOffset + theElement - 1];
 }
 
 int CShader::GetAttributeIndex(const char* inVarName)
 {
-	return GetVariableIndex(inVarName, false);
+	CShaderStats::Count(CShaderStats::COUNTER_ATTRIBUTE_LOOKUPS);
+	const SProgramData& theData = GetData();
+	return GetLocation(theData.attributes, FindVariable(theData, theData.attributes, inVarName));
+}
+
+int CShader::GetUniformHandle(const char* inVarName) const
+{
+	CShaderStats::Count(CShaderStats::COUNTER_UNIFORM_LOOKUPS);
+	const SProgramData& theData = GetData();
+	return FindVariable(theData, theData.uniforms, inVarName);
 }
 
-int CShader::GetVariableIndex(const char *inVarName, bool inIsUniform)
+int CShader::GetAttributeHandle(const char* inVarName) const
 {
-	int theResult = -1;
+	CShaderStats::Count(CShaderStats::COUNTER_ATTRIBUTE_LOOKUPS);
+	const SProgramData& theData = GetData();
+	return FindVariable(theData, theData.attributes, inVarName);
+}
 
-	if (m_Program != 0)
+void CShader::Reflect()
+{
+	SProgramData& theData = *m_Data.load(std::memory_order_relaxed);
+	theData.uniforms.clear();
+	theData.attributes.clear();
+	theData.names.clear();
+	theData.elementLocations.clear();
+	theData.uniformValues.clear();
+	theData.dirtyUniforms.clear();
+
+	// an evicted shader has no variable left until its program is loaded again
+	GLuint theProgram = theData.program;
+	if (theProgram == 0) {
+		ResolveBindings(theData);
+		return;
+	}
+
+	GLint theCount = 0, theMaxLength = 0, theLength = 0, theSize = 0;
+	GLenum theType = 0;
+	std::vector<char> theName;
+
+	// uniforms
+	glGetProgramiv(theProgram, GL_ACTIVE_UNIFORMS, &theCount);
+	glGetProgramiv(theProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &theMaxLength);
+	theName.resize(theMaxLength + 1);
+	for (GLint i = 0; i < theCount; ++i)
+	{
+		glGetActiveUniform(theProgram, i, (GLsizei)theName.size(), &theLength, &theSize, &theType, &theName[0]);
+
+		// uniforms in blocks have no location
+		int theLocation = glGetUniformLocation(theProgram, &theName[0]);
+		if (theLocation != -1)
+			AddVariable(theData, theData.uniforms, &theName[0], theLocation, theType, theSize);
+	}
+
+	// attributes
+	glGetProgramiv(theProgram, GL_ACTIVE_ATTRIBUTES, &theCount);
+	glGetProgramiv(theProgram, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &theMaxLength);
+	theName.resize(theMaxLength + 1);
+	for (GLint i = 0; i < theCount; ++i)
+	{
+		glGetActiveAttrib(theProgram, i, (GLsizei)theName.size(), &theLength, &theSize, &theType, &theName[0]);
+
+		// built-in attributes have no location
+		int theLocation = glGetAttribLocation(theProgram, &theName[0]);
+		if (theLocation != -1)
+			AddVariable(theData, theData.attributes, &theName[0], theLocation, theType, theSize);
+	}
+
+	std::sort(theData.uniforms.begin(), theData.uniforms.end(), IsLess);
+	std::sort(theData.attributes.begin(), theData.attributes.end(), IsLess);
+
+	// the locations of the array elements, so that no lookup calls the driver
+	for (size_t i = 0; i < theData.uniforms.size(); ++i)
 	{
-		TVariableMap::iterator iter;
-		iter = m_VariableMap.find(inVarName);
-		if (iter == m_VariableMap.end())
+		theData.uniforms[i].elementOffset = (unsigned int)theData.elementLocations.size();
+		std::string theElementName(&theData.names[theData.uniforms[i].nameOffset]);
+		size_t theNameLength = theElementName.length();
+		for (int theElement = 1; theElement < theData.uniforms[i].size; ++theElement)
 		{
-			if (inIsUniform) // uniform variables
-				theResult = glGetUniformLocation(m_Program, inVarName);
-			else // attribute variables
-				theResult = glGetAttribLocation(m_Program, inVarName);
-			if(theResult != -1)
-				m_VariableMap[inVarName] = theResult;
+			char theIndex[16];
+			sprintf(theIndex, "[%d]", theElement);
+			theElementName.resize(theNameLength);
+			theElementName += theIndex;
+			theData.elementLocations.push_back(glGetUniformLocation(theProgram, theElementName.c_str()));
 		}
-		else
-			theResult = iter->second;
 	}
 
-	return theResult;
-}
\ No newline at end of file
+	// the CPU copy starts at 0, it is not compared until a value was uploaded since
+	// a newly linked program's uniforms may be set by initializers in the source
+	unsigned int theValueSize = 0;
+	for (size_t i = 0; i < theData.uniforms.size(); ++i)
+	{
+		bool isFloat;
+		theData.uniforms[i].valueOffset = theValueSize;
+		theData.uniforms[i].valueSize = GetUniformComponents(theData.uniforms[i].type, isFloat) * theData.uniforms[i].size * 4;
+		theValueSize += theData.uniforms[i].valueSize;
+	}
+	theData.uniformValues.assign(theValueSize, 0);
+
+	ResolveBindings(theData);
+}
+
+void CShader::Swap(CShader& ioShader)
+{
+	// the generated IDs of this shader are resolved before the program is published
+	SProgramData* theData = ioShader.m_Data.load(std::memory_order_relaxed);
+	ResolveBindings(*theData);
+	ioShader.m_Data.store(m_Data.exchange(theData, std::memory_order_acq_rel), std::memory_order_relaxed);
+}
+
+void CShader::SetUniform(int inHandle, const float* inValues)
+{
+	SetUniformValue(inHandle, inValues);
+}
+
+void CShader::SetUniform(int inHandle, const int* inValues)
+{
+	SetUniformValue(inHandle, inValues);
+}
+
+void CShader::SetUniformValue(int inHandle, const void* inValues)
+{
+	// the values are set by the rendering thread, which is also the one swapping the program
+	SProgramData& theData = *m_Data.load(std::memory_order_relaxed);
+	if (inHandle < 0 || inHandle >= (int)theData.uniforms.size())
+		return;
+
+	// double types have no CPU copy and cannot be set
+	SVariable& theUniform = theData.uniforms[inHandle];
+	if (theUniform.valueSize == 0)
+		return;
+
+	unsigned char* pValue = &theData.uniformValues[0] + theUniform.valueOffset;
+	if (theUniform.isUploaded && memcmp(pValue, inValues, theUniform.valueSize) == 0)
+	{
+		s_SkippedUniformCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	memcpy(pValue, inValues, theUniform.valueSize);
+	if (!theUniform.isDirty)
+	{
+		theUniform.isDirty = true;
+		theData.dirtyUniforms.push_back(inHandle);
+	}
+}
+
+void CShader::ApplyUniforms()
+{
+	SProgramData& theData = *m_Data.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < theData.dirtyUniforms.size(); ++i)
+	{
+		SVariable& theUniform = theData.uniforms[theData.dirtyUniforms[i]];
+		UploadUniform(theUniform.location, theUniform.type, theUniform.size, &theData.uniformValues[0] + theUniform.valueOffset);
+		theUniform.isDirty = false;
+		theUniform.isUploaded = true;
+	}
+	s_IssuedUniformCount.fetch_add((unsigned int)theData.dirtyUniforms.size(), std::memory_order_relaxed);
+	theData.dirtyUniforms.clear();
+}
+
+void CShader::SetBindings(const char* const* inUniformNames, int inUniformCount, const char* const* inAttributeNames, int inAttributeCount)
+{
+	if (inUniformCount > MAX_BOUND_VARIABLES || inAttributeCount > MAX_BOUND_VARIABLES) {
+		printf("Too many bound variables, at most %d uniforms and %d attributes\n", MAX_BOUND_VARIABLES, MAX_BOUND_VARIABLES);
+		return;
+	}
+
+	m_BoundUniformNames = inUniformNames;
+	m_BoundUniformCount = inUniformCount;
+	m_BoundAttributeNames = inAttributeNames;
+	m_BoundAttributeCount = inAttributeCount;
+	ResolveBindings(*m_Data.load(std::memory_order_relaxed));
+}
+
+void CShader::ResolveBindings(SProgramData& ioData) const
+{
+	for (int i = 0; i < MAX_BOUND_VARIABLES; ++i)
+	{
+		ioData.boundUniformHandles[i] = (i < m_BoundUniformCount) ? FindVariable(ioData, ioData.uniforms, m_BoundUniformNames[i]) : -1;
+		ioData.boundUniforms[i] = GetLocation(ioData.uniforms, ioData.boundUniformHandles[i]);
+		ioData.boundAttributes[i] = (i < m_BoundAttributeCount) ? GetLocation(ioData.attributes, FindVariable(ioData, ioData.attributes, m_BoundAttributeNames[i])) : -1;
+	}
+}
+
+int CShader::FindVariable(const SProgramData& inData, const TVariableTable& inTable, const char* inVarName)
+{
+	if (inVarName == NULL)
+		return -1;
+
+	// arrays are in the tables without their "[0]" suffix
+	size_t theLength = strlen(inVarName);
+	if (theLength > 3 && inVarName[theLength - 1] == ']' && strcmp(inVarName + theLength - 3, "[0]") == 0)
+		theLength -= 3;
+
+	return FindVariable(inData, inTable, inVarName, theLength);
+}
+
+int CShader::FindVariable(const SProgramData& inData, const TVariableTable& inTable, const char* inVarName, size_t inLength)
+{
+	SVariable theKey;
+	theKey.hash = HashBytes(inVarName, inLength);
+
+	// every active variable is in the table, a name which is not found is inactive
+	TVariableTable::const_iterator iter = std::lower_bound(inTable.begin(), inTable.end(), theKey, IsLess);
+	for (; iter != inTable.end() && iter->hash == theKey.hash; ++iter)
+	{
+		const char* theName = &inData.names[iter->nameOffset];
+		if (strncmp(theName, inVarName, inLength) == 0 && theName[inLength] == '\0')
+			return (int)(iter - inTable.begin());
+	}
+
+	return -1;
+}
+
+bool CShader::ParseArrayElement(const char* inVarName, size_t& outLength, int& outElement)
+{
+	size_t theLength = strlen(inVarName);
+	if (theLength < 4 || inVarName[theLength - 1] != ']')
+		return false;
+
+	// digits back to the opening bracket
+	size_t theOpen = theLength - 1;
+	while (theOpen > 0 && inVarName[theOpen - 1] >= '0' && inVarName[theOpen - 1] <= '9')
+		--theOpen;
+	if (theOpen == theLength - 1 || theOpen < 2 || inVarName[theOpen - 1] != '[')
+		return false;
+
+	outLength = theOpen - 1;
+	outElement = atoi(inVarName + theOpen);
+	return true;
+}
+
+void CShader::AddVariable(SProgramData& ioData, TVariableTable& ioTable, const char* inVarName, int inLocation, unsigned int inType, int inSize)
+{
+	// arrays are reported as "name[0]", they are looked up as "name"
+	size_t theLength = strlen(inVarName);
+	if (theLength > 3 && strcmp(inVarName + theLength - 3, "[0]") == 0)
+		theLength -= 3;
+
+	SVariable theVariable;
+	theVariable.hash = HashBytes(inVarName, theLength);
+	theVariable.nameOffset = (unsigned int)ioData.names.size();
+	theVariable.location = inLocation;
+	theVariable.type = inType;
+	theVariable.size = inSize;
+	theVariable.elementOffset = 0;
+	theVariable.valueOffset = 0;
+	theVariable.valueSize = 0;
+	theVariable.isDirty = false;
+	theVariable.isUploaded = false;
+	ioTable.push_back(theVariable);
+
+	ioData.names.insert(ioData.names.end(), inVarName, inVarName + theLength);
+	ioData.names.push_back('\0');
+}
\ No newline at end of file
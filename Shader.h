@@ -28,30 +28,89 @@ OTHER DEALINGS IN THE SOFTWARE.
 #ifndef SHADER_H
 #define SHADER_H
 
-#include <string>
-#include <map>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
 
 class CShader
 {
 ////////////////////////////////////////////////////////////
 //	Types
 ////////////////////////////////////////////////////////////
+public:
+	/// Maximum number of uniforms/attributes with generated IDs, see tools/ShaderBindingGen.cpp
+	enum { MAX_BOUND_VARIABLES = 32 };
+
 protected:
-	typedef std::map<std::string, int> TVariableMap;
+	/// An active uniform or attribute of the linked program
+	struct SVariable
+	{
+		uint64_t hash;			// hash of the name, the tables are sorted by it
+		unsigned int nameOffset;	// offset of the name in m_Names
+		int location;
+		unsigned int type;		// GL type, e.g. GL_FLOAT_MAT4
+		int size;				// number of array elements
+		unsigned int elementOffset;	// offset of the locations of the elements past the first in m_ElementLocations
+		unsigned int valueOffset;	// offset of the uniform's value in m_UniformValues
+		unsigned int valueSize;	// size of the uniform's value in bytes
+		bool isDirty;			// whether the value changed since it was uploaded
+		bool isUploaded;		// whether the value was uploaded once, the program's own value is unknown until then
+	};
+	typedef std::vector<SVariable> TVariableTable;
+
+	/// A linked program and its reflection tables, built by Reflect() and replaced as a whole by Swap()
+	struct SProgramData
+	{
+		/// Shader properties
+		unsigned int vertexShader;
+		unsigned int geometricShader;
+		unsigned int fragmentShader;
+		unsigned int program;
+
+		/// Active uniforms and attributes, reflected once after link
+		TVariableTable uniforms;
+		TVariableTable attributes;
+
+		/// Null terminated names of the variables
+		std::vector<char> names;
+
+		/// Locations of the uniform array elements past the first, a run of size - 1 per array
+		std::vector<int> elementLocations;
+
+		/// Locations of the variables with generated IDs, indexed by ID
+		int boundUniforms[MAX_BOUND_VARIABLES];
+		int boundAttributes[MAX_BOUND_VARIABLES];
+
+		/// Handles of the uniforms with generated IDs, indexed by ID
+		int boundUniformHandles[MAX_BOUND_VARIABLES];
+
+		/// CPU copy of the uniform values, and the handles of the values not uploaded yet
+		std::vector<unsigned char> uniformValues;
+		std::vector<int> dirtyUniforms;
+	};
 
 ////////////////////////////////////////////////////////////
 //	Fields
 ////////////////////////////////////////////////////////////
 protected:
-	/// map stores shader's variables
-	TVariableMap m_VariableMap;
+	/// The program and its variables, read by any thread. Swap() publishes new ones with
+	/// release order, so a lookup sees either the previous program or the new one as a whole
+	std::atomic<SProgramData*> m_Data;
 
-	/// Shader properties
-	unsigned int m_VertexShader;
-	unsigned int m_GeometricShader;
-	unsigned int m_FragmentShader;
-	unsigned int m_Program;
+	/// Names of the variables with generated IDs, in the order of their IDs
+	const char* const* m_BoundUniformNames;
+	const char* const* m_BoundAttributeNames;
+	int m_BoundUniformCount;
+	int m_BoundAttributeCount;
 
+	/// Number of uniform uploads issued and skipped as redundant, over all shaders and threads
+	static std::atomic<unsigned int> s_IssuedUniformCount;
+	static std::atomic<unsigned int> s_SkippedUniformCount;
+
+	/// Whether the program is still being loaded asynchronously, read by any thread; cleared
+	/// with release order once the program is set, so a reader seeing it clear sees the program
+	std::atomic<bool> m_IsPending;
 
 ////////////////////////////////////////////////////////////
 //	Methods
@@ -63,30 +122,141 @@ public:
 	/// Destructor
 	~CShader();
 
-	/// Getter/setters shader properties
-	inline unsigned int GetVert() { return m_VertexShader; }
-	inline unsigned int GetGeom() { return m_GeometricShader; }
-	inline unsigned int GetFrag() { return m_FragmentShader; }
-	inline unsigned int GetProgram() { return m_Program; }
+	/// Getters shader properties
+	inline unsigned int GetVert() { return GetData().vertexShader; }
+	inline unsigned int GetGeom() { return GetData().geometricShader; }
+	inline unsigned int GetFrag() { return GetData().fragmentShader; }
+	inline unsigned int GetProgram() { return GetData().program; }
+
+	/// Setters shader properties, for a shader no other thread reads yet, see Swap()
+	inline void SetVertShader(unsigned int inValue) { m_Data.load(std::memory_order_relaxed)->vertexShader = inValue; }
+	inline void SetGeomShader(unsigned int inValue) { m_Data.load(std::memory_order_relaxed)->geometricShader = inValue; }
+	inline void SetFragShader(unsigned int inValue) { m_Data.load(std::memory_order_relaxed)->fragmentShader = inValue; }
+	inline void SetProgram(unsigned int inValue) { m_Data.load(std::memory_order_relaxed)->program = inValue; }
 
-	inline void SetVertShader(unsigned int inValue) { m_VertexShader = inValue; }
-	inline void SetGeomShader(unsigned int inValue) { m_GeometricShader = inValue; }
-	inline void SetFragShader(unsigned int inValue) { m_FragmentShader = inValue; }
-	inline void SetProgram(unsigned int inValue) { m_Program = inValue; }
+	inline bool IsPending() { return m_IsPending.load(std::memory_order_acquire); }
+	inline void SetPending(bool inValue) { m_IsPending.store(inValue, std::memory_order_release); }
+
+	/// Set the shader pending unless it already is, true for the one thread which set it
+	inline bool TrySetPending() { bool isPending = false; return m_IsPending.compare_exchange_strong(isPending, true, std::memory_order_acq_rel, std::memory_order_relaxed); }
 
 	///Get index of an atribute variable of this shader
 	int GetAttributeIndex(const char* inVarName);
 
-	/// Get index of an uniform variable of this shader
+	/**
+	 * Get index of an uniform variable of this shader. An element of an array of basic
+	 * types, e.g. "Lights[2]", has its own location, queried from the driver once by Reflect().
+	 */
 	int GetUniformIndex(const char* inVarName);
 
+	/**
+	 * Get the handle of an active uniform/attribute, a small index into the reflection table.
+	 * Lookups never allocate nor call the driver, inactive names return -1. An array has one
+	 * handle, found by its name with or without "[0]". A reload may number the handles anew.
+	 */
+	int GetUniformHandle(const char* inVarName) const;
+	int GetAttributeHandle(const char* inVarName) const;
+
+	/// Get the location of a uniform/attribute handle, -1 for an invalid handle
+	inline int GetUniformLocation(int inHandle) const { return GetLocation(GetData().uniforms, inHandle); }
+	inline int GetAttributeLocation(int inHandle) const { return GetLocation(GetData().attributes, inHandle); }
+
+	/// Number of active uniforms/attributes, handles range from 0 to the count - 1
+	inline int GetUniformCount() const { return (int)GetData().uniforms.size(); }
+	inline int GetAttributeCount() const { return (int)GetData().attributes.size(); }
+
+	/// Build the reflection tables from the linked program, called after link; empties them for program 0
+	void Reflect();
+
+	/**
+	 * Publish the program of another shader, set with the setters and Reflect(), at once:
+	 * a thread looking up this shader meanwhile sees either its previous program or the new one.
+	 * ioShader gets the previous program, it has to be kept until no thread can read it anymore.
+	 */
+	void Swap(CShader& ioShader);
+
+	/**
+	 * Set the variables with generated IDs, their locations are resolved now and after every link.
+	 * Called by the generated S<Name>Program::Bind(), see ShaderBindings.h.
+	 * @param inUniformNames uniform names indexed by ID, must outlive the shader
+	 * @param inAttributeNames attribute names indexed by ID, must outlive the shader
+	 */
+	void SetBindings(const char* const* inUniformNames, int inUniformCount, const char* const* inAttributeNames, int inAttributeCount);
+
+	/// Get the location of a variable by generated ID, an array load
+	inline int GetBoundUniform(int inId) const { return GetData().boundUniforms[inId]; }
+	inline int GetBoundAttribute(int inId) const { return GetData().boundAttributes[inId]; }
+
+	/// Get the handle of a uniform by generated ID, for SetUniform
+	inline int GetBoundUniformHandle(int inId) const { return GetData().boundUniformHandles[inId]; }
+
+	/**
+	 * Set the value of a uniform. The value is compared with a CPU copy and only
+	 * uploaded by ApplyUniforms() if it changed; the first value set after a link is
+	 * always uploaded, as the program may have initialized the uniform. Values set
+	 * with glUniform* directly bypass the copy, so a program's uniforms should be set
+	 * through here only.
+	 * @param inHandle handle from GetUniformHandle, invalid handles are ignored
+	 * @param inValues values for all components and array elements of the uniform,
+	 *        e.g. 16 floats for a mat4; float setters for float types, int setters for
+	 *        int, bool and sampler types
+	 */
+	void SetUniform(int inHandle, const float* inValues);
+	void SetUniform(int inHandle, const int* inValues);
+	inline void SetUniform(int inHandle, float inValue) { SetUniform(inHandle, &inValue); }
+	inline void SetUniform(int inHandle, int inValue) { SetUniform(inHandle, &inValue); }
+
+	/// Upload the uniforms changed since the last call, the program must be in use
+	void ApplyUniforms();
+
+	/// Get the number of uniform uploads issued and skipped as redundant since the last reset
+	static inline unsigned int GetIssuedUniformCount() { return s_IssuedUniformCount.load(std::memory_order_relaxed); }
+	static inline unsigned int GetSkippedUniformCount() { return s_SkippedUniformCount.load(std::memory_order_relaxed); }
+	static inline void ResetUniformCounts() { s_IssuedUniformCount.store(0, std::memory_order_relaxed); s_SkippedUniformCount.store(0, std::memory_order_relaxed); }
+
 protected:
+	/// Get the current program and variables, a lookup reads them once so a swap cannot split it
+	inline const SProgramData& GetData() const { return *m_Data.load(std::memory_order_acquire); }
+
+	/// Get the location of a handle in a reflection table, -1 for an invalid handle
+	static inline int GetLocation(const TVariableTable& inTable, int inHandle) { return (inHandle >= 0 && inHandle < (int)inTable.size()) ? inTable[inHandle].location : -1; }
+
+	/**
+	 * Find a variable in a reflection table
+	 * @param inData the program whose table it is, for the names
+	 * @param inTable the uniform or attribute table
+	 * @param inVarName the variable name, a trailing "[0]" is ignored
+	 * @return the handle of the variable, -1 if it is not active
+	 */
+	static int FindVariable(const SProgramData& inData, const TVariableTable& inTable, const char* inVarName);
+
+	/// Find a variable by the first inLength characters of a name
+	static int FindVariable(const SProgramData& inData, const TVariableTable& inTable, const char* inVarName, size_t inLength);
+
 	/**
-	 * Get index of an variable of the shader
-	 * @param inVarName the variable name
-	 * @param inIsUniform whether the variable is an uniform
+	 * Split an array element name, e.g. "Lights[2]", into its array name and index
+	 * @param outLength length of the array name
+	 * @param outElement index of the element
+	 * @return false if the name does not end with an index
 	 */
-	int GetVariableIndex(const char* inVarName, bool inIsUniform);
+	static bool ParseArrayElement(const char* inVarName, size_t& outLength, int& outElement);
+
+	/// Add a variable to a reflection table of a program, array names are added without their "[0]" suffix
+	static void AddVariable(SProgramData& ioData, TVariableTable& ioTable, const char* inVarName, int inLocation, unsigned int inType, int inSize);
+
+	/// Resolve the locations of the variables with generated IDs in a program
+	void ResolveBindings(SProgramData& ioData) const;
+
+	/// Copy a uniform value to the CPU copy, marking it dirty if it changed or was never uploaded
+	void SetUniformValue(int inHandle, const void* inValues);
+
+	/// Order of the reflection tables
+	static inline bool IsLess(const SVariable& inLeft, const SVariable& inRight) { return inLeft.hash < inRight.hash; }
+
+private:
+	/// Not copyable, the program is owned
+	CShader(const CShader&);
+	CShader& operator=(const CShader&);
 
 }; // end class CShader
 
@@ -0,0 +1,54 @@
+// Generated by ShaderBindingGen, do not edit.
+
+#pragma once
+
+#ifndef SHADER_BINDINGS_H
+#define SHADER_BINDINGS_H
+
+#include "Shader.h"
+
+/// Uniforms and attributes of simple.vert simple.frag
+struct SSimpleProgram
+{
+	/// Uniform IDs, indexes of the shader's bound uniforms
+	static constexpr int UNIF_MODELVIEWMATRIX = 0;
+	static constexpr int UNIF_PROJMATRIX = 1;
+	static constexpr int UNIF_TEXTUREMAP = 2;
+	static constexpr int UNIFORM_COUNT = 3;
+	static_assert(UNIFORM_COUNT <= CShader::MAX_BOUND_VARIABLES, "too many bound variables");
+
+	/// Attribute IDs, indexes of the shader's bound attributes
+	static constexpr int ATTR_IN_INSTANCEMATRIX = 0;
+	static constexpr int ATTR_IN_POSITION = 1;
+	static constexpr int ATTR_IN_TEXCOORD = 2;
+	static constexpr int ATTR_IN_NORMAL = 3;
+	static constexpr int ATTRIBUTE_COUNT = 4;
+	static_assert(ATTRIBUTE_COUNT <= CShader::MAX_BOUND_VARIABLES, "too many bound variables");
+
+	static const char* const* GetUniformNames()
+	{
+		static const char* const theNames[] = { "ModelViewMatrix", "ProjMatrix", "TextureMap", NULL };
+		return theNames;
+	}
+
+	static const char* const* GetAttributeNames()
+	{
+		static const char* const theNames[] = { "in_InstanceMatrix", "in_Position", "in_TexCoord", "in_Normal", NULL };
+		return theNames;
+	}
+
+	/// Resolve the IDs of this program to the locations of a shader, once after link
+	static inline void Bind(CShader* inShader)
+	{
+		inShader->SetBindings(GetUniformNames(), UNIFORM_COUNT, GetAttributeNames(), ATTRIBUTE_COUNT);
+	}
+
+	/// Get the location of a uniform/attribute of a bound shader
+	static inline int UniformLocation(const CShader* inShader, int inUniform) { return inShader->GetBoundUniform(inUniform); }
+	static inline int AttributeLocation(const CShader* inShader, int inAttribute) { return inShader->GetBoundAttribute(inAttribute); }
+
+	/// Get the handle of a uniform of a bound shader, for CShader::SetUniform
+	static inline int Handle(const CShader* inShader, int inUniform) { return inShader->GetBoundUniformHandle(inUniform); }
+};
+
+#endif
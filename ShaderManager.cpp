@@ -25,266 +25,1426 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #include "Shader.h"
 #include "ShaderManager.h"
+#include "Hash.h"
+#include "SourceFile.h"
+#include "SharedContext.h"
+#include "UniformBufferManager.h"
+#include "VertexArrayCache.h"
+#include "GLStateCache.h"
+#include "ShaderStats.h"
 #include <GL/glew.h>
+#include <ctype.h>
+#include <algorithm>
+#include <functional>
 
-/// Maximum line length of a shader's source file
-const int MAX_LINE_LENGTH = 1024;
+/// Shader types of the program stages
+const unsigned int STAGE_TYPES[CShaderManager::STAGE_COUNT] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER_EXT };
 
 CShaderManager* CShaderManager::s_Instance = NULL;
-const char* CShaderManager::DEFAULT_SHADER = "DefaultShader";
+std::once_flag CShaderManager::s_InstanceFlag;
 
 CShaderManager::CShaderManager()
+: m_IsParallelCompileChecked(false),
+m_HasParallelCompile(false),
+m_WorkerContexts(NULL),
+m_IsStoppingWorkers(false),
+m_StartedWorkerCount(0),
+m_FailedWorkerCount(0),
+m_MaxProgramCount(0),
+m_MaxByteCount(0),
+m_LoadedCount(0),
+m_LoadedBytes(0),
+m_EvictionCount(0)
 {
+	m_FeatureCount.store(0, std::memory_order_relaxed);
+	m_Frame.store(0, std::memory_order_relaxed);
+	m_RestoreCount.store(0, std::memory_order_relaxed);
+
 	// create default shader for unsuccessful GetShader()
 	// the default Shader has program value which is 0 (default)
-	CShader* theDefaultShader = new CShader();
-	m_ShaderMap[DEFAULT_SHADER] = theDefaultShader;
+	unsigned int theIndex;
+	SProgram* theDefault = m_Programs.Reserve(theIndex);
+	SProgramKey theKey;
+	memset(&theKey, 0, sizeof(theKey));
+	InitProgram(*theDefault, theKey);
+	theDefault->shader.store(new CShader(), std::memory_order_relaxed);
+	m_Programs.Publish();
+
+	// string id 0 is none
+	*m_Strings.Reserve(theIndex) = NULL;
+	m_Strings.Publish();
 }
 
 CShaderManager::~CShaderManager()
 {
-	// clean up all shaders
-	TShaderMap::iterator iter;
-	for (iter = m_ShaderMap.begin(); iter != m_ShaderMap.end(); ++iter)
+	DisableHotReload();
+	StopWorkers();
+
+	// drop loads which have not finished yet
+	for (SLoadJob* theJob = m_CompletedJobs.PopAll(); theJob != NULL; )
+	{
+		SLoadJob* theNext = theJob->next;
+		m_FencedJobs.push_back(theJob);
+		theJob = theNext;
+	}
+	for (size_t i = 0; i < m_FencedJobs.size(); ++i)
+	{
+		if (m_FencedJobs[i]->fence != NULL)
+			glDeleteSync((GLsync)m_FencedJobs[i]->fence);
+		ReleaseLoad(*m_FencedJobs[i]);
+		delete m_FencedJobs[i];
+	}
+	for (size_t i = 0; i < m_PendingJobs.size(); ++i)
 	{
-		Dispose(iter->second);
+		ReleaseLoad(*m_PendingJobs[i]);
+		delete m_PendingJobs[i];
+	}
+	for (size_t i = 0; i < m_QueuedJobs.size(); ++i)
+		delete m_QueuedJobs[i];
+	for (TSteppedJobMap::iterator iter = m_SteppedJobs.begin(); iter != m_SteppedJobs.end(); ++iter)
+	{
+		ReleaseLoad(*iter->second);
 		delete iter->second;
 	}
-	m_ShaderMap.clear();
+	m_FencedJobs.clear();
+	m_PendingJobs.clear();
+	m_QueuedJobs.clear();
+	m_SteppedJobs.clear();
+	DeleteRetiredShaders();
+
+	// clean up all shaders, the program and string tables go away with the manager
+	for (unsigned int i = 0; i < m_Programs.GetCount(); ++i)
+	{
+		CShader* theShader = m_Programs[i].shader.load(std::memory_order_relaxed);
+		if (theShader == NULL)
+			continue;
+
+		Dispose(theShader);
+		delete theShader;
+	}
+
+	for (unsigned int i = 0; i < m_Strings.GetCount(); ++i)
+		free(m_Strings[i]);
 }
 
 CShaderManager* CShaderManager::GetInstance()
 {
-	if (s_Instance == NULL)
-		s_Instance = new CShaderManager;
+	// the first call may come from any thread
+	std::call_once(s_InstanceFlag, CreateInstance);
 	return (s_Instance);
 }
 
-CShader* CShaderManager::GetShader(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName)
+void CShaderManager::CreateInstance()
 {
-	std::string theString = inVertFileName;
-	if(inFragFileName)
-		theString += inFragFileName;
-	if(inGeomFileName)
-		theString += inGeomFileName;
+	s_Instance = new CShaderManager;
+}
+
+void CShaderManager::DestroyInstance()
+{
+	// the programs are deleted with the context still current
+	delete s_Instance;
+	s_Instance = NULL;
+}
+
+bool CShaderManager::EnableBinaryCache(const char* inDirectory)
+{
+	return m_BinaryCache.Initialize(inDirectory);
+}
 
-	TShaderMap::iterator i = m_ShaderMap.find(theString);
-	if(i != m_ShaderMap.end())
+bool CShaderManager::SProgramKey::operator==(const SProgramKey& inOther) const
+{
+	for (int i = 0; i < STAGE_COUNT; ++i)
 	{
-		return (i->second);
+		if (stages[i] != inOther.stages[i])
+			return false;
 	}
-	else
+	return defines == inOther.defines && features == inOther.features;
+}
+
+CShaderManager::TShaderHandle CShaderManager::RegisterProgram(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines)
+{
+	if (inVertFileName == NULL || inVertFileName[0] == '\0')
+		return DEFAULT_SHADER_HANDLE;
+
+	std::lock_guard<std::mutex> theLock(m_RegisterMutex);
+
+	SProgramKey theKey;
+	theKey.stages[STAGE_VERTEX] = InternString(inVertFileName);
+	theKey.stages[STAGE_FRAGMENT] = InternString(inFragFileName);
+	theKey.stages[STAGE_GEOMETRY] = InternString(inGeomFileName);
+	theKey.defines = InternString(inDefines);
+	theKey.features = 0;
+
+	// another thread may have registered it since the caller's lookup
+	uint64_t theHash = HashKey(theKey);
+	TShaderHandle theHandle = FindHandle(theKey, theHash);
+	if (theHandle != DEFAULT_SHADER_HANDLE)
+		return theHandle;
+
+	SProgram* theProgram = m_Programs.Reserve(theHandle);
+	if (theProgram == NULL) {
+		printf("Too many shader programs registered.\n");
+		return DEFAULT_SHADER_HANDLE;
+	}
+	InitProgram(*theProgram, theKey);
+	m_Programs.Publish();
+
+	// published after the program, a reader finding the handle finds the program
+	m_ProgramIndex.Insert(theHash, theHandle);
+	return theHandle;
+}
+
+CShaderManager::TShaderHandle CShaderManager::FindProgram(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines) const
+{
+	SProgramKey theKey;
+	if (!FindKey(inVertFileName, inFragFileName, inGeomFileName, inDefines, theKey))
+		return DEFAULT_SHADER_HANDLE;
+	return FindHandle(theKey, HashKey(theKey));
+}
+
+CShaderManager::TVariantMask CShaderManager::RegisterFeature(const char* inName)
+{
+	if (inName == NULL || inName[0] == '\0')
+		return 0;
+
+	std::lock_guard<std::mutex> theLock(m_RegisterMutex);
+
+	unsigned int theCount = m_FeatureCount.load(std::memory_order_relaxed);
+	for (unsigned int i = 0; i < theCount; ++i)
+	{
+		if (m_FeatureNames[i] == inName)
+			return 1u << i;
+	}
+
+	if (theCount == MAX_FEATURES) {
+		printf("Too many shader features registered.\n");
+		return 0;
+	}
+
+	// published after the name, a reader seeing the count sees the name
+	m_FeatureNames[theCount] = inName;
+	m_FeatureCount.store(theCount + 1, std::memory_order_release);
+	return 1u << theCount;
+}
+
+CShaderManager::TShaderHandle CShaderManager::GetVariant(TShaderHandle inProgram, TVariantMask inFeatures)
+{
+	if (inProgram == DEFAULT_SHADER_HANDLE || inProgram >= m_Programs.GetCount())
+		return DEFAULT_SHADER_HANDLE;
+
+	// a variant is a program whose key differs by its features only
+	SProgramKey theKey = m_Programs[inProgram].key;
+	if ((theKey.features | inFeatures) == theKey.features)
+		return inProgram;
+	theKey.features |= inFeatures;
+
+	uint64_t theHash = HashKey(theKey);
+	TShaderHandle theHandle = FindHandle(theKey, theHash);
+	if (theHandle != DEFAULT_SHADER_HANDLE)
+		return theHandle;
+
+	std::lock_guard<std::mutex> theLock(m_RegisterMutex);
+
+	// another thread may have registered it since the lookup above
+	theHandle = FindHandle(theKey, theHash);
+	if (theHandle != DEFAULT_SHADER_HANDLE)
+		return theHandle;
+
+	SProgram* theProgram = m_Programs.Reserve(theHandle);
+	if (theProgram == NULL) {
+		printf("Too many shader programs registered.\n");
+		return DEFAULT_SHADER_HANDLE;
+	}
+	InitProgram(*theProgram, theKey);
+	m_Programs.Publish();
+	m_ProgramIndex.Insert(theHash, theHandle);
+	return theHandle;
+}
+
+void CShaderManager::WarmUp(const SVariant* inVariants, size_t inCount)
+{
+	// the loads are queued like any asynchronous request, nothing blocks here
+	for (size_t i = 0; i < inCount; ++i)
+		GetShaderAsync(GetVariant(inVariants[i].program, inVariants[i].features));
+}
+
+CShader* CShaderManager::GetShader(TShaderHandle inHandle)
+{
+	if (inHandle >= m_Programs.GetCount())
+		return m_Programs[DEFAULT_SHADER_HANDLE].shader.load(std::memory_order_acquire);
+
+	SProgram& theProgram = m_Programs[inHandle];
+	TouchProgram(theProgram);
+	CShader* theShader = theProgram.shader.load(std::memory_order_acquire);
+	bool isCreated = false;
+	if (theShader == NULL)
+		theShader = CreateShader(theProgram, isCreated);
+	else if (theProgram.isEvicted.load(std::memory_order_relaxed))
+		isCreated = RestoreShader(theProgram);
+	CShaderStats::Count(isCreated ? CShaderStats::COUNTER_SHADER_MISSES : CShaderStats::COUNTER_SHADER_HITS);
+
+	if (!isCreated)
 	{
-		CShader* theResult = Load(inVertFileName, inFragFileName, inGeomFileName);
-		if(theResult != NULL)
+		// an asynchronous load of this program is still running, wait for it
+		if (theShader->IsPending())
+			CompleteLoad(theShader);
+
+		// a program which failed to load gets the default shader, as on the request which loaded it
+		if (theShader->GetProgram() == 0)
+			return m_Programs[DEFAULT_SHADER_HANDLE].shader.load(std::memory_order_acquire);
+		return theShader;
+	}
+
+	// load it now, the shader is published pending so other threads wait for this load
+	SLoadJob theJob;
+	theJob.shader = theShader;
+	SetProgram(theJob, theProgram);
+	theJob.handle = inHandle;
+	if (!BeginLoad(theJob) || !FinishLoad(theJob))
+	{
+		// if load/link unsuccessfully, return default shader which program = 0
+		theShader->SetPending(false);
+		return m_Programs[DEFAULT_SHADER_HANDLE].shader.load(std::memory_order_acquire);
+	}
+
+	return theShader;
+}
+
+CShader* CShaderManager::GetShaderAsync(TShaderHandle inHandle)
+{
+	if (inHandle >= m_Programs.GetCount())
+		return m_Programs[DEFAULT_SHADER_HANDLE].shader.load(std::memory_order_acquire);
+
+	SProgram& theProgram = m_Programs[inHandle];
+	TouchProgram(theProgram);
+	CShader* theShader = theProgram.shader.load(std::memory_order_acquire);
+
+	// only the thread which creates the shader, or restores an evicted one, queues its load
+	bool isCreated = false;
+	if (theShader == NULL)
+		theShader = CreateShader(theProgram, isCreated);
+	else if (theProgram.isEvicted.load(std::memory_order_relaxed))
+		isCreated = RestoreShader(theProgram);
+	CShaderStats::Count(isCreated ? CShaderStats::COUNTER_SHADER_MISSES : CShaderStats::COUNTER_SHADER_HITS);
+	if (!isCreated)
+		return theShader;
+
+	SLoadJob* theJob = new SLoadJob;
+	theJob->shader = theShader;
+	SetProgram(*theJob, theProgram);
+	theJob->handle = inHandle;
+	QueueLoad(theJob);
+	return theShader;
+}
+
+void CShaderManager::QueueLoad(SLoadJob* inJob)
+{
+	{
+		std::lock_guard<std::mutex> theLock(m_WorkerMutex);
+		if (!m_Workers.empty())
 		{
-			// successful loaded and linked shader program, added to map and return the result
-			m_ShaderMap[theString] = theResult;
-			return theResult;
+			// the whole load runs on a worker thread
+			m_WorkerJobs.push_back(inJob);
+			m_WorkerCondition.notify_one();
+			return;
 		}
 	}
 
-	// if load/link unsuccessfully, return default shader which program = 0
-	return m_ShaderMap[DEFAULT_SHADER];
+	std::lock_guard<std::mutex> theLock(m_QueueMutex);
+	m_QueuedJobs.push_back(inJob);
+}
+
+void CShaderManager::InvalidateFile(const char* inFileName)
+{
+	std::vector<unsigned int> thePrograms;
+	m_Preprocessor.Invalidate(inFileName, thePrograms);
+
+	for (size_t i = 0; i < thePrograms.size(); ++i)
+	{
+		// programs never loaded or evicted read the new files on their next load, and
+		// a load still in flight would publish after the reload, so all are left alone
+		SProgram& theProgram = m_Programs[thePrograms[i]];
+		CShader* theShader = theProgram.shader.load(std::memory_order_acquire);
+		if (theShader == NULL || theShader->IsPending() || theProgram.isEvicted.load(std::memory_order_acquire))
+			continue;
+
+		SLoadJob* theJob = new SLoadJob;
+		theJob->shader = theShader;
+		SetProgram(*theJob, theProgram);
+		theJob->handle = thePrograms[i];
+		theJob->isReload = true;
+		theJob->generation = theProgram.generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+		QueueLoad(theJob);
+	}
+}
+
+bool CShaderManager::EnableHotReload()
+{
+	return m_FileWatcher.IsRunning() || m_FileWatcher.Start(OnFileChanged, this);
+}
+
+void CShaderManager::DisableHotReload()
+{
+	m_FileWatcher.Stop();
+}
+
+void CShaderManager::OnFileChanged(const char* inFileName, void* inUserData)
+{
+	printf("Reloading shaders using %s.\n", inFileName);
+	static_cast<CShaderManager*>(inUserData)->InvalidateFile(inFileName);
+}
+
+CShader* CShaderManager::CreateShader(SProgram& ioProgram, bool& outIsCreated)
+{
+	// the handle has program 0, like the default shader, until the load completes
+	CShader* theShader = new CShader;
+	theShader->SetPending(true);
+
+	CShader* theExpected = NULL;
+	outIsCreated = ioProgram.shader.compare_exchange_strong(theExpected, theShader, std::memory_order_acq_rel, std::memory_order_acquire);
+	if (outIsCreated)
+		return theShader;
+
+	// another thread created it first and loads it
+	delete theShader;
+	return theExpected;
+}
+
+bool CShaderManager::RestoreShader(SProgram& ioProgram)
+{
+	// only the thread setting the shader pending loads the program, the others find it pending
+	CShader* theShader = ioProgram.shader.load(std::memory_order_acquire);
+	if (!theShader->TrySetPending())
+		return false;
+
+	// another thread restored the program since it was found evicted
+	bool isEvicted = true;
+	if (!ioProgram.isEvicted.compare_exchange_strong(isEvicted, false, std::memory_order_acq_rel, std::memory_order_relaxed))
+	{
+		theShader->SetPending(false);
+		return false;
+	}
+
+	m_RestoreCount.fetch_add(1, std::memory_order_relaxed);
+	return true;
 }
 
-CShader* CShaderManager::Load(const char* inVertexFilename, const char* inFragmentFilename, const char* inGeometryFilename)
+void CShaderManager::SetCacheBudget(unsigned int inMaxPrograms, size_t inMaxBytes)
 {
-	unsigned int vertShader = 0, fragShader = 0, geomShader = 0, programShader = 0;
-	bool loadStatus;
-	
-	// load and compile vertex. geometric and fragment sources
-	loadStatus = LoadShader(GL_VERTEX_SHADER, inVertexFilename, vertShader);
-	loadStatus &= LoadShader(GL_FRAGMENT_SHADER, inFragmentFilename, fragShader);
-	// if geometry file is provided, load it
-	if (inGeometryFilename)
-		loadStatus &= LoadShader(GL_GEOMETRY_SHADER_EXT, inGeometryFilename, geomShader);
+	m_MaxProgramCount = inMaxPrograms;
+	m_MaxByteCount = inMaxBytes;
+}
+
+void CShaderManager::AcquireProgram(TShaderHandle inHandle)
+{
+	if (inHandle != DEFAULT_SHADER_HANDLE && inHandle < m_Programs.GetCount())
+		m_Programs[inHandle].refCount.fetch_add(1, std::memory_order_relaxed);
+}
 
+void CShaderManager::ReleaseProgram(TShaderHandle inHandle)
+{
+	if (inHandle != DEFAULT_SHADER_HANDLE && inHandle < m_Programs.GetCount())
+		m_Programs[inHandle].refCount.fetch_sub(1, std::memory_order_relaxed);
+}
 
-	if (loadStatus) 
+void CShaderManager::GetCacheStats(SCacheStats& outStats) const
+{
+	outStats.programCount = m_LoadedCount;
+	outStats.byteCount = m_LoadedBytes;
+	outStats.referencedCount = 0;
+	outStats.evictedCount = 0;
+	for (unsigned int i = DEFAULT_SHADER_HANDLE + 1; i < m_Programs.GetCount(); ++i)
 	{
-		// create a program
-		programShader = glCreateProgram();
+		const SProgram& theProgram = m_Programs[i];
+		if (theProgram.isEvicted.load(std::memory_order_relaxed))
+			++outStats.evictedCount;
+		else if (theProgram.byteCount != 0 && theProgram.refCount.load(std::memory_order_relaxed) > 0)
+			++outStats.referencedCount;
+	}
 
-		if (programShader == 0)
-			return NULL;
+	{
+		std::lock_guard<std::mutex> theLock(m_StageMutex);
+		outStats.stageCount = (unsigned int)m_StageRefMap.size();
+	}
+	outStats.evictionCount = m_EvictionCount;
+	outStats.restoreCount = m_RestoreCount.load(std::memory_order_relaxed);
+}
 
-		// attach the vertex and fragment shader codes, and the geometric if available
-		glAttachShader(programShader, vertShader);
+bool CShaderManager::IsOverBudget() const
+{
+	return (m_MaxProgramCount != 0 && m_LoadedCount > m_MaxProgramCount)
+		|| (m_MaxByteCount != 0 && m_LoadedBytes > m_MaxByteCount);
+}
 
-		if (geomShader != 0)
-			glAttachShader(programShader, geomShader);
+void CShaderManager::EvictPrograms()
+{
+	if (!IsOverBudget())
+		return;
 
-		glAttachShader(programShader, fragShader);
+	// loaded programs nobody references and not used in this frame, by age in frames
+	unsigned int theFrame = m_Frame.load(std::memory_order_relaxed);
+	std::vector<std::pair<unsigned int, TShaderHandle> > theCandidates;
+	for (unsigned int i = DEFAULT_SHADER_HANDLE + 1; i < m_Programs.GetCount(); ++i)
+	{
+		SProgram& theProgram = m_Programs[i];
+		CShader* theShader = theProgram.shader.load(std::memory_order_acquire);
+		if (theShader == NULL || theShader->IsPending() || theShader->GetProgram() == 0
+			|| theProgram.refCount.load(std::memory_order_relaxed) > 0)
+			continue;
 
-		// link
-		glLinkProgram(programShader);
+		unsigned int theLastUse = theProgram.lastUse.load(std::memory_order_relaxed);
+		if (theLastUse != theFrame)
+			theCandidates.push_back(std::make_pair(theFrame - theLastUse, i));
+	}
 
-		// check link status
-		GLint status = GL_FALSE;
-		glGetProgramiv(programShader, GL_LINK_STATUS, &status);
-		if (status != GL_TRUE) {
-			// The link has failed, check log info
-			int logLength = 1;
-			glGetProgramiv(programShader, GL_INFO_LOG_LENGTH, &logLength);
+	// the oldest first, the frame counter may wrap so ages are compared rather than frames
+	std::sort(theCandidates.begin(), theCandidates.end(), std::greater<std::pair<unsigned int, TShaderHandle> >());
+	for (size_t i = 0; i < theCandidates.size() && IsOverBudget(); ++i)
+		EvictProgram(theCandidates[i].second);
+}
+
+void CShaderManager::EvictProgram(TShaderHandle inHandle)
+{
+	SProgram& theProgram = m_Programs[inHandle];
+	CShader* theShader = theProgram.shader.load(std::memory_order_acquire);
 
-			char* infoLog = (char*)malloc(logLength+1);
-			glGetProgramInfoLog(programShader, logLength, &logLength, infoLog);
-			printf("Failed to link the shader: %s\n", infoLog);
-			free(infoLog);
+	// flagged first, so a thread finding the shader without a program restores it
+	theProgram.isEvicted.store(true, std::memory_order_release);
+
+	// the shader object is kept, a pointer still held draws nothing until the program is loaded again;
+	// the program and stage objects are deleted by the next Update(), like those a reload replaces
+	SwapProgram(theShader, new CShader);
+
+	--m_LoadedCount;
+	m_LoadedBytes -= theProgram.byteCount;
+	theProgram.byteCount = 0;
+	++m_EvictionCount;
+}
 
-			return NULL;
+size_t CShaderManager::EstimateBytes(const SLoadJob& inJob) const
+{
+	// the binary is the closest the API gets to the driver's memory use of a program,
+	// without program binaries the length of its sources stands in for it
+	GLint theLength = 0;
+	if (GLEW_ARB_get_program_binary)
+		glGetProgramiv(inJob.program, GL_PROGRAM_BINARY_LENGTH, &theLength);
+	return (theLength > 0) ? (size_t)theLength : inJob.sourceBytes;
+}
+
+CShader* CShaderManager::GetShader(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines)
+{
+	// registered programs are found without allocating
+	TShaderHandle theHandle = FindProgram(inVertFileName, inFragFileName, inGeomFileName, inDefines);
+	if (theHandle == DEFAULT_SHADER_HANDLE)
+		theHandle = RegisterProgram(inVertFileName, inFragFileName, inGeomFileName, inDefines);
+	return GetShader(theHandle);
+}
+
+CShader* CShaderManager::GetShaderAsync(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines)
+{
+	TShaderHandle theHandle = FindProgram(inVertFileName, inFragFileName, inGeomFileName, inDefines);
+	if (theHandle == DEFAULT_SHADER_HANDLE)
+		theHandle = RegisterProgram(inVertFileName, inFragFileName, inGeomFileName, inDefines);
+	return GetShaderAsync(theHandle);
+}
+
+void CShaderManager::Update()
+{
+	// programs used from now on are used in a new frame
+	m_Frame.fetch_add(1, std::memory_order_relaxed);
+
+	// programs replaced in the last frame are no longer read by any thread
+	DeleteRetiredShaders();
+
+	// publish the programs the worker threads have finished
+	ProcessCompletedJobs(NULL);
+
+	// finish the loads issued in earlier frames whose compile/link is done
+	size_t theCount = 0;
+	for (size_t i = 0; i < m_PendingJobs.size(); ++i)
+	{
+		if (IsLoadComplete(*m_PendingJobs[i]))
+		{
+			FinishLoad(*m_PendingJobs[i]);
+			delete m_PendingJobs[i];
 		}
+		else
+			m_PendingJobs[theCount++] = m_PendingJobs[i];
+	}
+	m_PendingJobs.resize(theCount);
 
-		// check if the shader will run in the current OpenGL state
-		glValidateProgram(programShader);
-		glGetProgramiv(programShader, GL_VALIDATE_STATUS, &status);
-		if (status != GL_TRUE) {
-			printf("Shader program will not run in this OpenGL environment!\n");
-			return NULL;
+	// make room for the programs used in this frame
+	EvictPrograms();
+
+	TLoadJobList theJobs;
+	{
+		std::lock_guard<std::mutex> theLock(m_QueueMutex);
+		theJobs.swap(m_QueuedJobs);
+	}
+	if (theJobs.empty())
+		return;
+
+	// issue the compiles and links of the whole batch, no status is queried
+	// before a later frame so the driver can work on them in the background
+	EnableParallelCompile();
+	for (size_t i = 0; i < theJobs.size(); ++i)
+	{
+		if (BeginLoad(*theJobs[i]))
+			m_PendingJobs.push_back(theJobs[i]);
+		else
+		{
+			theJobs[i]->shader->SetPending(false);
+			delete theJobs[i];
 		}
+	}
+}
+
+CShaderManager::ELoadStep CShaderManager::LoadStep(TShaderHandle inHandle)
+{
+	if (inHandle == DEFAULT_SHADER_HANDLE || inHandle >= m_Programs.GetCount())
+		return LOAD_DONE;
+
+	SLoadJob* theJob;
+	TSteppedJobMap::iterator iter = m_SteppedJobs.find(inHandle);
+	if (iter != m_SteppedJobs.end())
+		theJob = iter->second;
+	else
+	{
+		// a program already loaded, or loaded by another request, has nothing left to step
+		SProgram& theProgram = m_Programs[inHandle];
+		CShader* theShader = theProgram.shader.load(std::memory_order_acquire);
+		bool isCreated = false;
+		if (theShader == NULL)
+			theShader = CreateShader(theProgram, isCreated);
+		else if (theProgram.isEvicted.load(std::memory_order_relaxed))
+			isCreated = RestoreShader(theProgram);
+		if (!isCreated)
+			return LOAD_DONE;
+
+		theJob = new SLoadJob;
+		theJob->shader = theShader;
+		SetProgram(*theJob, theProgram);
+		theJob->handle = inHandle;
+		theJob->isStepped = true;
+		m_SteppedJobs[inHandle] = theJob;
+	}
+
+	ELoadStep theStep = theJob->nextStep;
+	if (!RunLoadStep(*theJob))
+		theJob->shader->SetPending(false);
+	else if (theJob->nextStep != LOAD_DONE)
+		return theStep;
 
+	m_SteppedJobs.erase(inHandle);
+	delete theJob;
+	return theStep;
+}
+
+bool CShaderManager::RunLoadStep(SLoadJob& ioJob)
+{
+	switch (ioJob.nextStep)
+	{
+	case LOAD_READ:
+		if (!ReadSources(ioJob))
+			return false;
+		ioJob.nextStep = ioJob.isFromBinary ? LOAD_VALIDATE : LOAD_COMPILE;
+		return true;
 
-		// the program has been loaded/linked successfully
-		CShader* theResult = new CShader;
-		theResult->SetVertShader(vertShader);
-		theResult->SetFragShader(fragShader);
-		theResult->SetGeomShader(geomShader);
-		theResult->SetProgram(programShader);
+	case LOAD_COMPILE:
+		// one stage per step, the optional geometric stage takes none if it is missing
+		while (ioJob.nextStage < STAGE_COUNT && !ioJob.sources[ioJob.nextStage].IsOpen())
+			++ioJob.nextStage;
+		if (ioJob.nextStage < STAGE_COUNT && !CompileStage(ioJob, ioJob.nextStage++))
+			return false;
+		while (ioJob.nextStage < STAGE_COUNT && !ioJob.sources[ioJob.nextStage].IsOpen())
+			++ioJob.nextStage;
+		if (ioJob.nextStage == STAGE_COUNT)
+			ioJob.nextStep = LOAD_LINK;
+		return true;
 
-		return theResult;
+	case LOAD_LINK:
+		// querying the link status waits for the link within this step
+		LinkProgram(ioJob);
+		if (!CheckLoad(ioJob))
+			return false;
+		ioJob.nextStep = LOAD_VALIDATE;
+		return true;
+
+	case LOAD_VALIDATE:
+		ioJob.nextStep = LOAD_DONE;
+		return PublishLoad(ioJob);
+
+	default:
+		return true;
 	}
+}
 
-	return NULL;
+bool CShaderManager::StartWorkers(CSharedContextFactory* inContexts, int inCount)
+{
+	StopWorkers();
+
+	if (inContexts == NULL || inCount <= 0 || !inContexts->Create(inCount))
+		return false;
+
+	m_WorkerContexts = inContexts;
+	m_IsStoppingWorkers = false;
+	m_StartedWorkerCount = 0;
+	m_FailedWorkerCount = 0;
+	for (int i = 0; i < inCount; ++i)
+		m_Workers.push_back(std::thread(&CShaderManager::WorkerMain, this, i));
+
+	// wait until every worker made its context current
+	bool isStarted;
+	{
+		std::unique_lock<std::mutex> theLock(m_WorkerMutex);
+		while (m_StartedWorkerCount + m_FailedWorkerCount < inCount)
+			m_WorkerCondition.wait(theLock);
+		isStarted = (m_FailedWorkerCount == 0);
+	}
+
+	if (!isStarted) {
+		printf("Cannot start shader worker threads.\n");
+		StopWorkers();
+	}
+	return isStarted;
 }
 
-void CShaderManager::Dispose(CShader* inShader)
+void CShaderManager::StopWorkers()
 {
-	if (inShader->GetProgram() != 0) {
-		glDeleteProgram(inShader->GetProgram());
+	if (m_Workers.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> theLock(m_WorkerMutex);
+		m_IsStoppingWorkers = true;
+		m_WorkerCondition.notify_all();
+	}
+	for (size_t i = 0; i < m_Workers.size(); ++i)
+		m_Workers[i].join();
+	m_Workers.clear();
+
+	m_WorkerContexts->Destroy();
+	m_WorkerContexts = NULL;
+
+	// requests no worker started are loaded on the rendering thread
+	std::lock_guard<std::mutex> theLock(m_QueueMutex);
+	m_QueuedJobs.insert(m_QueuedJobs.end(), m_WorkerJobs.begin(), m_WorkerJobs.end());
+	m_WorkerJobs.clear();
+}
+
+void CShaderManager::WorkerMain(int inIndex)
+{
+	bool isCurrent = m_WorkerContexts->MakeCurrent(inIndex);
+	{
+		std::lock_guard<std::mutex> theLock(m_WorkerMutex);
+		if (isCurrent)
+			++m_StartedWorkerCount;
+		else
+			++m_FailedWorkerCount;
+		m_WorkerCondition.notify_all();
+	}
+	if (!isCurrent)
+		return;
+
+	for (;;)
+	{
+		SLoadJob* theJob = NULL;
+		{
+			std::unique_lock<std::mutex> theLock(m_WorkerMutex);
+			while (m_WorkerJobs.empty() && !m_IsStoppingWorkers)
+				m_WorkerCondition.wait(theLock);
+			if (m_IsStoppingWorkers)
+				break;
+			theJob = m_WorkerJobs.front();
+			m_WorkerJobs.pop_front();
+		}
+
+		// blocking on the link status is fine here, the rendering thread does not wait
+		theJob->isOnWorker = true;
+		theJob->isLinked = BeginLoad(*theJob) && CheckLoad(*theJob);
+
+		// the rendering thread uses the program once the fence has signaled
+		if (theJob->isLinked)
+			theJob->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		m_CompletedJobs.Push(theJob);
 	}
 
-	if (inShader->GetVert() != 0) {
-		glDeleteShader(inShader->GetVert());
+	m_WorkerContexts->ReleaseCurrent();
+}
+
+void CShaderManager::ProcessCompletedJobs(CShader* inWaitShader)
+{
+	for (SLoadJob* theJob = m_CompletedJobs.PopAll(); theJob != NULL; )
+	{
+		SLoadJob* theNext = theJob->next;
+		m_FencedJobs.push_back(theJob);
+		theJob = theNext;
 	}
 
-	if (inShader->GetGeom() != 0) {
-		glDeleteShader(inShader->GetGeom());
+	size_t theCount = 0;
+	for (size_t i = 0; i < m_FencedJobs.size(); ++i)
+	{
+		SLoadJob* theJob = m_FencedJobs[i];
+		if (theJob->fence != NULL)
+		{
+			GLuint64 theTimeout = (theJob->shader == inWaitShader) ? GL_TIMEOUT_IGNORED : 0;
+			if (glClientWaitSync((GLsync)theJob->fence, 0, theTimeout) == GL_TIMEOUT_EXPIRED)
+			{
+				m_FencedJobs[theCount++] = theJob;
+				continue;
+			}
+			glDeleteSync((GLsync)theJob->fence);
+			theJob->fence = NULL;
+		}
+
+		if (theJob->isLinked)
+			PublishLoad(*theJob);
+		else
+			theJob->shader->SetPending(false);
+		delete theJob;
 	}
+	m_FencedJobs.resize(theCount);
+}
+
+bool CShaderManager::BeginLoad(SLoadJob& ioJob)
+{
+	if (!ReadSources(ioJob))
+		return false;
+	if (ioJob.isFromBinary)
+		return true;
 
-	if (inShader->GetFrag() != 0) {
-		glDeleteShader(inShader->GetFrag());
+	// get the compiled vertex, geometric and fragment shaders and attach them
+	for (int i = 0; i < STAGE_COUNT; ++i)
+	{
+		if (!CompileStage(ioJob, i))
+			return false;
 	}
+
+	LinkProgram(ioJob);
+	return true;
 }
 
-bool CShaderManager::LoadShader(unsigned int inShaderType, const std::string& inFileName, GLuint &inOutShader)
+bool CShaderManager::ReadSources(SLoadJob& ioJob)
 {
-	if (inFileName.empty()) {
-		printf("Shader's filename is empty!\n");
+	uint64_t theSourceHash = HASH_SEED;
+
+	ioJob.program = 0;
+	ioJob.sourceBytes = 0;
+	for (int i = 0; i < STAGE_COUNT; ++i)
+		ioJob.stages[i] = 0;
+
+	// load vertex, fragment and geometric sources, the geometric one is optional
+	for (int i = 0; i < STAGE_COUNT; ++i)
+	{
+		if (ioJob.fileNames[i].empty())
+		{
+			if (i == STAGE_GEOMETRY)
+				continue;
+
+			printf("Shader's filename is empty!\n");
+			return false;
+		}
+
+		double theStart = CShaderStats::BeginPhase();
+		CSourceFile& theSource = ioJob.sources[i];
+		if (!theSource.Open(ioJob.fileNames[i].c_str())) {
+			printf("Cannot load file source %s.\n", ioJob.fileNames[i].c_str());
+			return false;
+		}
+
+		// stages without #include are compiled from the file content as is
+		if (!m_Preprocessor.Expand(ioJob.fileNames[i].c_str(), theSource.GetData(), theSource.GetLength(), ioJob.expandedSources[i], ioJob.sourceFiles[i]))
+			return false;
+		const char* theData = ioJob.expandedSources[i].empty() ? theSource.GetData() : ioJob.expandedSources[i].data();
+		size_t theLength = ioJob.expandedSources[i].empty() ? theSource.GetLength() : ioJob.expandedSources[i].length();
+
+		// a feature only makes a different stage out of the sources which mention it,
+		// the other stages of a variant are shared with the base program
+		ioJob.stageDefines[i] = ioJob.defines;
+		AppendFeatureDefines(ioJob.features, theData, theLength, ioJob.stageDefines[i]);
+
+		// stages are shared by source and defines, the program binary by its stage types and sources
+		uint64_t theDefinesHash = ioJob.stageDefines[i].empty() ? HASH_SEED : HashString(ioJob.stageDefines[i].c_str());
+		ioJob.stageHashes[i] = HashBytes(theData, theLength, theDefinesHash);
+		ioJob.sourceBytes += theLength;
+		theSourceHash = HashBytes(&STAGE_TYPES[i], sizeof(STAGE_TYPES[i]), theSourceHash);
+		theSourceHash = HashBytes(&ioJob.stageHashes[i], sizeof(ioJob.stageHashes[i]), theSourceHash);
+
+		CShaderStats::Count(CShaderStats::COUNTER_SOURCE_BYTES, theSource.GetLength());
+		CShaderStats::EndPhase(CShaderStats::PHASE_READ, ioJob.handle, i, ioJob.fileNames[i].c_str(), theStart);
+	}
+
+	// a change to any of the files reloads the program, see InvalidateFile()
+	if (ioJob.handle != DEFAULT_SHADER_HANDLE)
+	{
+		for (int i = 0; i < STAGE_COUNT; ++i)
+		{
+			m_Preprocessor.AddDependent(ioJob.sourceFiles[i], ioJob.handle);
+			for (size_t j = 0; j < ioJob.sourceFiles[i].size(); ++j)
+				m_FileWatcher.Watch(m_Preprocessor.GetFileName(ioJob.sourceFiles[i][j]).c_str());
+		}
+	}
+
+	// create a program
+	ioJob.program = glCreateProgram();
+	if (ioJob.program == 0)
 		return false;
+
+	// try the binary cache first, compile and link the sources on a miss
+	// a program loaded from a binary has the load in its link phase
+	double theStart = CShaderStats::BeginPhase();
+	ioJob.binaryKey = m_BinaryCache.GetKey(theSourceHash);
+	ioJob.isFromBinary = m_BinaryCache.Load(ioJob.binaryKey, ioJob.program);
+	if (ioJob.isFromBinary)
+	{
+		CShaderStats::EndPhase(CShaderStats::PHASE_LINK, ioJob.handle, -1, NULL, theStart);
+		CloseSources(ioJob);
 	}
+	return true;
+}
+
+bool CShaderManager::CompileStage(SLoadJob& ioJob, int inStage)
+{
+	const CSourceFile& theSource = ioJob.sources[inStage];
+	if (!theSource.IsOpen())
+		return true;
 
-	// load shader source from file
-	int sourceSize = 0;
-	char** pShaderSource = LoadSource(sourceSize, inFileName);
-	if (pShaderSource == NULL){
-		printf("Cannot load file source %s.\n", inFileName.c_str());
+	const std::string& theExpanded = ioJob.expandedSources[inStage];
+	const char* theData = theExpanded.empty() ? theSource.GetData() : theExpanded.data();
+	size_t theLength = theExpanded.empty() ? theSource.GetLength() : theExpanded.length();
+	double theStart = CShaderStats::BeginPhase();
+	if (!AcquireStage(STAGE_TYPES[inStage], theData, theLength, ioJob.stageHashes[inStage], ioJob.stageDefines[inStage]
+		, ioJob.isOnWorker || ioJob.isStepped, ioJob.stages[inStage])) {
+		ReleaseLoad(ioJob);
 		return false;
 	}
+	glAttachShader(ioJob.program, ioJob.stages[inStage]);
+	CShaderStats::EndPhase(CShaderStats::PHASE_COMPILE, ioJob.handle, inStage, ioJob.fileNames[inStage].c_str(), theStart);
+	return true;
+}
 
-	// create shader pointer
-	inOutShader = glCreateShader(inShaderType);
-	if (inOutShader == 0) {
-		printf("Cannot create shader, type: %u\n", inShaderType);
+void CShaderManager::LinkProgram(SLoadJob& ioJob)
+{
+	// the driver has its own copy of the sources once they are compiled
+	CloseSources(ioJob);
+
+	// ask the driver to keep the binary around for the cache
+	if (m_BinaryCache.IsEnabled())
+		glProgramParameteri(ioJob.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	// link, the status is checked by FinishLoad
+	double theStart = CShaderStats::BeginPhase();
+	glLinkProgram(ioJob.program);
+	CShaderStats::EndPhase(CShaderStats::PHASE_LINK, ioJob.handle, -1, NULL, theStart);
+}
+
+void CShaderManager::CloseSources(SLoadJob& ioJob)
+{
+	for (int i = 0; i < STAGE_COUNT; ++i)
+	{
+		ioJob.sources[i].Close();
+		ioJob.expandedSources[i].clear();
+	}
+}
+
+bool CShaderManager::IsLoadComplete(const SLoadJob& inJob)
+{
+	if (!m_HasParallelCompile)
+		return true;
+
+	GLint status = GL_TRUE;
+	glGetProgramiv(inJob.program, GL_COMPLETION_STATUS_KHR, &status);
+	return (status == GL_TRUE);
+}
+
+bool CShaderManager::FinishLoad(SLoadJob& ioJob)
+{
+	if (!CheckLoad(ioJob))
+	{
+		ioJob.shader->SetPending(false);
 		return false;
 	}
 
-	// compile shader
-	glShaderSource(inOutShader, sourceSize, (const GLchar**)pShaderSource, NULL);
-	glCompileShader(inOutShader);
+	return PublishLoad(ioJob);
+}
+
+bool CShaderManager::CheckLoad(SLoadJob& ioJob)
+{
+	if (!ioJob.isFromBinary)
+	{
+		// check link status, which waits for the link
+		double theStart = CShaderStats::BeginPhase();
+		GLint status = GL_FALSE;
+		glGetProgramiv(ioJob.program, GL_LINK_STATUS, &status);
+		CShaderStats::EndPhase(CShaderStats::PHASE_LINK, ioJob.handle, -1, NULL, theStart);
+		if (status != GL_TRUE) {
+			// report the stages which failed to compile, otherwise the link log
+			bool isCompiled = true;
+			for (int i = 0; i < STAGE_COUNT; ++i)
+				isCompiled &= CheckShader(ioJob.stages[i], ioJob.fileNames[i], ioJob.sourceFiles[i]);
+
+			if (isCompiled) {
+				// The link has failed, check log info
+				int logLength = 1;
+				glGetProgramiv(ioJob.program, GL_INFO_LOG_LENGTH, &logLength);
+
+				char* infoLog = (char*)malloc(logLength+1);
+				glGetProgramInfoLog(ioJob.program, logLength, &logLength, infoLog);
+				printf("Failed to link the shader: %s\n", infoLog);
+				free(infoLog);
+			}
+
+			ReleaseLoad(ioJob);
+			return false;
+		}
+
+		m_BinaryCache.Store(ioJob.binaryKey, ioJob.program);
+	}
+
+	return true;
+}
 
-	// free up the source
-	for (int i=0; i < sourceSize; ++i) {
-		if (pShaderSource[i] != NULL)
-			free(pShaderSource[i]);
+bool CShaderManager::PublishLoad(SLoadJob& ioJob)
+{
+	// an evicted program reads its files again when it is loaded again, its reload is dropped
+	SProgram& theProgram = m_Programs[ioJob.handle];
+	if (ioJob.isReload && theProgram.isEvicted.load(std::memory_order_acquire))
+	{
+		ReleaseLoad(ioJob);
+		return false;
 	}
-	free(pShaderSource);
 
-	// check compilation success
+	// a file changed again since this reload started, the newer reload replaces it
+	if (ioJob.isReload && theProgram.generation.load(std::memory_order_acquire) != ioJob.generation)
+	{
+		ReleaseLoad(ioJob);
+		ioJob.shader->SetPending(false);
+		return false;
+	}
+
+	// check if the shader will run in the current OpenGL state
+	double theStart = CShaderStats::BeginPhase();
 	GLint status = GL_FALSE;
-	glGetShaderiv(inOutShader, GL_COMPILE_STATUS, &status);
+	glValidateProgram(ioJob.program);
+	glGetProgramiv(ioJob.program, GL_VALIDATE_STATUS, &status);
 	if (status != GL_TRUE) {
-		// fail to compile, check the log
-		int logLength = 1;
-		glGetShaderiv(inOutShader, GL_INFO_LOG_LENGTH, &logLength);
-
-		char* infoLog = (char*)malloc(logLength + 1);
-		glGetShaderInfoLog(inOutShader, logLength, &logLength, infoLog);
-		printf("Failed to compile shader %s\n%s", inFileName.c_str(), infoLog);
-		free(infoLog);
-
+		CShaderStats::EndPhase(CShaderStats::PHASE_VALIDATE, ioJob.handle, -1, NULL, theStart);
+		printf("Shader program will not run in this OpenGL environment!\n");
+		ReleaseLoad(ioJob);
+		ioJob.shader->SetPending(false);
 		return false;
 	}
 
+	// the program has been loaded/linked successfully, its variables are reflected aside
+	// programs loaded from a binary have no shader objects
+	CShader* theStaged = new CShader;
+	theStaged->SetVertShader(ioJob.stages[STAGE_VERTEX]);
+	theStaged->SetFragShader(ioJob.stages[STAGE_FRAGMENT]);
+	theStaged->SetGeomShader(ioJob.stages[STAGE_GEOMETRY]);
+	theStaged->SetProgram(ioJob.program);
+	theStaged->Reflect();
+
+	// shared uniform blocks use fixed binding points in every program
+	CUniformBufferManager::GetInstance()->BindBlocks(ioJob.program);
+
+	// a reloaded shader drops its previous program only now, it is kept if the reload fails
+	bool isLoaded = (ioJob.shader->GetProgram() != 0);
+	SwapProgram(ioJob.shader, theStaged);
+
+	// a program just loaded counts as used in this frame, it is not evicted right away
+	size_t theBytes = EstimateBytes(ioJob);
+	if (!isLoaded)
+		++m_LoadedCount;
+	m_LoadedBytes += theBytes - theProgram.byteCount;
+	theProgram.byteCount = theBytes;
+	theProgram.lastUse.store(m_Frame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	// the last write of the load, a thread seeing the shader not pending sees its program and variables
+	ioJob.shader->SetPending(false);
+
+	CShaderStats::EndPhase(CShaderStats::PHASE_VALIDATE, ioJob.handle, -1, NULL, theStart);
 	return true;
-} // end LoadShader
+}
+
+void CShaderManager::ReleaseLoad(SLoadJob& ioJob)
+{
+	// release whatever was created before the failure
+	if (ioJob.program != 0)
+		glDeleteProgram(ioJob.program);
+	ioJob.program = 0;
+
+	for (int i = 0; i < STAGE_COUNT; ++i) {
+		ReleaseStage(ioJob.stages[i]);
+		ioJob.stages[i] = 0;
+	}
+}
+
+void CShaderManager::CompleteLoad(CShader* inShader)
+{
+	// the thread which set the shader pending may not have queued its load yet
+	while (inShader->IsPending())
+	{
+		SLoadJob* theQueuedJob = NULL;
+		{
+			std::lock_guard<std::mutex> theLock(m_QueueMutex);
+			for (size_t i = 0; i < m_QueuedJobs.size(); ++i)
+			{
+				if (m_QueuedJobs[i]->shader == inShader)
+				{
+					theQueuedJob = m_QueuedJobs[i];
+					m_QueuedJobs.erase(m_QueuedJobs.begin() + i);
+					break;
+				}
+			}
+		}
+		if (theQueuedJob != NULL)
+		{
+			if (BeginLoad(*theQueuedJob))
+				FinishLoad(*theQueuedJob);
+			else
+				inShader->SetPending(false);
+			delete theQueuedJob;
+			return;
+		}
+
+		for (size_t i = 0; i < m_PendingJobs.size(); ++i)
+		{
+			SLoadJob* theJob = m_PendingJobs[i];
+			if (theJob->shader == inShader)
+			{
+				FinishLoad(*theJob);
+				m_PendingJobs.erase(m_PendingJobs.begin() + i);
+				delete theJob;
+				return;
+			}
+		}
+
+		// a load stepped by LoadStep() runs its remaining steps at once
+		for (TSteppedJobMap::iterator iter = m_SteppedJobs.begin(); iter != m_SteppedJobs.end(); ++iter)
+		{
+			if (iter->second->shader == inShader)
+			{
+				TShaderHandle theHandle = iter->first;
+				while (LoadStep(theHandle) != LOAD_DONE);
+				return;
+			}
+		}
+
+		// otherwise a worker thread has it
+		ProcessCompletedJobs(inShader);
+		if (inShader->IsPending())
+			std::this_thread::yield();
+	}
+}
+
+void CShaderManager::EnableParallelCompile()
+{
+	if (m_IsParallelCompileChecked)
+		return;
 
+	// let the driver compile and link on its own threads, the completion
+	// status can then be polled without blocking
+	m_IsParallelCompileChecked = true;
+	m_HasParallelCompile = (GLEW_KHR_parallel_shader_compile != 0);
+	if (m_HasParallelCompile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
 
-GLchar** CShaderManager::LoadSource(int& outLineCount, const std::string &inFileName)
+bool CShaderManager::FindKey(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines, SProgramKey& outKey) const
 {
-	char line[MAX_LINE_LENGTH];
-	int length = 0, lineLength;
-	GLchar** pSource;
+	const char* theStrings[STAGE_COUNT + 1] = { inVertFileName, inFragFileName, inGeomFileName, inDefines };
+	unsigned int* theIds[STAGE_COUNT + 1] = { &outKey.stages[STAGE_VERTEX], &outKey.stages[STAGE_FRAGMENT], &outKey.stages[STAGE_GEOMETRY], &outKey.defines };
+	outKey.features = 0;
+	for (int i = 0; i <= STAGE_COUNT; ++i)
+	{
+		*theIds[i] = 0;
+		if (theStrings[i] == NULL || theStrings[i][0] == '\0')
+			continue;
 
-	outLineCount = 0;
-	FILE* pFile = fopen(inFileName.c_str(), "r");
-	if (pFile == NULL) {
-		printf("Cannot open file: %s\n", inFileName.c_str());
-		return NULL;
+		// a string never interned cannot be part of a registered program
+		*theIds[i] = FindString(theStrings[i], HashString(theStrings[i]));
+		if (*theIds[i] == 0)
+			return false;
 	}
+	return true;
+}
+
+CShaderManager::TShaderHandle CShaderManager::FindHandle(const SProgramKey& inKey, uint64_t inHash) const
+{
+	// the whole key is compared, equal hashes of different programs do not collide
+	const CConcurrentArray<SProgram>& thePrograms = m_Programs;
+	return m_ProgramIndex.Find(inHash, [&](unsigned int inHandle) { return thePrograms[inHandle].key == inKey; });
+}
+
+unsigned int CShaderManager::FindString(const char* inString, uint64_t inHash) const
+{
+	if (inString == NULL || inString[0] == '\0')
+		return 0;
+
+	const CConcurrentArray<char*>& theStrings = m_Strings;
+	return m_StringIndex.Find(inHash, [&](unsigned int inId) { return strcmp(theStrings[inId], inString) == 0; });
+}
 
-	// get the total length of the code
-	while (fgets(line, MAX_LINE_LENGTH, pFile) != NULL) {
-		lineLength = strlen(line);
-		if (lineLength > MAX_LINE_LENGTH) {
-			printf("Cannot read lines longer than %i characters in file: %s", MAX_LINE_LENGTH, inFileName.c_str());
-			outLineCount = 0;
-			fclose(pFile);
-			return NULL;
+unsigned int CShaderManager::InternString(const char* inString)
+{
+	if (inString == NULL || inString[0] == '\0')
+		return 0;
+
+	uint64_t theHash = HashString(inString);
+	unsigned int theId = FindString(inString, theHash);
+	if (theId != 0)
+		return theId;
+
+	char** theString = m_Strings.Reserve(theId);
+	if (theString == NULL)
+		return 0;
+	*theString = strdup(inString);
+	m_Strings.Publish();
+	m_StringIndex.Insert(theHash, theId);
+	return theId;
+}
+
+uint64_t CShaderManager::HashKey(const SProgramKey& inKey)
+{
+	return HashBytes(&inKey, sizeof(inKey));
+}
+
+void CShaderManager::InitProgram(SProgram& outProgram, const SProgramKey& inKey)
+{
+	outProgram.key = inKey;
+	outProgram.shader.store(NULL, std::memory_order_relaxed);
+	outProgram.generation.store(0, std::memory_order_relaxed);
+	outProgram.refCount.store(0, std::memory_order_relaxed);
+	outProgram.lastUse.store(0, std::memory_order_relaxed);
+	outProgram.isEvicted.store(false, std::memory_order_relaxed);
+	outProgram.byteCount = 0;
+}
+
+void CShaderManager::SetFileNames(SLoadJob& outJob, const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines, TVariantMask inFeatures)
+{
+	outJob.fileNames[STAGE_VERTEX] = (inVertFileName != NULL) ? inVertFileName : "";
+	outJob.fileNames[STAGE_FRAGMENT] = (inFragFileName != NULL) ? inFragFileName : "";
+	outJob.fileNames[STAGE_GEOMETRY] = (inGeomFileName != NULL) ? inGeomFileName : "";
+	outJob.defines = (inDefines != NULL) ? inDefines : "";
+	outJob.features = inFeatures;
+	outJob.handle = DEFAULT_SHADER_HANDLE;
+	outJob.program = 0;
+	outJob.binaryKey = 0;
+	outJob.isFromBinary = false;
+	outJob.sourceBytes = 0;
+	outJob.isReload = false;
+	outJob.generation = 0;
+	outJob.isStepped = false;
+	outJob.nextStep = LOAD_READ;
+	outJob.nextStage = 0;
+	outJob.isOnWorker = false;
+	outJob.isLinked = false;
+	outJob.fence = NULL;
+	outJob.next = NULL;
+	for (int i = 0; i < STAGE_COUNT; ++i)
+		outJob.stages[i] = 0;
+}
+
+void CShaderManager::SetProgram(SLoadJob& outJob, const SProgram& inProgram) const
+{
+	SetFileNames(outJob, GetString(inProgram.key.stages[STAGE_VERTEX]), GetString(inProgram.key.stages[STAGE_FRAGMENT])
+		, GetString(inProgram.key.stages[STAGE_GEOMETRY]), GetString(inProgram.key.defines), inProgram.key.features);
+}
+
+void CShaderManager::AppendFeatureDefines(TVariantMask inFeatures, const char* inSource, size_t inLength, std::string& ioDefines) const
+{
+	unsigned int theCount = m_FeatureCount.load(std::memory_order_acquire);
+	for (unsigned int i = 0; i < theCount; ++i)
+	{
+		if ((inFeatures & (1u << i)) == 0)
+			continue;
+
+		// look for the name as a whole identifier, e.g. INSTANCED but not INSTANCED_COUNT
+		const std::string& theName = m_FeatureNames[i];
+		for (size_t j = 0; j + theName.length() <= inLength; ++j)
+		{
+			size_t theEnd = j + theName.length();
+			if (strncmp(inSource + j, theName.c_str(), theName.length()) != 0
+				|| (j > 0 && (isalnum((unsigned char)inSource[j - 1]) || inSource[j - 1] == '_'))
+				|| (theEnd < inLength && (isalnum((unsigned char)inSource[theEnd]) || inSource[theEnd] == '_')))
+				continue;
+
+			ioDefines += "#define ";
+			ioDefines += theName;
+			ioDefines += "\n";
+			break;
 		}
-		length += lineLength + 1;
-		++outLineCount;
 	}
+}
+
+void CShaderManager::Dispose(CShader* inShader)
+{
+	if (inShader->GetProgram() != 0) {
+		CGLStateCache::GetInstance()->OnDeleteProgram(inShader->GetProgram());
+		glDeleteProgram(inShader->GetProgram());
+	}
+
+	// the program name can be reused, drop the VAOs set up for it
+	CVertexArrayCache::GetInstance()->RemoveShader(inShader);
 
-	rewind(pFile);
-	pSource = (GLchar**)malloc(sizeof(GLchar*) * (outLineCount));
-	if (pSource == NULL) {
-		printf("Out of memory!\n");
-		return NULL;
+	// stage objects are shared, they go away with their last program
+	ReleaseStage(inShader->GetVert());
+	ReleaseStage(inShader->GetGeom());
+	ReleaseStage(inShader->GetFrag());
+}
+
+void CShaderManager::SwapProgram(CShader* ioShader, CShader* inStaged)
+{
+	// other threads looking the shader up see the previous program or the new one, never a mix
+	ioShader->Swap(*inStaged);
+
+	// the VAOs were set up for the previous program
+	CVertexArrayCache::GetInstance()->RemoveShader(ioShader);
+	m_RetiredShaders.push_back(inStaged);
+}
+
+void CShaderManager::DeleteRetiredShaders()
+{
+	for (size_t i = 0; i < m_RetiredShaders.size(); ++i)
+	{
+		Dispose(m_RetiredShaders[i]);
+		delete m_RetiredShaders[i];
 	}
+	m_RetiredShaders.clear();
+}
 
-	length = 0;
-	int i = 0;
-	while (fgets(line, MAX_LINE_LENGTH, pFile) != NULL) {
-		lineLength = strlen(line);
-		pSource[i] = (GLchar*)malloc(sizeof(GLchar) * (lineLength + 1));
-		if (pSource[i] == NULL) {
-			printf("Out of memory!\n");
-			return NULL;
+bool CShaderManager::AcquireStage(unsigned int inShaderType, const char* inSource, size_t inLength, uint64_t inSourceHash, const std::string& inDefines, bool inWaitCompile, unsigned int& outShader)
+{
+	TStageKey theKey(inShaderType, inSourceHash);
+	{
+		std::lock_guard<std::mutex> theLock(m_StageMutex);
+		TStageMap::iterator iter = m_StageMap.find(theKey);
+		if (iter != m_StageMap.end())
+		{
+			// already compiled for another program
+			outShader = iter->second;
+			++m_StageRefMap[outShader].refCount;
+			return true;
 		}
+	}
 
-		GLchar* ps = pSource[i];
-		GLchar* pl = line;
+	if (!CompileShader(inShaderType, inSource, inLength, inDefines, outShader))
+		return false;
 
-		// concatenates the string
-		while (*pl != '\0')
-			*ps++ = *pl++;
+	// a stage compiled on a worker context is only shared once its compile is done,
+	// and a stepped load does the compile within its step
+	if (inWaitCompile)
+	{
+		GLint status = GL_FALSE;
+		glGetShaderiv(outShader, GL_COMPILE_STATUS, &status);
+	}
 
-		*ps++ = '\0';
-		++i;
+	std::lock_guard<std::mutex> theLock(m_StageMutex);
+	TStageMap::iterator iter = m_StageMap.find(theKey);
+	if (iter != m_StageMap.end())
+	{
+		// another thread compiled the same stage meanwhile
+		glDeleteShader(outShader);
+		outShader = iter->second;
+		++m_StageRefMap[outShader].refCount;
+		return true;
 	}
 
-	fclose(pFile);
+	SStageEntry theEntry;
+	theEntry.key = theKey;
+	theEntry.refCount = 1;
+	m_StageMap[theKey] = outShader;
+	m_StageRefMap[outShader] = theEntry;
+	return true;
+}
 
-	return pSource;
-} // end LoadSource
\ No newline at end of file
+void CShaderManager::ReleaseStage(unsigned int inShader)
+{
+	if (inShader == 0)
+		return;
+
+	std::lock_guard<std::mutex> theLock(m_StageMutex);
+	TStageRefMap::iterator iter = m_StageRefMap.find(inShader);
+	if (iter == m_StageRefMap.end())
+	{
+		glDeleteShader(inShader);
+		return;
+	}
+
+	if (--iter->second.refCount == 0)
+	{
+		glDeleteShader(inShader);
+		m_StageMap.erase(iter->second.key);
+		m_StageRefMap.erase(iter);
+	}
+}
+
+bool CShaderManager::CompileShader(unsigned int inShaderType, const char* inSource, size_t inLength, const std::string& inDefines, GLuint &outShader)
+{
+	// create shader pointer
+	outShader = glCreateShader(inShaderType);
+	if (outShader == 0) {
+		printf("Cannot create shader, type: %u\n", inShaderType);
+		return false;
+	}
+
+	// compile shader, the whole file is passed as a single string
+	const GLchar* theSource = inSource;
+	GLint theLength = (GLint)inLength;
+	if (inDefines.empty())
+	{
+		glShaderSource(outShader, 1, &theSource, &theLength);
+		glCompileShader(outShader);
+		return true;
+	}
+
+	// the defines go after the #version line, or first if there is none
+	size_t theSplit = 0;
+	unsigned int theNextLine = 1;
+	unsigned int theVersion = CShaderPreprocessor::FindVersion(inSource, inLength, theSplit, theNextLine);
+
+	// the lines after the defines keep their numbers in the compile log
+	char theLine[32];
+	sprintf(theLine, "#line %u 0\n", CShaderPreprocessor::GetLineNumber(theVersion, theNextLine));
+	std::string thePrelude = inDefines + theLine;
+
+	const GLchar* theStrings[3] = { theSource, thePrelude.c_str(), theSource + theSplit };
+	GLint theLengths[3] = { (GLint)theSplit, (GLint)thePrelude.length(), theLength - (GLint)theSplit };
+	glShaderSource(outShader, 3, theStrings, theLengths);
+	glCompileShader(outShader);
+
+	return true;
+} // end CompileShader
+
+bool CShaderManager::CheckShader(unsigned int inShader, const std::string& inFileName, const std::vector<unsigned int>& inSourceFiles)
+{
+	if (inShader == 0)
+		return true;
+
+	// check compilation success
+	GLint status = GL_FALSE;
+	glGetShaderiv(inShader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE) {
+		// fail to compile, check the log
+		int logLength = 1;
+		glGetShaderiv(inShader, GL_INFO_LOG_LENGTH, &logLength);
+
+		char* infoLog = (char*)malloc(logLength + 1);
+		glGetShaderInfoLog(inShader, logLength, &logLength, infoLog);
+		printf("Failed to compile shader %s\n%s", inFileName.c_str(), infoLog);
+		free(infoLog);
+
+		// the log numbers the files of an expanded stage by their #line source string
+		if (inSourceFiles.size() > 1)
+		{
+			for (size_t i = 0; i < inSourceFiles.size(); ++i)
+				printf("  %u: %s\n", inSourceFiles[i], m_Preprocessor.GetFileName(inSourceFiles[i]).c_str());
+		}
+
+		return false;
+	}
+
+	return true;
+} // end CheckShader
@@ -30,31 +30,247 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #include <string>
 #include <map>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "ProgramBinaryCache.h"
+#include "CompletionQueue.h"
+#include "ConcurrentTable.h"
+#include "ShaderPreprocessor.h"
+#include "FileWatcher.h"
+#include "SourceFile.h"
 
 // Forward declaration
 class CShader;
+class CSharedContextFactory;
 
 class CShaderManager
 {
 ////////////////////////////////////////////////////////////
 //	Types
 ////////////////////////////////////////////////////////////
+public:
+	/// Stages of a program, in the order their sources are hashed
+	enum EStage { STAGE_VERTEX, STAGE_FRAGMENT, STAGE_GEOMETRY, STAGE_COUNT };
+
+	/// Handle of a registered program, DEFAULT_SHADER_HANDLE is the default shader
+	typedef unsigned int TShaderHandle;
+	enum { DEFAULT_SHADER_HANDLE = 0 };
+
+	/// Set of features of a variant, one bit per feature returned by RegisterFeature()
+	typedef unsigned int TVariantMask;
+	enum { MAX_FEATURES = 32 };
+
+	/// A variant of a program, for WarmUp()
+	struct SVariant
+	{
+		TShaderHandle program;
+		TVariantMask features;
+	};
+
+	/// Steps of a program load run one at a time by LoadStep(), in order
+	enum ELoadStep { LOAD_READ, LOAD_COMPILE, LOAD_LINK, LOAD_VALIDATE, LOAD_DONE, LOAD_STEP_COUNT = LOAD_DONE };
+
+	/// Memory held by the loaded programs, see SetCacheBudget()
+	struct SCacheStats
+	{
+		unsigned int programCount;		// loaded programs, without the default shader
+		size_t byteCount;				// estimated driver memory of the loaded programs
+		unsigned int referencedCount;	// loaded programs held by AcquireProgram()
+		unsigned int evictedCount;		// programs evicted and not loaded again yet
+		unsigned int stageCount;		// compiled stage objects, shared by the programs
+		unsigned int evictionCount;		// evictions since the start
+		unsigned int restoreCount;		// loads of evicted programs since the start
+	};
+
 protected:
-	typedef std::map<std::string, CShader*> TShaderMap;
+	/// Key of a program: the interned ids of its stage paths and defines, 0 for none, and its features
+	struct SProgramKey
+	{
+		unsigned int stages[STAGE_COUNT];
+		unsigned int defines;
+		TVariantMask features;
+
+		bool operator==(const SProgramKey& inOther) const;
+	};
+
+	/// A registered program, its shader is created once by the first GetShader/GetShaderAsync
+	struct SProgram
+	{
+		SProgramKey key;
+		std::atomic<CShader*> shader;
+
+		/// Incremented by every reload, only the latest reload of a program is published
+		std::atomic<unsigned int> generation;
+
+		/// References taken by AcquireProgram(), a referenced program is never evicted
+		std::atomic<int> refCount;
+
+		/// Frame of the last GetShader/GetShaderAsync, evictions go least recently used first
+		std::atomic<unsigned int> lastUse;
+
+		/// Whether the program was evicted, its shader has program 0 until it is loaded again
+		std::atomic<bool> isEvicted;
+
+		/// Estimated driver memory of the loaded program, used by the rendering thread only
+		size_t byteCount;
+	};
+
+	/// Compiled stages are identified by their type and a hash of their source
+	typedef std::pair<unsigned int, uint64_t> TStageKey;
+	typedef std::map<TStageKey, unsigned int> TStageMap;
+
+	/// A compiled stage shared by all programs attaching it
+	struct SStageEntry
+	{
+		TStageKey key;
+		int refCount;
+	};
+	typedef std::map<unsigned int, SStageEntry> TStageRefMap;
+
+	/// A program being loaded, its compile/link is issued by BeginLoad and checked by FinishLoad
+	struct SLoadJob
+	{
+		CShader* shader;
+		TShaderHandle handle;
+		std::string fileNames[STAGE_COUNT];
+		std::string defines;
+		TVariantMask features;
+		unsigned int stages[STAGE_COUNT];
+		unsigned int program;
+		uint64_t binaryKey;
+		bool isFromBinary;
+
+		/// Length of the expanded stage sources, estimates the program's memory without program binaries
+		size_t sourceBytes;
+
+		/// Whether the job replaces the program of a loaded shader, which keeps it if the load fails
+		bool isReload;
+		unsigned int generation;
+
+		/// Ids of the files each stage was expanded from, see CShaderPreprocessor
+		std::vector<unsigned int> sourceFiles[STAGE_COUNT];
+
+		/// Sources of the stages, kept from ReadSources until the program is linked
+		CSourceFile sources[STAGE_COUNT];
+		std::string expandedSources[STAGE_COUNT];
+		std::string stageDefines[STAGE_COUNT];
+		uint64_t stageHashes[STAGE_COUNT];
+
+		/// For a load stepped by LoadStep(): the next step, and the next stage of LOAD_COMPILE
+		bool isStepped;
+		ELoadStep nextStep;
+		int nextStage;
+
+		/// Set by the worker threads: whether the program linked, and the fence of its commands
+		bool isOnWorker;
+		bool isLinked;
+		void* fence;
+
+		/// Link of the completion queue
+		SLoadJob* next;
+	};
+	typedef std::vector<SLoadJob*> TLoadJobList;
+	typedef std::map<TShaderHandle, SLoadJob*> TSteppedJobMap;
 
 ////////////////////////////////////////////////////////////
 //	Fields
 ////////////////////////////////////////////////////////////
 protected:
 
-	/// Map of shader name and shader obj pointer
-	TShaderMap m_ShaderMap;
+	/// Registered programs indexed by handle, the first one is the default shader
+	CConcurrentArray<SProgram> m_Programs;
+
+	/// Program handles by key hash, read without locking
+	CConcurrentHashIndex m_ProgramIndex;
+
+	/// Interned stage paths and define sets indexed by id, id 0 is none
+	CConcurrentArray<char*> m_Strings;
+
+	/// String ids by string hash, read without locking
+	CConcurrentHashIndex m_StringIndex;
+
+	/// Serializes the registration of programs, strings and features, lookups take no lock
+	std::mutex m_RegisterMutex;
+
+	/// Names of the features by bit, the count is published after the name
+	std::string m_FeatureNames[MAX_FEATURES];
+	std::atomic<unsigned int> m_FeatureCount;
+
+	/// Compiled stage objects by type and source, and their reference counts
+	TStageMap m_StageMap;
+	TStageRefMap m_StageRefMap;
+
+	/// Asynchronous loads waiting to be issued, guarded by m_QueueMutex since any thread may request one
+	TLoadJobList m_QueuedJobs;
+	std::mutex m_QueueMutex;
+
+	/// Issued loads waiting for completion
+	TLoadJobList m_PendingJobs;
+
+	/// Loads run step by step by LoadStep(), by program handle
+	TSteppedJobMap m_SteppedJobs;
+
+	/// Whether the driver compiles and links in the background (KHR_parallel_shader_compile)
+	bool m_IsParallelCompileChecked;
+	bool m_HasParallelCompile;
+
+	/// Worker threads loading programs on contexts shared with the rendering one
+	std::vector<std::thread> m_Workers;
+	CSharedContextFactory* m_WorkerContexts;
+
+	/// Loads waiting for a worker, guarded by m_WorkerMutex
+	std::deque<SLoadJob*> m_WorkerJobs;
+	std::mutex m_WorkerMutex;
+	std::condition_variable m_WorkerCondition;
+	bool m_IsStoppingWorkers;
+	int m_StartedWorkerCount;
+	int m_FailedWorkerCount;
+
+	/// Loads finished by the workers, and those whose fence has not signaled yet
+	CCompletionQueue<SLoadJob> m_CompletedJobs;
+	TLoadJobList m_FencedJobs;
+
+	/// Shaders holding the programs replaced by a reload, other threads may still be
+	/// reading them until the next Update() deletes them
+	std::vector<CShader*> m_RetiredShaders;
+
+	/// Guards the stage maps, which the workers share
+	mutable std::mutex m_StageMutex;
 
-	/// Default shader string
-	static const char* DEFAULT_SHADER;
+	/// Budget of the loaded programs, 0 for no limit, see SetCacheBudget()
+	unsigned int m_MaxProgramCount;
+	size_t m_MaxByteCount;
 
-	/// The unique instance of this class
+	/// Loaded programs and their estimated driver memory, updated by the rendering thread
+	unsigned int m_LoadedCount;
+	size_t m_LoadedBytes;
+
+	/// Counted by Update(), the programs are stamped with it when used
+	std::atomic<unsigned int> m_Frame;
+
+	/// Evictions, and loads of evicted programs which any thread can request
+	unsigned int m_EvictionCount;
+	std::atomic<unsigned int> m_RestoreCount;
+
+	/// On-disk cache of linked program binaries
+	CProgramBinaryCache m_BinaryCache;
+
+	/// Resolves the #include directives of the stage sources, and which programs depend on which files
+	CShaderPreprocessor m_Preprocessor;
+
+	/// Watches the stage and included files of the loaded programs for hot reload
+	CFileWatcher m_FileWatcher;
+
+protected:
+
+	/// The unique instance of this class, created once by the first GetInstance() of any thread
 	static CShaderManager*	s_Instance;
+	static std::once_flag	s_InstanceFlag;
 
 ////////////////////////////////////////////////////////////
 //	Methods
@@ -66,43 +282,336 @@ public:
 	// Get the unique instance of this class
 	static CShaderManager*	GetInstance();
 
+	/// Delete the unique instance with all its programs, GetInstance() returns NULL afterwards
+	static void DestroyInstance();
+
+	/**
+	 * Register a program once, its handle then resolves it with GetShader(TShaderHandle).
+	 * Registering the same stage paths and defines again returns the same handle.
+	 * Can be called from any thread.
+	 * @param inDefines preprocessor lines inserted after the #version line of each stage, NULL for none
+	 * @return the program's handle, DEFAULT_SHADER_HANDLE if it has no vertex stage
+	 */
+	TShaderHandle RegisterProgram(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines = NULL);
+
+	/**
+	 * Find the handle of a registered program without allocating or locking, from any thread
+	 * @return the program's handle, DEFAULT_SHADER_HANDLE if it is not registered
+	 */
+	TShaderHandle FindProgram(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines = NULL) const;
+
 	/**
-	 * Get shader object pointer
+	 * Register a feature of the variants, e.g. "INSTANCED". A variant with the feature compiles
+	 * its stages with "#define <name>", for the stages whose source mentions the name only.
+	 * Registering the same name again returns the same bit. Can be called from any thread.
+	 * @return the feature's bit, 0 if MAX_FEATURES are registered
+	 */
+	TVariantMask RegisterFeature(const char* inName);
+
+	/**
+	 * Get the handle of a variant of a program, registering it on first use.
+	 * The variant is compiled lazily by the first GetShader/GetShaderAsync of its handle,
+	 * and stages which do not mention any of its features are shared with the base program.
+	 * Can be called from any thread.
+	 * @param inFeatures features added to the program's own ones
+	 * @return the variant's handle, inProgram if it adds no feature
+	 */
+	TShaderHandle GetVariant(TShaderHandle inProgram, TVariantMask inFeatures);
+
+	/**
+	 * Start loading a list of variants ahead of their first use, like GetShaderAsync()
+	 * for each of them; Update() or a later GetShader() finishes the loads.
+	 */
+	void WarmUp(const SVariant* inVariants, size_t inCount);
+
+	/**
+	 * Get the shader of a registered program, loading it on first use; O(1) and lock-free once loaded.
+	 * A program which is not loaded yet is loaded with the calling thread's context, so only
+	 * the rendering thread may call this for it; other threads use GetShaderAsync().
+	 * @return the loaded/linked shader, the default shader if the load failed
+	 */
+	CShader* GetShader(TShaderHandle inHandle);
+
+	/**
+	 * Get the shader of a registered program without waiting for its compile/link, see GetShaderAsync().
+	 * Can be called from any thread, concurrent requests of a program load it once.
+	 */
+	CShader* GetShaderAsync(TShaderHandle inHandle);
+
+	/**
+	 * Get shader object pointer, registering the program on first use
+	 * @param inDefines preprocessor lines inserted after the #version line of each stage
 	 * @return if successful load/link, the loaded/linked shader object point is return, otherwise return the default shader
 	 */
-	CShader* GetShader(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName);
+	CShader* GetShader(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines = NULL);
+
+	/**
+	 * Get shader object pointer without waiting for the compile/link.
+	 * The returned handle is pending and has program 0, like the default shader,
+	 * until a later Update() finds its load completed.
+	 */
+	CShader* GetShaderAsync(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines = NULL);
+
+	/**
+	 * Progress asynchronous loads, call once per frame from the rendering thread.
+	 * Loads issued in earlier frames are finished when the driver reports them complete,
+	 * then the compiles and links of newly requested programs are issued as one batch.
+	 * Programs over the cache budget are evicted here, see SetCacheBudget().
+	 * The programs a reload replaced are deleted here too, so a lookup on another
+	 * thread has to finish before the Update() following the one which reloaded.
+	 */
+	void Update();
+
+	/**
+	 * Limit the memory held by the loaded programs. Once over budget, Update() evicts the
+	 * unreferenced programs not used in the current frame, least recently used first: their
+	 * program and stage objects are deleted, while their CShader stays allocated with program 0,
+	 * so a pointer still held is safe to use. The next GetShader/GetShaderAsync of an
+	 * evicted program loads it again into the same CShader, from the binary cache if it is enabled.
+	 * A pointer kept across frames should come with a reference, see AcquireProgram().
+	 * @param inMaxPrograms number of loaded programs, 0 for no limit
+	 * @param inMaxBytes estimated driver memory of the loaded programs: the size of their binaries,
+	 *        or of their sources without program binaries; 0 for no limit
+	 */
+	void SetCacheBudget(unsigned int inMaxPrograms, size_t inMaxBytes);
+
+	/**
+	 * Take or drop a reference to a registered program, a referenced program is never evicted.
+	 * Can be called from any thread, see CShaderRef for a reference released by its destructor.
+	 */
+	void AcquireProgram(TShaderHandle inHandle);
+	void ReleaseProgram(TShaderHandle inHandle);
+
+	/// Get the memory held by the loaded programs, from the rendering thread
+	void GetCacheStats(SCacheStats& outStats) const;
+
+	/**
+	 * Run the next step of a program's load on the rendering thread: read its sources,
+	 * compile one of its stages, link it or validate it. Steps which wait for the driver
+	 * wait within the step, so a caller can spread a load over frames under a time budget.
+	 * A program loaded from the binary cache skips its compile and link steps.
+	 * @return the step which ran, LOAD_DONE if the program has no step left
+	 */
+	ELoadStep LoadStep(TShaderHandle inHandle);
+
+	/**
+	 * Start worker threads which run the whole load (file I/O, compile and link) of
+	 * asynchronous requests. Call from the rendering thread with its context current.
+	 * @param inContexts creates the shared contexts of the workers, must outlive them
+	 * @param inCount number of worker threads
+	 * @return true if all workers have a current context, false otherwise
+	 */
+	bool StartWorkers(CSharedContextFactory* inContexts, int inCount);
+
+	/// Stop the worker threads, requests they did not start are loaded by Update() instead
+	void StopWorkers();
+
+	/**
+	 * Enable the on-disk program binary cache, requires a current OpenGL context
+	 * @param inDirectory directory the binaries are stored in
+	 * @return true if the driver supports program binaries, false otherwise
+	 */
+	bool EnableBinaryCache(const char* inDirectory);
+
+	/**
+	 * Reload the programs built from a stage or included file which changed on disk.
+	 * Stages which do not depend on the file are not recompiled, and a loaded shader keeps
+	 * its CShader object and its current program until the new one is linked, or for good if
+	 * the new one fails. The reloads are queued like GetShaderAsync(). Can be called from any thread.
+	 */
+	void InvalidateFile(const char* inFileName);
+
+	/**
+	 * Reload programs in the background when one of their files is saved, see InvalidateFile().
+	 * Only the stages depending on the file are recompiled, the others are reused from the stage cache.
+	 * @return false if file notifications are not available
+	 */
+	bool EnableHotReload();
+
+	/// Stop watching the files
+	void DisableHotReload();
+
+	/// Get the program binary cache, e.g. to report its hit/miss counts
+	inline const CProgramBinaryCache& GetBinaryCache() const { return m_BinaryCache; }
 
 protected:
 	/// Default constructor (protected)
 	CShaderManager();
 
+	/// Create the unique instance
+	static void CreateInstance();
+
+	/**
+	 * Create the shader of a program unless another thread did first
+	 * @param outIsCreated whether this call created it, and is the one to load it
+	 * @return the program's shader
+	 */
+	CShader* CreateShader(SProgram& ioProgram, bool& outIsCreated);
+
 	/**
-	 * Load, compile and create a vertex/fragment/geometric shader program and link the program
-	 * @return CShader object pointer if all shaders are loaded successfully, NULL otherwise
+	 * Claim the load of an evicted program, its shader is set pending again
+	 * @return true if this call claimed it, false if the program is not evicted or another thread claimed it
 	 */
-	CShader* Load(const char* inVertexFilename
-				, const char* inFragmentFilename
-				, const char* inGeometryFilename);
+	bool RestoreShader(SProgram& ioProgram);
+
+	/// Stamp a program as used in the current frame, once per frame so repeated lookups only read
+	inline void TouchProgram(SProgram& ioProgram) const
+	{
+		unsigned int theFrame = m_Frame.load(std::memory_order_relaxed);
+		if (ioProgram.lastUse.load(std::memory_order_relaxed) != theFrame)
+			ioProgram.lastUse.store(theFrame, std::memory_order_relaxed);
+	}
+
+	/// Whether the loaded programs exceed the cache budget
+	bool IsOverBudget() const;
+
+	/// Evict unreferenced programs, least recently used first, until the loaded ones fit the budget
+	void EvictPrograms();
+
+	/// Retire the program and stage objects of a loaded program, its shader gets program 0 at once
+	void EvictProgram(TShaderHandle inHandle);
+
+	/// Estimate the driver memory of a linked program
+	size_t EstimateBytes(const SLoadJob& inJob) const;
+
+	/**
+	 * Load the sources of a program and issue its compile and link without querying any status
+	 * @return false if a source cannot be loaded or an object cannot be created
+	 */
+	bool BeginLoad(SLoadJob& ioJob);
+
+	/**
+	 * Load and hash the sources of a program, create it and try the binary cache
+	 * @return false if a source cannot be loaded or the program cannot be created
+	 */
+	bool ReadSources(SLoadJob& ioJob);
+
+	/// Get the compiled object of a stage and attach it, false if it cannot be created
+	bool CompileStage(SLoadJob& ioJob, int inStage);
+
+	/// Issue the link of a program whose stages are attached, the status is checked by CheckLoad
+	void LinkProgram(SLoadJob& ioJob);
 
-	/** Releases all resources */
+	/// Release the sources of a load once they are no longer needed
+	void CloseSources(SLoadJob& ioJob);
+
+	/// Run the next step of a stepped load, false if the load failed
+	bool RunLoadStep(SLoadJob& ioJob);
+
+	/// Whether the compile/link issued by BeginLoad can be checked without blocking
+	bool IsLoadComplete(const SLoadJob& inJob);
+
+	/// Check and publish a load, CheckLoad followed by PublishLoad
+	bool FinishLoad(SLoadJob& ioJob);
+
+	/**
+	 * Check the link status and store the binary of a program
+	 * @return true if the program linked, false otherwise
+	 */
+	bool CheckLoad(SLoadJob& ioJob);
+
+	/**
+	 * Validate a linked program and set it to the job's shader
+	 * @return true if the program is usable, false otherwise
+	 */
+	bool PublishLoad(SLoadJob& ioJob);
+
+	/// Release the objects created for a load which failed or is dropped
+	void ReleaseLoad(SLoadJob& ioJob);
+
+	/// Hand an asynchronous load to the worker threads, or to the next Update() without workers
+	void QueueLoad(SLoadJob* inJob);
+
+	/// Block until the asynchronous load of a shader has finished
+	void CompleteLoad(CShader* inShader);
+
+	/// Enable driver-side parallel compilation if it is supported
+	void EnableParallelCompile();
+
+	/// Main function of a worker thread
+	void WorkerMain(int inIndex);
+
+	/// Called by the file watcher thread when a file was saved
+	static void OnFileChanged(const char* inFileName, void* inUserData);
+
+	/**
+	 * Publish the loads finished by the workers whose fence has signaled
+	 * @param inWaitShader a shader whose load is waited for, NULL to never block
+	 */
+	void ProcessCompletedJobs(CShader* inWaitShader);
+
+	/// Build the key of a program from interned ids, false if a string has not been interned
+	bool FindKey(const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines, SProgramKey& outKey) const;
+
+	/// Get the handle of a program key, DEFAULT_SHADER_HANDLE if it is not registered
+	TShaderHandle FindHandle(const SProgramKey& inKey, uint64_t inHash) const;
+
+	/// Get the id of an interned string, 0 if it is NULL, empty or not interned
+	unsigned int FindString(const char* inString, uint64_t inHash) const;
+
+	/// Intern a string with m_RegisterMutex locked, 0 if it is NULL or empty
+	unsigned int InternString(const char* inString);
+
+	/// Get an interned string, NULL for id 0
+	inline const char* GetString(unsigned int inId) const { return m_Strings[inId]; }
+
+	/// Hash of a program key
+	static uint64_t HashKey(const SProgramKey& inKey);
+
+	/// Initialize a registered program, before it is published
+	static void InitProgram(SProgram& outProgram, const SProgramKey& inKey);
+
+	/// Initialize a load job for the given stage files, defines and features
+	static void SetFileNames(SLoadJob& outJob, const char* inVertFileName, const char* inFragFileName, const char* inGeomFileName, const char* inDefines, TVariantMask inFeatures = 0);
+
+	/// Initialize a load job for a registered program
+	void SetProgram(SLoadJob& outJob, const SProgram& inProgram) const;
+
+	/// Append "#define <name>" to the prelude of a stage for each feature its source mentions
+	void AppendFeatureDefines(TVariantMask inFeatures, const char* inSource, size_t inLength, std::string& ioDefines) const;
+
+	/** Releases all resources, shared stage objects are deleted with their last program */
 	void Dispose(CShader* inShader);
 
-	/** 
-	 * Load and compile a shader
-	 * @param inShaderType type of shader: GL_VERTEX_SHADER, GL_GEOMETRY_SHADER_EXT or GL_FRAGMENT_SHADER
-	 * @param inFileName shader file name
-	 * @param inOutShader the pointer to shader
-	 * @return true if successfully loaded, false otherwise
+	/// Swap the program of a staged shader into a published one, the previous program is retired
+	void SwapProgram(CShader* ioShader, CShader* inStaged);
+
+	/// Delete the programs retired before the current Update()
+	void DeleteRetiredShaders();
+
+	/**
+	 * Get a compiled stage object, compiling it only if no program uses the same source yet
+	 * @param inSource the stage's source with its includes expanded, not null terminated
+	 * @param inSourceHash hash of the stage's source and defines
+	 * @param inDefines preprocessor lines inserted after the #version line
+	 * @param inWaitCompile whether the compile completes before the stage is shared, for worker threads and stepped loads
+	 * @param outShader the shared shader object, with its reference count incremented
+	 * @return true if the stage is compiled, false otherwise
 	 */
-	bool LoadShader(unsigned int inShaderType,  const std::string& inFileName, unsigned int & inOutShader);
+	bool AcquireStage(unsigned int inShaderType, const char* inSource, size_t inLength, uint64_t inSourceHash, const std::string& inDefines, bool inWaitCompile, unsigned int& outShader);
 
+	/// Release a reference to a stage object, deleting it with its last reference
+	void ReleaseStage(unsigned int inShader);
 
 	/**
-	 * Load a shader source code from a file. 
-	 * @return the pointer to the source
+	 * Create a shader and issue its compile, the status is checked by CheckShader
+	 * @param inShaderType type of shader: GL_VERTEX_SHADER, GL_GEOMETRY_SHADER_EXT or GL_FRAGMENT_SHADER
+	 * @param inSource the stage's source, not null terminated
+	 * @param inDefines preprocessor lines inserted after the #version line, which has to stay first
+	 * @param outShader the pointer to shader
+	 * @return true if the shader was created, false otherwise
 	 */
-	char** LoadSource(int& outLineCount, const std::string& inFileName);
+	bool CompileShader(unsigned int inShaderType, const char* inSource, size_t inLength, const std::string& inDefines, unsigned int& outShader);
+
+	/**
+	 * Check the compile status of a shader and print its log on failure
+	 * @param inFileName shader file name, used for error messages
+	 * @param inSourceFiles ids of the files the stage was expanded from, listed with the log
+	 * @return true if successfully compiled, false otherwise
+	 */
+	bool CheckShader(unsigned int inShader, const std::string& inFileName, const std::vector<unsigned int>& inSourceFiles);
+
 
 }; // end class ShaderManager
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShaderPreprocessor.h"
+#include "SourceFile.h"
+#include "ShaderStats.h"
+#include <stdio.h>
+#include <string.h>
+
+CShaderPreprocessor::CShaderPreprocessor()
+{
+}
+
+CShaderPreprocessor::~CShaderPreprocessor()
+{
+	for (size_t i = 0; i < m_Files.size(); ++i)
+		delete m_Files[i];
+}
+
+bool CShaderPreprocessor::Expand(const char* inFileName, const char* inData, size_t inLength, std::string& outSource, std::vector<unsigned int>& outFiles)
+{
+	outSource.clear();
+	outFiles.clear();
+
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+
+	// the stage file is read by the caller, only its id is kept here
+	std::string theFileName(inFileName);
+	unsigned int theFile = GetFileId(theFileName);
+
+	TIncludeList theIncludes;
+	ParseIncludes(theFileName, inData, inLength, theIncludes);
+	if (theIncludes.empty())
+	{
+		// the source is passed through untouched
+		outFiles.push_back(theFile);
+		return true;
+	}
+
+	outSource.reserve(inLength * 2);
+
+	// the #version line has to stay first, CShaderManager inserts its defines after it
+	size_t theBegin = 0;
+	unsigned int theFirstLine = 1;
+	unsigned int theVersion = FindVersion(inData, inLength, theBegin, theFirstLine);
+	outSource.append(inData, theBegin);
+	return ExpandFile(theFile, inData, inLength, theIncludes, theVersion, theBegin, theFirstLine, outSource, outFiles);
+}
+
+void CShaderPreprocessor::AddDependent(const std::vector<unsigned int>& inFiles, unsigned int inProgram)
+{
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	for (size_t i = 0; i < inFiles.size(); ++i)
+		m_Dependents[inFiles[i]].insert(inProgram);
+}
+
+void CShaderPreprocessor::Invalidate(const char* inFileName, std::vector<unsigned int>& outPrograms)
+{
+	outPrograms.clear();
+
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	std::map<std::string, unsigned int>::iterator iter = m_FileIds.find(inFileName);
+	if (iter == m_FileIds.end())
+		return;
+
+	SFile* theFile = m_Files[iter->second];
+	theFile->isLoaded = false;
+	theFile->text.clear();
+	theFile->includes.clear();
+
+	TDependentMap::iterator theDependents = m_Dependents.find(iter->second);
+	if (theDependents != m_Dependents.end())
+		outPrograms.assign(theDependents->second.begin(), theDependents->second.end());
+}
+
+std::string CShaderPreprocessor::GetFileName(unsigned int inFile) const
+{
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	return (inFile < m_Files.size()) ? m_Files[inFile]->name : std::string();
+}
+
+unsigned int CShaderPreprocessor::GetFileId(const std::string& inFileName)
+{
+	std::map<std::string, unsigned int>::iterator iter = m_FileIds.find(inFileName);
+	if (iter != m_FileIds.end())
+		return iter->second;
+
+	SFile* theFile = new SFile;
+	theFile->name = inFileName;
+	theFile->isLoaded = false;
+
+	unsigned int theId = (unsigned int)m_Files.size();
+	m_Files.push_back(theFile);
+	m_FileIds[inFileName] = theId;
+	return theId;
+}
+
+bool CShaderPreprocessor::LoadFile(unsigned int inFile)
+{
+	SFile* theFile = m_Files[inFile];
+	if (theFile->isLoaded)
+		return true;
+
+	CSourceFile theSource;
+	if (!theSource.Open(theFile->name.c_str()))
+		return false;
+
+	theFile->text.assign(theSource.GetData(), theSource.GetLength());
+	CShaderStats::Count(CShaderStats::COUNTER_SOURCE_BYTES, theSource.GetLength());
+	ParseIncludes(theFile->name, theFile->text.data(), theFile->text.length(), theFile->includes);
+	theFile->isLoaded = true;
+	return true;
+}
+
+void CShaderPreprocessor::ParseIncludes(const std::string& inFileName, const char* inData, size_t inLength, TIncludeList& outIncludes)
+{
+	outIncludes.clear();
+
+	// included files are relative to the directory of the including one
+	size_t theSlash = inFileName.find_last_of("/\\");
+	std::string theDirectory = (theSlash != std::string::npos) ? inFileName.substr(0, theSlash + 1) : std::string();
+
+	unsigned int theLine = 1;
+	for (size_t theBegin = 0; theBegin < inLength; ++theLine)
+	{
+		size_t theEnd = theBegin;
+		while (theEnd < inLength && inData[theEnd] != '\n')
+			++theEnd;
+		if (theEnd < inLength)
+			++theEnd;
+
+		// #include "file" or #include <file>, with optional blanks
+		size_t i = theBegin;
+		while (i < theEnd && (inData[i] == ' ' || inData[i] == '\t'))
+			++i;
+		if (i < theEnd && inData[i] == '#')
+		{
+			for (++i; i < theEnd && (inData[i] == ' ' || inData[i] == '\t'); ++i);
+			if (i + 7 <= theEnd && strncmp(inData + i, "include", 7) == 0)
+			{
+				for (i += 7; i < theEnd && (inData[i] == ' ' || inData[i] == '\t'); ++i);
+				char theClose = (i < theEnd && inData[i] == '<') ? '>' : '"';
+				size_t theNameEnd = i + 1;
+				while (theNameEnd < theEnd && inData[theNameEnd] != theClose && inData[theNameEnd] != '\n')
+					++theNameEnd;
+
+				if (i < theEnd && (inData[i] == '"' || inData[i] == '<') && theNameEnd < theEnd && inData[theNameEnd] == theClose)
+				{
+					SInclude theInclude;
+					theInclude.begin = theBegin;
+					theInclude.end = theEnd;
+					theInclude.line = theLine;
+					theInclude.file = GetFileId(theDirectory + std::string(inData + i + 1, theNameEnd - i - 1));
+					outIncludes.push_back(theInclude);
+				}
+			}
+		}
+
+		theBegin = theEnd;
+	}
+}
+
+unsigned int CShaderPreprocessor::FindVersion(const char* inData, size_t inLength, size_t& outEnd, unsigned int& outNextLine)
+{
+	outEnd = 0;
+	outNextLine = 1;
+	unsigned int theLine = 1;
+	for (size_t i = 0; i + 8 <= inLength; ++i)
+	{
+		if (inData[i] == '\n')
+			++theLine;
+		else if ((i == 0 || inData[i - 1] == '\n') && strncmp(inData + i, "#version", 8) == 0)
+		{
+			// the source is not null terminated, the number is read up to the end of the line
+			unsigned int theVersion = 0;
+			for (outEnd = i + 8; outEnd < inLength && inData[outEnd] != '\n'; ++outEnd)
+			{
+				if (inData[outEnd] >= '0' && inData[outEnd] <= '9')
+					theVersion = theVersion * 10 + (inData[outEnd] - '0');
+				else if (theVersion != 0)
+					break;
+			}
+			for (; outEnd < inLength && inData[outEnd] != '\n'; ++outEnd);
+			if (outEnd < inLength)
+				++outEnd;
+			outNextLine = theLine + 1;
+			return theVersion;
+		}
+	}
+	return 0;
+}
+
+unsigned int CShaderPreprocessor::GetLineNumber(unsigned int inVersion, unsigned int inLine)
+{
+	// the ES versions are 100 and 300 and up, the desktop ones below 330 are 110 to 150
+	bool isNextLine = (inVersion >= 300 || inVersion == 100);
+	return isNextLine ? inLine : inLine - 1;
+}
+
+bool CShaderPreprocessor::ExpandFile(unsigned int inFile, const char* inData, size_t inLength, const TIncludeList& inIncludes, unsigned int inVersion, size_t inBegin, unsigned int inFirstLine, std::string& ioSource, std::vector<unsigned int>& ioFiles)
+{
+	ioFiles.push_back(inFile);
+
+	// #line <line> <file> numbers the lines the way the stage's version has it, the file id is the source string number
+	char theLine[32];
+	size_t thePosition = inBegin;
+	sprintf(theLine, "#line %u %u\n", GetLineNumber(inVersion, inFirstLine), inFile);
+	ioSource += theLine;
+
+	for (size_t i = 0; i < inIncludes.size(); ++i)
+	{
+		const SInclude& theInclude = inIncludes[i];
+		if (theInclude.begin < thePosition)
+			continue;
+
+		ioSource.append(inData + thePosition, theInclude.begin - thePosition);
+		thePosition = theInclude.end;
+
+		// a file already included by this stage is skipped
+		bool isIncluded = false;
+		for (size_t j = 0; j < ioFiles.size() && !isIncluded; ++j)
+			isIncluded = (ioFiles[j] == theInclude.file);
+
+		if (!isIncluded)
+		{
+			if (!LoadFile(theInclude.file)) {
+				printf("Cannot load include %s in %s.\n", m_Files[theInclude.file]->name.c_str(), m_Files[inFile]->name.c_str());
+				return false;
+			}
+
+			const SFile* theIncluded = m_Files[theInclude.file];
+			if (!ExpandFile(theInclude.file, theIncluded->text.data(), theIncluded->text.length(), theIncluded->includes, inVersion, 0, 1, ioSource, ioFiles))
+				return false;
+			if (!ioSource.empty() && ioSource[ioSource.length() - 1] != '\n')
+				ioSource += '\n';
+		}
+
+		// back to the including file, on the line after the directive
+		sprintf(theLine, "#line %u %u\n", GetLineNumber(inVersion, theInclude.line + 1), inFile);
+		ioSource += theLine;
+	}
+
+	ioSource.append(inData + thePosition, inLength - thePosition);
+	return true;
+}
@@ -0,0 +1,159 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+
+/**
+ * Resolves the #include "file" directives of shader sources. Included files are
+ * read and parsed once, then kept in memory until they are invalidated. Each file
+ * gets an id which the expanded source uses as its #line source string number, so
+ * the compile log of a stage can be mapped back to files with GetFileName().
+ * Every file is included at most once per stage, which also breaks include cycles.
+ * The files a program was expanded from are recorded, so invalidating one file
+ * returns the programs to reload. All methods can be called from several threads.
+ */
+class CShaderPreprocessor
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+protected:
+	/// An #include directive of a file
+	struct SInclude
+	{
+		size_t begin;		// offset of the directive's line
+		size_t end;			// offset after the directive's line
+		unsigned int line;	// line number of the directive, from 1
+		unsigned int file;	// id of the included file
+	};
+	typedef std::vector<SInclude> TIncludeList;
+
+	/// A file known to the preprocessor, its content is loaded by the first include
+	struct SFile
+	{
+		std::string name;
+		std::string text;
+		TIncludeList includes;
+		bool isLoaded;
+	};
+
+	/// Programs by the id of a file they were expanded from
+	typedef std::map<unsigned int, std::set<unsigned int> > TDependentMap;
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Files indexed by id, and the ids by file name
+	std::vector<SFile*> m_Files;
+	std::map<std::string, unsigned int> m_FileIds;
+
+	/// Programs depending on each file
+	TDependentMap m_Dependents;
+
+	/// Guards the files and the dependency graph, stages are expanded from the worker threads too
+	mutable std::mutex m_Mutex;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CShaderPreprocessor();
+
+	/// Destructor
+	~CShaderPreprocessor();
+
+	/**
+	 * Expand the includes of a stage source
+	 * @param inFileName the stage's file name, includes are relative to its directory
+	 * @param inData the stage's source, not null terminated
+	 * @param outSource the expanded source, left empty if the stage has no #include
+	 * @param outFiles ids of the stage file and the files it includes
+	 * @return false if an included file cannot be read
+	 */
+	bool Expand(const char* inFileName, const char* inData, size_t inLength, std::string& outSource, std::vector<unsigned int>& outFiles);
+
+	/// Record that a program was expanded from the given files
+	void AddDependent(const std::vector<unsigned int>& inFiles, unsigned int inProgram);
+
+	/**
+	 * Drop the cached content of a file, the next include reads it again
+	 * @param outPrograms the programs expanded from the file
+	 */
+	void Invalidate(const char* inFileName, std::vector<unsigned int>& outPrograms);
+
+	/// Get the name of a file by id, as used in #line directives
+	std::string GetFileName(unsigned int inFile) const;
+
+	/**
+	 * Find the #version line of a stage source
+	 * @param outEnd offset after the #version line, 0 if there is none
+	 * @param outNextLine number of the line after it, 1 if there is none
+	 * @return the version number, 0 if there is none
+	 */
+	static unsigned int FindVersion(const char* inData, size_t inLength, size_t& outEnd, unsigned int& outNextLine);
+
+	/**
+	 * Get the line number a #line directive takes so that the line after it is inLine.
+	 * Before GLSL 3.30, except for GLSL ES, the directive numbers itself, not the next line.
+	 * @param inVersion the stage's version number, 0 if it has none
+	 */
+	static unsigned int GetLineNumber(unsigned int inVersion, unsigned int inLine);
+
+protected:
+	/// Get the id of a file, registering it on first use; with m_Mutex locked
+	unsigned int GetFileId(const std::string& inFileName);
+
+	/// Read and parse a file on first use; with m_Mutex locked
+	bool LoadFile(unsigned int inFile);
+
+	/**
+	 * Find the #include directives of a source; with m_Mutex locked
+	 * @param inFileName the file name of the source, includes are resolved relative to its directory
+	 */
+	void ParseIncludes(const std::string& inFileName, const char* inData, size_t inLength, TIncludeList& outIncludes);
+
+	/**
+	 * Append a source with its includes expanded; with m_Mutex locked
+	 * @param inVersion the stage's version number, which decides how the #line directives number the lines
+	 * @param inBegin offset the source is appended from, after the stage's #version line
+	 * @param inFirstLine number of the line at inBegin
+	 * @param ioFiles the files included so far, a file already in it is skipped
+	 */
+	bool ExpandFile(unsigned int inFile, const char* inData, size_t inLength, const TIncludeList& inIncludes, unsigned int inVersion, size_t inBegin, unsigned int inFirstLine, std::string& ioSource, std::vector<unsigned int>& ioFiles);
+
+}; // end class CShaderPreprocessor
+
+#endif
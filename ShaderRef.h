@@ -0,0 +1,91 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#ifndef SHADER_REF_H
+#define SHADER_REF_H
+
+#include "ShaderManager.h"
+
+/**
+ * Counted reference to a registered program, which keeps it loaded whatever the cache
+ * budget of the shader manager, see CShaderManager::SetCacheBudget(). Copies add a reference,
+ * the destructor drops it. A reference may outlive the shader manager, it then drops nothing.
+ */
+class CShaderRef
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	CShaderManager::TShaderHandle m_Handle;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor, a reference to nothing
+	CShaderRef() : m_Handle(CShaderManager::DEFAULT_SHADER_HANDLE) {}
+
+	/// Constructor, a reference to a registered program
+	explicit CShaderRef(CShaderManager::TShaderHandle inHandle) : m_Handle(CShaderManager::DEFAULT_SHADER_HANDLE) { Reset(inHandle); }
+
+	/// Copy constructor
+	CShaderRef(const CShaderRef& inOther) : m_Handle(CShaderManager::DEFAULT_SHADER_HANDLE) { Reset(inOther.m_Handle); }
+
+	/// Destructor
+	~CShaderRef() { Reset(CShaderManager::DEFAULT_SHADER_HANDLE); }
+
+	CShaderRef& operator=(const CShaderRef& inOther)
+	{
+		Reset(inOther.m_Handle);
+		return *this;
+	}
+
+	/// Refer to another program, DEFAULT_SHADER_HANDLE for none
+	void Reset(CShaderManager::TShaderHandle inHandle)
+	{
+		CShaderManager* theShaderManager = CShaderManager::GetInstance();
+		if (theShaderManager == NULL)
+			return;
+
+		// the new reference is taken first, so the program is never unreferenced if it is the same
+		theShaderManager->AcquireProgram(inHandle);
+		theShaderManager->ReleaseProgram(m_Handle);
+		m_Handle = inHandle;
+	}
+
+	/// Get the handle of the program
+	inline CShaderManager::TShaderHandle GetHandle() const { return m_Handle; }
+
+	/// Get the shader of the program, see CShaderManager::GetShader and GetShaderAsync
+	inline CShader* GetShader() const { return CShaderManager::GetInstance()->GetShader(m_Handle); }
+	inline CShader* GetShaderAsync() const { return CShaderManager::GetInstance()->GetShaderAsync(m_Handle); }
+
+}; // end class CShaderRef
+
+#endif
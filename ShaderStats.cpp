@@ -0,0 +1,240 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShaderStats.h"
+#include <stdio.h>
+#include <chrono>
+
+/// Names of the phases and counters in the output files
+static const char* const PHASE_NAMES[CShaderStats::PHASE_COUNT] = { "read", "compile", "link", "validate" };
+static const char* const COUNTER_NAMES[CShaderStats::COUNTER_COUNT] = { "shaderHits", "shaderMisses", "uniformLookups", "attributeLookups", "sourceBytes" };
+
+std::atomic<bool> CShaderStats::s_IsEnabled(false);
+CShaderStats* CShaderStats::s_Instance = NULL;
+std::once_flag CShaderStats::s_InstanceFlag;
+
+/// Write a string as a JSON string, file names may hold quotes and backslashes
+static void WriteString(FILE* inFile, const std::string& inString)
+{
+	fputc('"', inFile);
+	for (size_t i = 0; i < inString.length(); ++i)
+	{
+		unsigned char c = (unsigned char)inString[i];
+		if (c == '"' || c == '\\')
+			fprintf(inFile, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(inFile, "\\u%04x", c);
+		else
+			fputc(c, inFile);
+	}
+	fputc('"', inFile);
+}
+
+CShaderStats::CShaderStats()
+: m_Origin(GetTime())
+{
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+		m_Counters[i].store(0, std::memory_order_relaxed);
+}
+
+CShaderStats* CShaderStats::GetInstance()
+{
+	// probes may come from the shader worker threads
+	std::call_once(s_InstanceFlag, CreateInstance);
+	return (s_Instance);
+}
+
+void CShaderStats::CreateInstance()
+{
+	s_Instance = new CShaderStats;
+}
+
+void CShaderStats::SetEnabled(bool inValue)
+{
+	if (inValue)
+		GetInstance()->Reset();
+	s_IsEnabled.store(inValue, std::memory_order_relaxed);
+}
+
+void CShaderStats::Reset()
+{
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+		m_Counters[i].store(0, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	m_Events.clear();
+	m_Threads.clear();
+	m_Origin = GetTime();
+}
+
+double CShaderStats::GetPhaseTime(EPhase inPhase) const
+{
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	double theTime = 0.0;
+	for (size_t i = 0; i < m_Events.size(); ++i)
+	{
+		if (m_Events[i].phase == inPhase)
+			theTime += m_Events[i].duration;
+	}
+	return theTime;
+}
+
+unsigned int CShaderStats::GetPhaseCount(EPhase inPhase) const
+{
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	unsigned int theCount = 0;
+	for (size_t i = 0; i < m_Events.size(); ++i)
+	{
+		if (m_Events[i].phase == inPhase)
+			++theCount;
+	}
+	return theCount;
+}
+
+double CShaderStats::GetProgramPhaseTime(unsigned int inProgram, EPhase inPhase) const
+{
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+	double theTime = 0.0;
+	for (size_t i = 0; i < m_Events.size(); ++i)
+	{
+		if (m_Events[i].program == inProgram && m_Events[i].phase == inPhase)
+			theTime += m_Events[i].duration;
+	}
+	return theTime;
+}
+
+bool CShaderStats::WriteJSON(const char* inFileName) const
+{
+	FILE* pFile = fopen(inFileName, "w");
+	if (pFile == NULL) {
+		printf("Cannot write file: %s\n", inFileName);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+
+	fprintf(pFile, "{\n  \"counters\": {");
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+		fprintf(pFile, "%s\n    \"%s\": %llu", (i == 0) ? "" : ",", COUNTER_NAMES[i], (unsigned long long)GetCounter((ECounter)i));
+
+	// totals in milliseconds by phase, then by program and phase
+	double thePhaseTimes[PHASE_COUNT] = { 0.0, 0.0, 0.0, 0.0 };
+	unsigned int thePhaseCounts[PHASE_COUNT] = { 0, 0, 0, 0 };
+	std::map<unsigned int, std::vector<double> > thePrograms;
+	for (size_t i = 0; i < m_Events.size(); ++i)
+	{
+		const SEvent& theEvent = m_Events[i];
+		thePhaseTimes[theEvent.phase] += theEvent.duration;
+		++thePhaseCounts[theEvent.phase];
+
+		std::vector<double>& theProgramTimes = thePrograms[theEvent.program];
+		theProgramTimes.resize(PHASE_COUNT, 0.0);
+		theProgramTimes[theEvent.phase] += theEvent.duration;
+	}
+
+	fprintf(pFile, "\n  },\n  \"phases\": {");
+	for (int i = 0; i < PHASE_COUNT; ++i)
+		fprintf(pFile, "%s\n    \"%s\": { \"count\": %u, \"ms\": %.3f }", (i == 0) ? "" : ",", PHASE_NAMES[i], thePhaseCounts[i], thePhaseTimes[i] * 1000.0);
+
+	fprintf(pFile, "\n  },\n  \"programs\": [");
+	for (std::map<unsigned int, std::vector<double> >::const_iterator iter = thePrograms.begin(); iter != thePrograms.end(); ++iter)
+	{
+		fprintf(pFile, "%s\n    { \"program\": %u", (iter == thePrograms.begin()) ? "" : ",", iter->first);
+		for (int i = 0; i < PHASE_COUNT; ++i)
+			fprintf(pFile, ", \"%sMs\": %.3f", PHASE_NAMES[i], iter->second[i] * 1000.0);
+		fprintf(pFile, " }");
+	}
+
+	fprintf(pFile, "\n  ],\n  \"events\": [");
+	for (size_t i = 0; i < m_Events.size(); ++i)
+	{
+		const SEvent& theEvent = m_Events[i];
+		fprintf(pFile, "%s\n    { \"phase\": \"%s\", \"program\": %u, \"stage\": %d, \"file\": ", (i == 0) ? "" : ",", PHASE_NAMES[theEvent.phase], theEvent.program, theEvent.stage);
+		WriteString(pFile, theEvent.fileName);
+		fprintf(pFile, ", \"thread\": %u, \"startMs\": %.3f, \"ms\": %.3f }", theEvent.thread, theEvent.start * 1000.0, theEvent.duration * 1000.0);
+	}
+	fprintf(pFile, "\n  ]\n}\n");
+
+	fclose(pFile);
+	return true;
+}
+
+bool CShaderStats::WriteTrace(const char* inFileName) const
+{
+	FILE* pFile = fopen(inFileName, "w");
+	if (pFile == NULL) {
+		printf("Cannot write file: %s\n", inFileName);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+
+	// complete events ("ph": "X") with times in microseconds, one track per thread
+	fprintf(pFile, "{\"traceEvents\": [");
+	for (size_t i = 0; i < m_Events.size(); ++i)
+	{
+		const SEvent& theEvent = m_Events[i];
+		std::string theName = std::string(PHASE_NAMES[theEvent.phase]) + (theEvent.fileName.empty() ? std::string() : " " + theEvent.fileName);
+		fprintf(pFile, "%s\n  {\"name\": ", (i == 0) ? "" : ",");
+		WriteString(pFile, theName);
+		fprintf(pFile, ", \"cat\": \"shader\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %u, \"args\": {\"program\": %u, \"stage\": %d}}"
+			, theEvent.start * 1000000.0, theEvent.duration * 1000000.0, theEvent.thread, theEvent.program, theEvent.stage);
+	}
+	fprintf(pFile, "\n], \"displayTimeUnit\": \"ms\"}\n");
+
+	fclose(pFile);
+	return true;
+}
+
+double CShaderStats::GetTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CShaderStats::AddEvent(EPhase inPhase, unsigned int inProgram, int inStage, const char* inFileName, double inStart)
+{
+	double theEnd = GetTime();
+
+	std::lock_guard<std::mutex> theLock(m_Mutex);
+
+	// a phase started before the stats were reset is dropped
+	if (inStart < m_Origin)
+		return;
+
+	std::map<std::thread::id, unsigned int>::iterator iter = m_Threads.find(std::this_thread::get_id());
+	if (iter == m_Threads.end())
+		iter = m_Threads.insert(std::make_pair(std::this_thread::get_id(), (unsigned int)m_Threads.size())).first;
+
+	SEvent theEvent;
+	theEvent.start = inStart - m_Origin;
+	theEvent.duration = theEnd - inStart;
+	theEvent.program = inProgram;
+	theEvent.stage = inStage;
+	theEvent.phase = inPhase;
+	theEvent.thread = iter->second;
+	if (inFileName != NULL)
+		theEvent.fileName = inFileName;
+	m_Events.push_back(theEvent);
+}
@@ -0,0 +1,179 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef SHADER_STATS_H
+#define SHADER_STATS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Timing of the phases of shader loads and counters of the shader manager's hot paths.
+ * Disabled by default: every probe is then a single relaxed load of the enabled flag,
+ * no clock is read and nothing is recorded. Probes can be hit from any thread.
+ *
+ * With driver-side parallel compilation glCompileShader and glLinkProgram return early,
+ * the compile and link time is then spent in the link phase's status query.
+ */
+class CShaderStats
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	/// Phases of a load: file I/O and preprocessing, stage compiles, link (or binary load) and validation
+	enum EPhase { PHASE_READ, PHASE_COMPILE, PHASE_LINK, PHASE_VALIDATE, PHASE_COUNT };
+
+	/// Counters of the hot paths
+	enum ECounter
+	{
+		COUNTER_SHADER_HITS,		// GetShader/GetShaderAsync of a program already loaded or loading
+		COUNTER_SHADER_MISSES,		// GetShader/GetShaderAsync starting a load
+		COUNTER_UNIFORM_LOOKUPS,	// CShader::GetUniformHandle/GetUniformIndex
+		COUNTER_ATTRIBUTE_LOOKUPS,	// CShader::GetAttributeHandle/GetAttributeIndex
+		COUNTER_SOURCE_BYTES,		// bytes of stage and included files read
+		COUNTER_COUNT
+	};
+
+protected:
+	/// A timed phase
+	struct SEvent
+	{
+		double start;			// seconds since the stats were enabled
+		double duration;		// seconds
+		unsigned int program;	// handle of the program
+		int stage;				// index of the stage, -1 for the whole program
+		EPhase phase;
+		unsigned int thread;	// small index of the thread, in order of first event
+		std::string fileName;	// file of the stage, empty for the whole program
+	};
+	typedef std::vector<SEvent> TEventList;
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Counters, by ECounter
+	std::atomic<uint64_t> m_Counters[COUNTER_COUNT];
+
+	/// Timed phases in the order they ended
+	TEventList m_Events;
+
+	/// Indices of the threads which recorded events
+	std::map<std::thread::id, unsigned int> m_Threads;
+
+	/// Time the events are relative to, in seconds of a steady clock
+	double m_Origin;
+
+	/// Guards the events
+	mutable std::mutex m_Mutex;
+
+	/// Whether probes record anything
+	static std::atomic<bool> s_IsEnabled;
+
+	/// The unique instance of this class, created once by the first GetInstance() of any thread
+	static CShaderStats*	s_Instance;
+	static std::once_flag	s_InstanceFlag;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Get the unique instance of this class
+	static CShaderStats* GetInstance();
+
+	/// Enable or disable recording, enabling resets the stats
+	static void SetEnabled(bool inValue);
+	static inline bool IsEnabled() { return s_IsEnabled.load(std::memory_order_relaxed); }
+
+	/// Add to a counter if recording
+	static inline void Count(ECounter inCounter, uint64_t inValue = 1)
+	{
+		if (IsEnabled())
+			GetInstance()->m_Counters[inCounter].fetch_add(inValue, std::memory_order_relaxed);
+	}
+
+	/// Start timing a phase, the returned time is given to EndPhase; 0 if not recording
+	static inline double BeginPhase() { return IsEnabled() ? GetTime() : 0.0; }
+
+	/**
+	 * Record a phase started by BeginPhase, nothing if not recording
+	 * @param inStage index of the stage, -1 for the whole program
+	 * @param inFileName file of the stage, NULL for the whole program
+	 */
+	static inline void EndPhase(EPhase inPhase, unsigned int inProgram, int inStage, const char* inFileName, double inStart)
+	{
+		if (inStart != 0.0 && IsEnabled())
+			GetInstance()->AddEvent(inPhase, inProgram, inStage, inFileName, inStart);
+	}
+
+	/// Clear the counters and the timed phases
+	void Reset();
+
+	/// Get a counter
+	inline uint64_t GetCounter(ECounter inCounter) const { return m_Counters[inCounter].load(std::memory_order_relaxed); }
+
+	/// Total time in seconds and number of the recorded phases of a kind
+	double GetPhaseTime(EPhase inPhase) const;
+	unsigned int GetPhaseCount(EPhase inPhase) const;
+
+	/// Total time in seconds of the recorded phases of a program
+	double GetProgramPhaseTime(unsigned int inProgram, EPhase inPhase) const;
+
+	/**
+	 * Write the counters, the totals by phase and by program, and the phases
+	 * @return false if the file cannot be written
+	 */
+	bool WriteJSON(const char* inFileName) const;
+
+	/**
+	 * Write the phases in the Chrome trace event format, for chrome://tracing or Perfetto
+	 * @return false if the file cannot be written
+	 */
+	bool WriteTrace(const char* inFileName) const;
+
+	/// Current time of a steady clock in seconds
+	static double GetTime();
+
+protected:
+	/// Constructor (protected)
+	CShaderStats();
+
+	/// Create the unique instance
+	static void CreateInstance();
+
+	/// Record a phase which ends now
+	void AddEvent(EPhase inPhase, unsigned int inProgram, int inStage, const char* inFileName, double inStart);
+
+}; // end class CShaderStats
+
+#endif
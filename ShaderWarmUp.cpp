@@ -0,0 +1,166 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShaderWarmUp.h"
+#include "SourceFile.h"
+#include <stdio.h>
+#include <string>
+#include <chrono>
+
+/// Names of the load steps in reports
+static const char* const STEP_NAMES[CShaderManager::LOAD_STEP_COUNT] = { "read", "compile", "link", "validate" };
+
+CShaderWarmUp::CShaderWarmUp()
+: m_Next(0),
+m_StartTime(0.0),
+m_EndTime(0.0)
+{
+	for (int i = 0; i < CShaderManager::LOAD_STEP_COUNT; ++i)
+	{
+		m_StepCounts[i] = 0;
+		m_StepTimes[i] = 0.0;
+	}
+}
+
+bool CShaderWarmUp::LoadManifest(const char* inFileName)
+{
+	CSourceFile theManifest;
+	if (!theManifest.Open(inFileName))
+		return false;
+
+	CShaderManager* theShaderManager = CShaderManager::GetInstance();
+	const char* theData = theManifest.GetData();
+	size_t theLength = theManifest.GetLength();
+	for (size_t theBegin = 0; theBegin < theLength; )
+	{
+		size_t theEnd = theBegin;
+		while (theEnd < theLength && theData[theEnd] != '\n')
+			++theEnd;
+
+		// blank separated files then features, up to a comment
+		std::string theFiles[CShaderManager::STAGE_COUNT];
+		int theFileCount = 0;
+		CShaderManager::TVariantMask theFeatures = 0;
+		for (size_t i = theBegin; i < theEnd && theData[i] != '#'; )
+		{
+			if (theData[i] == ' ' || theData[i] == '\t' || theData[i] == '\r') {
+				++i;
+				continue;
+			}
+
+			size_t theTokenEnd = i;
+			while (theTokenEnd < theEnd && theData[theTokenEnd] != ' ' && theData[theTokenEnd] != '\t' && theData[theTokenEnd] != '\r')
+				++theTokenEnd;
+
+			std::string theToken(theData + i, theTokenEnd - i);
+			if (theToken[0] == '+')
+				theFeatures |= theShaderManager->RegisterFeature(theToken.c_str() + 1);
+			else if (theFileCount < CShaderManager::STAGE_COUNT)
+				theFiles[theFileCount++] = theToken;
+			else
+				printf("Too many files in manifest %s: %s\n", inFileName, theToken.c_str());
+			i = theTokenEnd;
+		}
+
+		if (theFileCount == 1)
+			printf("Missing fragment shader in manifest %s.\n", inFileName);
+		else if (theFileCount > 1)
+		{
+			CShaderManager::TShaderHandle theProgram = theShaderManager->RegisterProgram(theFiles[CShaderManager::STAGE_VERTEX].c_str()
+				, theFiles[CShaderManager::STAGE_FRAGMENT].c_str(), theFiles[CShaderManager::STAGE_GEOMETRY].c_str());
+			Add(theShaderManager->GetVariant(theProgram, theFeatures));
+		}
+
+		theBegin = theEnd + 1;
+	}
+
+	return true;
+}
+
+void CShaderWarmUp::Add(CShaderManager::TShaderHandle inProgram)
+{
+	if (inProgram == CShaderManager::DEFAULT_SHADER_HANDLE)
+		return;
+
+	for (size_t i = 0; i < m_Programs.size(); ++i)
+	{
+		if (m_Programs[i] == inProgram)
+			return;
+	}
+	m_Programs.push_back(inProgram);
+	m_EndTime = 0.0;
+}
+
+bool CShaderWarmUp::Update(double inBudget)
+{
+	double theTime = GetTime();
+	if (m_StartTime == 0.0)
+		m_StartTime = theTime;
+
+	CShaderManager* theShaderManager = CShaderManager::GetInstance();
+	double theEndTime = theTime + inBudget;
+	while (m_Next < m_Programs.size())
+	{
+		CShaderManager::ELoadStep theStep = theShaderManager->LoadStep(m_Programs[m_Next]);
+		double theStepEnd = GetTime();
+		if (theStep == CShaderManager::LOAD_DONE)
+			++m_Next;
+		else
+		{
+			++m_StepCounts[theStep];
+			m_StepTimes[theStep] += theStepEnd - theTime;
+		}
+		theTime = theStepEnd;
+
+		if (theTime >= theEndTime)
+			break;
+	}
+
+	if (m_Next < m_Programs.size())
+		return false;
+
+	if (m_EndTime == 0.0)
+		m_EndTime = theTime;
+	return true;
+}
+
+double CShaderWarmUp::GetWarmUpTime() const
+{
+	if (m_StartTime == 0.0)
+		return 0.0;
+	return ((m_EndTime != 0.0) ? m_EndTime : GetTime()) - m_StartTime;
+}
+
+void CShaderWarmUp::PrintReport() const
+{
+	printf("Shader warm-up: %u/%u programs in %.1f ms\n", (unsigned int)m_Next, (unsigned int)m_Programs.size(), GetWarmUpTime() * 1000.0);
+	for (int i = 0; i < CShaderManager::LOAD_STEP_COUNT; ++i)
+		printf("  %-8s %4u steps %8.2f ms\n", STEP_NAMES[i], m_StepCounts[i], m_StepTimes[i] * 1000.0);
+}
+
+double CShaderWarmUp::GetTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,115 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef SHADER_WARM_UP_H
+#define SHADER_WARM_UP_H
+
+#include <vector>
+#include "ShaderManager.h"
+
+/**
+ * Prepares a list of programs ahead of their first use, a few load steps per frame.
+ * Every Update() runs read, compile, link and validate steps of the listed programs,
+ * see CShaderManager::LoadStep(), until the frame's time budget is spent.
+ *
+ * The list can be read from a manifest, one program per line:
+ *
+ *     # comment
+ *     <vertex file> <fragment file> [<geometry file>] [+<feature> ...]
+ *
+ * where each +<feature> selects a variant, see CShaderManager::RegisterFeature().
+ * Use from the rendering thread only.
+ */
+class CShaderWarmUp
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Programs to prepare, in order, and the index of the one being prepared
+	std::vector<CShaderManager::TShaderHandle> m_Programs;
+	size_t m_Next;
+
+	/// Number of steps run and their time in seconds, by step
+	unsigned int m_StepCounts[CShaderManager::LOAD_STEP_COUNT];
+	double m_StepTimes[CShaderManager::LOAD_STEP_COUNT];
+
+	/// Time of the first Update() and of the completion, in seconds of a steady clock, 0 until then
+	double m_StartTime;
+	double m_EndTime;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CShaderWarmUp();
+
+	/**
+	 * Add the programs of a manifest, registering them with the shader manager
+	 * @return false if the manifest cannot be read
+	 */
+	bool LoadManifest(const char* inFileName);
+
+	/// Add a registered program, a program added twice is prepared once
+	void Add(CShaderManager::TShaderHandle inProgram);
+
+	/**
+	 * Run load steps until the budget is spent, at least one step if any is left.
+	 * A step is not interrupted, so a slow compile or link can exceed the budget.
+	 * @param inBudget time budget of the call in seconds, e.g. 0.002
+	 * @return true once all programs are prepared
+	 */
+	bool Update(double inBudget);
+
+	/// Whether all programs are prepared
+	inline bool IsDone() const { return m_Next == m_Programs.size(); }
+
+	/// Number of programs prepared and to prepare
+	inline size_t GetDoneCount() const { return m_Next; }
+	inline size_t GetCount() const { return m_Programs.size(); }
+
+	/// Fraction of the programs prepared, from 0 to 1
+	inline float GetProgress() const { return m_Programs.empty() ? 1.f : (float)m_Next / (float)m_Programs.size(); }
+
+	/// Wall time from the first Update() to the completion, or until now while in progress, in seconds
+	double GetWarmUpTime() const;
+
+	/// Number of steps run and their total time in seconds, by CShaderManager::ELoadStep
+	inline unsigned int GetStepCount(CShaderManager::ELoadStep inStep) const { return m_StepCounts[inStep]; }
+	inline double GetStepTime(CShaderManager::ELoadStep inStep) const { return m_StepTimes[inStep]; }
+
+	/// Print the warm-up time and the time of each step
+	void PrintReport() const;
+
+protected:
+	/// Current time of a steady clock in seconds
+	static double GetTime();
+
+}; // end class CShaderWarmUp
+
+#endif
@@ -0,0 +1,62 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef SHARED_CONTEXT_H
+#define SHARED_CONTEXT_H
+
+/**
+ * Creates OpenGL contexts which share objects with the rendering context,
+ * one for each shader worker thread of CShaderManager.
+ */
+class CSharedContextFactory
+{
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Destructor
+	virtual ~CSharedContextFactory() {}
+
+	/**
+	 * Create the worker contexts, called on the rendering thread with its context current
+	 * @param inCount number of contexts
+	 * @return true if all contexts were created, false otherwise
+	 */
+	virtual bool Create(int inCount) = 0;
+
+	/// Destroy the worker contexts, called on the rendering thread once the workers stopped
+	virtual void Destroy() = 0;
+
+	/// Make a worker context current on the calling thread
+	virtual bool MakeCurrent(int inIndex) = 0;
+
+	/// Release the context of the calling thread
+	virtual void ReleaseCurrent() = 0;
+
+}; // end class CSharedContextFactory
+
+#endif
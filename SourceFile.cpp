@@ -0,0 +1,98 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SourceFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Content of empty files, so an open file never has NULL data
+static const char EMPTY_SOURCE[] = "";
+
+CSourceFile::CSourceFile()
+: m_Data(NULL),
+m_Length(0)
+{
+}
+
+CSourceFile::~CSourceFile()
+{
+	Close();
+}
+
+bool CSourceFile::Open(const char* inFileName)
+{
+	Close();
+
+	// read the whole file into a single buffer, a file rewritten meanwhile fails the read
+	FILE* pFile = fopen(inFileName, "rb");
+	if (pFile == NULL) {
+		printf("Cannot open file: %s\n", inFileName);
+		return false;
+	}
+
+	fseek(pFile, 0, SEEK_END);
+	long theLength = ftell(pFile);
+	rewind(pFile);
+
+	if (theLength < 0) {
+		printf("Cannot read file: %s\n", inFileName);
+		fclose(pFile);
+		return false;
+	}
+
+	if (theLength == 0) {
+		fclose(pFile);
+		m_Data = EMPTY_SOURCE;
+		return true;
+	}
+
+	char* pBuffer = (char*)malloc(theLength);
+	if (pBuffer == NULL) {
+		printf("Out of memory!\n");
+		fclose(pFile);
+		return false;
+	}
+
+	if (fread(pBuffer, 1, theLength, pFile) != (size_t)theLength) {
+		printf("Cannot read file: %s\n", inFileName);
+		free(pBuffer);
+		fclose(pFile);
+		return false;
+	}
+
+	fclose(pFile);
+	m_Data = pBuffer;
+	m_Length = theLength;
+	return true;
+}
+
+void CSourceFile::Close()
+{
+	if (m_Data != NULL && m_Data != EMPTY_SOURCE)
+		free(const_cast<char*>(m_Data));
+
+	m_Data = NULL;
+	m_Length = 0;
+}
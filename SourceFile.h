@@ -0,0 +1,83 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef SOURCE_FILE_H
+#define SOURCE_FILE_H
+
+#include <stddef.h>
+
+/**
+ * Read-only view of a shader source file. The whole file is read with a
+ * single allocation and handed to glShaderSource as one pointer and length,
+ * so there is no per-line copy and no line length limit. The file is not
+ * mapped: a watched file truncated by an editor while its content is still
+ * in use would fault on the pages past its new end.
+ */
+class CSourceFile
+{
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// File content, not null terminated
+	const char* m_Data;
+
+	/// Length of the content in bytes
+	size_t m_Length;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Constructor
+	CSourceFile();
+
+	/// Destructor, closes the file
+	~CSourceFile();
+
+	/**
+	 * Open a source file, closing the previous one
+	 * @return true if the file was read, false otherwise
+	 */
+	bool Open(const char* inFileName);
+
+	/// Release the file content
+	void Close();
+
+	/// Getters of the file content
+	inline const char* GetData() const { return m_Data; }
+	inline size_t GetLength() const { return m_Length; }
+	inline bool IsOpen() const { return m_Data != NULL; }
+
+private:
+	/// Not copyable, the content is owned
+	CSourceFile(const CSourceFile&);
+	CSourceFile& operator=(const CSourceFile&);
+
+}; // end class CSourceFile
+
+#endif
@@ -0,0 +1,256 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "UniformBufferManager.h"
+#include "GLStateCache.h"
+#include <GL/glew.h>
+
+CUniformBufferManager* CUniformBufferManager::s_Instance = NULL;
+
+CUniformBufferManager::CUniformBufferManager()
+: m_Buffer(0),
+m_MappedData(NULL),
+m_FrameSize(0),
+m_FrameCount(0),
+m_FrameIndex(0),
+m_FrameOffset(0),
+m_Alignment(256)
+{
+}
+
+CUniformBufferManager::~CUniformBufferManager()
+{
+	Dispose();
+}
+
+CUniformBufferManager* CUniformBufferManager::GetInstance()
+{
+	if (s_Instance == NULL)
+		s_Instance = new CUniformBufferManager;
+	return (s_Instance);
+}
+
+bool CUniformBufferManager::Initialize(unsigned int inFrameSize, int inFrameCount)
+{
+	Dispose();
+
+	if (!GLEW_ARB_uniform_buffer_object) {
+		printf("Uniform buffers are not supported.\n");
+		return false;
+	}
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_Alignment);
+	if (m_Alignment <= 0)
+		m_Alignment = 256;
+
+	m_FrameSize = (inFrameSize + m_Alignment - 1) / m_Alignment * m_Alignment;
+	m_FrameCount = (inFrameCount > 0) ? inFrameCount : 1;
+	m_FrameIndex = 0;
+	m_FrameOffset = 0;
+	m_FrameFences.assign(m_FrameCount, (void*)NULL);
+
+	GLsizeiptr theSize = (GLsizeiptr)m_FrameSize * m_FrameCount;
+	glGenBuffers(1, &m_Buffer);
+	CGLStateCache::GetInstance()->BindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+	if (GLEW_ARB_buffer_storage)
+	{
+		// written through a persistent mapping, the fences keep the GPU and CPU apart
+		GLbitfield theFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, theSize, NULL, theFlags);
+		m_MappedData = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, theSize, theFlags);
+	}
+	else
+		glBufferData(GL_UNIFORM_BUFFER, theSize, NULL, GL_STREAM_DRAW);
+
+	return true;
+}
+
+void CUniformBufferManager::Dispose()
+{
+	for (size_t i = 0; i < m_FrameFences.size(); ++i)
+	{
+		if (m_FrameFences[i] != NULL)
+			glDeleteSync((GLsync)m_FrameFences[i]);
+	}
+	m_FrameFences.clear();
+
+	if (m_Buffer != 0)
+	{
+		if (m_MappedData != NULL)
+		{
+			CGLStateCache::GetInstance()->BindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+		CGLStateCache::GetInstance()->OnDeleteBuffer(m_Buffer);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+	m_Buffer = 0;
+	m_MappedData = NULL;
+}
+
+void CUniformBufferManager::RegisterBlock(const char* inBlockName, unsigned int inBindingPoint)
+{
+	m_BindingMap[inBlockName] = inBindingPoint;
+}
+
+void CUniformBufferManager::BindBlocks(unsigned int inProgram)
+{
+	if (inProgram == 0 || !GLEW_ARB_uniform_buffer_object)
+		return;
+
+	GLint theBlockCount = 0, theMaxLength = 0;
+	glGetProgramiv(inProgram, GL_ACTIVE_UNIFORM_BLOCKS, &theBlockCount);
+	glGetProgramiv(inProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &theMaxLength);
+	std::vector<char> theName(theMaxLength + 1);
+
+	for (GLint i = 0; i < theBlockCount; ++i)
+	{
+		glGetActiveUniformBlockName(inProgram, i, (GLsizei)theName.size(), NULL, &theName[0]);
+
+		TBindingMap::iterator iter = m_BindingMap.find(&theName[0]);
+		if (iter != m_BindingMap.end())
+			glUniformBlockBinding(inProgram, i, iter->second);
+
+		// std140 blocks have the same layout in every program, reflect it once
+		GLint theSize = 0;
+		glGetActiveUniformBlockiv(inProgram, i, GL_UNIFORM_BLOCK_DATA_SIZE, &theSize);
+		TLayoutMap::iterator layout = m_LayoutMap.find(&theName[0]);
+		if (layout != m_LayoutMap.end())
+		{
+			if (layout->second.size != theSize)
+				printf("Uniform block %s has different sizes across programs, is it std140?\n", &theName[0]);
+			continue;
+		}
+
+		SBlockLayout& theLayout = m_LayoutMap[&theName[0]];
+		theLayout.name = &theName[0];
+		theLayout.size = theSize;
+
+		GLint theMemberCount = 0;
+		glGetActiveUniformBlockiv(inProgram, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &theMemberCount);
+		if (theMemberCount <= 0)
+			continue;
+
+		std::vector<GLint> theIndices(theMemberCount);
+		glGetActiveUniformBlockiv(inProgram, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, &theIndices[0]);
+
+		std::vector<GLuint> theUniforms(theIndices.begin(), theIndices.end());
+		std::vector<GLint> theOffsets(theMemberCount), theTypes(theMemberCount), theArrayStrides(theMemberCount), theMatrixStrides(theMemberCount);
+		glGetActiveUniformsiv(inProgram, theMemberCount, &theUniforms[0], GL_UNIFORM_OFFSET, &theOffsets[0]);
+		glGetActiveUniformsiv(inProgram, theMemberCount, &theUniforms[0], GL_UNIFORM_TYPE, &theTypes[0]);
+		glGetActiveUniformsiv(inProgram, theMemberCount, &theUniforms[0], GL_UNIFORM_ARRAY_STRIDE, &theArrayStrides[0]);
+		glGetActiveUniformsiv(inProgram, theMemberCount, &theUniforms[0], GL_UNIFORM_MATRIX_STRIDE, &theMatrixStrides[0]);
+
+		GLint theMaxMemberLength = 0;
+		glGetProgramiv(inProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &theMaxMemberLength);
+		std::vector<char> theMemberName(theMaxMemberLength + 1);
+
+		for (GLint m = 0; m < theMemberCount; ++m)
+		{
+			glGetActiveUniformName(inProgram, theUniforms[m], (GLsizei)theMemberName.size(), NULL, &theMemberName[0]);
+
+			SBlockMember theMember;
+			theMember.name = &theMemberName[0];
+			theMember.offset = theOffsets[m];
+			theMember.type = theTypes[m];
+			theMember.arrayStride = theArrayStrides[m];
+			theMember.matrixStride = theMatrixStrides[m];
+			theLayout.members.push_back(theMember);
+		}
+	}
+}
+
+const CUniformBufferManager::SBlockLayout* CUniformBufferManager::GetBlockLayout(const char* inBlockName) const
+{
+	TLayoutMap::const_iterator iter = m_LayoutMap.find(inBlockName);
+	return (iter != m_LayoutMap.end()) ? &iter->second : NULL;
+}
+
+int CUniformBufferManager::GetMemberOffset(const char* inBlockName, const char* inMemberName) const
+{
+	const SBlockLayout* theLayout = GetBlockLayout(inBlockName);
+	if (theLayout == NULL)
+		return -1;
+
+	for (size_t i = 0; i < theLayout->members.size(); ++i)
+	{
+		if (theLayout->members[i].name == inMemberName)
+			return theLayout->members[i].offset;
+	}
+	return -1;
+}
+
+void CUniformBufferManager::BeginFrame()
+{
+	if (m_Buffer == 0)
+		return;
+
+	// wait until the GPU is done with the frame which used this segment last
+	void*& theFence = m_FrameFences[m_FrameIndex];
+	if (theFence != NULL)
+	{
+		GLbitfield theFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync((GLsync)theFence, theFlags, 1000000000) == GL_TIMEOUT_EXPIRED)
+			theFlags = 0;
+		glDeleteSync((GLsync)theFence);
+		theFence = NULL;
+	}
+	m_FrameOffset = 0;
+}
+
+void CUniformBufferManager::EndFrame()
+{
+	if (m_Buffer == 0)
+		return;
+
+	m_FrameFences[m_FrameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_FrameIndex = (m_FrameIndex + 1) % m_FrameCount;
+}
+
+bool CUniformBufferManager::BindBlockData(unsigned int inBindingPoint, const void* inData, unsigned int inSize)
+{
+	if (m_Buffer == 0)
+		return false;
+
+	if (m_FrameOffset + inSize > m_FrameSize) {
+		printf("Uniform ring buffer is full, %u bytes per frame.\n", m_FrameSize);
+		return false;
+	}
+
+	GLintptr theOffset = (GLintptr)m_FrameIndex * m_FrameSize + m_FrameOffset;
+	if (m_MappedData != NULL)
+		memcpy(m_MappedData + theOffset, inData, inSize);
+	else
+	{
+		CGLStateCache::GetInstance()->BindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, theOffset, inSize, inData);
+	}
+
+	CGLStateCache::GetInstance()->BindBufferRange(GL_UNIFORM_BUFFER, inBindingPoint, m_Buffer, theOffset, inSize);
+
+	// the next range has to start at an aligned offset
+	m_FrameOffset += (inSize + m_Alignment - 1) / m_Alignment * m_Alignment;
+	return true;
+}
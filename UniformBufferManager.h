@@ -0,0 +1,156 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef UNIFORM_BUFFER_MANAGER_H
+#define UNIFORM_BUFFER_MANAGER_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ * Manages uniform buffer objects shared by all programs. Named std140 blocks
+ * are bound to fixed binding points in every loaded program, so one buffer
+ * range (e.g. a per-frame block holding ProjMatrix) serves all of them.
+ * Block data is sub-allocated from a ring buffer with one segment per frame
+ * in flight; a segment is reused once the fence of its frame has signaled.
+ */
+class CUniformBufferManager
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+public:
+	/// A member of a uniform block
+	struct SBlockMember
+	{
+		std::string name;
+		int offset;
+		unsigned int type;
+		int arrayStride;
+		int matrixStride;
+	};
+
+	/// Layout of a uniform block, as reflected from the first program declaring it
+	struct SBlockLayout
+	{
+		std::string name;
+		int size;
+		std::vector<SBlockMember> members;
+	};
+
+protected:
+	typedef std::map<std::string, unsigned int> TBindingMap;
+	typedef std::map<std::string, SBlockLayout> TLayoutMap;
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Binding points of the registered blocks, by block name
+	TBindingMap m_BindingMap;
+
+	/// Reflected block layouts, by block name
+	TLayoutMap m_LayoutMap;
+
+	/// Ring buffer, mapped persistently if ARB_buffer_storage is supported
+	unsigned int m_Buffer;
+	unsigned char* m_MappedData;
+
+	/// Ring buffer segments, one per frame in flight
+	unsigned int m_FrameSize;
+	int m_FrameCount;
+	int m_FrameIndex;
+	unsigned int m_FrameOffset;
+	std::vector<void*> m_FrameFences;
+
+	/// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	int m_Alignment;
+
+	/// The unique instance of this class
+	static CUniformBufferManager* s_Instance;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Destructor
+	~CUniformBufferManager();
+
+	// Get the unique instance of this class
+	static CUniformBufferManager* GetInstance();
+
+	/**
+	 * Create the ring buffer, requires a current OpenGL context
+	 * @param inFrameSize bytes of block data per frame
+	 * @param inFrameCount number of frames in flight
+	 * @return true if uniform buffers are supported, false otherwise
+	 */
+	bool Initialize(unsigned int inFrameSize, int inFrameCount);
+
+	/// Whether the ring buffer has been created
+	inline bool IsInitialized() const { return m_Buffer != 0; }
+
+	/// Release the ring buffer, requires a current OpenGL context
+	void Dispose();
+
+	/**
+	 * Bind a named block to a fixed binding point in every program loaded afterwards
+	 * @param inBlockName the block name, e.g. "PerFrame"
+	 */
+	void RegisterBlock(const char* inBlockName, unsigned int inBindingPoint);
+
+	/// Reflect the blocks of a linked program and bind the registered ones, called by CShaderManager
+	void BindBlocks(unsigned int inProgram);
+
+	/// Get a reflected block layout, NULL if no loaded program declares the block
+	const SBlockLayout* GetBlockLayout(const char* inBlockName) const;
+
+	/// Get the offset of a block member, -1 if it is unknown
+	int GetMemberOffset(const char* inBlockName, const char* inMemberName) const;
+
+	/// Start a frame, waits if the GPU still reads the ring segment of this frame
+	void BeginFrame();
+
+	/// End a frame, fences its ring segment
+	void EndFrame();
+
+	/**
+	 * Copy block data into the ring buffer and bind it to a binding point
+	 * @param inData the data in std140 layout
+	 * @param inSize size of the data
+	 * @return false if the frame's ring segment is full
+	 */
+	bool BindBlockData(unsigned int inBindingPoint, const void* inData, unsigned int inSize);
+
+protected:
+	/// Default constructor (protected)
+	CUniformBufferManager();
+
+}; // end class CUniformBufferManager
+
+#endif
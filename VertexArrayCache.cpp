@@ -0,0 +1,236 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VertexArrayCache.h"
+#include "VertexLayout.h"
+#include "Shader.h"
+#include "GLStateCache.h"
+#include <GL/glew.h>
+
+CVertexArrayCache* CVertexArrayCache::s_Instance = NULL;
+
+bool CVertexArrayCache::SVertexArrayKey::operator<(const SVertexArrayKey& inOther) const
+{
+	if (shader != inOther.shader)
+		return shader < inOther.shader;
+	if (program != inOther.program)
+		return program < inOther.program;
+	if (layout != inOther.layout)
+		return layout < inOther.layout;
+	if (vbo != inOther.vbo)
+		return vbo < inOther.vbo;
+	if (ibo != inOther.ibo)
+		return ibo < inOther.ibo;
+	if (instanceLayout != inOther.instanceLayout)
+		return instanceLayout < inOther.instanceLayout;
+	return instanceVBO < inOther.instanceVBO;
+}
+
+CVertexArrayCache::CVertexArrayCache()
+: m_EnabledAttributes(0)
+{
+}
+
+CVertexArrayCache::~CVertexArrayCache()
+{
+	Dispose();
+}
+
+CVertexArrayCache* CVertexArrayCache::GetInstance()
+{
+	if (s_Instance == NULL)
+		s_Instance = new CVertexArrayCache;
+	return (s_Instance);
+}
+
+unsigned int CVertexArrayCache::GetVertexArray(CShader* inShader, const SVertexLayout* inLayout, unsigned int inVBO, unsigned int inIBO
+	, const SVertexLayout* inInstanceLayout, unsigned int inInstanceVBO)
+{
+	if (!GLEW_ARB_vertex_array_object || inShader->GetProgram() == 0)
+		return 0;
+
+	SVertexArrayKey theKey;
+	theKey.shader = inShader;
+	theKey.program = inShader->GetProgram();
+	theKey.layout = inLayout;
+	theKey.vbo = inVBO;
+	theKey.ibo = inIBO;
+	theKey.instanceLayout = inInstanceLayout;
+	theKey.instanceVBO = inInstanceVBO;
+
+	TVertexArrayMap::iterator iter = m_VertexArrayMap.find(theKey);
+	if (iter != m_VertexArrayMap.end())
+		return iter->second;
+
+	// record the attribute bindings and the index buffer once
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	unsigned int theVertexArray = 0;
+	glGenVertexArrays(1, &theVertexArray);
+	theStateCache->BindVertexArray(theVertexArray);
+	theStateCache->BindBuffer(GL_ARRAY_BUFFER, inVBO);
+	SetupAttributes(inShader, inLayout);
+	if (inInstanceLayout != NULL)
+	{
+		theStateCache->BindBuffer(GL_ARRAY_BUFFER, inInstanceVBO);
+		SetupAttributes(inShader, inInstanceLayout);
+	}
+	theStateCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, inIBO);
+
+	m_VertexArrayMap[theKey] = theVertexArray;
+	return theVertexArray;
+}
+
+void CVertexArrayCache::Bind(CShader* inShader, const SVertexLayout* inLayout, unsigned int inVBO, unsigned int inIBO
+	, const SVertexLayout* inInstanceLayout, unsigned int inInstanceVBO)
+{
+	unsigned int theVertexArray = GetVertexArray(inShader, inLayout, inVBO, inIBO, inInstanceLayout, inInstanceVBO);
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	if (GLEW_ARB_vertex_array_object)
+	{
+		// a shader without a program gets no VAO, unbind so nothing draws with the last one's
+		theStateCache->BindVertexArray(theVertexArray);
+		return;
+	}
+
+	// no VAO, set up the attributes for this draw and disable the ones left from the last
+	theStateCache->BindBuffer(GL_ARRAY_BUFFER, inVBO);
+	unsigned int theEnabled = SetupAttributes(inShader, inLayout);
+	if (inInstanceLayout != NULL)
+	{
+		theStateCache->BindBuffer(GL_ARRAY_BUFFER, inInstanceVBO);
+		theEnabled |= SetupAttributes(inShader, inInstanceLayout);
+	}
+	DisableAttributes(m_EnabledAttributes & ~theEnabled);
+	m_EnabledAttributes = theEnabled;
+	theStateCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, inIBO);
+}
+
+void CVertexArrayCache::Unbind()
+{
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	if (GLEW_ARB_vertex_array_object)
+	{
+		theStateCache->BindVertexArray(0);
+		return;
+	}
+
+	DisableAttributes(m_EnabledAttributes);
+	m_EnabledAttributes = 0;
+	theStateCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	theStateCache->BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CVertexArrayCache::PointAttributes(CShader* inShader, const SVertexLayout* inLayout, unsigned int inVBO, unsigned int inOffset)
+{
+	CGLStateCache::GetInstance()->BindBuffer(GL_ARRAY_BUFFER, inVBO);
+	SetupAttributes(inShader, inLayout, inOffset);
+}
+
+void CVertexArrayCache::RemoveShader(const CShader* inShader)
+{
+	TVertexArrayMap::iterator iter = m_VertexArrayMap.begin();
+	while (iter != m_VertexArrayMap.end())
+	{
+		if (iter->first.shader == inShader)
+		{
+			DeleteVertexArray(iter->second);
+			m_VertexArrayMap.erase(iter++);
+		}
+		else
+			++iter;
+	}
+}
+
+void CVertexArrayCache::RemoveBuffer(unsigned int inBuffer)
+{
+	TVertexArrayMap::iterator iter = m_VertexArrayMap.begin();
+	while (iter != m_VertexArrayMap.end())
+	{
+		if (iter->first.vbo == inBuffer || iter->first.ibo == inBuffer || iter->first.instanceVBO == inBuffer)
+		{
+			DeleteVertexArray(iter->second);
+			m_VertexArrayMap.erase(iter++);
+		}
+		else
+			++iter;
+	}
+}
+
+void CVertexArrayCache::Dispose()
+{
+	TVertexArrayMap::iterator iter;
+	for (iter = m_VertexArrayMap.begin(); iter != m_VertexArrayMap.end(); ++iter)
+		DeleteVertexArray(iter->second);
+	m_VertexArrayMap.clear();
+}
+
+unsigned int CVertexArrayCache::SetupAttributes(CShader* inShader, const SVertexLayout* inLayout, unsigned int inOffset)
+{
+	// a new vertex array starts with divisor 0 on every location; without vertex arrays a
+	// location keeps the divisor of the last draw which used it, e.g. an instance transform's
+	bool isDivisorSet = !GLEW_ARB_vertex_array_object && (GLEW_ARB_instanced_arrays || GLEW_VERSION_3_3);
+
+	unsigned int theEnabled = 0;
+	for (int i = 0; i < inLayout->attributeCount; ++i)
+	{
+		const SVertexAttribute& theAttribute = inLayout->attributes[i];
+
+		// attributes the shader does not use are skipped
+		int theLocation = inShader->GetAttributeIndex(theAttribute.name);
+		if (theLocation < 0)
+			continue;
+
+		// a matrix takes one location per column of 4 components
+		int theColumnCount = (theAttribute.size + 3) / 4;
+		int theColumnSize = (theColumnCount > 1) ? 4 : theAttribute.size;
+		for (int j = 0; j < theColumnCount; ++j, ++theLocation)
+		{
+			size_t theOffset = inOffset + theAttribute.offset + j * theColumnSize * sizeof(GLfloat);
+			glEnableVertexAttribArray(theLocation);
+			glVertexAttribPointer(theLocation, theColumnSize, theAttribute.type, theAttribute.isNormalized ? GL_TRUE : GL_FALSE
+				, inLayout->stride, (const GLvoid*)theOffset);
+			if (inLayout->divisor != 0 || isDivisorSet)
+				glVertexAttribDivisor(theLocation, inLayout->divisor);
+			if (theLocation < 32)
+				theEnabled |= 1u << theLocation;
+		}
+	}
+	return theEnabled;
+}
+
+void CVertexArrayCache::DisableAttributes(unsigned int inAttributes)
+{
+	for (unsigned int i = 0; inAttributes != 0; ++i, inAttributes >>= 1)
+	{
+		if (inAttributes & 1)
+			glDisableVertexAttribArray(i);
+	}
+}
+
+void CVertexArrayCache::DeleteVertexArray(unsigned int inVertexArray)
+{
+	CGLStateCache::GetInstance()->OnDeleteVertexArray(inVertexArray);
+	glDeleteVertexArrays(1, &inVertexArray);
+}
@@ -0,0 +1,135 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef VERTEX_ARRAY_CACHE_H
+#define VERTEX_ARRAY_CACHE_H
+
+#include <map>
+#include <stddef.h>
+
+// Forward declaration
+class CShader;
+struct SVertexLayout;
+
+/**
+ * Cache of vertex array objects per (shader, vertex layout, vertex buffer,
+ * index buffer). The attribute bindings are set up once when the VAO is
+ * created, a draw then only binds the VAO.
+ */
+class CVertexArrayCache
+{
+////////////////////////////////////////////////////////////
+//	Types
+////////////////////////////////////////////////////////////
+protected:
+	/// Key of a cached VAO, the program is part of it since a relink can move attributes
+	struct SVertexArrayKey
+	{
+		const CShader* shader;
+		unsigned int program;
+		const SVertexLayout* layout;
+		unsigned int vbo;
+		unsigned int ibo;
+		const SVertexLayout* instanceLayout;
+		unsigned int instanceVBO;
+
+		bool operator<(const SVertexArrayKey& inOther) const;
+	};
+	typedef std::map<SVertexArrayKey, unsigned int> TVertexArrayMap;
+
+////////////////////////////////////////////////////////////
+//	Fields
+////////////////////////////////////////////////////////////
+protected:
+	/// Cached VAOs
+	TVertexArrayMap m_VertexArrayMap;
+
+	/// Attribute locations enabled by the last Bind() when VAOs are not supported
+	unsigned int m_EnabledAttributes;
+
+	/// The unique instance of this class
+	static CVertexArrayCache* s_Instance;
+
+////////////////////////////////////////////////////////////
+//	Methods
+////////////////////////////////////////////////////////////
+public:
+	/// Destructor
+	~CVertexArrayCache();
+
+	// Get the unique instance of this class
+	static CVertexArrayCache* GetInstance();
+
+	/**
+	 * Get the VAO of a shader drawing from a vertex and index buffer, created on first use
+	 * @param inInstanceLayout layout of the per-instance attributes in inInstanceVBO, NULL for none
+	 * @return the VAO, 0 if VAOs are not supported
+	 */
+	unsigned int GetVertexArray(CShader* inShader, const SVertexLayout* inLayout, unsigned int inVBO, unsigned int inIBO
+		, const SVertexLayout* inInstanceLayout = NULL, unsigned int inInstanceVBO = 0);
+
+	/**
+	 * Bind the vertex and index buffer of a draw with the shader's attributes.
+	 * Binds the cached VAO, or sets up the attributes directly if VAOs are not supported.
+	 */
+	void Bind(CShader* inShader, const SVertexLayout* inLayout, unsigned int inVBO, unsigned int inIBO
+		, const SVertexLayout* inInstanceLayout = NULL, unsigned int inInstanceVBO = 0);
+
+	/**
+	 * Point the attributes of a layout to an offset of a buffer, in the bound VAO.
+	 * Used to select the instances of a draw without ARB_base_instance.
+	 */
+	void PointAttributes(CShader* inShader, const SVertexLayout* inLayout, unsigned int inVBO, unsigned int inOffset);
+
+	/// Unbind the vertex and index buffers after drawing
+	void Unbind();
+
+	/// Delete the VAOs of a shader, called when its program is deleted
+	void RemoveShader(const CShader* inShader);
+
+	/// Delete the VAOs using a buffer, call before deleting the buffer
+	void RemoveBuffer(unsigned int inBuffer);
+
+	/// Delete all VAOs
+	void Dispose();
+
+protected:
+	/// Default constructor (protected)
+	CVertexArrayCache();
+
+	/// Set up the attribute pointers of a layout in the bound vertex buffer, starting at an offset
+	unsigned int SetupAttributes(CShader* inShader, const SVertexLayout* inLayout, unsigned int inOffset = 0);
+
+	/// Disable the attribute arrays of a location bit mask
+	void DisableAttributes(unsigned int inAttributes);
+
+	/// Delete a cached VAO
+	void DeleteVertexArray(unsigned int inVertexArray);
+
+}; // end class CVertexArrayCache
+
+#endif
@@ -0,0 +1,53 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+/// An attribute of a vertex layout
+struct SVertexAttribute
+{
+	const char* name;		// attribute name in the shader
+	int size;				// number of components, matrices are consecutive locations of 4 components
+	unsigned int type;		// component type, e.g. GL_FLOAT
+	bool isNormalized;
+	unsigned int offset;	// offset of the attribute in a vertex
+};
+
+/**
+ * Layout of the vertices in a vertex buffer. Layouts are compared by address,
+ * so each layout should be a single static instance.
+ */
+struct SVertexLayout
+{
+	const SVertexAttribute* attributes;
+	int attributeCount;
+	unsigned int stride;	// size of a vertex
+	unsigned int divisor;	// 0 per vertex, 1 per instance
+};
+
+#endif
@@ -25,9 +25,28 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #include <GL/glew.h>
 #include <GL/glfw.h>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
 
 #include "ShaderManager.h"
+#include "ShaderRef.h"
 #include "Shader.h"
+#include "ShaderBindings.h"
+#include "UniformBufferManager.h"
+#include "VertexArrayCache.h"
+#include "GLStateCache.h"
+#include "RenderQueue.h"
+#include "MeshArena.h"
+#include "MultiDrawRenderer.h"
+#include "VertexLayout.h"
+#include "ShaderWarmUp.h"
+#include "ShaderStats.h"
+#include "GPUProfiler.h"
+#include "EGLHeadlessContext.h"
+#include "EGLSharedContext.h"
 
 
 #define WINDOW_WIDTH 1280
@@ -37,13 +56,36 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 const char* TEXTURE_FILE_NAME			= "simpletexture.tga";
 const char* VERTEX_SHADER_FILE_NAME		= "simple.vert";
+const char* VERTEX_SHADER_UBO_FILE_NAME	= "simple_ubo.vert";
+const char* VERTEX_SHADER_MDI_FILE_NAME	= "simple_mdi.vert";
 const char* FRAGMENT_SHADER_FILE_NAME	= "simple.frag";
-const char* SHADER_ATTR_POSITION		= "in_Position";
-const char* SHADER_ATTR_TEXCOORD		= "in_TexCoord";
-const char* SHADER_ATTR_NORMAL			= "in_Normal";
-const char* SHADER_UNIF_MODELVIEWMAT	= "ModelViewMatrix";
-const char* SHADER_UNIF_PROJMAT			= "ProjMatrix";
-const char* SHADER_UNIF_TEXTUREMAP		= "TextureMap";
+const char* SHADER_CACHE_DIRECTORY		= "shadercache";
+const char* WARMUP_MANIFEST_FILE_NAME		= "simple.manifest";
+const char* WARMUP_UBO_MANIFEST_FILE_NAME	= "simple_ubo.manifest";
+const char* SHADER_STATS_FILE_NAME		= "shaderstats.json";
+const char* SHADER_TRACE_FILE_NAME		= "shadertrace.json";
+const char* UNIFORM_BLOCK_PER_FRAME		= "PerFrame";
+const char* UNIFORM_BLOCK_PER_DRAW		= "PerDraw";
+const char* SCENE_SHADER_DEFINE			= "#define SCENE_SHADER %d\n";
+
+// uniform buffer binding points and ring buffer size
+#define BINDING_PER_FRAME		0
+#define BINDING_PER_DRAW		1
+#define UNIFORM_RING_FRAME_SIZE	(256 * 1024)
+#define UNIFORM_RING_FRAME_COUNT	3
+#define MULTI_DRAW_FRAME_DRAW_COUNT	4096
+#define MULTI_DRAW_FRAME_COUNT		3
+#define MESH_ARENA_VERTEX_COUNT		(64 * 1024)
+#define MESH_ARENA_INDEX_COUNT		(256 * 1024)
+
+// time spent preparing shaders per frame of the loading phase, in seconds
+#define WARMUP_FRAME_BUDGET			0.002
+
+// frames the GPU profiler reads its timer queries late by
+#define GPU_PROFILER_FRAME_COUNT	4
+
+// size of the generated textures of the scene
+#define SCENE_TEXTURE_SIZE			64
 
 
 ///////////////////////////////////////
@@ -55,34 +97,115 @@ struct SVertex {
 	float	normal[3];
 };
 
+/// Layout of SVertex, the attribute bindings of each (shader, buffers) pair are cached in a VAO
+const SVertexAttribute SVERTEX_ATTRIBUTES[] = {
+	{ "in_Position",	3, GL_FLOAT, false,	offsetof(SVertex, position) },
+	{ "in_TexCoord",	2, GL_FLOAT, true,	offsetof(SVertex, texCoord) },
+	{ "in_Normal",		3, GL_FLOAT, false,	offsetof(SVertex, normal) } };
+const SVertexLayout SVERTEX_LAYOUT = { SVERTEX_ATTRIBUTES, 3, sizeof(SVertex), 0 };
+
 struct STriangleObj {
 	unsigned int vbo;
 	unsigned int ibo;
 	unsigned int triangleCount;
 	unsigned int texture;
+	unsigned int shader;	// index in g_SceneShaders
 	float modelViewMatrix[16];
 };
 
+/// A program of the scene and its instanced variant
+struct SSceneShader {
+	// the shaders are kept across frames, the references keep them loaded whatever the cache budget
+	CShaderRef program;
+	CShaderRef instancedProgram;
+	CShader* shader;
+	CShader* instancedShader;
+};
+
+/// Scene and run options, from the command line
+struct SSceneConfig {
+	int isHeadless;
+	int objectCount;		// STriangleObj instances, laid out in a grid
+	int shaderCount;		// distinct programs, compiled with different SCENE_SHADER defines
+	int textureCount;
+	int frameCount;			// frames to render before exiting, 0 to run until the window is closed
+	const char* screenshotFileName;	// TGA file the last frame is written to, NULL for none
+	int programBudget;		// loaded programs kept by the shader manager, 0 for no limit
+	int shaderWorkerCount;	// shader load threads on shared EGL contexts, headless only, -1 for the default
+};
+
 ///////////////////////////////////////
 /////			VARIABLES		//////
 //////////////////////////////////////
 int			g_IsRunning = 1;
 
-CShader*		g_SimpleShader = NULL;
-STriangleObj*	g_SimpleObj;
+SSceneConfig	g_Scene = { 0, 1, 1, 1, 0, NULL, 0, -1 };
+
+// the scene: objects sharing one rectangle mesh, their programs and textures
+std::vector<SSceneShader>	g_SceneShaders;
+std::vector<STriangleObj>	g_SceneObjs;
+std::vector<unsigned int>	g_SceneTextures;
+
+// context of the headless mode, instead of the GLFW window
+CEGLHeadlessContext	g_HeadlessContext;
+
+// shared contexts of the shader worker threads in headless mode, outlive the shader manager
+CEGLSharedContextFactory	g_ShaderWorkerContexts;
+
+// CPU time of the frames and driver work of all frames, when running a fixed number of frames
+std::vector<double>	g_FrameTimes;
+unsigned int		g_FrameDrawCount = 0;
+unsigned int		g_FrameStateCount = 0;
+
+CRenderQueue	g_RenderQueue;
+
+// multi-draw mode, toggled with the M key: meshes are drawn from a shared arena
+int					g_IsMultiDraw = 0;
+CShaderRef			g_SimpleMultiDrawProgram;
+CShader*			g_SimpleMultiDrawShader = NULL;
+CMeshArena			g_MeshArena;
+SArenaMesh			g_RectMesh;
+CMultiDrawRenderer	g_MultiDrawRenderer;
 
 float		g_ProjMatrix[16] = {0};
 
+// programs prepared by the loading phase before the first frame
+CShaderWarmUp	g_ShaderWarmUp;
+
+// parse the command line options
+void parseOptions(int argc, const char* argv[]);
 // Initialize glfw and opengl, return 0 if failed
 void initialize(void);
 // set up scene
 void setupScene(void);
+// loading phase: prepare the shaders a few steps per frame, then get them
+void loadShaders(void);
+// get the scene's programs, queued to the shader workers if not loaded yet; true while one is still loading
+bool updateSceneShaders(void);
 // dispose scene
 void disposeScene(void);
 // render the scene
 void renderScene(void);
-// draw an STriangleObj
-void drawTriangleObj(STriangleObj* inObj, CShader* inShader);
+// show the rendered frame
+void presentFrame(void);
+// record the CPU time and driver work of a frame
+void recordFrame(double inCpuTime);
+// print the frame times and driver work per frame
+void printFrameReport(void);
+// write the framebuffer to an uncompressed 32-bit TGA file
+bool writeFramebuffer(const char* inFileName);
+// create a generated texture, a checker tinted by the texture's index
+unsigned int createSceneTexture(int inIndex);
+// current time of a steady clock in seconds
+double getTime(void);
+// submit an STriangleObj to the render queue, copies sharing its mesh are drawn with inInstancedShader
+void submitTriangleObj(STriangleObj* inObj, CShader* inShader, CShader* inInstancedShader);
+// set up the per-draw uniforms of a render queue item
+void setupDrawUniforms(const SRenderItem& inItem, CShader* inShader, void* inUserData);
+// submit an STriangleObj drawn from the mesh arena to the multi-draw renderer, inShader draws it without multi-draw
+void submitMultiDrawObj(STriangleObj* inObj, const SArenaMesh& inMesh, CShader* inShader);
+// set up the uniforms of a multi-draw, or of a single draw in the fallback loop
+void setupMultiDrawUniforms(const SMultiDrawItem& inItem, CShader* inShader, void* inUserData);
 // key callback
 void GLFWCALL keyFunction(int inKey, int inAction);
 // mouse callback
@@ -94,21 +217,113 @@ void shutDown(int inReturnCode, const char* inErrorMsg);
 
 int main (int argc, const char * argv[])
 {
+	parseOptions(argc, argv);
+
     initialize();
+	loadShaders();
+
+	// the uniform uploads of the timed frames, without those of the loading screen
+	if (g_Scene.frameCount != 0)
+		CShader::ResetUniformCounts();
     
     while (g_IsRunning)
     {
+		double theStart = getTime();
         renderScene();
+
+		// a fixed number of frames is timed, the last one can be saved
+		if (g_Scene.frameCount != 0)
+		{
+			recordFrame(getTime() - theStart);
+			if ((int)g_FrameTimes.size() == g_Scene.frameCount)
+			{
+				if (g_Scene.screenshotFileName != NULL)
+					writeFramebuffer(g_Scene.screenshotFileName);
+				g_IsRunning = 0;
+			}
+		}
+		presentFrame();
         
 		// Check if window was closed
-        g_IsRunning = g_IsRunning && glfwGetWindowParam( GLFW_OPENED );
+        g_IsRunning = g_IsRunning && (g_Scene.isHeadless || glfwGetWindowParam( GLFW_OPENED ));
     }
+
+	if (g_Scene.frameCount != 0)
+		printFrameReport();
     
     shutDown(EXIT_SUCCESS, "");
 }
 
+void parseOptions(int argc, const char* argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		// --shader-stats times the shader loads and writes the stats on exit
+		if (strcmp(argv[i], "--shader-stats") == 0)
+			CShaderStats::SetEnabled(true);
+		// --headless renders to an offscreen EGL surface, e.g. with llvmpipe on a build server
+		else if (strcmp(argv[i], "--headless") == 0)
+			g_Scene.isHeadless = 1;
+		else if (strcmp(argv[i], "--multi-draw") == 0)
+			g_IsMultiDraw = 1;
+		else if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+			g_Scene.objectCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--shaders") == 0 && i + 1 < argc)
+			g_Scene.shaderCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--textures") == 0 && i + 1 < argc)
+			g_Scene.textureCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			g_Scene.frameCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc)
+			g_Scene.screenshotFileName = argv[++i];
+		// --program-budget N evicts the programs the scene does not use beyond N loaded ones
+		else if (strcmp(argv[i], "--program-budget") == 0 && i + 1 < argc)
+			g_Scene.programBudget = atoi(argv[++i]);
+		// --shader-workers N loads the programs on N threads with shared contexts, 0 on the rendering thread
+		else if (strcmp(argv[i], "--shader-workers") == 0 && i + 1 < argc)
+			g_Scene.shaderWorkerCount = atoi(argv[++i]);
+		else
+			printf("Unknown option: %s\n", argv[i]);
+	}
+
+	g_Scene.objectCount = std::max(g_Scene.objectCount, 1);
+	g_Scene.shaderCount = std::max(g_Scene.shaderCount, 1);
+	g_Scene.textureCount = std::max(g_Scene.textureCount, 1);
+	g_Scene.frameCount = std::max(g_Scene.frameCount, 0);
+	g_Scene.programBudget = std::max(g_Scene.programBudget, 0);
+
+	// without a window the demo would never end
+	if (g_Scene.isHeadless && g_Scene.frameCount == 0)
+		g_Scene.frameCount = 100;
+
+	// shared contexts are only created for the EGL context of the headless mode
+	if (!g_Scene.isHeadless)
+		g_Scene.shaderWorkerCount = 0;
+	else if (g_Scene.shaderWorkerCount < 0)
+		g_Scene.shaderWorkerCount = 2;
+}
+
 void initialize()
 {
+	if (g_Scene.isHeadless)
+	{
+		if (!g_HeadlessContext.Create(WINDOW_WIDTH, WINDOW_HEIGHT))
+			shutDown(EXIT_FAILURE, "Failed to create headless context");
+
+		// with a GLX build of GLEW, glewInit loads the GL entry points then reports
+		// that there is no GLX display, which does not matter here
+		glewInit();
+
+		// the workers read, compile and link the programs of asynchronous loads
+		if (g_Scene.shaderWorkerCount > 0 && !CShaderManager::GetInstance()->StartWorkers(&g_ShaderWorkerContexts, g_Scene.shaderWorkerCount))
+			g_Scene.shaderWorkerCount = 0;
+		printf("Shader workers: %d\n", g_Scene.shaderWorkerCount);
+
+		setupScene();
+		resizeFunction(WINDOW_WIDTH, WINDOW_HEIGHT);
+		return;
+	}
+
     // initialze GLFW
     if (!glfwInit())
         shutDown(EXIT_FAILURE, "Failed to initialize GLFW");
@@ -140,7 +355,63 @@ void initialize()
 
 void setupScene()
 {
-	g_SimpleShader = CShaderManager::GetInstance()->GetShader(VERTEX_SHADER_FILE_NAME, FRAGMENT_SHADER_FILE_NAME, NULL);
+	// reuse program binaries from previous runs when the driver allows it
+	CShaderManager::GetInstance()->EnableBinaryCache(SHADER_CACHE_DIRECTORY);
+
+	// saved shader files are recompiled in the background while the demo runs
+	CShaderManager::GetInstance()->EnableHotReload();
+
+	// unreferenced programs over the budget are evicted, and loaded again from the binary cache on use
+	CShaderManager::GetInstance()->SetCacheBudget(g_Scene.programBudget, 0);
+
+	// with uniform buffers, ProjMatrix and ModelViewMatrix come from shared blocks
+	// instead of per-program uniforms; the blocks must be registered before loading
+	CUniformBufferManager* theUniformBuffers = CUniformBufferManager::GetInstance();
+	const char* theVertexShader = VERTEX_SHADER_FILE_NAME;
+	const char* theManifest = WARMUP_MANIFEST_FILE_NAME;
+	if (theUniformBuffers->Initialize(UNIFORM_RING_FRAME_SIZE, UNIFORM_RING_FRAME_COUNT))
+	{
+		theUniformBuffers->RegisterBlock(UNIFORM_BLOCK_PER_FRAME, BINDING_PER_FRAME);
+		theUniformBuffers->RegisterBlock(UNIFORM_BLOCK_PER_DRAW, BINDING_PER_DRAW);
+		theVertexShader = VERTEX_SHADER_UBO_FILE_NAME;
+		theManifest = WARMUP_UBO_MANIFEST_FILE_NAME;
+	}
+
+	// the manifest lists the programs and variants prepared by the loading phase
+	g_ShaderWarmUp.LoadManifest(theManifest);
+
+	// the instanced variant reads its transform from per-instance attributes, only the
+	// vertex stage mentions INSTANCED so the fragment stage is shared with the base program;
+	// the other programs of the scene differ by a define, so each one is compiled separately
+	CShaderManager* theShaderManager = CShaderManager::GetInstance();
+	CShaderManager::TVariantMask theInstanced = theShaderManager->RegisterFeature("INSTANCED");
+	g_SceneShaders.resize(g_Scene.shaderCount);
+	for (int i = 0; i < g_Scene.shaderCount; ++i)
+	{
+		char theDefines[64];
+		sprintf(theDefines, SCENE_SHADER_DEFINE, i);
+		SSceneShader& theShader = g_SceneShaders[i];
+		theShader.program.Reset(theShaderManager->RegisterProgram(theVertexShader, FRAGMENT_SHADER_FILE_NAME, NULL, (i == 0) ? NULL : theDefines));
+		theShader.instancedProgram.Reset(theShaderManager->GetVariant(theShader.program.GetHandle(), theInstanced));
+		theShader.shader = NULL;
+		theShader.instancedShader = NULL;
+		g_ShaderWarmUp.Add(theShader.program.GetHandle());
+		g_ShaderWarmUp.Add(theShader.instancedProgram.GetHandle());
+	}
+
+	// per-draw uniforms of the queued draws
+	g_RenderQueue.SetDrawSetup(setupDrawUniforms, NULL);
+
+	// one glMultiDrawElementsIndirect per program if the driver allows it, a loop of draws otherwise
+	if (g_MultiDrawRenderer.Initialize(MULTI_DRAW_FRAME_DRAW_COUNT, MULTI_DRAW_FRAME_COUNT))
+	{
+		g_SimpleMultiDrawProgram.Reset(theShaderManager->RegisterProgram(VERTEX_SHADER_MDI_FILE_NAME, FRAGMENT_SHADER_FILE_NAME, NULL));
+		g_ShaderWarmUp.Add(g_SimpleMultiDrawProgram.GetHandle());
+	}
+	g_MultiDrawRenderer.SetDrawSetup(setupMultiDrawUniforms, NULL);
+
+	// GPU time per program, read a few frames late so the queries never stall
+	CGPUProfiler::GetInstance()->Initialize(GPU_PROFILER_FRAME_COUNT);
 	
 	/// set up a rectangle object
 	SVertex rectVertBuffer[4] = { {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 1.f},
@@ -150,115 +421,354 @@ void setupScene()
     
 	int rectIndexBuffer[6] = {0, 1, 2, 0, 2, 3};
     
-	g_SimpleObj = new STriangleObj;
-	g_SimpleObj->vbo = 0;
-	g_SimpleObj->ibo = 0;
-	glGenBuffers(1, &g_SimpleObj->vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, g_SimpleObj->vbo);
+	STriangleObj theObj;
+	theObj.vbo = 0;
+	theObj.ibo = 0;
+	// the element array binding belongs to the bound VAO, upload with none bound
+	CGLStateCache* theStateCache = CGLStateCache::GetInstance();
+	if (GLEW_ARB_vertex_array_object)
+		theStateCache->BindVertexArray(0);
+
+	glGenBuffers(1, &theObj.vbo);
+	theStateCache->BindBuffer(GL_ARRAY_BUFFER, theObj.vbo);
 	glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(SVertex), &rectVertBuffer[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
     
-	glGenBuffers(1, &g_SimpleObj->ibo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_SimpleObj->ibo);
+	glGenBuffers(1, &theObj.ibo);
+	theStateCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, theObj.ibo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,6 * sizeof(int), &rectIndexBuffer[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    
-	g_SimpleObj->triangleCount = 2;
-    
-	float modelViewMatrix[16] = {400.f, 0.f,	0.f, 0.f,
-        0.f,	400.f,	0.f, 0.f,
-        0.f,	0.f,	1.f, 0.f,
-        350.f, 150.f,	0.f, 1.f};
     
-	memcpy(&g_SimpleObj->modelViewMatrix[0], &modelViewMatrix[0], sizeof(float) * 16);
-    
-	// texture
-	glGenTextures(1, &g_SimpleObj->texture);
-	glBindTexture(GL_TEXTURE_2D, g_SimpleObj->texture);
+	theObj.triangleCount = 2;
+
+	// the same rectangle in the mesh arena of the multi-draw mode
+	if (g_MeshArena.Initialize(&SVERTEX_LAYOUT, MESH_ARENA_VERTEX_COUNT, MESH_ARENA_INDEX_COUNT))
+		g_MeshArena.AddMesh(&rectVertBuffer[0], 4, (const unsigned int*)&rectIndexBuffer[0], 6, g_RectMesh);
+
+	// textures, the first one from a file unless headless since GLFW reads it
+	for (int i = 0; i < g_Scene.textureCount; ++i)
+		g_SceneTextures.push_back(createSceneTexture(i));
+
+	// the objects share the rectangle and cycle through the programs and textures, in a grid
+	int theColumns = (int)ceil(sqrt((double)g_Scene.objectCount));
+	int theRows = (g_Scene.objectCount + theColumns - 1) / theColumns;
+	float theCell = std::min((float)WINDOW_WIDTH / theColumns, (float)WINDOW_HEIGHT / theRows);
+	float theSize = theCell * 0.8f;
+	g_SceneObjs.reserve(g_Scene.objectCount);
+	for (int i = 0; i < g_Scene.objectCount; ++i)
+	{
+		float modelViewMatrix[16] = {theSize, 0.f,	0.f, 0.f,
+			0.f,	theSize,	0.f, 0.f,
+			0.f,	0.f,	1.f, 0.f,
+			(i % theColumns) * theCell + theCell * 0.1f, (i / theColumns) * theCell + theCell * 0.1f,	0.f, 1.f};
+    
+		memcpy(&theObj.modelViewMatrix[0], &modelViewMatrix[0], sizeof(float) * 16);
+		theObj.texture = g_SceneTextures[i % g_Scene.textureCount];
+		theObj.shader = i % g_Scene.shaderCount;
+		g_SceneObjs.push_back(theObj);
+	}
+}
+
+unsigned int createSceneTexture(int inIndex)
+{
+	unsigned int theTexture = 0;
+	glGenTextures(1, &theTexture);
+	CGLStateCache::GetInstance()->BindTexture(0, GL_TEXTURE_2D, theTexture);
     
-	glfwLoadTexture2D(TEXTURE_FILE_NAME, GLFW_BUILD_MIPMAPS_BIT | GLFW_ORIGIN_UL_BIT);
+	if (inIndex == 0 && !g_Scene.isHeadless)
+		glfwLoadTexture2D(TEXTURE_FILE_NAME, GLFW_BUILD_MIPMAPS_BIT | GLFW_ORIGIN_UL_BIT);
+	else
+	{
+		// a checker of white and a color picked from the index, so each texture is told apart
+		unsigned char theColor[3] = { (unsigned char)(64 + (inIndex * 97) % 192), (unsigned char)(64 + (inIndex * 57) % 192), (unsigned char)(64 + (inIndex * 151) % 192) };
+		std::vector<unsigned char> thePixels(SCENE_TEXTURE_SIZE * SCENE_TEXTURE_SIZE * 4);
+		for (int y = 0; y < SCENE_TEXTURE_SIZE; ++y)
+		{
+			for (int x = 0; x < SCENE_TEXTURE_SIZE; ++x)
+			{
+				unsigned char* thePixel = &thePixels[(y * SCENE_TEXTURE_SIZE + x) * 4];
+				bool isWhite = ((x / 8 + y / 8) % 2) == 0;
+				for (int c = 0; c < 3; ++c)
+					thePixel[c] = isWhite ? 255 : theColor[c];
+				thePixel[3] = 255;
+			}
+		}
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCENE_TEXTURE_SIZE, SCENE_TEXTURE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, &thePixels[0]);
+	}
     
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    
-	glBindTexture(GL_TEXTURE_2D, 0);
+	return theTexture;
+}
+
+void loadShaders()
+{
+	// with shader workers the scene's programs load on their threads, the warm-up only
+	// steps through the ones they have not taken, such as the other manifest variants
+	bool isLoadingOnWorkers = (g_Scene.shaderWorkerCount > 0) && updateSceneShaders();
+
+	// a few load steps per frame, the window keeps responding while the shaders are prepared
+	while (g_IsRunning && (!g_ShaderWarmUp.Update(WARMUP_FRAME_BUDGET) || isLoadingOnWorkers))
+	{
+		if (isLoadingOnWorkers)
+			isLoadingOnWorkers = updateSceneShaders();
+
+		float theProgress = g_ShaderWarmUp.GetProgress();
+		glClearColor(0.4f * theProgress, 0.5f * theProgress, 0.6f * theProgress, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		presentFrame();
+
+		g_IsRunning = g_IsRunning && (g_Scene.isHeadless || glfwGetWindowParam( GLFW_OPENED ));
+	}
+	g_ShaderWarmUp.PrintReport();
+
+	// the programs are loaded now, a program which failed keeps program 0
+	for (size_t i = 0; i < g_SceneShaders.size(); ++i)
+	{
+		SSceneShader& theShader = g_SceneShaders[i];
+		theShader.shader = theShader.program.GetShaderAsync();
+		theShader.instancedShader = theShader.instancedProgram.GetShaderAsync();
+
+		// uniform/attribute locations are resolved by generated ID, now and after every link
+		SSimpleProgram::Bind(theShader.shader);
+		SSimpleProgram::Bind(theShader.instancedShader);
+	}
+
+	if (g_SimpleMultiDrawProgram.GetHandle() != CShaderManager::DEFAULT_SHADER_HANDLE)
+	{
+		g_SimpleMultiDrawShader = g_SimpleMultiDrawProgram.GetShaderAsync();
+		SSimpleProgram::Bind(g_SimpleMultiDrawShader);
+	}
+}
+
+bool updateSceneShaders()
+{
+	// publishes the programs the workers have finished
+	CShaderManager::GetInstance()->Update();
+
+	bool isLoading = false;
+	for (size_t i = 0; i < g_SceneShaders.size(); ++i)
+	{
+		isLoading = g_SceneShaders[i].program.GetShaderAsync()->IsPending() || isLoading;
+		isLoading = g_SceneShaders[i].instancedProgram.GetShaderAsync()->IsPending() || isLoading;
+	}
+	if (g_SimpleMultiDrawProgram.GetHandle() != CShaderManager::DEFAULT_SHADER_HANDLE)
+		isLoading = g_SimpleMultiDrawProgram.GetShaderAsync()->IsPending() || isLoading;
+	return isLoading;
 }
 
 void disposeScene()
 {
-	/// free g_SimpleObj
-	if (g_SimpleObj != NULL)
+	/// free the rectangle shared by the objects
+	if (!g_SceneObjs.empty())
 	{
-		if (g_SimpleObj->vbo != 0)
+		STriangleObj& theObj = g_SceneObjs[0];
+		CVertexArrayCache::GetInstance()->RemoveBuffer(theObj.vbo);
+		CVertexArrayCache::GetInstance()->RemoveBuffer(theObj.ibo);
+
+		if (theObj.vbo != 0)
 		{
-			glDeleteBuffers(1, &g_SimpleObj->vbo);
-			g_SimpleObj->vbo = 0;
+			CGLStateCache::GetInstance()->OnDeleteBuffer(theObj.vbo);
+			glDeleteBuffers(1, &theObj.vbo);
 		}
         
-		if (g_SimpleObj->ibo != 0)
+		if (theObj.ibo != 0)
 		{
-			glDeleteBuffers(1, &g_SimpleObj->ibo);
-			g_SimpleObj->ibo = 0;
+			CGLStateCache::GetInstance()->OnDeleteBuffer(theObj.ibo);
+			glDeleteBuffers(1, &theObj.ibo);
 		}
         
-		delete g_SimpleObj;
-		g_SimpleObj = NULL;
+		g_SceneObjs.clear();
+	}
+
+	for (size_t i = 0; i < g_SceneTextures.size(); ++i)
+	{
+		CGLStateCache::GetInstance()->OnDeleteTexture(g_SceneTextures[i]);
+		glDeleteTextures(1, &g_SceneTextures[i]);
 	}
+	g_SceneTextures.clear();
 }
 
 void renderScene()
 {	
+	// progress shader loads without blocking the frame
+	CShaderManager::GetInstance()->Update();
+
+	CGPUProfiler* theProfiler = CGPUProfiler::GetInstance();
+	theProfiler->BeginFrame();
+
+	CUniformBufferManager* theUniformBuffers = CUniformBufferManager::GetInstance();
+	theUniformBuffers->BeginFrame();
+	theUniformBuffers->BindBlockData(BINDING_PER_FRAME, &g_ProjMatrix[0], sizeof(g_ProjMatrix));
+
 	glClearColor(0.4f, 0.5f, 0.6f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
     
-	glUseProgram(g_SimpleShader->GetProgram());
-    
-	// projection matrix
-	glUniformMatrix4fv(g_SimpleShader->GetUniformIndex(SHADER_UNIF_PROJMAT)
-                       , 1, GL_FALSE, &g_ProjMatrix[0]);
-	
-	drawTriangleObj(g_SimpleObj, g_SimpleShader);
-    
-    glfwSwapBuffers();
+	// projection matrix, only uploaded when it changed
+	for (size_t i = 0; i < g_SceneShaders.size(); ++i)
+	{
+		CShader* theShader = g_SceneShaders[i].shader;
+		CShader* theInstancedShader = g_SceneShaders[i].instancedShader;
+		theShader->SetUniform(SSimpleProgram::Handle(theShader, SSimpleProgram::UNIF_PROJMATRIX), &g_ProjMatrix[0]);
+		theInstancedShader->SetUniform(SSimpleProgram::Handle(theInstancedShader, SSimpleProgram::UNIF_PROJMATRIX), &g_ProjMatrix[0]);
+	}
+
+	if (g_IsMultiDraw)
+	{
+		if (g_SimpleMultiDrawShader != NULL)
+			g_SimpleMultiDrawShader->SetUniform(SSimpleProgram::Handle(g_SimpleMultiDrawShader, SSimpleProgram::UNIF_PROJMATRIX), &g_ProjMatrix[0]);
+
+		// one multi-draw per program, texture and arena
+		for (size_t i = 0; i < g_SceneObjs.size(); ++i)
+			submitMultiDrawObj(&g_SceneObjs[i], g_RectMesh, g_SceneShaders[g_SceneObjs[i].shader].shader);
+		g_MultiDrawRenderer.Flush();
+	}
+	else
+	{
+		// draws are issued sorted by program, texture and mesh
+		for (size_t i = 0; i < g_SceneObjs.size(); ++i)
+		{
+			const SSceneShader& theShader = g_SceneShaders[g_SceneObjs[i].shader];
+			submitTriangleObj(&g_SceneObjs[i], theShader.shader, theShader.instancedShader);
+		}
+		g_RenderQueue.Flush();
+	}
+
+	theUniformBuffers->EndFrame();
+	CGLStateCache::GetInstance()->EndFrame();
+	theProfiler->EndFrame();
 }
 
-void drawTriangleObj(STriangleObj* inObj, CShader* inShader)
+void presentFrame()
 {
-	// set up model view matrix
-	glUniformMatrix4fv(inShader->GetUniformIndex(SHADER_UNIF_MODELVIEWMAT)
-                       , 1, GL_FALSE, &inObj->modelViewMatrix[0]);
-    
-	// texture
-	glEnable(GL_TEXTURE_2D);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, inObj->texture);
-	glUniform1i(inShader->GetUniformIndex(SHADER_UNIF_TEXTUREMAP), 0);
-    
-	glBindBuffer(GL_ARRAY_BUFFER, inObj->vbo);
-	// set up position
-	int attrPosition = inShader->GetAttributeIndex(SHADER_ATTR_POSITION);
-	glEnableVertexAttribArray(attrPosition);
-	glVertexAttribPointer(attrPosition, 3, GL_FLOAT, GL_FALSE, sizeof(SVertex), (GLvoid*)offsetof(SVertex, position));
-    
-	// set up texture coordinate
-	int attrTexCoord = inShader->GetAttributeIndex(SHADER_ATTR_TEXCOORD);
-	glEnableVertexAttribArray(attrTexCoord);
-	glVertexAttribPointer(attrTexCoord, 2, GL_FLOAT, GL_TRUE, sizeof(SVertex), (GLvoid*)offsetof(SVertex, texCoord));
-    
-	// set up normal vector
-	int attrNormal = inShader->GetAttributeIndex(SHADER_ATTR_NORMAL);
-	glEnableVertexAttribArray(attrNormal);
-	glVertexAttribPointer(attrNormal, 3, GL_FLOAT, GL_FALSE, sizeof(SVertex), (GLvoid*)offsetof(SVertex, normal));
-    
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, inObj->ibo);
-    
-	glDrawElements(GL_TRIANGLES, inObj->triangleCount * 3, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
-    
-	// Unbind the buffers
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (g_Scene.isHeadless)
+		g_HeadlessContext.SwapBuffers();
+	else
+		glfwSwapBuffers();
+}
+
+void recordFrame(double inCpuTime)
+{
+	g_FrameTimes.push_back(inCpuTime);
+	g_FrameDrawCount += g_IsMultiDraw ? g_MultiDrawRenderer.GetCallCount() : g_RenderQueue.GetDrawCount();
+	g_FrameStateCount += CGLStateCache::GetInstance()->GetFrameIssuedCount();
+}
+
+void printFrameReport()
+{
+	if (g_FrameTimes.empty())
+		return;
+
+	// nearest rank percentiles of the CPU time of the frames
+	std::vector<double> theTimes(g_FrameTimes);
+	std::sort(theTimes.begin(), theTimes.end());
+	double theTotal = 0.0;
+	for (size_t i = 0; i < theTimes.size(); ++i)
+		theTotal += theTimes[i];
+	size_t theLast = theTimes.size() - 1;
+	unsigned int theCount = (unsigned int)theTimes.size();
+
+	printf("Scene: %d objects, %d shaders, %d textures%s\n", g_Scene.objectCount, g_Scene.shaderCount, g_Scene.textureCount, g_IsMultiDraw ? ", multi-draw" : "");
+	printf("CPU frame time: %u frames, mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n", theCount, theTotal / theCount * 1000.0
+		, theTimes[(size_t)(theLast * 0.50 + 0.5)] * 1000.0, theTimes[(size_t)(theLast * 0.95 + 0.5)] * 1000.0
+		, theTimes[(size_t)(theLast * 0.99 + 0.5)] * 1000.0, theTimes[theLast] * 1000.0);
+	printf("Driver calls per frame: %.1f draws, %.1f state changes, %.1f uniform uploads\n"
+		, (double)g_FrameDrawCount / theCount, (double)g_FrameStateCount / theCount, (double)CShader::GetIssuedUniformCount() / theCount);
+}
+
+bool writeFramebuffer(const char* inFileName)
+{
+	int theViewport[4];
+	glGetIntegerv(GL_VIEWPORT, theViewport);
+	int theWidth = theViewport[2];
+	int theHeight = theViewport[3];
+
+	// rows come bottom up, the default origin of TGA
+	std::vector<unsigned char> thePixels(theWidth * theHeight * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, theWidth, theHeight, GL_BGRA, GL_UNSIGNED_BYTE, &thePixels[0]);
+
+	FILE* pFile = fopen(inFileName, "wb");
+	if (pFile == NULL) {
+		printf("Cannot write file: %s\n", inFileName);
+		return false;
+	}
+
+	// uncompressed true color, 32 bits per pixel with 8 bits of alpha
+	unsigned char theHeader[18] = { 0 };
+	theHeader[2] = 2;
+	theHeader[12] = (unsigned char)(theWidth & 0xFF);
+	theHeader[13] = (unsigned char)(theWidth >> 8);
+	theHeader[14] = (unsigned char)(theHeight & 0xFF);
+	theHeader[15] = (unsigned char)(theHeight >> 8);
+	theHeader[16] = 32;
+	theHeader[17] = 8;
+	fwrite(theHeader, 1, sizeof(theHeader), pFile);
+	fwrite(&thePixels[0], 1, thePixels.size(), pFile);
+	fclose(pFile);
+
+	printf("Framebuffer written to %s\n", inFileName);
+	return true;
+}
+
+double getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void submitTriangleObj(STriangleObj* inObj, CShader* inShader, CShader* inInstancedShader)
+{
+	SRenderItem theItem;
+	theItem.shader = inShader;
+	theItem.instancedShader = inInstancedShader;
+	theItem.layout = &SVERTEX_LAYOUT;
+	theItem.vbo = inObj->vbo;
+	theItem.ibo = inObj->ibo;
+	theItem.firstIndex = 0;
+	theItem.indexCount = inObj->triangleCount * 3;
+	theItem.texture = inObj->texture;
+	theItem.modelViewMatrix = &inObj->modelViewMatrix[0];
+	theItem.depth = inObj->modelViewMatrix[14];
+	g_RenderQueue.Submit(theItem);
+}
+
+void setupDrawUniforms(const SRenderItem& inItem, CShader* inShader, void* inUserData)
+{
+	// set up model view matrix, one of the two is inactive depending on the vertex shader;
+	// the instanced variant reads it from the instance buffer instead
+	if (inShader != inItem.instancedShader)
+	{
+		CUniformBufferManager::GetInstance()->BindBlockData(BINDING_PER_DRAW, inItem.modelViewMatrix, 16 * sizeof(float));
+		inShader->SetUniform(SSimpleProgram::Handle(inShader, SSimpleProgram::UNIF_MODELVIEWMATRIX), inItem.modelViewMatrix);
+	}
+
+	// texture unit 0
+	inShader->SetUniform(SSimpleProgram::Handle(inShader, SSimpleProgram::UNIF_TEXTUREMAP), 0);
+}
+
+void submitMultiDrawObj(STriangleObj* inObj, const SArenaMesh& inMesh, CShader* inShader)
+{
+	SMultiDrawItem theItem;
+	theItem.shader = inShader;
+	theItem.multiDrawShader = g_SimpleMultiDrawShader;
+	theItem.arena = &g_MeshArena;
+	theItem.mesh = inMesh;
+	theItem.texture = inObj->texture;
+	theItem.modelViewMatrix = &inObj->modelViewMatrix[0];
+	g_MultiDrawRenderer.Submit(theItem);
+}
+
+void setupMultiDrawUniforms(const SMultiDrawItem& inItem, CShader* inShader, void* inUserData)
+{
+	// the multi-draw shader reads the model view matrices from the storage buffer
+	if (inShader != inItem.multiDrawShader)
+	{
+		CUniformBufferManager::GetInstance()->BindBlockData(BINDING_PER_DRAW, inItem.modelViewMatrix, 16 * sizeof(float));
+		inShader->SetUniform(SSimpleProgram::Handle(inShader, SSimpleProgram::UNIF_MODELVIEWMATRIX), inItem.modelViewMatrix);
+	}
+
+	// texture unit 0
+	inShader->SetUniform(SSimpleProgram::Handle(inShader, SSimpleProgram::UNIF_TEXTUREMAP), 0);
 }
 
 void GLFWCALL keyFunction(int key, int action)
@@ -270,6 +780,10 @@ void GLFWCALL keyFunction(int key, int action)
             case GLFW_KEY_ESC:
                 g_IsRunning = 0;
                 break;
+            case 'M':
+                g_IsMultiDraw = !g_IsMultiDraw;
+                printf("Multi-draw mode %s\n", g_IsMultiDraw ? (g_MultiDrawRenderer.IsMultiDraw() ? "on" : "on, fallback loop") : "off");
+                break;
             default:
                 break;
         }
@@ -317,11 +831,41 @@ void GLFWCALL resizeFunction(int w, int h)
 
 void shutDown(int returnCode, const char* errorMsg)
 {
-    glfwTerminate();
     if (returnCode != EXIT_SUCCESS)
         printf("%s\n", errorMsg);
     
 	disposeScene();
+	g_RenderQueue.Dispose();
+	g_MultiDrawRenderer.Dispose();
+	g_MeshArena.Dispose();
+	CVertexArrayCache::GetInstance()->Dispose();
+	CUniformBufferManager::GetInstance()->Dispose();
+	CGPUProfiler::GetInstance()->PrintReport();
+	CGPUProfiler::GetInstance()->Dispose();
+
+	const CProgramBinaryCache& theBinaryCache = CShaderManager::GetInstance()->GetBinaryCache();
+	if (theBinaryCache.IsEnabled())
+		printf("Program binary cache: %u hits, %u misses\n", theBinaryCache.GetHits(), theBinaryCache.GetMisses());
+	CShaderManager::SCacheStats theCacheStats;
+	CShaderManager::GetInstance()->GetCacheStats(theCacheStats);
+	printf("Loaded programs: %u (%u referenced), %.1f KB, %u stage objects, %u evicted, %u evictions, %u restores\n", theCacheStats.programCount
+		, theCacheStats.referencedCount, theCacheStats.byteCount / 1024.0, theCacheStats.stageCount, theCacheStats.evictedCount
+		, theCacheStats.evictionCount, theCacheStats.restoreCount);
+	printf("Uniform uploads: %u issued, %u skipped\n", CShader::GetIssuedUniformCount(), CShader::GetSkippedUniformCount());
+	printf("GL state changes last frame: %u issued, %u filtered\n", CGLStateCache::GetInstance()->GetFrameIssuedCount(), CGLStateCache::GetInstance()->GetFrameFilteredCount());
+
+	if (CShaderStats::IsEnabled())
+	{
+		CShaderStats::GetInstance()->WriteJSON(SHADER_STATS_FILE_NAME);
+		CShaderStats::GetInstance()->WriteTrace(SHADER_TRACE_FILE_NAME);
+	}
+
+	// the programs are deleted while the context is still current, it goes away last
+	CShaderManager::DestroyInstance();
+	if (g_Scene.isHeadless)
+		g_HeadlessContext.Destroy();
+	else
+		glfwTerminate();
     
     exit(returnCode);
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
 /* VERT */
 
+#ifdef INSTANCED
+// per-instance transform, read with an attribute divisor of 1
+attribute mat4 in_InstanceMatrix;
+#define ModelViewMatrix in_InstanceMatrix
+#else
 uniform mat4 ModelViewMatrix;
+#endif
 uniform mat4 ProjMatrix;
 
 attribute vec3 in_Position;
@@ -0,0 +1,32 @@
+/* VERT, multi-draw indirect variant of simple.vert */
+#version 430 compatibility
+#extension GL_ARB_shader_draw_parameters : require
+
+uniform mat4 ProjMatrix;
+
+// transforms of the draws of one glMultiDrawElementsIndirect, see CMultiDrawRenderer
+layout(std430, binding = 2) readonly buffer PerDrawData
+{
+    mat4 ModelViewMatrices[];
+};
+
+in vec3 in_Position;
+in vec2 in_TexCoord;
+in vec3 in_Normal;
+
+// output for fragment shader
+out vec2 out_TexCoord;
+out vec3 out_Normal;
+
+void main(void)
+{
+    mat4 ModelViewMatrix = ModelViewMatrices[gl_DrawIDARB];
+    mat4 MVPMatrix = ProjMatrix * ModelViewMatrix;
+    gl_Position = MVPMatrix * vec4(in_Position.x, in_Position.y, in_Position.z, 1.0);
+
+    out_TexCoord.x = in_TexCoord.x;
+    out_TexCoord.y = in_TexCoord.y;
+
+    out_Normal = (MVPMatrix * vec4(in_Normal.x, in_Normal.y, in_Normal.z, 0.0)).xyz;
+    out_Normal = normalize(out_Normal);
+}
@@ -0,0 +1,40 @@
+/* VERT, uniform buffer variant of simple.vert */
+#version 140
+
+// shared by every program, bound once per frame
+layout(std140) uniform PerFrame
+{
+    mat4 ProjMatrix;
+};
+
+#ifdef INSTANCED
+// per-instance transform, read with an attribute divisor of 1
+in mat4 in_InstanceMatrix;
+#define ModelViewMatrix in_InstanceMatrix
+#else
+// sub-allocated from the uniform ring buffer for every draw
+layout(std140) uniform PerDraw
+{
+    mat4 ModelViewMatrix;
+};
+#endif
+
+in vec3 in_Position;
+in vec2 in_TexCoord;
+in vec3 in_Normal;
+
+// output for fragment shader
+out vec2 out_TexCoord;
+out vec3 out_Normal;
+
+void main(void)
+{
+    mat4 MVPMatrix = ProjMatrix * ModelViewMatrix;
+    gl_Position = MVPMatrix * vec4(in_Position.x, in_Position.y, in_Position.z, 1.0);
+
+    out_TexCoord.x = in_TexCoord.x;
+    out_TexCoord.y = in_TexCoord.y;
+
+    out_Normal = (MVPMatrix * vec4(in_Normal.x, in_Normal.y, in_Normal.z, 0.0)).xyz;
+    out_Normal = normalize(out_Normal);
+}
@@ -0,0 +1,705 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * ShaderBenchmark - measures the CPU cost of the shader manager's hot paths
+ * against the stub GL implementation of tools/StubGL.cpp, without a GPU.
+ *
+ * Usage: ShaderBenchmark [-n <programs>] [-r <rounds>] [-c <compile us>] [-l <link us>] [-s <large source MB>] [-q <queued objects>] [-d <directory>] [-o <json file>] [--stats]
+ *
+ * Generates <programs> vertex shaders sharing one fragment shader in <directory>,
+ * then times registration, GetShader misses and hits (also from 1 up to one thread
+ * per core at once), source file reads (also
+ * of multi-megabyte sources, against the former line by line loader),
+ * uniform/attribute lookups, the sort and submission of a frame of
+ * <queued objects> through CRenderQueue, the same frame through CMultiDrawRenderer
+ * with and without multi-draw indirect, and the disposal of every program. Compiles and
+ * links spin for the given latencies to stand for the driver. Results are
+ * written as JSON, to stdout unless -o is given; --stats runs with
+ * CShaderStats recording, to measure the cost of its probes.
+ */
+
+#include "../ShaderManager.h"
+#include "../Shader.h"
+#include "../ShaderStats.h"
+#include "../SourceFile.h"
+#include "../Hash.h"
+#include "../RenderQueue.h"
+#include "../VertexLayout.h"
+#include "../MeshArena.h"
+#include "../MultiDrawRenderer.h"
+#include "StubGL.h"
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+/// Uniforms and attributes declared by every generated program
+static const char* const UNIFORM_NAMES[] = { "ProjMatrix", "ModelViewMatrix", "NormalMatrix", "Color", "Tint", "LightPosition", "LightColor"
+	, "Ambient", "Specular", "Shininess", "Time", "Scale", "Offset", "FogColor", "FogDensity", "Texture" };
+static const char* const ATTRIBUTE_NAMES[] = { "Position", "Normal", "TexCoord" };
+static const int UNIFORM_COUNT = sizeof(UNIFORM_NAMES) / sizeof(UNIFORM_NAMES[0]);
+static const int ATTRIBUTE_COUNT = sizeof(ATTRIBUTE_NAMES) / sizeof(ATTRIBUTE_NAMES[0]);
+
+/// Results of the lookups, so the compiler cannot drop them
+static volatile int s_Sink = 0;
+
+/// Number of multi-megabyte sources read by the load_source_large benchmarks
+static const int LARGE_SOURCE_COUNT = 4;
+
+/// Line length limit of the former line by line loader
+static const int MAX_LINE_LENGTH = 1024;
+
+/// Meshes and textures the queued objects are spread over
+static const int QUEUE_MESH_COUNT = 64;
+static const int QUEUE_TEXTURE_COUNT = 16;
+
+/// Vertex layout of the queued meshes, with the attributes of the generated programs
+static const SVertexAttribute QUEUE_ATTRIBUTES[] = {
+	{ "Position", 4, GL_FLOAT, false, 0 },
+	{ "Normal", 3, GL_FLOAT, false, 16 },
+	{ "TexCoord", 2, GL_FLOAT, false, 28 } };
+static const SVertexLayout QUEUE_LAYOUT = { QUEUE_ATTRIBUTES, 3, 36, 0 };
+
+/// Vertices and indices of each queued mesh in the multi-draw arena
+static const unsigned int QUEUE_MESH_VERTEX_COUNT = 24;
+static const unsigned int QUEUE_MESH_INDEX_COUNT = 36;
+
+/// Multi-draw programs the queued objects are spread over, each replacing many single-draw programs
+static const int MULTI_DRAW_SHADER_COUNT = 8;
+
+/// Exposes the eviction of loaded programs to the benchmark
+class CBenchShaderManager : public CShaderManager
+{
+public:
+	/// Constructor, each benchmark run owns its manager instead of the singleton
+	CBenchShaderManager() {}
+
+	/// Evict programs, their next GetShader loads them again into the same shaders
+	void EvictAll(const std::vector<TShaderHandle>& inHandles)
+	{
+		for (size_t i = 0; i < inHandles.size(); ++i)
+			EvictProgram(inHandles[i]);
+	}
+};
+
+/// A timed benchmark
+struct SResult
+{
+	std::string name;
+	uint64_t ops;
+	double seconds;
+	uint64_t glCalls;
+	uint64_t bytes;		// bytes processed, 0 if not relevant
+};
+
+/// Current time of a steady clock in seconds
+static double getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Write a file, return false if it cannot be written
+static bool writeFile(const std::string& inFileName, const std::string& inContent)
+{
+	FILE* pFile = fopen(inFileName.c_str(), "wb");
+	if (pFile == NULL) {
+		fprintf(stderr, "Cannot write file: %s\n", inFileName.c_str());
+		return false;
+	}
+	fwrite(inContent.c_str(), 1, inContent.length(), pFile);
+	fclose(pFile);
+	return true;
+}
+
+/// Generate the shared fragment shader and one vertex shader per program, each with its own source
+static bool generateSources(const std::string& inDirectory, int inCount, std::vector<std::string>& outVertFiles, std::string& outFragFile)
+{
+#ifdef _WIN32
+	_mkdir(inDirectory.c_str());
+#else
+	mkdir(inDirectory.c_str(), 0755);
+#endif
+
+	std::string theUniforms;
+	const char* const UNIFORM_TYPES[] = { "mat4", "mat4", "mat3", "vec4", "vec4", "vec3", "vec3", "vec3", "vec3", "float", "float", "vec2", "vec2", "vec3", "float", "sampler2D" };
+	for (int i = 0; i < UNIFORM_COUNT; ++i)
+		theUniforms += std::string("uniform ") + UNIFORM_TYPES[i] + " " + UNIFORM_NAMES[i] + ";\n";
+
+	outFragFile = inDirectory + "/bench.frag";
+	std::string theFrag = "#version 120\n" + theUniforms
+		+ "varying vec2 vTexCoord;\nvarying vec3 vNormal;\n"
+		  "void main()\n{\n"
+		  "\tvec3 theLight = LightColor * max(dot(normalize(vNormal), normalize(LightPosition)), 0.0) + Ambient;\n"
+		  "\tgl_FragColor = texture2D(Texture, vTexCoord) * Color * Tint * vec4(theLight, 1.0);\n}\n";
+	if (!writeFile(outFragFile, theFrag))
+		return false;
+
+	outVertFiles.resize(inCount);
+	for (int i = 0; i < inCount; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "/bench%05d.vert", i);
+		outVertFiles[i] = inDirectory + theName;
+
+		char theBody[256];
+		sprintf(theBody, "\tgl_Position = ProjMatrix * ModelViewMatrix * vec4(Position.xyz * Scale.x * %d.0 + vec3(Offset, Time), 1.0);\n", i + 1);
+		std::string theVert = "#version 120\n" + theUniforms
+			+ "attribute vec4 Position;\nattribute vec3 Normal;\nattribute vec2 TexCoord;\n"
+			  "varying vec2 vTexCoord;\nvarying vec3 vNormal;\n"
+			  "void main()\n{\n"
+			  "\tvTexCoord = TexCoord;\n"
+			  "\tvNormal = NormalMatrix * Normal;\n" + theBody + "}\n";
+		if (!writeFile(outVertFiles[i], theVert))
+			return false;
+	}
+	return true;
+}
+
+/// Generate sources of about inMegabytes each, a long run of short functions as in generated shader libraries
+static bool generateLargeSources(const std::string& inDirectory, int inMegabytes, std::vector<std::string>& outFiles)
+{
+	size_t theSize = (size_t)inMegabytes * 1024 * 1024;
+	std::string theSource = "#version 120\n";
+	theSource.reserve(theSize + 256);
+	for (int i = 0; theSource.length() < theSize; ++i)
+	{
+		char theFunction[256];
+		sprintf(theFunction, "vec4 Function%07d(vec4 inValue, float inScale)\n{\n\treturn inValue * inScale + vec4(%d.0, 0.5, 0.25, 1.0);\n}\n\n", i, i & 255);
+		theSource += theFunction;
+	}
+	theSource += "void main()\n{\n\tgl_Position = Function0000000(gl_Vertex, 1.0);\n}\n";
+
+	outFiles.resize(LARGE_SOURCE_COUNT);
+	for (int i = 0; i < LARGE_SOURCE_COUNT; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "/large%d.vert", i);
+		outFiles[i] = inDirectory + theName;
+		if (!writeFile(outFiles[i], theSource))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * The loader CSourceFile replaced: one fgets pass to count the lines, a second
+ * one to copy each line into its own allocation, then the lines are hashed as
+ * a load did. Kept as the baseline of the load_source_large benchmark, returns
+ * the bytes read or 0 on error.
+ */
+static size_t loadSourceLines(const std::string& inFileName)
+{
+	char line[MAX_LINE_LENGTH];
+	FILE* pFile = fopen(inFileName.c_str(), "r");
+	if (pFile == NULL)
+		return 0;
+
+	int lineCount = 0;
+	while (fgets(line, MAX_LINE_LENGTH, pFile) != NULL)
+		++lineCount;
+
+	rewind(pFile);
+	char** pSource = (char**)malloc(sizeof(char*) * lineCount);
+	size_t length = 0;
+	int i = 0;
+	while (i < lineCount && fgets(line, MAX_LINE_LENGTH, pFile) != NULL)
+	{
+		size_t lineLength = strlen(line);
+		pSource[i] = (char*)malloc(lineLength + 1);
+		memcpy(pSource[i], line, lineLength + 1);
+		length += lineLength;
+		++i;
+	}
+	fclose(pFile);
+
+	uint64_t theHash = HASH_SEED;
+	for (int line = 0; line < i; ++line)
+		theHash = HashBytes(pSource[line], strlen(pSource[line]), theHash);
+	s_Sink += (int)theHash;
+
+	for (int line = 0; line < i; ++line)
+		free(pSource[line]);
+	free(pSource);
+	return length;
+}
+
+/**
+ * Build the objects of a frame for the render queue: programs, meshes and textures
+ * are picked so that neighbours in submission order differ, and depths scatter
+ */
+static void buildQueueItems(const std::vector<CShader*>& inShaders, int inCount, std::vector<float>& outMatrices, std::vector<SRenderItem>& outItems)
+{
+	outMatrices.assign((size_t)inCount * 16, 0.0f);
+	outItems.resize(inCount);
+	for (int i = 0; i < inCount; ++i)
+	{
+		float* theMatrix = &outMatrices[(size_t)i * 16];
+		theMatrix[0] = theMatrix[5] = theMatrix[10] = theMatrix[15] = 1.0f;
+		theMatrix[12] = (float)(i % 1000);
+		theMatrix[13] = (float)(i / 1000);
+
+		unsigned int theMesh = (unsigned int)((i * 37) % QUEUE_MESH_COUNT);
+		SRenderItem& theItem = outItems[i];
+		theItem.shader = inShaders[(size_t)(i * 7919u) % inShaders.size()];
+		theItem.instancedShader = NULL;
+		theItem.layout = &QUEUE_LAYOUT;
+		theItem.vbo = 100000 + theMesh;
+		theItem.ibo = 200000 + theMesh;
+		theItem.firstIndex = 0;
+		theItem.indexCount = 36;
+		theItem.texture = 1 + (unsigned int)((i * 13) % QUEUE_TEXTURE_COUNT);
+		theItem.modelViewMatrix = theMatrix;
+		theItem.depth = (float)((i * 2654435761u) % 100000) * 0.01f;
+	}
+}
+
+/// Put the queued meshes into one arena, as the multi-draw renderer draws them
+static bool buildMeshArena(CMeshArena& outArena, std::vector<SArenaMesh>& outMeshes)
+{
+	if (!outArena.Initialize(&QUEUE_LAYOUT, QUEUE_MESH_COUNT * QUEUE_MESH_VERTEX_COUNT, QUEUE_MESH_COUNT * QUEUE_MESH_INDEX_COUNT))
+		return false;
+
+	std::vector<char> theVertices(QUEUE_MESH_VERTEX_COUNT * QUEUE_LAYOUT.stride, 0);
+	std::vector<unsigned int> theIndices(QUEUE_MESH_INDEX_COUNT);
+	for (unsigned int i = 0; i < QUEUE_MESH_INDEX_COUNT; ++i)
+		theIndices[i] = i % QUEUE_MESH_VERTEX_COUNT;
+
+	outMeshes.resize(QUEUE_MESH_COUNT);
+	for (int i = 0; i < QUEUE_MESH_COUNT; ++i)
+	{
+		if (!outArena.AddMesh(&theVertices[0], QUEUE_MESH_VERTEX_COUNT, &theIndices[0], QUEUE_MESH_INDEX_COUNT, outMeshes[i]))
+			return false;
+	}
+	return true;
+}
+
+/// The queued objects as multi-draw items, the objects of many single-draw programs share a multi-draw program
+static void buildMultiDrawItems(const std::vector<SRenderItem>& inQueueItems, const CMeshArena& inArena, const std::vector<SArenaMesh>& inMeshes
+	, const std::vector<CShader*>& inShaders, std::vector<SMultiDrawItem>& outItems)
+{
+	size_t theMultiDrawCount = std::min(inShaders.size(), (size_t)MULTI_DRAW_SHADER_COUNT);
+	outItems.resize(inQueueItems.size());
+	for (size_t i = 0; i < inQueueItems.size(); ++i)
+	{
+		const SRenderItem& theQueueItem = inQueueItems[i];
+		SMultiDrawItem& theItem = outItems[i];
+		theItem.shader = theQueueItem.shader;
+		theItem.multiDrawShader = inShaders[(i / QUEUE_TEXTURE_COUNT) % theMultiDrawCount];
+		theItem.arena = &inArena;
+		theItem.mesh = inMeshes[theQueueItem.vbo - 100000];
+		theItem.texture = theQueueItem.texture;
+		theItem.modelViewMatrix = theQueueItem.modelViewMatrix;
+	}
+}
+
+/// GetShader hits of every program, run by each of the threads of get_shader_hit_<n>t
+static void getShaderHits(CShaderManager* inManager, const std::vector<CShaderManager::TShaderHandle>* inHandles, int inRounds, std::atomic<int>* ioHitCount)
+{
+	int theHitCount = 0;
+	for (int r = 0; r < inRounds; ++r)
+	{
+		for (size_t i = 0; i < inHandles->size(); ++i)
+			theHitCount += (inManager->GetShader((*inHandles)[i]) != NULL);
+	}
+	ioHitCount->fetch_add(theHitCount, std::memory_order_relaxed);
+}
+
+/// Start a result, the GL call count is taken relative to now
+static SResult beginResult(const char* inName)
+{
+	SResult theResult;
+	theResult.name = inName;
+	theResult.ops = 0;
+	theResult.bytes = 0;
+	CStubGL::ResetCallCount();
+	theResult.seconds = getTime();
+	return theResult;
+}
+
+/// End a result
+static void endResult(SResult& ioResult, uint64_t inOps, std::vector<SResult>& ioResults)
+{
+	ioResult.seconds = getTime() - ioResult.seconds;
+	ioResult.glCalls = CStubGL::GetCallCount();
+	ioResult.ops = inOps;
+	ioResults.push_back(ioResult);
+	fprintf(stderr, "%-24s %10llu ops %10.3f ms %10.1f ns/op\n", ioResult.name.c_str(), (unsigned long long)inOps
+		, ioResult.seconds * 1000.0, (inOps != 0) ? ioResult.seconds * 1e9 / inOps : 0.0);
+}
+
+/// Write the configuration and the results as JSON
+static bool writeResults(FILE* pFile, int inCount, int inRounds, double inCompileLatency, double inLinkLatency, bool inIsStatsEnabled, const std::vector<SResult>& inResults)
+{
+	fprintf(pFile, "{\n  \"config\": { \"programs\": %d, \"rounds\": %d, \"compileUs\": %.1f, \"linkUs\": %.1f, \"stats\": %s },\n  \"results\": ["
+		, inCount, inRounds, inCompileLatency * 1e6, inLinkLatency * 1e6, inIsStatsEnabled ? "true" : "false");
+	for (size_t i = 0; i < inResults.size(); ++i)
+	{
+		const SResult& theResult = inResults[i];
+		double theOps = (theResult.ops != 0) ? (double)theResult.ops : 1.0;
+		fprintf(pFile, "%s\n    { \"name\": \"%s\", \"ops\": %llu, \"ms\": %.3f, \"nsPerOp\": %.2f, \"opsPerSec\": %.0f, \"glCallsPerOp\": %.2f"
+			, (i == 0) ? "" : ",", theResult.name.c_str(), (unsigned long long)theResult.ops, theResult.seconds * 1000.0
+			, theResult.seconds * 1e9 / theOps, (theResult.seconds > 0.0) ? theResult.ops / theResult.seconds : 0.0, theResult.glCalls / theOps);
+		if (theResult.bytes != 0)
+			fprintf(pFile, ", \"bytes\": %llu, \"mbPerSec\": %.1f", (unsigned long long)theResult.bytes
+				, (theResult.seconds > 0.0) ? theResult.bytes / theResult.seconds / (1024.0 * 1024.0) : 0.0);
+		fprintf(pFile, " }");
+	}
+	fprintf(pFile, "\n  ]\n}\n");
+	return true;
+}
+
+int main(int argc, const char* argv[])
+{
+	int theCount = 2000;
+	int theRounds = 100;
+	double theCompileLatency = 0.0;
+	double theLinkLatency = 0.0;
+	int theLargeSourceSize = 4;
+	int theQueueCount = 100000;
+	std::string theDirectory = "shaderbench";
+	std::string theOutput;
+	bool isStatsEnabled = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			theCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			theRounds = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			theCompileLatency = atof(argv[++i]) * 1e-6;
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			theLinkLatency = atof(argv[++i]) * 1e-6;
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			theLargeSourceSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc)
+			theQueueCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+			theDirectory = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			theOutput = argv[++i];
+		else if (strcmp(argv[i], "--stats") == 0)
+			isStatsEnabled = true;
+		else
+		{
+			fprintf(stderr, "Usage: %s [-n <programs>] [-r <rounds>] [-c <compile us>] [-l <link us>] [-s <large source MB>] [-q <queued objects>] [-d <directory>] [-o <json file>] [--stats]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (theCount <= 0 || theRounds <= 0 || theLargeSourceSize <= 0 || theQueueCount <= 0) {
+		fprintf(stderr, "The program, round and object counts and the source size must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> theVertFiles;
+	std::string theFragFile;
+	if (!generateSources(theDirectory, theCount, theVertFiles, theFragFile))
+		return EXIT_FAILURE;
+
+	std::vector<std::string> theLargeFiles;
+	if (!generateLargeSources(theDirectory, theLargeSourceSize, theLargeFiles))
+		return EXIT_FAILURE;
+
+	CStubGL::SetCompileLatency(theCompileLatency);
+	CStubGL::SetLinkLatency(theLinkLatency);
+	CShaderStats::SetEnabled(isStatsEnabled);
+
+	CBenchShaderManager* theManager = new CBenchShaderManager;
+	std::vector<CShaderManager::TShaderHandle> theHandles(theCount);
+	std::vector<CShader*> theShaders(theCount);
+	std::vector<SResult> theResults;
+
+	// registration interns the paths and indexes the program
+	SResult theResult = beginResult("register");
+	for (int i = 0; i < theCount; ++i)
+		theHandles[i] = theManager->RegisterProgram(theVertFiles[i].c_str(), theFragFile.c_str(), NULL);
+	endResult(theResult, theCount, theResults);
+
+	// first use: read, preprocess, compile (the fragment stage once), link, validate and reflect
+	theResult = beginResult("get_shader_miss");
+	for (int i = 0; i < theCount; ++i)
+		theShaders[i] = theManager->GetShader(theHandles[i]);
+	endResult(theResult, theCount, theResults);
+
+	for (int i = 0; i < theCount; ++i)
+	{
+		if (theShaders[i]->GetProgram() == 0) {
+			fprintf(stderr, "Failed to load program %s\n", theVertFiles[i].c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	theResult = beginResult("get_shader_hit");
+	for (int r = 0; r < theRounds; ++r)
+	{
+		for (int i = 0; i < theCount; ++i)
+			s_Sink += (theManager->GetShader(theHandles[i]) != NULL);
+	}
+	endResult(theResult, (uint64_t)theRounds * theCount, theResults);
+
+	// the same hits from 1, 2, 4... threads up to one per core, ops are the hits of all threads
+	unsigned int theCoreCount = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int theThreadCount = 1; ; theThreadCount = std::min(theThreadCount * 2, theCoreCount))
+	{
+		char theName[64];
+		sprintf(theName, "get_shader_hit_%ut", theThreadCount);
+		std::atomic<int> theHitCount(0);
+		std::vector<std::thread> theThreads;
+		theResult = beginResult(theName);
+		for (unsigned int t = 0; t < theThreadCount; ++t)
+			theThreads.push_back(std::thread(getShaderHits, theManager, &theHandles, theRounds, &theHitCount));
+		for (unsigned int t = 0; t < theThreadCount; ++t)
+			theThreads[t].join();
+		endResult(theResult, (uint64_t)theThreadCount * theRounds * theCount, theResults);
+		s_Sink += theHitCount.load(std::memory_order_relaxed);
+		if (theThreadCount == theCoreCount)
+			break;
+	}
+
+	theResult = beginResult("get_shader_async_hit");
+	for (int r = 0; r < theRounds; ++r)
+	{
+		for (int i = 0; i < theCount; ++i)
+			s_Sink += (theManager->GetShaderAsync(theHandles[i]) != NULL);
+	}
+	endResult(theResult, (uint64_t)theRounds * theCount, theResults);
+
+	// lookups by path hash the names and probe the program index
+	theResult = beginResult("get_shader_by_name_hit");
+	for (int r = 0; r < theRounds; ++r)
+	{
+		for (int i = 0; i < theCount; ++i)
+			s_Sink += (theManager->GetShader(theVertFiles[i].c_str(), theFragFile.c_str(), NULL) != NULL);
+	}
+	endResult(theResult, (uint64_t)theRounds * theCount, theResults);
+
+	// source files as read by a load, without the preprocessing
+	int theReadRounds = (theRounds >= 10) ? theRounds / 10 : 1;
+	theResult = beginResult("load_source");
+	uint64_t theBytes = 0;
+	for (int r = 0; r < theReadRounds; ++r)
+	{
+		for (int i = 0; i < theCount; ++i)
+		{
+			CSourceFile theSource;
+			if (theSource.Open(theVertFiles[i].c_str()))
+				theBytes += theSource.GetLength();
+		}
+	}
+	theResult.bytes = theBytes;
+	endResult(theResult, (uint64_t)theReadRounds * theCount, theResults);
+
+	// multi-megabyte sources: one read into a single buffer against two fgets passes and an allocation per line,
+	// both hashed as a load does so that every page is read
+	theResult = beginResult("load_source_large");
+	theBytes = 0;
+	for (int r = 0; r < theReadRounds; ++r)
+	{
+		for (int i = 0; i < LARGE_SOURCE_COUNT; ++i)
+		{
+			CSourceFile theSource;
+			if (theSource.Open(theLargeFiles[i].c_str())) {
+				s_Sink += (int)HashBytes(theSource.GetData(), theSource.GetLength());
+				theBytes += theSource.GetLength();
+			}
+		}
+	}
+	theResult.bytes = theBytes;
+	endResult(theResult, (uint64_t)theReadRounds * LARGE_SOURCE_COUNT, theResults);
+
+	theResult = beginResult("load_source_large_lines");
+	theBytes = 0;
+	for (int r = 0; r < theReadRounds; ++r)
+	{
+		for (int i = 0; i < LARGE_SOURCE_COUNT; ++i)
+			theBytes += loadSourceLines(theLargeFiles[i]);
+	}
+	theResult.bytes = theBytes;
+	endResult(theResult, (uint64_t)theReadRounds * LARGE_SOURCE_COUNT, theResults);
+
+	theResult = beginResult("get_uniform_index");
+	for (int r = 0; r < theRounds; ++r)
+	{
+		for (int i = 0; i < theCount; ++i)
+		{
+			for (int u = 0; u < UNIFORM_COUNT; ++u)
+				s_Sink += theShaders[i]->GetUniformIndex(UNIFORM_NAMES[u]);
+		}
+	}
+	endResult(theResult, (uint64_t)theRounds * theCount * UNIFORM_COUNT, theResults);
+
+	theResult = beginResult("get_uniform_index_inactive");
+	for (int r = 0; r < theRounds; ++r)
+	{
+		for (int i = 0; i < theCount; ++i)
+			s_Sink += theShaders[i]->GetUniformIndex("Undeclared");
+	}
+	endResult(theResult, (uint64_t)theRounds * theCount, theResults);
+
+	theResult = beginResult("get_attribute_index");
+	for (int r = 0; r < theRounds; ++r)
+	{
+		for (int i = 0; i < theCount; ++i)
+		{
+			for (int a = 0; a < ATTRIBUTE_COUNT; ++a)
+				s_Sink += theShaders[i]->GetAttributeIndex(ATTRIBUTE_NAMES[a]);
+		}
+	}
+	endResult(theResult, (uint64_t)theRounds * theCount * ATTRIBUTE_COUNT, theResults);
+
+	// a frame of objects through the render queue, ops are frames: submission and the
+	// radix sort alone, then the whole flush with its batching, state changes and draws
+	std::vector<float> theMatrices;
+	std::vector<SRenderItem> theItems;
+	buildQueueItems(theShaders, theQueueCount, theMatrices, theItems);
+	CRenderQueue theQueue;
+	theQueue.Reserve(theQueueCount);
+
+	theResult = beginResult("render_queue_sort");
+	for (int r = 0; r < theReadRounds; ++r)
+	{
+		for (int i = 0; i < theQueueCount; ++i)
+			theQueue.Submit(theItems[i]);
+		theQueue.Sort();
+		theQueue.Clear();
+	}
+	endResult(theResult, theReadRounds, theResults);
+
+	theResult = beginResult("render_queue_flush");
+	for (int r = 0; r < theReadRounds; ++r)
+	{
+		for (int i = 0; i < theQueueCount; ++i)
+			theQueue.Submit(theItems[i]);
+		theQueue.Flush();
+	}
+	endResult(theResult, theReadRounds, theResults);
+	s_Sink += theQueue.GetDrawCount();
+	theQueue.Dispose();
+
+	// the frame through the multi-draw renderer, one glMultiDrawElementsIndirect per multi-draw
+	// program and texture, against a draw per object where multi-draw indirect is not supported
+	CMeshArena theArena;
+	std::vector<SArenaMesh> theMeshes;
+	if (!buildMeshArena(theArena, theMeshes)) {
+		fprintf(stderr, "Cannot build the mesh arena\n");
+		return EXIT_FAILURE;
+	}
+	std::vector<SMultiDrawItem> theMultiDrawItems;
+	buildMultiDrawItems(theItems, theArena, theMeshes, theShaders, theMultiDrawItems);
+
+	std::set<std::pair<CShader*, unsigned int> > theGroups;
+	for (size_t i = 0; i < theMultiDrawItems.size(); ++i)
+		theGroups.insert(std::make_pair(theMultiDrawItems[i].multiDrawShader, theMultiDrawItems[i].texture));
+
+	GLEW_ARB_multi_draw_indirect = GLEW_ARB_shader_draw_parameters = GLEW_ARB_shader_storage_buffer_object = GLEW_ARB_buffer_storage = 1;
+	CMultiDrawRenderer theMultiDrawRenderer;
+	bool isMultiDraw = theMultiDrawRenderer.Initialize(theQueueCount, 3);
+	GLEW_ARB_multi_draw_indirect = GLEW_ARB_shader_draw_parameters = GLEW_ARB_shader_storage_buffer_object = GLEW_ARB_buffer_storage = 0;
+	if (!isMultiDraw) {
+		fprintf(stderr, "Cannot initialize the multi-draw renderer\n");
+		return EXIT_FAILURE;
+	}
+
+	theResult = beginResult("multi_draw");
+	for (int r = 0; r < theReadRounds; ++r)
+	{
+		for (int i = 0; i < theQueueCount; ++i)
+			theMultiDrawRenderer.Submit(theMultiDrawItems[i]);
+		theMultiDrawRenderer.Flush();
+	}
+	endResult(theResult, theReadRounds, theResults);
+	if (theMultiDrawRenderer.GetCallCount() != theGroups.size())
+		fprintf(stderr, "Issued %u multi-draws instead of %u\n", theMultiDrawRenderer.GetCallCount(), (unsigned int)theGroups.size());
+	theMultiDrawRenderer.Dispose();
+
+	// without Initialize() the renderer takes the fallback path
+	CMultiDrawRenderer theFallbackRenderer;
+	theResult = beginResult("multi_draw_fallback");
+	for (int r = 0; r < theReadRounds; ++r)
+	{
+		for (int i = 0; i < theQueueCount; ++i)
+			theFallbackRenderer.Submit(theMultiDrawItems[i]);
+		theFallbackRenderer.Flush();
+	}
+	endResult(theResult, theReadRounds, theResults);
+	s_Sink += theFallbackRenderer.GetCallCount();
+	theArena.Dispose();
+
+	// the last program using the shared fragment stage deletes it, the shaders stay allocated
+	theResult = beginResult("dispose");
+	theManager->EvictAll(theHandles);
+	endResult(theResult, theCount, theResults);
+
+	if (CStubGL::GetShaderCount() != 0 || CStubGL::GetProgramCount() != 0)
+		fprintf(stderr, "Leaked %u shaders and %u programs\n", CStubGL::GetShaderCount(), CStubGL::GetProgramCount());
+
+	// loads again after the eviction, the stage sources are read anew
+	theResult = beginResult("get_shader_reload");
+	for (int i = 0; i < theCount; ++i)
+		theShaders[i] = theManager->GetShader(theHandles[i]);
+	endResult(theResult, theCount, theResults);
+
+	// Update() over budget scans the programs and evicts the least recently used half
+	int theEvictCount = theCount - theCount / 2;
+	theManager->SetCacheBudget(theCount / 2, 0);
+	theResult = beginResult("evict_over_budget");
+	theManager->Update();
+	endResult(theResult, theEvictCount, theResults);
+
+	CShaderManager::SCacheStats theCacheStats;
+	theManager->GetCacheStats(theCacheStats);
+	if (theCacheStats.evictedCount != (unsigned int)theEvictCount)
+		fprintf(stderr, "Evicted %u programs instead of %d\n", theCacheStats.evictedCount, theEvictCount);
+
+	theResult = beginResult("destroy_manager");
+	delete theManager;
+	endResult(theResult, theCount, theResults);
+
+	if (theOutput.empty())
+		return writeResults(stdout, theCount, theRounds, theCompileLatency, theLinkLatency, isStatsEnabled, theResults) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	FILE* pFile = fopen(theOutput.c_str(), "w");
+	if (pFile == NULL) {
+		fprintf(stderr, "Cannot write file: %s\n", theOutput.c_str());
+		return EXIT_FAILURE;
+	}
+	writeResults(pFile, theCount, theRounds, theCompileLatency, theLinkLatency, isStatsEnabled, theResults);
+	fclose(pFile);
+	return EXIT_SUCCESS;
+}
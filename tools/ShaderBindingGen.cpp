@@ -0,0 +1,341 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * ShaderBindingGen - generates a C++ header with compile time IDs for the
+ * uniforms and attributes of GLSL programs.
+ *
+ * Usage: ShaderBindingGen -o <header> -p <ProgramName> <stage file>... [-p <ProgramName> <stage file>...]
+ *
+ * Each program becomes a struct S<ProgramName>Program with constexpr UNIF_/ATTR_
+ * IDs. CShader resolves the IDs to locations once after link (SetBindings),
+ * so draw code reads locations from a fixed array, and a misspelled name is a
+ * compile error instead of a -1 location at runtime.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+
+/// A program and the variables declared by its stages
+struct SProgram
+{
+	std::string name;
+	std::vector<std::string> files;
+	std::vector<std::string> uniforms;
+	std::vector<std::string> attributes;
+};
+
+/// Read a whole file, return false if it cannot be read
+static bool readFile(const std::string& inFileName, std::string& outContent)
+{
+	FILE* pFile = fopen(inFileName.c_str(), "rb");
+	if (pFile == NULL)
+		return false;
+
+	char theBuffer[4096];
+	size_t theLength;
+	while ((theLength = fread(theBuffer, 1, sizeof(theBuffer), pFile)) > 0)
+		outContent.append(theBuffer, theLength);
+	fclose(pFile);
+	return true;
+}
+
+/// Replace comments and preprocessor lines with spaces
+static void stripComments(std::string& ioSource)
+{
+	size_t i = 0;
+	bool isLineStart = true;
+	while (i < ioSource.size())
+	{
+		if (ioSource.compare(i, 2, "//") == 0 || (isLineStart && ioSource[i] == '#'))
+		{
+			while (i < ioSource.size() && ioSource[i] != '\n')
+				ioSource[i++] = ' ';
+		}
+		else if (ioSource.compare(i, 2, "/*") == 0)
+		{
+			size_t theEnd = ioSource.find("*/", i + 2);
+			theEnd = (theEnd == std::string::npos) ? ioSource.size() : theEnd + 2;
+			for (; i < theEnd; ++i)
+				if (ioSource[i] != '\n')
+					ioSource[i] = ' ';
+		}
+		else
+		{
+			if (ioSource[i] == '\n')
+				isLineStart = true;
+			else if (!isspace((unsigned char)ioSource[i]))
+				isLineStart = false;
+			++i;
+		}
+	}
+}
+
+/// Split a source into identifiers, numbers and single punctuation characters
+static void tokenize(const std::string& inSource, std::vector<std::string>& outTokens)
+{
+	size_t i = 0;
+	while (i < inSource.size())
+	{
+		unsigned char c = inSource[i];
+		if (isspace(c))
+			++i;
+		else if (isalnum(c) || c == '_')
+		{
+			size_t theStart = i;
+			while (i < inSource.size() && (isalnum((unsigned char)inSource[i]) || inSource[i] == '_'))
+				++i;
+			outTokens.push_back(inSource.substr(theStart, i - theStart));
+		}
+		else
+			outTokens.push_back(std::string(1, inSource[i++]));
+	}
+}
+
+/// Add a name once
+static void addUnique(std::vector<std::string>& ioNames, const std::string& inName)
+{
+	for (size_t i = 0; i < ioNames.size(); ++i)
+		if (ioNames[i] == inName)
+			return;
+	ioNames.push_back(inName);
+}
+
+/// Whether a token is a qualifier which can appear between the storage qualifier and the type
+static bool isQualifier(const std::string& inToken)
+{
+	static const char* QUALIFIERS[] = { "lowp", "mediump", "highp", "flat", "smooth", "noperspective", "centroid", "invariant", NULL };
+	for (int i = 0; QUALIFIERS[i] != NULL; ++i)
+		if (inToken == QUALIFIERS[i])
+			return true;
+	return false;
+}
+
+/**
+ * Collect the uniforms and attributes declared at global scope of a stage.
+ * Vertex stage inputs ("attribute" or "in") are the program's attributes.
+ */
+static bool parseStage(const std::string& inFileName, SProgram& ioProgram)
+{
+	std::string theSource;
+	if (!readFile(inFileName, theSource)) {
+		fprintf(stderr, "Cannot open file: %s\n", inFileName.c_str());
+		return false;
+	}
+
+	size_t theDot = inFileName.rfind('.');
+	bool isVertex = (theDot != std::string::npos && inFileName.compare(theDot, std::string::npos, ".vert") == 0);
+
+	stripComments(theSource);
+	std::vector<std::string> theTokens;
+	tokenize(theSource, theTokens);
+
+	int theDepth = 0;
+	bool isStatementStart = true;
+	for (size_t i = 0; i < theTokens.size(); ++i)
+	{
+		const std::string& theToken = theTokens[i];
+		if (theToken == "{")
+			++theDepth;
+		else if (theToken == "}")
+			--theDepth;
+
+		bool isDeclaration = isStatementStart && theDepth == 0;
+		isStatementStart = (theToken == ";" || theToken == "{" || theToken == "}");
+		if (!isDeclaration)
+			continue;
+
+		// skip a layout qualifier
+		size_t j = i;
+		if (theTokens[j] == "layout")
+		{
+			while (j < theTokens.size() && theTokens[j] != ")")
+				++j;
+			++j;
+		}
+		if (j >= theTokens.size())
+			break;
+
+		std::vector<std::string>* pNames = NULL;
+		if (theTokens[j] == "uniform")
+			pNames = &ioProgram.uniforms;
+		else if (isVertex && (theTokens[j] == "attribute" || theTokens[j] == "in"))
+			pNames = &ioProgram.attributes;
+		if (pNames == NULL)
+			continue;
+
+		// qualifiers, type, then a comma separated list of names
+		++j;
+		while (j < theTokens.size() && isQualifier(theTokens[j]))
+			++j;
+		if (j + 1 >= theTokens.size() || theTokens[j + 1] == "{")
+			continue; // uniform blocks are bound through their block, not by location
+
+		for (++j; j < theTokens.size() && theTokens[j] != ";"; ++j)
+		{
+			if (theTokens[j] == "[")
+			{
+				while (j < theTokens.size() && theTokens[j] != "]")
+					++j;
+			}
+			else if (isalpha((unsigned char)theTokens[j][0]) || theTokens[j][0] == '_')
+				addUnique(*pNames, theTokens[j]);
+		}
+		i = j - 1;
+	}
+
+	return true;
+}
+
+/// Convert a GLSL name to a constant name, e.g. in_TexCoord to IN_TEXCOORD
+static std::string toConstant(const std::string& inPrefix, const std::string& inName)
+{
+	std::string theResult = inPrefix;
+	for (size_t i = 0; i < inName.size(); ++i)
+		theResult += (char)toupper((unsigned char)inName[i]);
+	return theResult;
+}
+
+/// Write the IDs and their count of one variable kind
+static void writeVariables(FILE* pFile, const char* inComment, const char* inPrefix, const char* inCount, const std::vector<std::string>& inNames)
+{
+	fprintf(pFile, "\t/// %s\n", inComment);
+	for (size_t i = 0; i < inNames.size(); ++i)
+		fprintf(pFile, "\tstatic constexpr int %s = %d;\n", toConstant(inPrefix, inNames[i]).c_str(), (int)i);
+	fprintf(pFile, "\tstatic constexpr int %s = %d;\n", inCount, (int)inNames.size());
+	fprintf(pFile, "\tstatic_assert(%s <= CShader::MAX_BOUND_VARIABLES, \"too many bound variables\");\n\n", inCount);
+}
+
+static void writeNames(FILE* pFile, const char* inFunction, const std::vector<std::string>& inNames)
+{
+	fprintf(pFile, "\tstatic const char* const* %s()\n\t{\n", inFunction);
+	fprintf(pFile, "\t\tstatic const char* const theNames[] = { ");
+	for (size_t i = 0; i < inNames.size(); ++i)
+		fprintf(pFile, "\"%s\", ", inNames[i].c_str());
+	fprintf(pFile, "NULL };\n\t\treturn theNames;\n\t}\n\n");
+}
+
+/// Write the generated header
+static bool writeHeader(const std::string& inFileName, const std::vector<SProgram>& inPrograms)
+{
+	FILE* pFile = fopen(inFileName.c_str(), "wb");
+	if (pFile == NULL) {
+		fprintf(stderr, "Cannot open file: %s\n", inFileName.c_str());
+		return false;
+	}
+
+	// include guard from the file name, e.g. ShaderBindings.h to SHADER_BINDINGS_H
+	std::string theGuard;
+	for (size_t i = 0; i < inFileName.size(); ++i)
+	{
+		unsigned char c = inFileName[i];
+		if (c == '/' || c == '\\')
+			theGuard.clear();
+		else if (isalnum(c))
+		{
+			if (isupper(c) && i > 0 && islower((unsigned char)inFileName[i - 1]))
+				theGuard += '_';
+			theGuard += (char)toupper(c);
+		}
+		else
+			theGuard += '_';
+	}
+
+	fprintf(pFile, "// Generated by ShaderBindingGen, do not edit.\n\n");
+	fprintf(pFile, "#pragma once\n\n#ifndef %s\n#define %s\n\n#include \"Shader.h\"\n", theGuard.c_str(), theGuard.c_str());
+
+	for (size_t p = 0; p < inPrograms.size(); ++p)
+	{
+		const SProgram& theProgram = inPrograms[p];
+
+		fprintf(pFile, "\n/// Uniforms and attributes of");
+		for (size_t i = 0; i < theProgram.files.size(); ++i)
+			fprintf(pFile, " %s", theProgram.files[i].c_str());
+		fprintf(pFile, "\nstruct S%sProgram\n{\n", theProgram.name.c_str());
+
+		writeVariables(pFile, "Uniform IDs, indexes of the shader's bound uniforms", "UNIF_", "UNIFORM_COUNT", theProgram.uniforms);
+		writeVariables(pFile, "Attribute IDs, indexes of the shader's bound attributes", "ATTR_", "ATTRIBUTE_COUNT", theProgram.attributes);
+		writeNames(pFile, "GetUniformNames", theProgram.uniforms);
+		writeNames(pFile, "GetAttributeNames", theProgram.attributes);
+
+		fprintf(pFile, "\t/// Resolve the IDs of this program to the locations of a shader, once after link\n");
+		fprintf(pFile, "\tstatic inline void Bind(CShader* inShader)\n\t{\n");
+		fprintf(pFile, "\t\tinShader->SetBindings(GetUniformNames(), UNIFORM_COUNT, GetAttributeNames(), ATTRIBUTE_COUNT);\n\t}\n\n");
+		fprintf(pFile, "\t/// Get the location of a uniform/attribute of a bound shader\n");
+		fprintf(pFile, "\tstatic inline int UniformLocation(const CShader* inShader, int inUniform) { return inShader->GetBoundUniform(inUniform); }\n");
+		fprintf(pFile, "\tstatic inline int AttributeLocation(const CShader* inShader, int inAttribute) { return inShader->GetBoundAttribute(inAttribute); }\n\n");
+		fprintf(pFile, "\t/// Get the handle of a uniform of a bound shader, for CShader::SetUniform\n");
+		fprintf(pFile, "\tstatic inline int Handle(const CShader* inShader, int inUniform) { return inShader->GetBoundUniformHandle(inUniform); }\n");
+		fprintf(pFile, "};\n");
+	}
+
+	fprintf(pFile, "\n#endif\n");
+	fclose(pFile);
+	return true;
+}
+
+int main(int argc, const char* argv[])
+{
+	std::string theOutput;
+	std::vector<SProgram> thePrograms;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			theOutput = argv[++i];
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+		{
+			thePrograms.push_back(SProgram());
+			thePrograms.back().name = argv[++i];
+		}
+		else if (!thePrograms.empty())
+			thePrograms.back().files.push_back(argv[i]);
+		else
+		{
+			fprintf(stderr, "Stage file %s is given before any -p <ProgramName>\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (theOutput.empty() || thePrograms.empty()) {
+		fprintf(stderr, "Usage: %s -o <header> -p <ProgramName> <stage file>... [-p <ProgramName> <stage file>...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (size_t p = 0; p < thePrograms.size(); ++p)
+	{
+		for (size_t i = 0; i < thePrograms[p].files.size(); ++i)
+		{
+			if (!parseStage(thePrograms[p].files[i], thePrograms[p]))
+				return EXIT_FAILURE;
+		}
+	}
+
+	return writeHeader(theOutput, thePrograms) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
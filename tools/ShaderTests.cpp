@@ -0,0 +1,1678 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * ShaderTests - checks of the GL state cache, the vertex array cache, the shader manager and
+ * the program binary cache against the stub GL implementation of tools/StubGL.cpp, without a GPU.
+ *
+ * Usage: ShaderTests
+ *
+ * Each failed check is printed with its line, the exit code is non-zero if
+ * any check failed. The GL state cache is checked by the exact stream of
+ * calls it makes to GL, recorded by the stub.
+ */
+
+#include "../GLStateCache.h"
+#include "../RenderQueue.h"
+#include "../ShaderManager.h"
+#include "../ShaderPreprocessor.h"
+#include "../ShaderStats.h"
+#include "../ShaderWarmUp.h"
+#include "../SharedContext.h"
+#include "../Shader.h"
+#include "../UniformBufferManager.h"
+#include "../VertexArrayCache.h"
+#include "../VertexLayout.h"
+#include "StubGL.h"
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <new>
+
+/// Bytes per frame and frames in flight of the uniform ring test
+static const int UNIFORM_FRAME_SIZE = 512;
+static const int UNIFORM_FRAME_COUNT = 2;
+
+/// Programs and threads of the concurrent loading test
+static const int STRESS_PROGRAM_COUNT = 64;
+static const int STRESS_THREAD_COUNT = 4;
+static const int STRESS_WORKER_COUNT = 2;
+static const int STRESS_HIT_ROUNDS = 1000;
+
+/// Programs registered and lookups made by the program handle test
+static const int HANDLE_PROGRAM_COUNT = 1000;
+static const int HANDLE_LOOKUP_COUNT = 100;
+
+/// Programs of the stage sharing test
+static const int SHARE_PROGRAM_COUNT = 3;
+
+/// Reloads of the program the reload test looks up while another thread reads it
+static const int RELOAD_ROUNDS = 200;
+static const int RELOAD_LOOKUP_COUNT = 16;
+
+/// Programs of the include test including a file, one per GLSL version
+static const int INCLUDE_PROGRAM_COUNT = 2;
+
+/// Frame budget and compile time of the warm-up test, in seconds, and its frame limit
+static const double WARM_UP_BUDGET = 0.002;
+static const double WARM_UP_COMPILE_LATENCY = 0.005;
+static const int WARM_UP_MAX_FRAMES = 100;
+
+/// Programs of the eviction test, one over its budget
+static const int EVICT_PROGRAM_COUNT = 3;
+
+/// Binaries of the same program each thread of the binary cache test stores
+static const int BINARY_STORE_COUNT = 200;
+
+/// Worker contexts of the stub GL, which needs none
+class CStubContextFactory : public CSharedContextFactory
+{
+public:
+	virtual bool Create(int inCount) { return true; }
+	virtual void Destroy() {}
+	virtual bool MakeCurrent(int inIndex) { return true; }
+	virtual void ReleaseCurrent() {}
+};
+
+/// Exposes the constructor, each test owns its manager instead of the singleton
+class CTestShaderManager : public CShaderManager
+{
+public:
+	CTestShaderManager() {}
+
+	/// Get the name of a file by its #line source string number
+	std::string GetFileName(unsigned int inFile) const { return m_Preprocessor.GetFileName(inFile); }
+};
+
+/// What a thread requesting the programs found, checked once the threads are joined
+struct SStressResult
+{
+	std::vector<CShader*> shaders;
+	std::vector<unsigned int> programs;
+	std::vector<int> uniformIndices;
+	bool isSameOnHit;
+};
+
+/// Number of failed checks
+static int s_FailureCount = 0;
+
+/// Number of allocations made by new, for the checks of code which must not allocate
+static std::atomic<unsigned int> s_AllocationCount(0);
+
+/// Inlined into the callers, the malloc and free of the replacements would seem to pair with their new and delete
+#ifdef _MSC_VER
+#define TEST_NOINLINE __declspec(noinline)
+#else
+#define TEST_NOINLINE __attribute__((noinline))
+#endif
+
+TEST_NOINLINE void* operator new(size_t inSize)
+{
+	s_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* theMemory = malloc((inSize != 0) ? inSize : 1);
+	if (theMemory == NULL)
+		throw std::bad_alloc();
+	return theMemory;
+}
+
+TEST_NOINLINE void operator delete(void* inMemory) noexcept
+{
+	free(inMemory);
+}
+
+TEST_NOINLINE void operator delete(void* inMemory, size_t inSize) noexcept
+{
+	free(inMemory);
+}
+
+/// Check a condition, print it if it does not hold
+#define CHECK(inCondition) checkCondition((inCondition), #inCondition, __LINE__)
+
+static void checkCondition(bool inCondition, const char* inText, int inLine)
+{
+	if (inCondition)
+		return;
+	fprintf(stderr, "  line %d: CHECK(%s) failed\n", inLine, inText);
+	++s_FailureCount;
+}
+
+/// Compare calls with the expected ones
+static void compareCalls(const std::vector<std::string>& inCalls, const char* const* inExpected, size_t inCount, int inLine)
+{
+	bool isSame = (inCalls.size() == inCount);
+	for (size_t i = 0; isSame && i < inCount; ++i)
+		isSame = (inCalls[i] == inExpected[i]);
+	if (isSame)
+		return;
+
+	fprintf(stderr, "  line %d: unexpected GL calls\n    expected:\n", inLine);
+	for (size_t i = 0; i < inCount; ++i)
+		fprintf(stderr, "      %s\n", inExpected[i]);
+	fprintf(stderr, "    recorded:\n");
+	for (size_t i = 0; i < inCalls.size(); ++i)
+		fprintf(stderr, "      %s\n", inCalls[i].c_str());
+	++s_FailureCount;
+}
+
+/// Compare the calls recorded by the stub with the expected ones, and clear them
+static void checkCalls(const char* const* inExpected, size_t inCount, int inLine)
+{
+	std::vector<std::string> theCalls = CStubGL::GetRecordedCalls();
+	CStubGL::ClearRecordedCalls();
+	compareCalls(theCalls, inExpected, inCount, inLine);
+}
+
+/// Compare the program changes, texture binds and draws recorded by the stub with the expected ones, and clear them
+static void checkDrawCalls(const char* const* inExpected, size_t inCount, int inLine)
+{
+	std::vector<std::string> theCalls;
+	std::vector<std::string> theRecordedCalls = CStubGL::GetRecordedCalls();
+	CStubGL::ClearRecordedCalls();
+	for (size_t i = 0; i < theRecordedCalls.size(); ++i)
+	{
+		const std::string& theCall = theRecordedCalls[i];
+		if (theCall.compare(0, 12, "glUseProgram") == 0 || theCall.compare(0, 13, "glBindTexture") == 0 || theCall.compare(0, 6, "glDraw") == 0)
+			theCalls.push_back(theCall);
+	}
+	compareCalls(theCalls, inExpected, inCount, inLine);
+}
+
+#define CHECK_CALLS(inExpected) checkCalls(inExpected, sizeof(inExpected) / sizeof(inExpected[0]), __LINE__)
+#define CHECK_NO_CALLS() checkCalls(NULL, 0, __LINE__)
+
+/// Redundant binds and enables are dropped, the ones changing the state are issued once
+static void testStateCacheFiltersRedundantCalls()
+{
+	CGLStateCache* theCache = CGLStateCache::GetInstance();
+	theCache->Invalidate();
+	theCache->EndFrame();
+	CStubGL::SetRecording(true);
+
+	theCache->UseProgram(5);
+	theCache->UseProgram(5);
+	theCache->UseProgram(6);
+	const char* const PROGRAM_CALLS[] = { "glUseProgram(5)", "glUseProgram(6)" };
+	CHECK_CALLS(PROGRAM_CALLS);
+
+	// the element array binding belongs to the vertex array, the array buffer binding does not
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 3);
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 3);
+	theCache->BindVertexArray(7);
+	theCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 4);
+	theCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 4);
+	theCache->BindVertexArray(8);
+	theCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 4);
+	theCache->BindVertexArray(8);
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 3);
+	const char* const BUFFER_CALLS[] = { "glBindBuffer(GL_ARRAY_BUFFER, 3)", "glBindVertexArray(7)", "glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 4)"
+		, "glBindVertexArray(8)", "glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 4)" };
+	CHECK_CALLS(BUFFER_CALLS);
+
+	// a range bind also sets the generic binding, each binding point has its own range
+	theCache->BindBufferRange(GL_UNIFORM_BUFFER, 1, 9, 0, 256);
+	theCache->BindBufferRange(GL_UNIFORM_BUFFER, 1, 9, 0, 256);
+	theCache->BindBufferRange(GL_UNIFORM_BUFFER, 1, 9, 256, 256);
+	theCache->BindBuffer(GL_UNIFORM_BUFFER, 9);
+	theCache->BindBufferRange(GL_UNIFORM_BUFFER, 2, 9, 256, 256);
+	const char* const RANGE_CALLS[] = { "glBindBufferRange(GL_UNIFORM_BUFFER, 1, 9, 0, 256)", "glBindBufferRange(GL_UNIFORM_BUFFER, 1, 9, 256, 256)"
+		, "glBindBufferRange(GL_UNIFORM_BUFFER, 2, 9, 256, 256)" };
+	CHECK_CALLS(RANGE_CALLS);
+
+	// each target of a unit has its own binding, the unit is activated even if the binding is filtered
+	theCache->BindTexture(0, GL_TEXTURE_2D, 10);
+	theCache->BindTexture(0, GL_TEXTURE_2D, 10);
+	theCache->BindTexture(1, GL_TEXTURE_2D, 10);
+	theCache->BindTexture(0, GL_TEXTURE_2D, 10);
+	theCache->BindTexture(1, GL_TEXTURE_CUBE_MAP, 11);
+	theCache->BindTexture(0, GL_TEXTURE_2D, 12);
+	const char* const TEXTURE_CALLS[] = { "glActiveTexture(GL_TEXTURE0)", "glBindTexture(GL_TEXTURE_2D, 10)", "glActiveTexture(GL_TEXTURE1)"
+		, "glBindTexture(GL_TEXTURE_2D, 10)", "glActiveTexture(GL_TEXTURE0)", "glActiveTexture(GL_TEXTURE1)", "glBindTexture(GL_TEXTURE_CUBE_MAP, 11)"
+		, "glActiveTexture(GL_TEXTURE0)", "glBindTexture(GL_TEXTURE_2D, 12)" };
+	CHECK_CALLS(TEXTURE_CALLS);
+
+	// GL_TEXTURE_2D is enabled per unit, the one of the last bind even if it was filtered,
+	// capabilities without a shadow always pass through
+	theCache->SetEnabled(GL_DEPTH_TEST, true);
+	theCache->SetEnabled(GL_DEPTH_TEST, true);
+	theCache->SetEnabled(GL_DEPTH_TEST, false);
+	theCache->SetEnabled(GL_TEXTURE_2D, true);
+	theCache->SetEnabled(GL_TEXTURE_2D, true);
+	theCache->BindTexture(1, GL_TEXTURE_2D, 10);
+	theCache->SetEnabled(GL_TEXTURE_2D, true);
+	theCache->SetEnabled(GL_POLYGON_OFFSET_FILL, true);
+	theCache->SetEnabled(GL_POLYGON_OFFSET_FILL, true);
+	const char* const ENABLE_CALLS[] = { "glEnable(GL_DEPTH_TEST)", "glDisable(GL_DEPTH_TEST)", "glEnable(GL_TEXTURE_2D)", "glActiveTexture(GL_TEXTURE1)"
+		, "glEnable(GL_TEXTURE_2D)", "glEnable(GL_POLYGON_OFFSET_FILL)", "glEnable(GL_POLYGON_OFFSET_FILL)" };
+	CHECK_CALLS(ENABLE_CALLS);
+
+	// every GL call is counted as issued, every dropped one as filtered, including
+	// the activation of the unit already active for a bind
+	theCache->EndFrame();
+	CHECK(theCache->GetFrameIssuedCount() == 26);
+	CHECK(theCache->GetFrameFilteredCount() == 13);
+
+	CStubGL::SetRecording(false);
+}
+
+/// Deleted objects and Invalidate() make the next bind of a state issued again
+static void testStateCacheDeletesAndInvalidate()
+{
+	CGLStateCache* theCache = CGLStateCache::GetInstance();
+	theCache->Invalidate();
+	theCache->UseProgram(5);
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 3);
+	theCache->BindTexture(0, GL_TEXTURE_2D, 10);
+	theCache->BindVertexArray(7);
+	CStubGL::SetRecording(true);
+
+	// a deleted program in use stays in use, GL unbinds deleted buffers, textures and vertex arrays
+	theCache->OnDeleteProgram(5);
+	theCache->UseProgram(5);
+	theCache->OnDeleteBuffer(3);
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 0);
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 3);
+	theCache->OnDeleteTexture(10);
+	theCache->BindTexture(0, GL_TEXTURE_2D, 0);
+	theCache->OnDeleteVertexArray(7);
+	theCache->BindVertexArray(0);
+	const char* const DELETE_CALLS[] = { "glUseProgram(5)", "glBindBuffer(GL_ARRAY_BUFFER, 3)" };
+	CHECK_CALLS(DELETE_CALLS);
+
+	// after a state change behind the cache's back, nothing is assumed
+	theCache->Invalidate();
+	theCache->UseProgram(5);
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 3);
+	theCache->BindTexture(0, GL_TEXTURE_2D, 0);
+	theCache->BindVertexArray(0);
+	theCache->SetEnabled(GL_BLEND, false);
+	const char* const INVALIDATE_CALLS[] = { "glUseProgram(5)", "glBindBuffer(GL_ARRAY_BUFFER, 3)", "glActiveTexture(GL_TEXTURE0)"
+		, "glBindTexture(GL_TEXTURE_2D, 0)", "glBindVertexArray(0)", "glDisable(GL_BLEND)" };
+	CHECK_CALLS(INVALIDATE_CALLS);
+
+	theCache->UseProgram(5);
+	theCache->BindBuffer(GL_ARRAY_BUFFER, 3);
+	theCache->BindTexture(0, GL_TEXTURE_2D, 0);
+	theCache->BindVertexArray(0);
+	theCache->SetEnabled(GL_BLEND, false);
+	CHECK_NO_CALLS();
+
+	CStubGL::SetRecording(false);
+}
+
+/// Block data is written to the ring segment of the frame, a segment is reused once the fence of its last frame signaled
+static void testUniformRingWaitsFenceOnWrap()
+{
+	GLEW_ARB_uniform_buffer_object = 1;
+	GLEW_ARB_buffer_storage = 0;
+	CGLStateCache::GetInstance()->Invalidate();
+	CUniformBufferManager* theManager = CUniformBufferManager::GetInstance();
+	CHECK(theManager->Initialize(UNIFORM_FRAME_SIZE, UNIFORM_FRAME_COUNT));
+
+	// the stub names the objects in order, the fences follow the buffer
+	GLint theBuffer = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_BINDING, &theBuffer);
+	CStubGL::SetSyncTimeoutCount(1);
+	CStubGL::SetRecording(true);
+
+	// ranges start at the 256 byte alignment, a range past the segment is refused
+	static const unsigned char DATA[UNIFORM_FRAME_SIZE] = { 0 };
+	theManager->BeginFrame();
+	CHECK(theManager->BindBlockData(0, DATA, 64));
+	CHECK(theManager->BindBlockData(1, DATA, 200));
+	CHECK(!theManager->BindBlockData(2, DATA, 64));
+	theManager->EndFrame();
+	char theCalls[6][64];
+	sprintf(theCalls[0], "glBufferSubData(GL_UNIFORM_BUFFER, 0, 64)");
+	sprintf(theCalls[1], "glBindBufferRange(GL_UNIFORM_BUFFER, 0, %d, 0, 64)", theBuffer);
+	sprintf(theCalls[2], "glBufferSubData(GL_UNIFORM_BUFFER, 256, 200)");
+	sprintf(theCalls[3], "glBindBufferRange(GL_UNIFORM_BUFFER, 1, %d, 256, 200)", theBuffer);
+	sprintf(theCalls[4], "glFenceSync(%d)", theBuffer + 1);
+	const char* const FIRST_CALLS[] = { theCalls[0], theCalls[1], theCalls[2], theCalls[3], theCalls[4] };
+	CHECK_CALLS(FIRST_CALLS);
+
+	// the second frame has a segment of its own, nothing to wait for
+	theManager->BeginFrame();
+	CHECK(theManager->BindBlockData(0, DATA, 64));
+	theManager->EndFrame();
+	sprintf(theCalls[0], "glBufferSubData(GL_UNIFORM_BUFFER, 512, 64)");
+	sprintf(theCalls[1], "glBindBufferRange(GL_UNIFORM_BUFFER, 0, %d, 512, 64)", theBuffer);
+	sprintf(theCalls[2], "glFenceSync(%d)", theBuffer + 2);
+	const char* const SECOND_CALLS[] = { theCalls[0], theCalls[1], theCalls[2] };
+	CHECK_CALLS(SECOND_CALLS);
+
+	// the third frame wraps to the first segment, it waits for the first fence, flushing once
+	theManager->BeginFrame();
+	CHECK(theManager->BindBlockData(0, DATA, 64));
+	sprintf(theCalls[0], "glClientWaitSync(%d, %d)", theBuffer + 1, GL_SYNC_FLUSH_COMMANDS_BIT);
+	sprintf(theCalls[1], "glClientWaitSync(%d, 0)", theBuffer + 1);
+	sprintf(theCalls[2], "glDeleteSync(%d)", theBuffer + 1);
+	sprintf(theCalls[3], "glBufferSubData(GL_UNIFORM_BUFFER, 0, 64)");
+	sprintf(theCalls[4], "glBindBufferRange(GL_UNIFORM_BUFFER, 0, %d, 0, 64)", theBuffer);
+	const char* const WRAP_CALLS[] = { theCalls[0], theCalls[1], theCalls[2], theCalls[3], theCalls[4] };
+	CHECK_CALLS(WRAP_CALLS);
+
+	// the fences not waited for are deleted with the ring
+	theManager->EndFrame();
+	CStubGL::ClearRecordedCalls();
+	theManager->Dispose();
+	std::vector<std::string> theDisposeCalls = CStubGL::GetRecordedCalls();
+	sprintf(theCalls[0], "glDeleteSync(%d)", theBuffer + 3);
+	sprintf(theCalls[1], "glDeleteSync(%d)", theBuffer + 2);
+	CHECK(theDisposeCalls.size() >= 2 && theDisposeCalls[0] == theCalls[0] && theDisposeCalls[1] == theCalls[1]);
+	CStubGL::SetRecording(false);
+	CStubGL::SetSyncTimeoutCount(0);
+	GLEW_ARB_uniform_buffer_object = 0;
+}
+
+/// Link a stub program from the source of a vertex shader and reflect it into ioShader
+static void createShader(CShader& ioShader, const char* inVertexSource)
+{
+	GLuint theShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(theShader, 1, &inVertexSource, NULL);
+	glCompileShader(theShader);
+	GLuint theProgram = glCreateProgram();
+	glAttachShader(theProgram, theShader);
+	glLinkProgram(theProgram);
+	glDeleteShader(theShader);
+	ioShader.SetProgram(theProgram);
+	ioShader.Reflect();
+}
+
+/// A uniform set to the value it has is not uploaded again, the first value after a link always is
+static void testShaderSkipsRedundantUniforms()
+{
+	static const char* const SOURCE = "uniform vec4 Color;\nuniform sampler2D Texture;\nvoid main() {}\n";
+	CShader theShader;
+	createShader(theShader, SOURCE);
+	int theColor = theShader.GetUniformHandle("Color");
+	int theTexture = theShader.GetUniformHandle("Texture");
+	CHECK(theColor >= 0 && theTexture >= 0);
+	CShader::ResetUniformCounts();
+	CStubGL::SetRecording(true);
+
+	// zeros are uploaded too, the program may have initialized the uniforms to other values
+	static const float BLACK[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	static const float RED[] = { 1.0f, 0.0f, 0.0f, 1.0f };
+	theShader.SetUniform(theColor, BLACK);
+	theShader.SetUniform(theTexture, 0);
+	theShader.ApplyUniforms();
+	const char* const FIRST_CALLS[] = { "glUniform4fv(0, 1, 0 0 0 0)", "glUniform1iv(1, 1, 0)" };
+	CHECK_CALLS(FIRST_CALLS);
+
+	// the same values again are skipped, only the last of the values set before an upload is uploaded
+	theShader.SetUniform(theColor, BLACK);
+	theShader.SetUniform(theTexture, 0);
+	theShader.ApplyUniforms();
+	CHECK_NO_CALLS();
+	theShader.SetUniform(theColor, BLACK);
+	theShader.SetUniform(theTexture, 1);
+	theShader.SetUniform(theTexture, 2);
+	theShader.SetUniform(theColor, RED);
+	theShader.ApplyUniforms();
+	const char* const CHANGED_CALLS[] = { "glUniform1iv(1, 1, 2)", "glUniform4fv(0, 1, 1 0 0 1)" };
+	CHECK_CALLS(CHANGED_CALLS);
+	CHECK(CShader::GetSkippedUniformCount() == 3 && CShader::GetIssuedUniformCount() == 4);
+
+	// a program swapped in uploads its first values, even those the previous program had
+	CShader theStaged;
+	createShader(theStaged, SOURCE);
+	theShader.Swap(theStaged);
+	CStubGL::ClearRecordedCalls();
+	theShader.SetUniform(theColor, RED);
+	theShader.ApplyUniforms();
+	const char* const SWAPPED_CALLS[] = { "glUniform4fv(0, 1, 1 0 0 1)" };
+	CHECK_CALLS(SWAPPED_CALLS);
+
+	// invalid handles are ignored
+	theShader.SetUniform(-1, RED);
+	theShader.SetUniform(theShader.GetUniformCount(), RED);
+	theShader.ApplyUniforms();
+	CHECK_NO_CALLS();
+	CStubGL::SetRecording(false);
+	glDeleteProgram(theShader.GetProgram());
+	glDeleteProgram(theStaged.GetProgram());
+}
+
+/// Without VAOs a per-vertex attribute resets the divisor an earlier instanced draw left on its location
+static void testVertexArrayCacheResetsDivisors()
+{
+	static const SVertexAttribute VERTEX_ATTRIBUTES[] = { { "Position", 3, GL_FLOAT, false, 0 } };
+	static const SVertexLayout VERTEX_LAYOUT = { VERTEX_ATTRIBUTES, 1, 12, 0 };
+	static const SVertexAttribute INSTANCE_ATTRIBUTES[] = { { "in_Offset", 4, GL_FLOAT, false, 0 } };
+	static const SVertexLayout INSTANCE_LAYOUT = { INSTANCE_ATTRIBUTES, 1, 16, 1 };
+
+	GLEW_ARB_vertex_array_object = 0;
+	GLEW_ARB_instanced_arrays = 1;
+	CGLStateCache::GetInstance()->Invalidate();
+	CShader theInstancedShader;
+	createShader(theInstancedShader, "attribute vec3 Position;\nattribute vec4 in_Offset;\nvoid main() {}\n");
+	CShader theShader;
+	createShader(theShader, "attribute vec4 Color;\nattribute vec3 Position;\nvoid main() {}\n");
+	CVertexArrayCache* theCache = CVertexArrayCache::GetInstance();
+	CStubGL::SetRecording(true);
+
+	theCache->Bind(&theInstancedShader, &VERTEX_LAYOUT, 1, 2, &INSTANCE_LAYOUT, 3);
+	const char* const INSTANCED_CALLS[] = { "glBindBuffer(GL_ARRAY_BUFFER, 1)", "glEnableVertexAttribArray(0)", "glVertexAttribPointer(0, 3, 12, 0)"
+		, "glVertexAttribDivisor(0, 0)", "glBindBuffer(GL_ARRAY_BUFFER, 3)", "glEnableVertexAttribArray(1)", "glVertexAttribPointer(1, 4, 16, 0)"
+		, "glVertexAttribDivisor(1, 1)", "glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 2)" };
+	CHECK_CALLS(INSTANCED_CALLS);
+
+	// Position now is at location 1, which still has the divisor of in_Offset
+	theCache->Bind(&theShader, &VERTEX_LAYOUT, 1, 2);
+	const char* const VERTEX_CALLS[] = { "glBindBuffer(GL_ARRAY_BUFFER, 1)", "glEnableVertexAttribArray(1)", "glVertexAttribPointer(1, 3, 12, 0)"
+		, "glVertexAttribDivisor(1, 0)", "glDisableVertexAttribArray(0)" };
+	CHECK_CALLS(VERTEX_CALLS);
+
+	theCache->Unbind();
+	CStubGL::SetRecording(false);
+	theCache->Dispose();
+	glDeleteProgram(theInstancedShader.GetProgram());
+	glDeleteProgram(theShader.GetProgram());
+	GLEW_ARB_instanced_arrays = 0;
+}
+
+static void testVertexArrayCacheUnbindsEmptyShader()
+{
+	static const SVertexAttribute VERTEX_ATTRIBUTES[] = { { "Position", 3, GL_FLOAT, false, 0 } };
+	static const SVertexLayout VERTEX_LAYOUT = { VERTEX_ATTRIBUTES, 1, 12, 0 };
+
+	GLEW_ARB_vertex_array_object = 1;
+	CGLStateCache::GetInstance()->Invalidate();
+	CShader theShader;
+	createShader(theShader, "attribute vec3 Position;\nvoid main() {}\n");
+	CShader theEmptyShader;
+	CVertexArrayCache* theCache = CVertexArrayCache::GetInstance();
+	CStubGL::SetRecording(true);
+
+	theCache->Bind(&theShader, &VERTEX_LAYOUT, 1, 2);
+	CStubGL::ClearRecordedCalls();
+
+	// a shader without a program has no VAO, the last one must not stay bound
+	theCache->Bind(&theEmptyShader, &VERTEX_LAYOUT, 1, 2);
+	const char* const EMPTY_CALLS[] = { "glBindVertexArray(0)" };
+	CHECK_CALLS(EMPTY_CALLS);
+
+	theCache->Unbind();
+	CStubGL::SetRecording(false);
+	theCache->Dispose();
+	glDeleteProgram(theShader.GetProgram());
+	GLEW_ARB_vertex_array_object = 0;
+}
+
+/// Handles and locations come from the reflection tables, inactive names and elements are -1
+static void testShaderReflectionHandles()
+{
+	CShader theShader;
+	createShader(theShader, "uniform mat4 ProjMatrix;\nuniform vec4 Lights[4];\nuniform float Scale;\n"
+		"attribute vec3 Position;\nattribute vec2 TexCoord;\nvoid main() {}\n");
+	GLuint theProgram = theShader.GetProgram();
+	CHECK(theShader.GetUniformCount() == 3 && theShader.GetAttributeCount() == 2);
+
+	// the stub's locations follow the declarations, an array takes one per element
+	uint64_t theCallCount = CStubGL::GetCallCount();
+	int theProjMatrix = theShader.GetUniformHandle("ProjMatrix");
+	int theLights = theShader.GetUniformHandle("Lights");
+	int theScale = theShader.GetUniformHandle("Scale");
+	CHECK(theProjMatrix >= 0 && theLights >= 0 && theScale >= 0);
+	CHECK(theProjMatrix != theLights && theLights != theScale && theScale != theProjMatrix);
+	CHECK(theShader.GetUniformLocation(theProjMatrix) == 0);
+	CHECK(theShader.GetUniformLocation(theLights) == 1);
+	CHECK(theShader.GetUniformLocation(theScale) == 5);
+	CHECK(theShader.GetUniformHandle("Lights[0]") == theLights);
+	CHECK(theShader.GetAttributeLocation(theShader.GetAttributeHandle("TexCoord")) == 1);
+
+	// an array has one handle, its elements have their own locations
+	CHECK(theShader.GetUniformHandle("Lights[1]") == -1);
+	CHECK(theShader.GetUniformIndex("Lights[0]") == 1);
+	CHECK(theShader.GetUniformIndex("Lights[3]") == 4);
+	CHECK(theShader.GetUniformIndex("ProjMatrix[0]") == 0);
+
+	// inactive names, elements out of range, other tables and invalid handles
+	CHECK(theShader.GetUniformHandle("Missing") == -1);
+	CHECK(theShader.GetUniformHandle(NULL) == -1);
+	CHECK(theShader.GetAttributeHandle("ProjMatrix") == -1);
+	CHECK(theShader.GetUniformIndex("Lights[4]") == -1);
+	CHECK(theShader.GetUniformIndex("Scale[1]") == -1);
+	CHECK(theShader.GetUniformIndex("Missing[1]") == -1);
+	CHECK(theShader.GetUniformLocation(-1) == -1);
+	CHECK(theShader.GetUniformLocation(3) == -1);
+	CHECK(theShader.GetAttributeLocation(2) == -1);
+
+	// none of the lookups called the driver
+	CHECK(CStubGL::GetCallCount() == theCallCount);
+
+	// without a program every name is inactive
+	theShader.SetProgram(0);
+	theShader.Reflect();
+	CHECK(theShader.GetUniformCount() == 0 && theShader.GetAttributeCount() == 0);
+	CHECK(theShader.GetUniformHandle("Lights") == -1);
+	CHECK(theShader.GetUniformIndex("Lights[3]") == -1);
+
+	glDeleteProgram(theProgram);
+}
+
+/// Write a file of the concurrent loading test
+static bool writeFile(const std::string& inFileName, const std::string& inContent)
+{
+	FILE* pFile = fopen(inFileName.c_str(), "wb");
+	if (pFile == NULL) {
+		fprintf(stderr, "  cannot write file: %s\n", inFileName.c_str());
+		return false;
+	}
+	fwrite(inContent.c_str(), 1, inContent.length(), pFile);
+	fclose(pFile);
+	return true;
+}
+
+/// Register and request every program from another thread than the rendering one, in an order of its own
+static void requestShaders(CShaderManager* inManager, const std::vector<std::string>* inVertFiles, const std::string* inFragFile
+	, int inIndex, SStressResult* outResult, std::atomic<int>* ioDoneCount)
+{
+	size_t theCount = inVertFiles->size();
+	std::vector<CShaderManager::TShaderHandle> theHandles(theCount);
+	outResult->shaders.assign(theCount, (CShader*)NULL);
+	for (size_t n = 0; n < theCount; ++n)
+	{
+		size_t i = (n * 7 + inIndex * 13) % theCount;
+		theHandles[i] = inManager->RegisterProgram((*inVertFiles)[i].c_str(), inFragFile->c_str(), NULL);
+		outResult->shaders[i] = inManager->GetShaderAsync(theHandles[i]);
+	}
+
+	// the rendering thread publishes the programs, once a shader is not pending its program is set
+	outResult->programs.assign(theCount, 0);
+	outResult->uniformIndices.assign(theCount, -1);
+	for (size_t i = 0; i < theCount; ++i)
+	{
+		CShader* theShader = outResult->shaders[i];
+		while (theShader->IsPending());
+		outResult->programs[i] = theShader->GetProgram();
+		outResult->uniformIndices[i] = theShader->GetUniformIndex("ModelViewMatrix");
+	}
+
+	// hits are lock-free from any thread
+	outResult->isSameOnHit = true;
+	for (int r = 0; r < STRESS_HIT_ROUNDS; ++r)
+	{
+		for (size_t i = 0; i < theCount; ++i)
+			outResult->isSameOnHit = (inManager->GetShaderAsync(theHandles[i]) == outResult->shaders[i]) && outResult->isSameOnHit;
+	}
+	ioDoneCount->fetch_add(1, std::memory_order_release);
+}
+
+/// Draws are issued by program, texture, mesh and depth; consecutive ranges are merged, repeated ones instanced
+static void testRenderQueueSortsAndBatches()
+{
+	static const SVertexAttribute VERTEX_ATTRIBUTES[] = { { "Position", 3, GL_FLOAT, false, 0 } };
+	static const SVertexLayout VERTEX_LAYOUT = { VERTEX_ATTRIBUTES, 1, 12, 0 };
+	static const float IDENTITY[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	static const float TRANSLATION[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 1, 2, 3, 1 };
+
+	GLEW_ARB_vertex_array_object = 1;
+	GLEW_ARB_instanced_arrays = 1;
+	GLEW_ARB_draw_instanced = 1;
+	GLEW_ARB_base_instance = 1;
+	CShader theFirstShader, theInstancedShader, theSecondShader, theEmptyShader;
+	createShader(theFirstShader, "uniform mat4 ModelViewMatrix;\nattribute vec3 Position;\nvoid main() {}\n");
+	createShader(theSecondShader, "uniform mat4 ModelViewMatrix;\nattribute vec3 Position;\nvoid main() {}\n");
+	createShader(theInstancedShader, "attribute mat4 in_InstanceMatrix;\nattribute vec3 Position;\nvoid main() {}\n");
+	CGLStateCache::GetInstance()->Invalidate();
+	CStubGL::SetRecording(true);
+
+	// shader, instanced shader, layout, vbo, ibo, first index, index count, texture, transform, depth
+	const SRenderItem ITEMS[] = {
+		{ &theSecondShader, NULL, &VERTEX_LAYOUT, 1, 2, 0, 6, 7, IDENTITY, 1.0f },
+		{ &theFirstShader, NULL, &VERTEX_LAYOUT, 1, 2, 0, 6, 8, IDENTITY, 5.0f },
+		{ &theFirstShader, NULL, &VERTEX_LAYOUT, 1, 2, 6, 6, 7, IDENTITY, 2.0f },
+		{ &theFirstShader, &theInstancedShader, &VERTEX_LAYOUT, 1, 2, 12, 3, 9, TRANSLATION, 3.0f },
+		{ &theFirstShader, NULL, &VERTEX_LAYOUT, 1, 2, 0, 6, 7, IDENTITY, 1.0f },
+		{ &theFirstShader, NULL, &VERTEX_LAYOUT, 1, 2, 12, 6, 7, TRANSLATION, 3.0f },
+		{ &theFirstShader, &theInstancedShader, &VERTEX_LAYOUT, 1, 2, 12, 3, 9, IDENTITY, 1.0f },
+		{ &theEmptyShader, NULL, &VERTEX_LAYOUT, 1, 2, 0, 6, 7, IDENTITY, 1.0f },
+	};
+	CRenderQueue theQueue;
+	for (size_t i = 0; i < sizeof(ITEMS) / sizeof(ITEMS[0]); ++i)
+		theQueue.Submit(ITEMS[i]);
+	CHECK(theQueue.GetSubmittedCount() == 7);
+	theQueue.Flush();
+
+	// the nearer range of the first texture continues the nearest one, the farther one has another transform
+	char theCalls[11][64];
+	sprintf(theCalls[0], "glUseProgram(%u)", theFirstShader.GetProgram());
+	sprintf(theCalls[1], "glBindTexture(GL_TEXTURE_2D, 7)");
+	sprintf(theCalls[2], "glDrawElements(12, 0)");
+	sprintf(theCalls[3], "glDrawElements(6, 48)");
+	sprintf(theCalls[4], "glBindTexture(GL_TEXTURE_2D, 8)");
+	sprintf(theCalls[5], "glDrawElements(6, 0)");
+	sprintf(theCalls[6], "glUseProgram(%u)", theInstancedShader.GetProgram());
+	sprintf(theCalls[7], "glBindTexture(GL_TEXTURE_2D, 9)");
+	sprintf(theCalls[8], "glDrawElementsInstancedBaseInstance(3, 48, 2, 0)");
+	sprintf(theCalls[9], "glUseProgram(%u)", theSecondShader.GetProgram());
+	sprintf(theCalls[10], "glBindTexture(GL_TEXTURE_2D, 7)");
+	const char* const DRAW_CALLS[] = { theCalls[0], theCalls[1], theCalls[2], theCalls[3], theCalls[4], theCalls[5]
+		, theCalls[6], theCalls[7], theCalls[8], theCalls[9], theCalls[10], "glDrawElements(6, 0)" };
+	checkDrawCalls(DRAW_CALLS, sizeof(DRAW_CALLS) / sizeof(DRAW_CALLS[0]), __LINE__);
+	CHECK(theQueue.GetItemCount() == 7 && theQueue.GetDrawCount() == 5);
+	CHECK(theQueue.GetMergedCount() == 1 && theQueue.GetInstancedCount() == 1);
+	CHECK(theQueue.GetSubmittedCount() == 0);
+
+	CStubGL::SetRecording(false);
+	theQueue.Dispose();
+	CVertexArrayCache::GetInstance()->RemoveShader(&theFirstShader);
+	CVertexArrayCache::GetInstance()->RemoveShader(&theSecondShader);
+	CVertexArrayCache::GetInstance()->RemoveShader(&theInstancedShader);
+	glDeleteProgram(theFirstShader.GetProgram());
+	glDeleteProgram(theSecondShader.GetProgram());
+	glDeleteProgram(theInstancedShader.GetProgram());
+	GLEW_ARB_vertex_array_object = 0;
+	GLEW_ARB_instanced_arrays = 0;
+	GLEW_ARB_draw_instanced = 0;
+	GLEW_ARB_base_instance = 0;
+}
+
+/// Threads racing to register and load the same programs share one load of each, and see it complete
+static void testShaderManagerConcurrentLoads()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	std::string theFragFile = theDirectory + "/stress.frag";
+	bool isWritten = writeFile(theFragFile, "#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color;\n}\n");
+	std::vector<std::string> theVertFiles(STRESS_PROGRAM_COUNT);
+	for (int i = 0; i < STRESS_PROGRAM_COUNT; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "/stress%03d.vert", i);
+		theVertFiles[i] = theDirectory + theName;
+
+		char theSource[256];
+		sprintf(theSource, "#version 120\nuniform mat4 ModelViewMatrix;\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = ModelViewMatrix * Position * %d.0;\n}\n", i + 1);
+		isWritten = writeFile(theVertFiles[i], theSource) && isWritten;
+	}
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	unsigned int theProgramCount = CStubGL::GetProgramCount();
+	CTestShaderManager* theManager = new CTestShaderManager;
+	CStubContextFactory theContexts;
+	CHECK(theManager->StartWorkers(&theContexts, STRESS_WORKER_COUNT));
+
+	// the test thread is the rendering thread, it publishes the loads until the requests are served
+	std::atomic<int> theDoneCount(0);
+	std::vector<SStressResult> theResults(STRESS_THREAD_COUNT);
+	std::vector<std::thread> theThreads;
+	for (int t = 0; t < STRESS_THREAD_COUNT; ++t)
+		theThreads.push_back(std::thread(requestShaders, theManager, &theVertFiles, &theFragFile, t, &theResults[t], &theDoneCount));
+	while (theDoneCount.load(std::memory_order_acquire) < STRESS_THREAD_COUNT)
+	{
+		theManager->Update();
+		std::this_thread::yield();
+	}
+	for (int t = 0; t < STRESS_THREAD_COUNT; ++t)
+		theThreads[t].join();
+
+	for (int t = 0; t < STRESS_THREAD_COUNT; ++t)
+	{
+		const SStressResult& theResult = theResults[t];
+		CHECK(theResult.isSameOnHit);
+		for (int i = 0; i < STRESS_PROGRAM_COUNT; ++i)
+		{
+			CHECK(theResult.shaders[i] == theResults[0].shaders[i]);
+			CHECK(theResult.programs[i] != 0);
+			CHECK(theResult.uniformIndices[i] >= 0);
+		}
+	}
+
+	// one program object per program, loaded once whichever thread asked first
+	CShaderManager::SCacheStats theStats;
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.programCount == STRESS_PROGRAM_COUNT);
+	CHECK(CStubGL::GetProgramCount() == theProgramCount + STRESS_PROGRAM_COUNT);
+
+	delete theManager;
+	CHECK(CStubGL::GetProgramCount() == theProgramCount);
+	remove(theFragFile.c_str());
+	for (int i = 0; i < STRESS_PROGRAM_COUNT; ++i)
+		remove(theVertFiles[i].c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// Programs with the same stage source share one stage object, deleted with the last program using it
+static void testShaderManagerSharesStages()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	// the first and third vertex stages are the same source in two files
+	static const char* const VERT_SOURCES[] = {
+		"#version 120\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = Position;\n}\n",
+		"#version 120\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = Position * 2.0;\n}\n",
+		"#version 120\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = Position;\n}\n"
+	};
+	std::string theFragFile = theDirectory + "/share.frag";
+	bool isWritten = writeFile(theFragFile, "#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color;\n}\n");
+	std::string theVertFiles[SHARE_PROGRAM_COUNT];
+	for (int i = 0; i < SHARE_PROGRAM_COUNT; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "/share%d.vert", i);
+		theVertFiles[i] = theDirectory + theName;
+		isWritten = writeFile(theVertFiles[i], VERT_SOURCES[i]) && isWritten;
+	}
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	// one program loaded per frame, so they are evicted in order
+	unsigned int theShaderCount = CStubGL::GetShaderCount();
+	CTestShaderManager* theManager = new CTestShaderManager;
+	CShader* theShaders[SHARE_PROGRAM_COUNT];
+	for (int i = 0; i < SHARE_PROGRAM_COUNT; ++i)
+	{
+		theManager->Update();
+		theShaders[i] = theManager->GetShader(theVertFiles[i].c_str(), theFragFile.c_str(), NULL);
+		CHECK(theShaders[i]->GetProgram() != 0);
+	}
+	CHECK(theShaders[0]->GetFrag() == theShaders[1]->GetFrag() && theShaders[1]->GetFrag() == theShaders[2]->GetFrag());
+	CHECK(theShaders[0]->GetVert() == theShaders[2]->GetVert() && theShaders[0]->GetVert() != theShaders[1]->GetVert());
+	CShaderManager::SCacheStats theStats;
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.stageCount == 3 && CStubGL::GetShaderCount() == theShaderCount + 3);
+
+	// the stages of the first program are still used by the third one
+	theManager->SetCacheBudget(SHARE_PROGRAM_COUNT - 1, 0);
+	theManager->Update();
+	theManager->Update();
+	theManager->GetCacheStats(theStats);
+	CHECK(theShaders[0]->GetProgram() == 0 && theStats.stageCount == 3 && CStubGL::GetShaderCount() == theShaderCount + 3);
+
+	// the vertex stage of the second program is its own
+	theManager->SetCacheBudget(SHARE_PROGRAM_COUNT - 2, 0);
+	theManager->Update();
+	theManager->Update();
+	theManager->GetCacheStats(theStats);
+	CHECK(theShaders[1]->GetProgram() == 0 && theStats.stageCount == 2 && CStubGL::GetShaderCount() == theShaderCount + 2);
+
+	delete theManager;
+	CHECK(CStubGL::GetShaderCount() == theShaderCount);
+	remove(theFragFile.c_str());
+	for (int i = 0; i < SHARE_PROGRAM_COUNT; ++i)
+		remove(theVertFiles[i].c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// A program registered once keeps its handle as the tables grow, lookups of registered programs do not allocate
+static void testShaderManagerProgramHandles()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	std::string theVertFile = theDirectory + "/handle.vert";
+	std::string theFragFile = theDirectory + "/handle.frag";
+	bool isWritten = writeFile(theVertFile, "#version 120\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = Position;\n}\n");
+	isWritten = writeFile(theFragFile, "#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color;\n}\n") && isWritten;
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	CTestShaderManager* theManager = new CTestShaderManager;
+	CShaderManager::TShaderHandle theHandle = theManager->RegisterProgram(theVertFile.c_str(), theFragFile.c_str(), NULL);
+	CShader* theShader = theManager->GetShader(theHandle);
+	CHECK(theHandle != CShaderManager::DEFAULT_SHADER_HANDLE && theShader->GetProgram() != 0);
+
+	// the paths are compared one by one, not concatenated, and the defines are part of the key
+	CShaderManager::TShaderHandle theSplitHandles[] = {
+		theManager->RegisterProgram("shadertests/ab", "c", NULL),
+		theManager->RegisterProgram("shadertests/a", "bc", NULL),
+		theManager->RegisterProgram("shadertests/a", "b", "c"),
+		theManager->RegisterProgram("shadertests/a", "b", NULL, "#define c"),
+		theManager->RegisterProgram("shadertests/a", "b", NULL)
+	};
+	for (size_t i = 0; i < sizeof(theSplitHandles) / sizeof(theSplitHandles[0]); ++i)
+	{
+		CHECK(theSplitHandles[i] != CShaderManager::DEFAULT_SHADER_HANDLE && theSplitHandles[i] != theHandle);
+		for (size_t j = 0; j < i; ++j)
+			CHECK(theSplitHandles[i] != theSplitHandles[j]);
+	}
+	CHECK(theManager->RegisterProgram(NULL, "b", NULL) == CShaderManager::DEFAULT_SHADER_HANDLE);
+	CHECK(theManager->FindProgram("shadertests/a", "c", NULL) == CShaderManager::DEFAULT_SHADER_HANDLE);
+	CHECK(theManager->FindProgram("shadertests/a", "c", NULL) == CShaderManager::DEFAULT_SHADER_HANDLE);
+
+	// enough programs for the tables to grow several times, the first handles stay the same
+	std::vector<CShaderManager::TShaderHandle> theHandles(HANDLE_PROGRAM_COUNT);
+	for (int i = 0; i < HANDLE_PROGRAM_COUNT; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "shadertests/grow%04d.vert", i);
+		theHandles[i] = theManager->RegisterProgram(theName, theFragFile.c_str(), NULL);
+	}
+	bool isSame = (theManager->RegisterProgram(theVertFile.c_str(), theFragFile.c_str(), NULL) == theHandle);
+	for (int i = 0; i < HANDLE_PROGRAM_COUNT; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "shadertests/grow%04d.vert", i);
+		isSame = isSame && theManager->FindProgram(theName, theFragFile.c_str(), NULL) == theHandles[i]
+			&& theManager->RegisterProgram(theName, theFragFile.c_str(), NULL) == theHandles[i];
+	}
+	CHECK(isSame);
+	CHECK(theManager->FindProgram("shadertests/ab", "c", NULL) == theSplitHandles[0]);
+	CHECK(theManager->GetShader(theHandle) == theShader && theShader->GetProgram() != 0);
+
+	// resolving a loaded program, by handle or by its paths, allocates nothing
+	unsigned int theAllocationCount = s_AllocationCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < HANDLE_LOOKUP_COUNT; ++i)
+	{
+		isSame = isSame && theManager->GetShader(theHandle) == theShader
+			&& theManager->GetShader(theVertFile.c_str(), theFragFile.c_str(), NULL) == theShader
+			&& theManager->FindProgram(theVertFile.c_str(), theFragFile.c_str(), NULL) == theHandle;
+	}
+	CHECK(isSame);
+	CHECK(s_AllocationCount.load(std::memory_order_relaxed) == theAllocationCount);
+
+	delete theManager;
+	remove(theVertFile.c_str());
+	remove(theFragFile.c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// The includes of a stage are expanded once each, with #line directives numbering the lines of every file
+/// the way the stage's version has them, and invalidating a file returns the programs expanded from it
+static void testShaderPreprocessorIncludes()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	static const char* const LIGHT_SOURCE = "vec4 light(vec4 c)\n{\n\treturn c;\n}\n";
+	std::string theCommonFile = theDirectory + "/common.glsl";
+	std::string theLightFile = theDirectory + "/light.glsl";
+	bool isWritten = writeFile(theCommonFile, "#include \"light.glsl\"\nuniform vec4 Color;\n");
+	isWritten = writeFile(theLightFile, LIGHT_SOURCE) && isWritten;
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	// the stage includes light.glsl twice, directly and through common.glsl
+	static const unsigned int VERSIONS[] = { 120, 330 };
+	for (size_t i = 0; i < sizeof(VERSIONS) / sizeof(VERSIONS[0]); ++i)
+	{
+		CShaderPreprocessor thePreprocessor;
+		char theStage[256];
+		sprintf(theStage, "#version %u\n#include \"common.glsl\"\n#include \"light.glsl\"\nvoid main()\n{\n\tgl_FragColor = light(Color);\n}\n", VERSIONS[i]);
+		std::string theSource;
+		std::vector<unsigned int> theFiles;
+		CHECK(thePreprocessor.Expand("shadertests/include.frag", theStage, strlen(theStage), theSource, theFiles));
+		CHECK(theFiles.size() == 3);
+		if (theFiles.size() != 3)
+			continue;
+		CHECK(thePreprocessor.GetFileName(theFiles[0]) == "shadertests/include.frag");
+		CHECK(thePreprocessor.GetFileName(theFiles[1]) == theCommonFile && thePreprocessor.GetFileName(theFiles[2]) == theLightFile);
+
+		// before GLSL 3.30 a #line directive numbers itself, so it takes the number of the next line minus one
+		unsigned int theOffset = (VERSIONS[i] >= 330) ? 1 : 0;
+		char theExpected[512];
+		sprintf(theExpected, "#version %u\n#line %u %u\n#line %u %u\n#line %u %u\n%s#line %u %u\nuniform vec4 Color;\n#line %u %u\n#line %u %u\nvoid main()\n{\n\tgl_FragColor = light(Color);\n}\n",
+			VERSIONS[i], 1 + theOffset, theFiles[0], theOffset, theFiles[1], theOffset, theFiles[2], LIGHT_SOURCE,
+			1 + theOffset, theFiles[1], 2 + theOffset, theFiles[0], 3 + theOffset, theFiles[0]);
+		CHECK(theSource == theExpected);
+
+		// a stage without includes is passed through
+		std::vector<unsigned int> thePlainFiles;
+		CHECK(thePreprocessor.Expand("shadertests/plain.frag", theStage, strlen("#version 120\n"), theSource, thePlainFiles));
+		CHECK(theSource.empty() && thePlainFiles.size() == 1);
+
+		// only the program expanded from the file is returned, and the file is read again
+		thePreprocessor.AddDependent(theFiles, 7);
+		thePreprocessor.AddDependent(thePlainFiles, 8);
+		std::vector<unsigned int> thePrograms;
+		thePreprocessor.Invalidate(theLightFile.c_str(), thePrograms);
+		CHECK(thePrograms.size() == 1 && thePrograms[0] == 7);
+		thePreprocessor.Invalidate("shadertests/missing.glsl", thePrograms);
+		CHECK(thePrograms.empty());
+		writeFile(theLightFile, "vec4 light(vec4 c) { return c * 0.5; }\n");
+		CHECK(thePreprocessor.Expand("shadertests/include.frag", theStage, strlen(theStage), theSource, theFiles));
+		CHECK(theSource.find("c * 0.5") != std::string::npos);
+		writeFile(theLightFile, LIGHT_SOURCE);
+	}
+
+	remove(theCommonFile.c_str());
+	remove(theLightFile.c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// A variant defines its features after the #version line of the stages mentioning them, shares the other stages,
+/// keeps the line numbers of the compile log, and is registered once per set of features
+static void testShaderManagerVariantDefines()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	// the vertex stage mentions SKINNED, the fragment stage FOG, and the error stages SKINNED on their fourth line
+	static const char* const VERT_SOURCE = "#version 120\nattribute vec4 Position;\nvoid main()\n{\n#ifdef SKINNED\n\tgl_Position = Position * 2.0;\n#else\n\tgl_Position = Position;\n#endif\n}\n";
+	static const char* const FRAG_SOURCE = "#version 120\nuniform vec4 Color;\nvoid main()\n{\n#ifdef FOG\n\tgl_FragColor = Color * 0.5;\n#else\n\tgl_FragColor = Color;\n#endif\n}\n";
+	static const char* const ERROR_SOURCES[] = {
+		"#version 120\nattribute vec4 Position;\n#ifdef SKINNED\n#error\n#endif\nvoid main()\n{\n\tgl_Position = Position;\n}\n",
+		"#version 330\nin vec4 Position;\n#ifdef SKINNED\n#error\n#endif\nvoid main()\n{\n\tgl_Position = Position;\n}\n"
+	};
+	std::string theVertFile = theDirectory + "/variant.vert";
+	std::string theFragFile = theDirectory + "/variant.frag";
+	std::string theErrorFiles[] = { theDirectory + "/variant_error120.vert", theDirectory + "/variant_error330.vert" };
+	bool isWritten = writeFile(theVertFile, VERT_SOURCE);
+	isWritten = writeFile(theFragFile, FRAG_SOURCE) && isWritten;
+	for (int i = 0; i < 2; ++i)
+		isWritten = writeFile(theErrorFiles[i], ERROR_SOURCES[i]) && isWritten;
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	CTestShaderManager* theManager = new CTestShaderManager;
+	CShaderManager::TVariantMask theSkinned = theManager->RegisterFeature("SKINNED");
+	CShaderManager::TVariantMask theFog = theManager->RegisterFeature("FOG");
+	CShaderManager::TVariantMask theUnused = theManager->RegisterFeature("NORMAL_MAP");
+	CHECK(theSkinned != 0 && theFog != 0 && theUnused != 0 && theSkinned != theFog && theFog != theUnused && theSkinned != theUnused);
+	CHECK(theManager->RegisterFeature("SKINNED") == theSkinned);
+
+	// one handle per set of features, the same one on each request
+	CShaderManager::TShaderHandle theBase = theManager->RegisterProgram(theVertFile.c_str(), theFragFile.c_str(), NULL);
+	CShaderManager::TShaderHandle theHandles[] = {
+		theBase,
+		theManager->GetVariant(theBase, theSkinned),
+		theManager->GetVariant(theBase, theFog),
+		theManager->GetVariant(theBase, theSkinned | theFog),
+		theManager->GetVariant(theBase, theUnused)
+	};
+	const int theVariantCount = sizeof(theHandles) / sizeof(theHandles[0]);
+	for (int i = 0; i < theVariantCount; ++i)
+	{
+		CHECK(theHandles[i] != CShaderManager::DEFAULT_SHADER_HANDLE);
+		for (int j = 0; j < i; ++j)
+			CHECK(theHandles[i] != theHandles[j]);
+	}
+	CHECK(theManager->GetVariant(theBase, 0) == theBase);
+	CHECK(theManager->GetVariant(theBase, theSkinned | theFog) == theHandles[3]);
+	CHECK(theManager->GetVariant(theHandles[1], theFog) == theHandles[3]);
+
+	// the variants are compiled on first use, the warm-up queues them, one Update() issues and the next finishes them
+	CShaderManager::SCacheStats theStats;
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.programCount == 0);
+	CShaderManager::SVariant theWarmUp[] = { { theBase, theSkinned }, { theBase, theFog } };
+	theManager->WarmUp(theWarmUp, 2);
+	CShader* theWarmShaders[] = { theManager->GetShaderAsync(theHandles[1]), theManager->GetShaderAsync(theHandles[2]) };
+	CHECK(theWarmShaders[0]->IsPending() && theWarmShaders[1]->IsPending());
+	theManager->Update();
+	theManager->Update();
+	CHECK(!theWarmShaders[0]->IsPending() && theWarmShaders[0]->GetProgram() != 0);
+	CHECK(!theWarmShaders[1]->IsPending() && theWarmShaders[1]->GetProgram() != 0);
+
+	CShader* theShaders[theVariantCount];
+	for (int i = 0; i < theVariantCount; ++i)
+	{
+		theShaders[i] = theManager->GetShader(theHandles[i]);
+		CHECK(theShaders[i]->GetProgram() != 0);
+	}
+	CHECK(theShaders[1] == theWarmShaders[0] && theShaders[2] == theWarmShaders[1]);
+
+	// a stage is only compiled again with the features it mentions
+	CHECK(theShaders[0]->GetVert() == theShaders[2]->GetVert() && theShaders[0]->GetVert() == theShaders[4]->GetVert());
+	CHECK(theShaders[1]->GetVert() == theShaders[3]->GetVert() && theShaders[0]->GetVert() != theShaders[1]->GetVert());
+	CHECK(theShaders[0]->GetFrag() == theShaders[1]->GetFrag() && theShaders[0]->GetFrag() == theShaders[4]->GetFrag());
+	CHECK(theShaders[2]->GetFrag() == theShaders[3]->GetFrag() && theShaders[0]->GetFrag() != theShaders[2]->GetFrag());
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.programCount == theVariantCount && theStats.stageCount == 4);
+
+	// the defines go after the #version line, then a #line directive numbering the next line 2
+	std::string theVersion = "#version 120\n";
+	CHECK(CStubGL::GetShaderSource(theShaders[0]->GetVert()) == VERT_SOURCE);
+	CHECK(CStubGL::GetShaderSource(theShaders[0]->GetFrag()) == FRAG_SOURCE);
+	CHECK(CStubGL::GetShaderSource(theShaders[1]->GetVert()) == theVersion + "#define SKINNED\n#line 1 0\n" + (VERT_SOURCE + theVersion.length()));
+	CHECK(CStubGL::GetShaderSource(theShaders[3]->GetFrag()) == theVersion + "#define FOG\n#line 1 0\n" + (FRAG_SOURCE + theVersion.length()));
+
+	// the error is on the fourth line of the file with or without the defines, before and since GLSL 3.30
+	for (int i = 0; i < 2; ++i)
+	{
+		CShaderManager::TShaderHandle theErrorHandle = theManager->RegisterProgram(theErrorFiles[i].c_str(), theFragFile.c_str(), NULL);
+		CHECK(theManager->GetShader(theErrorHandle)->GetProgram() == 0);
+		CHECK(CStubGL::GetLastCompileLog() == "0:4(1): error: #error\n");
+		CHECK(theManager->GetShader(theManager->GetVariant(theErrorHandle, theSkinned))->GetProgram() == 0);
+		CHECK(CStubGL::GetLastCompileLog() == "0:4(1): error: #error\n");
+	}
+
+	delete theManager;
+	remove(theVertFile.c_str());
+	remove(theFragFile.c_str());
+	for (int i = 0; i < 2; ++i)
+		remove(theErrorFiles[i].c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// Check that the last failed compile reported a line of a file
+static void checkCompileLog(CTestShaderManager* inManager, const std::string& inFileName, unsigned int inLine, int inCallerLine)
+{
+	unsigned int theFile = 0;
+	unsigned int theLine = 0;
+	std::string theLog = CStubGL::GetLastCompileLog();
+	bool isFound = (sscanf(theLog.c_str(), "%u:%u(1)", &theFile, &theLine) == 2);
+	std::string theText = "compile log " + theLog.substr(0, theLog.find('\n')) + " of " + inFileName;
+	checkCondition(isFound && inManager->GetFileName(theFile) == inFileName && theLine == inLine, theText.c_str(), inCallerLine);
+}
+
+/// A compile error of an included file or of the stage after an include is reported on its line of its file,
+/// and a changed file reloads only the programs built from it
+static void testShaderManagerIncludeReload()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	// the stages include their file on line 3, the broken include has its error on line 2 and the broken stage on line 4
+	static const char* const INCLUDE_SOURCE = "vec4 light(vec4 c)\n{\n\treturn c;\n}\n";
+	static const char* const BROKEN_INCLUDE_SOURCE = "vec4 light(vec4 c)\n#error\n{\n\treturn c;\n}\n";
+	static const unsigned int VERSIONS[INCLUDE_PROGRAM_COUNT] = { 120, 330 };
+	std::string theVertFile = theDirectory + "/include.vert";
+	std::string thePlainFile = theDirectory + "/plain.frag";
+	bool isWritten = writeFile(theVertFile, "#version 120\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = Position;\n}\n");
+	isWritten = writeFile(thePlainFile, "#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color;\n}\n") && isWritten;
+	std::string theStageFiles[INCLUDE_PROGRAM_COUNT];
+	std::string theIncludeFiles[INCLUDE_PROGRAM_COUNT];
+	std::string theStageSources[INCLUDE_PROGRAM_COUNT];
+	std::string theBrokenStageSources[INCLUDE_PROGRAM_COUNT];
+	for (int i = 0; i < INCLUDE_PROGRAM_COUNT; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "light%u.glsl", VERSIONS[i]);
+		theIncludeFiles[i] = theDirectory + "/" + theName;
+		char theHead[128];
+		sprintf(theHead, "#version %u\nuniform vec4 Color;\n#include \"%s\"\n", VERSIONS[i], theName);
+		theStageSources[i] = std::string(theHead) + "void main()\n{\n\tgl_FragColor = light(Color);\n}\n";
+		theBrokenStageSources[i] = std::string(theHead) + "#error\nvoid main()\n{\n\tgl_FragColor = light(Color);\n}\n";
+		sprintf(theName, "/include%u.frag", VERSIONS[i]);
+		theStageFiles[i] = theDirectory + theName;
+		isWritten = writeFile(theIncludeFiles[i], INCLUDE_SOURCE) && writeFile(theStageFiles[i], theStageSources[i]) && isWritten;
+	}
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	// the last program includes nothing
+	CTestShaderManager* theManager = new CTestShaderManager;
+	CShader* theShaders[INCLUDE_PROGRAM_COUNT + 1];
+	unsigned int thePrograms[INCLUDE_PROGRAM_COUNT + 1];
+	for (int i = 0; i <= INCLUDE_PROGRAM_COUNT; ++i)
+	{
+		const std::string& theFragFile = (i < INCLUDE_PROGRAM_COUNT) ? theStageFiles[i] : thePlainFile;
+		theShaders[i] = theManager->GetShader(theVertFile.c_str(), theFragFile.c_str(), NULL);
+		thePrograms[i] = theShaders[i]->GetProgram();
+		CHECK(thePrograms[i] != 0);
+	}
+
+	for (int i = 0; i < INCLUDE_PROGRAM_COUNT; ++i)
+	{
+		// a broken include fails the reload of the program including it, which keeps its program,
+		// a program reloaded without depending on the include would have linked a new one
+		writeFile(theIncludeFiles[i], BROKEN_INCLUDE_SOURCE);
+		theManager->InvalidateFile(theIncludeFiles[i].c_str());
+		theManager->Update();
+		theManager->Update();
+		for (int j = 0; j <= INCLUDE_PROGRAM_COUNT; ++j)
+			CHECK(theShaders[j]->GetProgram() == thePrograms[j]);
+		checkCompileLog(theManager, theIncludeFiles[i], 2, __LINE__);
+
+		// the stage, read again by each load, is numbered again after the include
+		writeFile(theIncludeFiles[i], INCLUDE_SOURCE);
+		writeFile(theStageFiles[i], theBrokenStageSources[i]);
+		theManager->InvalidateFile(theIncludeFiles[i].c_str());
+		theManager->Update();
+		theManager->Update();
+		for (int j = 0; j <= INCLUDE_PROGRAM_COUNT; ++j)
+			CHECK(theShaders[j]->GetProgram() == thePrograms[j]);
+		checkCompileLog(theManager, theStageFiles[i], 4, __LINE__);
+
+		// once fixed, the reload swaps in a new program
+		writeFile(theStageFiles[i], theStageSources[i]);
+		theManager->InvalidateFile(theStageFiles[i].c_str());
+		theManager->Update();
+		theManager->Update();
+		for (int j = 0; j <= INCLUDE_PROGRAM_COUNT; ++j)
+			CHECK((theShaders[j]->GetProgram() != thePrograms[j]) == (j == i) && theShaders[j]->GetProgram() != 0);
+		thePrograms[i] = theShaders[i]->GetProgram();
+	}
+
+	delete theManager;
+	remove(theVertFile.c_str());
+	remove(thePlainFile.c_str());
+	for (int i = 0; i < INCLUDE_PROGRAM_COUNT; ++i)
+	{
+		remove(theStageFiles[i].c_str());
+		remove(theIncludeFiles[i].c_str());
+	}
+	rmdir(theDirectory.c_str());
+}
+
+/// Every GetShader of a program which failed to load returns the default shader, not the program's empty one
+static void testShaderManagerFailedLoadIsDefault()
+{
+	CTestShaderManager* theManager = new CTestShaderManager;
+	CShader* theDefault = theManager->GetShader(CShaderManager::DEFAULT_SHADER_HANDLE);
+	CHECK(theDefault != NULL && theDefault->GetProgram() == 0);
+
+	CShaderManager::TShaderHandle theHandle = theManager->RegisterProgram("shadertests/missing.vert", "shadertests/missing.frag", NULL);
+	CHECK(theManager->GetShader(theHandle) == theDefault);
+	CHECK(theManager->GetShader(theHandle) == theDefault);
+	CHECK(theManager->GetShader("shadertests/missing.vert", "shadertests/missing.frag", NULL) == theDefault);
+
+	// a failed asynchronous load too, once it is no longer pending
+	CShaderManager::TShaderHandle theAsyncHandle = theManager->RegisterProgram("shadertests/missing_async.vert", "shadertests/missing.frag", NULL);
+	CShader* theShader = theManager->GetShaderAsync(theAsyncHandle);
+	CHECK(theShader != theDefault && theShader->IsPending());
+	theManager->Update();
+	CHECK(!theShader->IsPending());
+	CHECK(theManager->GetShader(theAsyncHandle) == theDefault);
+
+	delete theManager;
+}
+
+/// The warm-up reads a manifest into programs and variants, and steps them one load step at a time
+/// until the frame's budget is spent, at least one step per frame
+static void testShaderWarmUpStepsWithinBudget()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	// the second program line is a variant, the third repeats the first and the fourth misses its fragment stage
+	std::string theVertFiles[] = { theDirectory + "/warmup.vert", theDirectory + "/warmup_fog.vert" };
+	std::string theFragFiles[] = { theDirectory + "/warmup.frag", theDirectory + "/warmup_fog.frag" };
+	std::string theManifestFile = theDirectory + "/warmup.manifest";
+	bool isWritten = writeFile(theVertFiles[0], "#version 120\nattribute vec4 Position;\nvoid main()\n{\n#ifdef INSTANCED\n\tgl_Position = Position * 2.0;\n#else\n\tgl_Position = Position;\n#endif\n}\n");
+	isWritten = writeFile(theVertFiles[1], "#version 120\nattribute vec4 Position;\nvoid main()\n{\n#ifdef INSTANCED\n\tgl_Position = Position * 4.0;\n#else\n\tgl_Position = Position * 3.0;\n#endif\n}\n") && isWritten;
+	isWritten = writeFile(theFragFiles[0], "#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color;\n}\n") && isWritten;
+	isWritten = writeFile(theFragFiles[1], "#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color * 0.5;\n}\n") && isWritten;
+	isWritten = writeFile(theManifestFile, "# warm-up test\n\nshadertests/warmup.vert shadertests/warmup.frag\r\n"
+		"shadertests/warmup.vert\tshadertests/warmup.frag +INSTANCED # variant\nshadertests/warmup.vert shadertests/warmup.frag\nshadertests/warmup.vert\n") && isWritten;
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	CShaderManager* theManager = CShaderManager::GetInstance();
+	CShaderWarmUp theWarmUp;
+	CHECK(!theWarmUp.LoadManifest("shadertests/missing.manifest") && theWarmUp.GetCount() == 0 && theWarmUp.IsDone());
+	CHECK(theWarmUp.LoadManifest(theManifestFile.c_str()) && theWarmUp.GetCount() == 2 && theWarmUp.GetProgress() == 0.f);
+	CShaderManager::TShaderHandle theProgram = theManager->FindProgram(theVertFiles[0].c_str(), theFragFiles[0].c_str(), NULL);
+	CShaderManager::TShaderHandle theVariant = theManager->GetVariant(theProgram, theManager->RegisterFeature("INSTANCED"));
+	CHECK(theProgram != CShaderManager::DEFAULT_SHADER_HANDLE && theVariant != theProgram);
+
+	// without budget every frame runs one step: read, one compile per stage, link and validate,
+	// then a frame finds the program done
+	int theFrameCount = 0;
+	unsigned int theStepCount = 0;
+	while (!theWarmUp.Update(0.0) && theFrameCount < WARM_UP_MAX_FRAMES)
+	{
+		++theFrameCount;
+		unsigned int theSteps = 0;
+		for (int i = 0; i < CShaderManager::LOAD_STEP_COUNT; ++i)
+			theSteps += theWarmUp.GetStepCount((CShaderManager::ELoadStep)i);
+		CHECK(theSteps == theStepCount || theSteps == theStepCount + 1);
+		theStepCount = theSteps;
+		if (theFrameCount == 6)
+			CHECK(theWarmUp.GetDoneCount() == 1 && theWarmUp.GetProgress() == 0.5f);
+	}
+	CHECK(theFrameCount == 11 && theWarmUp.IsDone() && theWarmUp.GetProgress() == 1.f);
+	CHECK(theWarmUp.GetStepCount(CShaderManager::LOAD_READ) == 2 && theWarmUp.GetStepCount(CShaderManager::LOAD_COMPILE) == 4);
+	CHECK(theWarmUp.GetStepCount(CShaderManager::LOAD_LINK) == 2 && theWarmUp.GetStepCount(CShaderManager::LOAD_VALIDATE) == 2);
+	double theWarmUpTime = theWarmUp.GetWarmUpTime();
+	CHECK(theWarmUpTime > 0.0 && theWarmUp.GetWarmUpTime() == theWarmUpTime);
+
+	// the prepared programs are used without compiling anything
+	unsigned int theShaderCount = CStubGL::GetShaderCount();
+	CHECK(theManager->GetShader(theProgram)->GetProgram() != 0 && theManager->GetShader(theVariant)->GetProgram() != 0);
+	CHECK(CStubGL::GetShaderCount() == theShaderCount);
+
+	// a compile longer than the budget ends the frame, after the read in the first frame, and a large budget finishes in one frame
+	CShaderWarmUp theSlowWarmUp;
+	CShaderManager::TShaderHandle theFogProgram = theManager->RegisterProgram(theVertFiles[1].c_str(), theFragFiles[1].c_str(), NULL);
+	theSlowWarmUp.Add(theFogProgram);
+	theSlowWarmUp.Add(theManager->GetVariant(theFogProgram, theManager->RegisterFeature("INSTANCED")));
+	theSlowWarmUp.Add(theFogProgram);
+	CHECK(theSlowWarmUp.GetCount() == 2);
+	CStubGL::SetCompileLatency(WARM_UP_COMPILE_LATENCY);
+	for (int i = 0; i < 2; ++i)
+	{
+		unsigned int theCompileCount = theSlowWarmUp.GetStepCount(CShaderManager::LOAD_COMPILE);
+		CHECK(!theSlowWarmUp.Update(WARM_UP_BUDGET));
+		CHECK(theSlowWarmUp.GetStepCount(CShaderManager::LOAD_COMPILE) == theCompileCount + 1);
+	}
+	CStubGL::SetCompileLatency(0.0);
+	CHECK(theSlowWarmUp.Update(1.0) && theSlowWarmUp.GetStepCount(CShaderManager::LOAD_COMPILE) == 4);
+
+	CShaderManager::DestroyInstance();
+	for (int i = 0; i < 2; ++i)
+	{
+		remove(theVertFiles[i].c_str());
+		remove(theFragFiles[i].c_str());
+	}
+	remove(theManifestFile.c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// Look up a uniform of a shader until the reloads are done, count the lookups which found no program or no uniform.
+/// The lookups hold the frame lock, the reloading thread takes it for the Update() deleting the replaced programs
+static void lookUpUniforms(CShader* inShader, std::mutex* inFrameMutex, const std::atomic<bool>* inIsDone, std::atomic<int>* outBatchCount, std::atomic<int>* outMissCount)
+{
+	while (!inIsDone->load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> theLock(*inFrameMutex);
+		for (int i = 0; i < RELOAD_LOOKUP_COUNT; ++i)
+		{
+			if (inShader->GetProgram() == 0 || inShader->GetUniformIndex("Color") < 0)
+				outMissCount->fetch_add(1, std::memory_order_relaxed);
+		}
+		outBatchCount->fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+/// A reloaded program is swapped into its shader at once, a reload which fails to compile keeps the last good one
+static void testShaderManagerReloadSwapsProgram()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	// Color moves from the first location to the third one and back at each reload
+	static const char* const FRAG_SOURCES[] = {
+		"#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color;\n}\n",
+		"#version 120\nuniform vec4 Tint;\nuniform vec4 Fog;\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color * Tint + Fog;\n}\n"
+	};
+	std::string theVertFile = theDirectory + "/reload.vert";
+	std::string theFragFile = theDirectory + "/reload.frag";
+	bool isWritten = writeFile(theVertFile, "#version 120\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = Position;\n}\n");
+	isWritten = writeFile(theFragFile, FRAG_SOURCES[0]) && isWritten;
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	CTestShaderManager* theManager = new CTestShaderManager;
+	CShader* theShader = theManager->GetShader(theVertFile.c_str(), theFragFile.c_str(), NULL);
+	CHECK(theShader != NULL && theShader->GetProgram() != 0 && theShader->GetUniformIndex("Color") >= 0);
+
+	// the test thread is the rendering thread, it reloads while another thread reads the shader;
+	// the Update() after a reload deletes the replaced program, no lookup may span it
+	std::mutex theFrameMutex;
+	std::atomic<bool> isDone(false);
+	std::atomic<int> theBatchCount(0);
+	std::atomic<int> theMissCount(0);
+	std::thread theReader(lookUpUniforms, theShader, &theFrameMutex, &isDone, &theBatchCount, &theMissCount);
+	bool isReloaded = true;
+	for (int i = 1; i <= RELOAD_ROUNDS; ++i)
+	{
+		writeFile(theFragFile, FRAG_SOURCES[i % 2]);
+		unsigned int theProgram = theShader->GetProgram();
+		{
+			std::lock_guard<std::mutex> theLock(theFrameMutex);
+			theManager->InvalidateFile(theFragFile.c_str());
+			theManager->Update();
+		}
+
+		// the reader runs again before the reload is published
+		int theBatch = theBatchCount.load(std::memory_order_relaxed);
+		while (theBatchCount.load(std::memory_order_relaxed) == theBatch)
+			std::this_thread::yield();
+		for (int u = 0; u < 4 && theShader->GetProgram() == theProgram; ++u)
+			theManager->Update();
+		isReloaded = isReloaded && theShader->GetProgram() != theProgram;
+	}
+	isDone.store(true, std::memory_order_release);
+	theReader.join();
+	CHECK(isReloaded);
+	CHECK(theMissCount.load() == 0);
+	CHECK(theShader->GetUniformIndex("Color") == 0);
+
+	// a source which fails to compile leaves the shader as it was
+	unsigned int theProgram = theShader->GetProgram();
+	writeFile(theFragFile, "#version 120\n#error broken\nvoid main() {}\n");
+	theManager->InvalidateFile(theFragFile.c_str());
+	for (int u = 0; u < 4; ++u)
+		theManager->Update();
+	CHECK(theShader->GetProgram() == theProgram);
+	CHECK(theShader->GetUniformIndex("Color") == 0);
+	CHECK(theManager->GetShader(theVertFile.c_str(), theFragFile.c_str(), NULL) == theShader);
+
+	delete theManager;
+	remove(theVertFile.c_str());
+	remove(theFragFile.c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// Over budget, the least recently used unreferenced programs are evicted, and loaded again into the same shader
+static void testShaderManagerEvictionPinRestore()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	std::string theFragFile = theDirectory + "/evict.frag";
+	bool isWritten = writeFile(theFragFile, "#version 120\nuniform vec4 Color;\nvoid main()\n{\n\tgl_FragColor = Color;\n}\n");
+	std::string theVertFiles[EVICT_PROGRAM_COUNT];
+	for (int i = 0; i < EVICT_PROGRAM_COUNT; ++i)
+	{
+		char theName[64];
+		sprintf(theName, "/evict%d.vert", i);
+		theVertFiles[i] = theDirectory + theName;
+
+		char theSource[256];
+		sprintf(theSource, "#version 120\nattribute vec4 Position;\nvoid main()\n{\n\tgl_Position = Position * %d.0;\n}\n", i + 1);
+		isWritten = writeFile(theVertFiles[i], theSource) && isWritten;
+	}
+	CHECK(isWritten);
+	if (!isWritten)
+		return;
+
+	// one program used per frame, the first one referenced
+	CTestShaderManager* theManager = new CTestShaderManager;
+	theManager->SetCacheBudget(EVICT_PROGRAM_COUNT - 1, 0);
+	CShaderManager::TShaderHandle theHandles[EVICT_PROGRAM_COUNT];
+	CShader* theShaders[EVICT_PROGRAM_COUNT];
+	for (int i = 0; i < EVICT_PROGRAM_COUNT; ++i)
+	{
+		theManager->Update();
+		theHandles[i] = theManager->RegisterProgram(theVertFiles[i].c_str(), theFragFile.c_str(), NULL);
+		theShaders[i] = theManager->GetShader(theHandles[i]);
+		CHECK(theShaders[i]->GetProgram() != 0);
+	}
+	theManager->AcquireProgram(theHandles[0]);
+	unsigned int theProgramCount = CStubGL::GetProgramCount();
+	CShaderManager::SCacheStats theStats;
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.programCount == EVICT_PROGRAM_COUNT && theStats.stageCount == EVICT_PROGRAM_COUNT + 1);
+
+	// the second program is the oldest one not referenced, its shader has no program at once
+	theManager->Update();
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.programCount == EVICT_PROGRAM_COUNT - 1 && theStats.evictedCount == 1 && theStats.evictionCount == 1);
+	CHECK(theStats.referencedCount == 1);
+	CHECK(theShaders[0]->GetProgram() != 0 && theShaders[1]->GetProgram() == 0 && theShaders[2]->GetProgram() != 0);
+	CHECK(!theShaders[1]->IsPending() && theShaders[1]->GetUniformIndex("Color") == -1);
+
+	// its program and vertex stage are deleted by the next frame, a reload of its file is dropped
+	CHECK(CStubGL::GetProgramCount() == theProgramCount);
+	theManager->InvalidateFile(theVertFiles[1].c_str());
+	theManager->Update();
+	theManager->GetCacheStats(theStats);
+	CHECK(CStubGL::GetProgramCount() == theProgramCount - 1 && theStats.stageCount == EVICT_PROGRAM_COUNT);
+	CHECK(theShaders[1]->GetProgram() == 0 && theStats.evictedCount == 1);
+
+	// using it again loads it into the same shader, then the third program is the oldest one
+	CHECK(theManager->GetShader(theHandles[1]) == theShaders[1]);
+	CHECK(theShaders[1]->GetProgram() != 0 && theShaders[1]->GetUniformIndex("Color") >= 0);
+	theManager->Update();
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.restoreCount == 1 && theStats.evictionCount == 2 && theStats.evictedCount == 1);
+	CHECK(theShaders[1]->GetProgram() != 0 && theShaders[2]->GetProgram() == 0);
+
+	// without its reference the first program is the oldest one
+	theManager->ReleaseProgram(theHandles[0]);
+	theManager->SetCacheBudget(1, 0);
+	theManager->Update();
+	theManager->GetCacheStats(theStats);
+	CHECK(theStats.referencedCount == 0 && theStats.evictionCount == 3 && theStats.programCount == 1);
+	CHECK(theShaders[0]->GetProgram() == 0 && theShaders[1]->GetProgram() != 0);
+
+	delete theManager;
+	remove(theFragFile.c_str());
+	for (int i = 0; i < EVICT_PROGRAM_COUNT; ++i)
+		remove(theVertFiles[i].c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// Store the binary of a program again and again, from a thread of the binary cache test
+static void storeBinaries(CProgramBinaryCache* inCache, uint64_t inKey, unsigned int inProgram)
+{
+	for (int i = 0; i < BINARY_STORE_COUNT; ++i)
+		inCache->Store(inKey, inProgram);
+}
+
+static void testBinaryCacheHitMissRejected()
+{
+	static const char* const DIRECTORY = "shadertests_cache";
+	GLEW_ARB_get_program_binary = 1;
+	CProgramBinaryCache theCache;
+	CHECK(theCache.Initialize(DIRECTORY));
+	uint64_t theKey = theCache.GetKey(1);
+	char theFileName[64];
+	sprintf(theFileName, "%s/%016llx.bin", DIRECTORY, (unsigned long long)theKey);
+	remove(theFileName);
+
+	CShader theShader;
+	createShader(theShader, "uniform mat4 ProjMatrix;\nattribute vec3 Position;\nvoid main() {}\n");
+	CShader theOtherShader;
+	createShader(theOtherShader, "uniform vec4 Color;\nattribute vec3 Position;\nattribute vec2 TexCoord;\nvoid main() {}\n");
+
+	GLuint theProgram = glCreateProgram();
+	CHECK(!theCache.Load(theKey, theProgram));
+	CHECK(theCache.GetHits() == 0 && theCache.GetMisses() == 1);
+
+	// two threads store under the same key, each write goes through a file of its own
+	// so the binary is the whole one of either program
+	std::thread theThread(storeBinaries, &theCache, theKey, theShader.GetProgram());
+	storeBinaries(&theCache, theKey, theOtherShader.GetProgram());
+	theThread.join();
+	CHECK(theCache.Load(theKey, theProgram));
+	CHECK(theCache.GetHits() == 1 && theCache.GetMisses() == 1);
+	bool isShader = glGetUniformLocation(theProgram, "ProjMatrix") == 0 && glGetAttribLocation(theProgram, "TexCoord") == -1;
+	bool isOtherShader = glGetUniformLocation(theProgram, "Color") == 0 && glGetAttribLocation(theProgram, "TexCoord") == 1;
+	CHECK(isShader || isOtherShader);
+
+	// after a driver update the binary is rejected, the program has to be linked from its sources
+	CStubGL::SetBinaryFormat(2);
+	GLuint theRejectedProgram = glCreateProgram();
+	CHECK(!theCache.Load(theKey, theRejectedProgram));
+	CHECK(theCache.GetHits() == 1 && theCache.GetMisses() == 2);
+	GLint theStatus = GL_TRUE;
+	glGetProgramiv(theRejectedProgram, GL_LINK_STATUS, &theStatus);
+	CHECK(theStatus == GL_FALSE);
+	CStubGL::SetBinaryFormat(1);
+
+	// no temporary file is left behind
+	CHECK(remove(theFileName) == 0);
+	CHECK(rmdir(DIRECTORY) == 0);
+	glDeleteProgram(theRejectedProgram);
+	glDeleteProgram(theProgram);
+	glDeleteProgram(theOtherShader.GetProgram());
+	glDeleteProgram(theShader.GetProgram());
+	GLEW_ARB_get_program_binary = 0;
+}
+
+/// Read a whole file, empty if it cannot be read
+static std::string readFile(const std::string& inFileName)
+{
+	std::string theContent;
+	FILE* pFile = fopen(inFileName.c_str(), "rb");
+	if (pFile == NULL)
+		return theContent;
+	char theBuffer[256];
+	for (size_t theCount; (theCount = fread(theBuffer, 1, sizeof(theBuffer), pFile)) > 0; )
+		theContent.append(theBuffer, theCount);
+	fclose(pFile);
+	return theContent;
+}
+
+/// The stats file holds the counters, the totals by phase and by program and the phases in the order they ended,
+/// with the file names escaped; probes are ignored while disabled and phases started before a reset are dropped
+static void testShaderStatsWriteJSON()
+{
+	std::string theDirectory = "shadertests";
+#ifdef _WIN32
+	_mkdir(theDirectory.c_str());
+#else
+	mkdir(theDirectory.c_str(), 0755);
+#endif
+	std::string theFileName = theDirectory + "/stats.json";
+	CShaderStats* theStats = CShaderStats::GetInstance();
+	CShaderStats::SetEnabled(true);
+	double theStaleStart = CShaderStats::BeginPhase();
+	CShaderStats::SetEnabled(true);
+	CShaderStats::EndPhase(CShaderStats::PHASE_VALIDATE, 7, -1, NULL, theStaleStart);
+
+	static const char* const STAGE_FILE = "shadertests/a\"b\\c\t.vert";
+	CShaderStats::Count(CShaderStats::COUNTER_SHADER_HITS, 3);
+	CShaderStats::Count(CShaderStats::COUNTER_SOURCE_BYTES, 100);
+	CShaderStats::EndPhase(CShaderStats::PHASE_READ, 7, 0, STAGE_FILE, CShaderStats::BeginPhase());
+	CShaderStats::EndPhase(CShaderStats::PHASE_COMPILE, 7, 0, STAGE_FILE, CShaderStats::BeginPhase());
+	CShaderStats::EndPhase(CShaderStats::PHASE_LINK, 8, -1, NULL, CShaderStats::BeginPhase());
+	CShaderStats::EndPhase(CShaderStats::PHASE_LINK, 8, -1, NULL, CShaderStats::BeginPhase());
+
+	CShaderStats::SetEnabled(false);
+	CShaderStats::Count(CShaderStats::COUNTER_SHADER_MISSES);
+	CHECK(CShaderStats::BeginPhase() == 0.0);
+	CShaderStats::EndPhase(CShaderStats::PHASE_LINK, 8, -1, NULL, CShaderStats::GetTime());
+	CHECK(theStats->GetCounter(CShaderStats::COUNTER_SHADER_HITS) == 3 && theStats->GetCounter(CShaderStats::COUNTER_SHADER_MISSES) == 0);
+	CHECK(theStats->GetPhaseCount(CShaderStats::PHASE_LINK) == 2 && theStats->GetPhaseCount(CShaderStats::PHASE_VALIDATE) == 0);
+
+	CHECK(!theStats->WriteJSON("shadertests/missing/stats.json"));
+	CHECK(theStats->WriteJSON(theFileName.c_str()));
+
+	// the times vary, the value of each "ms" and "...Ms" key is replaced with T
+	std::string theJSON = readFile(theFileName);
+	for (size_t thePos = 0; (thePos = theJSON.find("s\": ", thePos)) != std::string::npos; )
+	{
+		bool isTime = (theJSON[thePos - 1] == 'M' || theJSON.compare(thePos - 2, 2, "\"m") == 0);
+		thePos += 4;
+		if (isTime)
+			theJSON.replace(thePos, theJSON.find_first_not_of("0123456789.", thePos) - thePos, "T");
+	}
+	const char* const EXPECTED_JSON =
+		"{\n"
+		"  \"counters\": {\n"
+		"    \"shaderHits\": 3,\n"
+		"    \"shaderMisses\": 0,\n"
+		"    \"uniformLookups\": 0,\n"
+		"    \"attributeLookups\": 0,\n"
+		"    \"sourceBytes\": 100\n"
+		"  },\n"
+		"  \"phases\": {\n"
+		"    \"read\": { \"count\": 1, \"ms\": T },\n"
+		"    \"compile\": { \"count\": 1, \"ms\": T },\n"
+		"    \"link\": { \"count\": 2, \"ms\": T },\n"
+		"    \"validate\": { \"count\": 0, \"ms\": T }\n"
+		"  },\n"
+		"  \"programs\": [\n"
+		"    { \"program\": 7, \"readMs\": T, \"compileMs\": T, \"linkMs\": T, \"validateMs\": T },\n"
+		"    { \"program\": 8, \"readMs\": T, \"compileMs\": T, \"linkMs\": T, \"validateMs\": T }\n"
+		"  ],\n"
+		"  \"events\": [\n"
+		"    { \"phase\": \"read\", \"program\": 7, \"stage\": 0, \"file\": \"shadertests/a\\\"b\\\\c\\u0009.vert\", \"thread\": 0, \"startMs\": T, \"ms\": T },\n"
+		"    { \"phase\": \"compile\", \"program\": 7, \"stage\": 0, \"file\": \"shadertests/a\\\"b\\\\c\\u0009.vert\", \"thread\": 0, \"startMs\": T, \"ms\": T },\n"
+		"    { \"phase\": \"link\", \"program\": 8, \"stage\": -1, \"file\": \"\", \"thread\": 0, \"startMs\": T, \"ms\": T },\n"
+		"    { \"phase\": \"link\", \"program\": 8, \"stage\": -1, \"file\": \"\", \"thread\": 0, \"startMs\": T, \"ms\": T }\n"
+		"  ]\n"
+		"}\n";
+	CHECK(theJSON == EXPECTED_JSON);
+
+	theStats->Reset();
+	remove(theFileName.c_str());
+	rmdir(theDirectory.c_str());
+}
+
+/// A test and its name
+struct STest
+{
+	const char* name;
+	void (*function)();
+};
+
+int main(int argc, const char* argv[])
+{
+	const STest TESTS[] = {
+		{ "state_cache_filters_redundant_calls", testStateCacheFiltersRedundantCalls },
+		{ "state_cache_deletes_and_invalidate", testStateCacheDeletesAndInvalidate },
+		{ "uniform_ring_waits_fence_on_wrap", testUniformRingWaitsFenceOnWrap },
+		{ "shader_reflection_handles", testShaderReflectionHandles },
+		{ "shader_skips_redundant_uniforms", testShaderSkipsRedundantUniforms },
+		{ "vertex_array_cache_resets_divisors", testVertexArrayCacheResetsDivisors },
+		{ "vertex_array_cache_unbinds_empty_shader", testVertexArrayCacheUnbindsEmptyShader },
+		{ "render_queue_sorts_and_batches", testRenderQueueSortsAndBatches },
+		{ "shader_manager_concurrent_loads", testShaderManagerConcurrentLoads },
+		{ "shader_manager_shares_stages", testShaderManagerSharesStages },
+		{ "shader_manager_program_handles", testShaderManagerProgramHandles },
+		{ "shader_manager_failed_load_is_default", testShaderManagerFailedLoadIsDefault },
+		{ "shader_preprocessor_includes", testShaderPreprocessorIncludes },
+		{ "shader_manager_variant_defines", testShaderManagerVariantDefines },
+		{ "shader_manager_include_reload", testShaderManagerIncludeReload },
+		{ "shader_warm_up_steps_within_budget", testShaderWarmUpStepsWithinBudget },
+		{ "shader_manager_reload_swaps_program", testShaderManagerReloadSwapsProgram },
+		{ "shader_manager_eviction_pin_restore", testShaderManagerEvictionPinRestore },
+		{ "binary_cache_hit_miss_rejected", testBinaryCacheHitMissRejected },
+		{ "shader_stats_write_json", testShaderStatsWriteJSON },
+	};
+
+	int theFailedTests = 0;
+	for (size_t i = 0; i < sizeof(TESTS) / sizeof(TESTS[0]); ++i)
+	{
+		int theFailures = s_FailureCount;
+		TESTS[i].function();
+		bool isPassed = (s_FailureCount == theFailures);
+		fprintf(stderr, "%-40s %s\n", TESTS[i].name, isPassed ? "passed" : "FAILED");
+		if (!isPassed)
+			++theFailedTests;
+	}
+
+	fprintf(stderr, "%d of %d tests failed\n", theFailedTests, (int)(sizeof(TESTS) / sizeof(TESTS[0])));
+	return (theFailedTests == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
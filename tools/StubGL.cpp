@@ -0,0 +1,851 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "StubGL.h"
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+/// A shader object: its type and source, and once compiled its status and log
+struct SStubShader
+{
+	GLenum type;
+	std::string source;
+	bool isCompiled;
+	std::string log;
+};
+
+/// A variable reflected by a link, an array has a size above 1
+struct SStubVariable
+{
+	std::string name;
+	GLenum type;
+	GLint size;
+};
+
+/// A program object: its stages and, once linked, its variables
+struct SStubProgram
+{
+	std::vector<GLuint> shaders;
+	std::vector<SStubVariable> uniforms;
+	std::vector<SStubVariable> attributes;
+	bool isLinked;
+};
+
+/// Objects by name, any thread may compile and link
+static std::map<GLuint, SStubShader> s_Shaders;
+static std::map<GLuint, SStubProgram> s_Programs;
+static GLuint s_NextName = 1;
+static std::mutex s_Mutex;
+
+/// Storage of the buffers created by glBufferStorage and the bound buffer of each target,
+/// only used by the rendering thread, so persistent mappings point to real memory
+static std::map<GLuint, std::vector<char> > s_BufferStorage;
+static std::map<GLenum, GLuint> s_BufferBindings;
+
+/// Format of the program binaries, glProgramBinary rejects the other ones
+static GLenum s_BinaryFormat = 1;
+
+/// Waits each fence times out before it signals, and the waits left of the fences not deleted
+static int s_SyncTimeoutCount = 0;
+static std::map<GLuint, int> s_SyncTimeouts;
+
+static std::string s_LastCompileLog;
+static double s_CompileLatency = 0.0;
+static double s_LinkLatency = 0.0;
+static std::atomic<uint64_t> s_CallCount(0);
+
+/// Calls recorded while recording is on
+static std::atomic<bool> s_IsRecording(false);
+static std::vector<std::string> s_RecordedCalls;
+
+/// Count a call
+#define STUB_CALL() s_CallCount.fetch_add(1, std::memory_order_relaxed)
+
+/// Record a call while recording, the arguments are formatted by printf
+#define STUB_RECORD(...) if (s_IsRecording.load(std::memory_order_relaxed)) Record(__VA_ARGS__)
+
+extern "C"
+{
+int GLEW_VERSION_3_3 = 0;
+int GLEW_ARB_base_instance = 0;
+int GLEW_ARB_buffer_storage = 0;
+int GLEW_ARB_draw_instanced = 0;
+int GLEW_ARB_get_program_binary = 0;
+int GLEW_ARB_instanced_arrays = 0;
+int GLEW_ARB_multi_draw_indirect = 0;
+int GLEW_ARB_shader_draw_parameters = 0;
+int GLEW_ARB_shader_storage_buffer_object = 0;
+int GLEW_ARB_timer_query = 0;
+int GLEW_ARB_uniform_buffer_object = 0;
+int GLEW_ARB_vertex_array_object = 0;
+int GLEW_KHR_parallel_shader_compile = 0;
+}
+
+void CStubGL::SetCompileLatency(double inSeconds)
+{
+	s_CompileLatency = inSeconds;
+}
+
+void CStubGL::SetLinkLatency(double inSeconds)
+{
+	s_LinkLatency = inSeconds;
+}
+
+void CStubGL::SetBinaryFormat(unsigned int inFormat)
+{
+	s_BinaryFormat = inFormat;
+}
+
+void CStubGL::SetSyncTimeoutCount(int inCount)
+{
+	s_SyncTimeoutCount = inCount;
+}
+
+uint64_t CStubGL::GetCallCount()
+{
+	return s_CallCount.load(std::memory_order_relaxed);
+}
+
+unsigned int CStubGL::GetShaderCount()
+{
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	return (unsigned int)s_Shaders.size();
+}
+
+unsigned int CStubGL::GetProgramCount()
+{
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	return (unsigned int)s_Programs.size();
+}
+
+std::string CStubGL::GetShaderSource(unsigned int inShader)
+{
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	std::map<GLuint, SStubShader>::const_iterator theIt = s_Shaders.find(inShader);
+	return (theIt != s_Shaders.end()) ? theIt->second.source : std::string();
+}
+
+std::string CStubGL::GetLastCompileLog()
+{
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	return s_LastCompileLog;
+}
+
+void CStubGL::ResetCallCount()
+{
+	s_CallCount.store(0, std::memory_order_relaxed);
+}
+
+void CStubGL::SetRecording(bool inIsRecording)
+{
+	ClearRecordedCalls();
+	s_IsRecording.store(inIsRecording, std::memory_order_relaxed);
+}
+
+std::vector<std::string> CStubGL::GetRecordedCalls()
+{
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	return s_RecordedCalls;
+}
+
+void CStubGL::ClearRecordedCalls()
+{
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	s_RecordedCalls.clear();
+}
+
+/// Append a call to the recorded calls
+static void Record(const char* inFormat, ...)
+{
+	char theCall[256];
+	va_list theArgs;
+	va_start(theArgs, inFormat);
+	vsnprintf(theCall, sizeof(theCall), inFormat, theArgs);
+	va_end(theArgs);
+
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	s_RecordedCalls.push_back(theCall);
+}
+
+/// Values of a recorded glUniform* call, space separated
+template <typename T>
+static std::string UniformValues(GLsizei inCount, int inComponents, const T* inValues)
+{
+	std::string theValues;
+	for (int i = 0; i < inCount * inComponents; ++i)
+	{
+		char theValue[32];
+		snprintf(theValue, sizeof(theValue), (i == 0) ? "%g" : " %g", (double)inValues[i]);
+		theValues += theValue;
+	}
+	return theValues;
+}
+
+/// Name of an enum in recorded calls, its hexadecimal value if it has no name here
+static std::string EnumName(GLenum inValue)
+{
+	static const struct { GLenum value; const char* name; } NAMES[] = {
+		{ GL_ARRAY_BUFFER, "GL_ARRAY_BUFFER" }, { GL_ELEMENT_ARRAY_BUFFER, "GL_ELEMENT_ARRAY_BUFFER" },
+		{ GL_UNIFORM_BUFFER, "GL_UNIFORM_BUFFER" }, { GL_DRAW_INDIRECT_BUFFER, "GL_DRAW_INDIRECT_BUFFER" },
+		{ GL_SHADER_STORAGE_BUFFER, "GL_SHADER_STORAGE_BUFFER" }, { GL_COPY_READ_BUFFER, "GL_COPY_READ_BUFFER" },
+		{ GL_TEXTURE_2D, "GL_TEXTURE_2D" }, { GL_TEXTURE_CUBE_MAP, "GL_TEXTURE_CUBE_MAP" }, { GL_TEXTURE_3D, "GL_TEXTURE_3D" },
+		{ GL_DEPTH_TEST, "GL_DEPTH_TEST" }, { GL_BLEND, "GL_BLEND" }, { GL_CULL_FACE, "GL_CULL_FACE" },
+		{ GL_SCISSOR_TEST, "GL_SCISSOR_TEST" }, { GL_STENCIL_TEST, "GL_STENCIL_TEST" }, { GL_POLYGON_OFFSET_FILL, "GL_POLYGON_OFFSET_FILL" },
+	};
+	for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); ++i)
+	{
+		if (NAMES[i].value == inValue)
+			return NAMES[i].name;
+	}
+
+	char theName[32];
+	if (inValue >= GL_TEXTURE0 && inValue <= GL_TEXTURE31)
+		sprintf(theName, "GL_TEXTURE%u", inValue - GL_TEXTURE0);
+	else
+		sprintf(theName, "0x%04X", inValue);
+	return theName;
+}
+
+/// Spin for a latency, sleeping is too coarse for the microseconds of a small compile
+static void Spin(double inSeconds)
+{
+	if (inSeconds <= 0.0)
+		return;
+
+	std::chrono::steady_clock::time_point theEnd = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(inSeconds));
+	while (std::chrono::steady_clock::now() < theEnd);
+}
+
+/// GL type of a GLSL type name
+static GLenum GetType(const std::string& inName)
+{
+	static const struct { const char* name; GLenum type; } TYPES[] = {
+		{ "float", GL_FLOAT }, { "vec2", GL_FLOAT_VEC2 }, { "vec3", GL_FLOAT_VEC3 }, { "vec4", GL_FLOAT_VEC4 },
+		{ "mat2", GL_FLOAT_MAT2 }, { "mat3", GL_FLOAT_MAT3 }, { "mat4", GL_FLOAT_MAT4 },
+		{ "int", GL_INT }, { "ivec2", GL_INT_VEC2 }, { "ivec3", GL_INT_VEC3 }, { "ivec4", GL_INT_VEC4 },
+		{ "uint", GL_UNSIGNED_INT }, { "bool", GL_BOOL }, { "sampler2D", GL_SAMPLER_2D },
+	};
+	for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); ++i)
+	{
+		if (inName == TYPES[i].name)
+			return TYPES[i].type;
+	}
+	return GL_FLOAT_VEC4;
+}
+
+/// Whether a character can be part of an identifier
+static inline bool IsIdentifier(char inChar)
+{
+	return (inChar >= 'a' && inChar <= 'z') || (inChar >= 'A' && inChar <= 'Z') || (inChar >= '0' && inChar <= '9') || inChar == '_';
+}
+
+/// Read the identifier at a position, skipping blanks before it
+static std::string ReadIdentifier(const std::string& inSource, size_t& ioPos)
+{
+	while (ioPos < inSource.length() && (inSource[ioPos] == ' ' || inSource[ioPos] == '\t'))
+		++ioPos;
+	size_t theBegin = ioPos;
+	while (ioPos < inSource.length() && IsIdentifier(inSource[ioPos]))
+		++ioPos;
+	return inSource.substr(theBegin, ioPos - theBegin);
+}
+
+/// Add the declarations of a stage to the program's variables, a variable declared by two stages once
+static void Reflect(const SStubShader& inShader, SStubProgram& ioProgram)
+{
+	const std::string& theSource = inShader.source;
+	for (size_t theLine = 0; theLine < theSource.length(); )
+	{
+		size_t thePos = theLine;
+		std::string theQualifier = ReadIdentifier(theSource, thePos);
+		std::vector<SStubVariable>* theTable = NULL;
+		if (theQualifier == "uniform")
+			theTable = &ioProgram.uniforms;
+		else if (theQualifier == "attribute" || (theQualifier == "in" && inShader.type == GL_VERTEX_SHADER))
+			theTable = &ioProgram.attributes;
+
+		if (theTable != NULL)
+		{
+			SStubVariable theVariable;
+			theVariable.type = GetType(ReadIdentifier(theSource, thePos));
+			theVariable.name = ReadIdentifier(theSource, thePos);
+			theVariable.size = 1;
+			if (thePos < theSource.length() && theSource[thePos] == '[')
+				theVariable.size = std::max(atoi(theSource.c_str() + thePos + 1), 1);
+
+			bool isFound = theVariable.name.empty();
+			for (size_t i = 0; i < theTable->size() && !isFound; ++i)
+				isFound = ((*theTable)[i].name == theVariable.name);
+			if (!isFound)
+				theTable->push_back(theVariable);
+		}
+
+		theLine = theSource.find('\n', theLine);
+		if (theLine == std::string::npos)
+			break;
+		++theLine;
+	}
+}
+
+/// Write the variables of a linked program as its binary, one "<table> <type> <size> <name>" line each
+static std::string GetBinary(const SStubProgram& inProgram)
+{
+	std::string theBinary;
+	char theLine[256];
+	for (size_t i = 0; i < inProgram.uniforms.size(); ++i)
+	{
+		snprintf(theLine, sizeof(theLine), "u %u %d %s\n", inProgram.uniforms[i].type, inProgram.uniforms[i].size, inProgram.uniforms[i].name.c_str());
+		theBinary += theLine;
+	}
+	for (size_t i = 0; i < inProgram.attributes.size(); ++i)
+	{
+		snprintf(theLine, sizeof(theLine), "a %u %d %s\n", inProgram.attributes[i].type, inProgram.attributes[i].size, inProgram.attributes[i].name.c_str());
+		theBinary += theLine;
+	}
+	return theBinary;
+}
+
+/// Read the variables of a program back from its binary
+static bool SetBinary(const std::string& inBinary, SStubProgram& ioProgram)
+{
+	ioProgram.uniforms.clear();
+	ioProgram.attributes.clear();
+	for (size_t theLine = 0; theLine < inBinary.length(); )
+	{
+		size_t theEnd = inBinary.find('\n', theLine);
+		if (theEnd == std::string::npos)
+			return false;
+
+		char theTable = 0;
+		char theName[256];
+		SStubVariable theVariable;
+		if (sscanf(inBinary.substr(theLine, theEnd - theLine).c_str(), "%c %u %d %255s", &theTable, &theVariable.type, &theVariable.size, theName) != 4)
+			return false;
+		theVariable.name = theName;
+		if (theTable == 'u')
+			ioProgram.uniforms.push_back(theVariable);
+		else if (theTable == 'a')
+			ioProgram.attributes.push_back(theVariable);
+		else
+			return false;
+		theLine = theEnd + 1;
+	}
+	return true;
+}
+
+/// Compile a shader: an "#error" line fails it, the log gives its "<source string>:<line>"
+/// numbered by the #line directives, the way the #version of the shader has them
+static void Compile(SStubShader& ioShader)
+{
+	ioShader.isCompiled = true;
+	ioShader.log.clear();
+
+	const std::string& theSource = ioShader.source;
+	unsigned int theVersion = 0;
+	unsigned int theLine = 1;
+	unsigned int theString = 0;
+	for (size_t thePos = 0; thePos < theSource.length(); ++theLine)
+	{
+		size_t theEnd = theSource.find('\n', thePos);
+		if (theEnd == std::string::npos)
+			theEnd = theSource.length();
+		std::string theText = theSource.substr(thePos, theEnd - thePos);
+		thePos = theEnd + 1;
+
+		unsigned int theNumber = 0;
+		if (sscanf(theText.c_str(), "#version %u", &theVersion) == 1)
+			continue;
+		if (sscanf(theText.c_str(), "#line %u %u", &theNumber, &theString) >= 1)
+		{
+			// since GLSL 3.30 and in GLSL ES the directive numbers the next line, before it numbers itself
+			bool isNextLine = (theVersion >= 300 || theVersion == 100);
+			theLine = isNextLine ? theNumber - 1 : theNumber;
+			continue;
+		}
+		if (theText.compare(0, 6, "#error") == 0 && ioShader.isCompiled)
+		{
+			char theLog[64];
+			snprintf(theLog, sizeof(theLog), "%u:%u(1): error: #error\n", theString, theLine);
+			ioShader.log = theLog;
+			ioShader.isCompiled = false;
+		}
+	}
+}
+
+/// Copy a name to a GL output buffer
+static void CopyName(const std::string& inName, GLsizei inBufSize, GLsizei* outLength, GLchar* outName)
+{
+	GLsizei theLength = (GLsizei)inName.length();
+	if (theLength > inBufSize - 1)
+		theLength = inBufSize - 1;
+	if (theLength < 0)
+		return;
+	memcpy(outName, inName.c_str(), theLength);
+	outName[theLength] = 0;
+	if (outLength != NULL)
+		*outLength = theLength;
+}
+
+/// Location of a variable, its index
+static GLint FindLocation(const std::vector<SStubVariable>& inTable, const GLchar* inName)
+{
+	// the variables follow each other, an array takes a location per element
+	GLint theLocation = 0;
+	for (size_t i = 0; i < inTable.size(); ++i)
+	{
+		const std::string& theName = inTable[i].name;
+		if (theName == inName)
+			return theLocation;
+
+		// an element of an array, "name[element]"
+		if (inTable[i].size > 1 && strncmp(inName, theName.c_str(), theName.length()) == 0 && inName[theName.length()] == '[')
+		{
+			char* theEnd = NULL;
+			long theElement = strtol(inName + theName.length() + 1, &theEnd, 10);
+			if (theEnd != inName + theName.length() + 1 && strcmp(theEnd, "]") == 0 && theElement >= 0 && theElement < inTable[i].size)
+				return theLocation + (GLint)theElement;
+		}
+		theLocation += inTable[i].size;
+	}
+	return -1;
+}
+
+extern "C"
+{
+
+int glewInit() { return GLEW_OK; }
+
+// shaders and programs
+GLuint APIENTRY glCreateShader(GLenum type)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	GLuint theName = s_NextName++;
+	s_Shaders[theName].type = type;
+	s_Shaders[theName].isCompiled = false;
+	return theName;
+}
+
+void APIENTRY glShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	std::string& theSource = s_Shaders[shader].source;
+	theSource.clear();
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (length != NULL && length[i] >= 0)
+			theSource.append(string[i], length[i]);
+		else
+			theSource.append(string[i]);
+	}
+}
+
+void APIENTRY glCompileShader(GLuint shader)
+{
+	STUB_CALL();
+	Spin(s_CompileLatency);
+
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	SStubShader& theShader = s_Shaders[shader];
+	Compile(theShader);
+	if (!theShader.isCompiled)
+		s_LastCompileLog = theShader.log;
+}
+
+void APIENTRY glGetShaderiv(GLuint shader, GLenum pname, GLint* params)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	const SStubShader& theShader = s_Shaders[shader];
+	switch (pname)
+	{
+	case GL_COMPILE_STATUS:
+		*params = theShader.isCompiled ? GL_TRUE : GL_FALSE;
+		break;
+	case GL_COMPLETION_STATUS_KHR:
+		*params = GL_TRUE;
+		break;
+	case GL_INFO_LOG_LENGTH:
+		*params = (GLint)theShader.log.length() + 1;
+		break;
+	default:
+		*params = 0;
+		break;
+	}
+}
+
+void APIENTRY glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	CopyName(s_Shaders[shader].log, bufSize, length, infoLog);
+}
+
+void APIENTRY glDeleteShader(GLuint shader)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	s_Shaders.erase(shader);
+}
+
+GLuint APIENTRY glCreateProgram(void)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	GLuint theName = s_NextName++;
+	s_Programs[theName].isLinked = false;
+	return theName;
+}
+
+void APIENTRY glAttachShader(GLuint program, GLuint shader)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	s_Programs[program].shaders.push_back(shader);
+}
+
+void APIENTRY glLinkProgram(GLuint program)
+{
+	STUB_CALL();
+	Spin(s_LinkLatency);
+
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	SStubProgram& theProgram = s_Programs[program];
+	theProgram.uniforms.clear();
+	theProgram.attributes.clear();
+	theProgram.isLinked = true;
+	for (size_t i = 0; i < theProgram.shaders.size(); ++i)
+	{
+		// a stage which failed to compile fails the link
+		std::map<GLuint, SStubShader>::const_iterator iter = s_Shaders.find(theProgram.shaders[i]);
+		if (iter != s_Shaders.end())
+		{
+			Reflect(iter->second, theProgram);
+			theProgram.isLinked &= iter->second.isCompiled;
+		}
+	}
+}
+
+void APIENTRY glValidateProgram(GLuint program) { STUB_CALL(); }
+void APIENTRY glProgramParameteri(GLuint program, GLenum pname, GLint value) { STUB_CALL(); }
+
+void APIENTRY glGetProgramiv(GLuint program, GLenum pname, GLint* params)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	const SStubProgram& theProgram = s_Programs[program];
+	GLint theMaxLength = 0;
+	switch (pname)
+	{
+	case GL_LINK_STATUS:
+	case GL_VALIDATE_STATUS:
+	case GL_COMPLETION_STATUS_KHR:
+		*params = theProgram.isLinked ? GL_TRUE : GL_FALSE;
+		break;
+	case GL_ACTIVE_UNIFORMS:
+		*params = (GLint)theProgram.uniforms.size();
+		break;
+	case GL_ACTIVE_ATTRIBUTES:
+		*params = (GLint)theProgram.attributes.size();
+		break;
+	case GL_ACTIVE_UNIFORM_MAX_LENGTH:
+		// with the "[0]" of an array
+		for (size_t i = 0; i < theProgram.uniforms.size(); ++i)
+			theMaxLength = std::max(theMaxLength, (GLint)theProgram.uniforms[i].name.length() + 4);
+		*params = theMaxLength;
+		break;
+	case GL_ACTIVE_ATTRIBUTE_MAX_LENGTH:
+		for (size_t i = 0; i < theProgram.attributes.size(); ++i)
+			theMaxLength = std::max(theMaxLength, (GLint)theProgram.attributes[i].name.length() + 1);
+		*params = theMaxLength;
+		break;
+	case GL_PROGRAM_BINARY_LENGTH:
+		*params = theProgram.isLinked ? (GLint)GetBinary(theProgram).length() : 0;
+		break;
+	default:
+		*params = 0;
+		break;
+	}
+}
+
+void APIENTRY glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+	STUB_CALL();
+	CopyName("", bufSize, length, infoLog);
+}
+
+void APIENTRY glDeleteProgram(GLuint program)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	s_Programs.erase(program);
+}
+
+void APIENTRY glGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	const SStubVariable& theVariable = s_Programs[program].uniforms.at(index);
+	CopyName((theVariable.size > 1) ? theVariable.name + "[0]" : theVariable.name, bufSize, length, name);
+	*size = theVariable.size;
+	*type = theVariable.type;
+}
+
+void APIENTRY glGetActiveAttrib(GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	const SStubVariable& theVariable = s_Programs[program].attributes.at(index);
+	CopyName(theVariable.name, bufSize, length, name);
+	*size = 1;
+	*type = theVariable.type;
+}
+
+GLint APIENTRY glGetUniformLocation(GLuint program, const GLchar* name)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	return FindLocation(s_Programs[program].uniforms, name);
+}
+
+GLint APIENTRY glGetAttribLocation(GLuint program, const GLchar* name)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	return FindLocation(s_Programs[program].attributes, name);
+}
+
+void APIENTRY glGetProgramBinary(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	std::string theBinary = GetBinary(s_Programs[program]);
+	GLsizei theLength = std::min((GLsizei)theBinary.length(), bufSize);
+	memcpy(binary, theBinary.data(), theLength);
+	if (length != NULL)
+		*length = theLength;
+	*binaryFormat = s_BinaryFormat;
+}
+
+void APIENTRY glProgramBinary(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	SStubProgram& theProgram = s_Programs[program];
+	theProgram.isLinked = (binaryFormat == s_BinaryFormat)
+		&& SetBinary(std::string((const char*)binary, length), theProgram);
+}
+
+// uniform blocks are not supported, see the GLEW flags
+void APIENTRY glGetActiveUniformBlockName(GLuint program, GLuint uniformBlockIndex, GLsizei bufSize, GLsizei* length, GLchar* uniformBlockName) { STUB_CALL(); CopyName("", bufSize, length, uniformBlockName); }
+void APIENTRY glGetActiveUniformBlockiv(GLuint program, GLuint uniformBlockIndex, GLenum pname, GLint* params) { STUB_CALL(); *params = 0; }
+void APIENTRY glGetActiveUniformName(GLuint program, GLuint uniformIndex, GLsizei bufSize, GLsizei* length, GLchar* uniformName) { STUB_CALL(); CopyName("", bufSize, length, uniformName); }
+void APIENTRY glGetActiveUniformsiv(GLuint program, GLsizei uniformCount, const GLuint* uniformIndices, GLenum pname, GLint* params) { STUB_CALL(); memset(params, 0, uniformCount * sizeof(GLint)); }
+void APIENTRY glUniformBlockBinding(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding) { STUB_CALL(); }
+void APIENTRY glMaxShaderCompilerThreadsKHR(GLuint count) { STUB_CALL(); }
+
+// uniforms
+void APIENTRY glUseProgram(GLuint program) { STUB_CALL(); STUB_RECORD("glUseProgram(%u)", program); }
+void APIENTRY glUniform1fv(GLint location, GLsizei count, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniform1fv(%d, %d, %s)", location, count, UniformValues(count, 1, value).c_str()); }
+void APIENTRY glUniform2fv(GLint location, GLsizei count, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniform2fv(%d, %d, %s)", location, count, UniformValues(count, 2, value).c_str()); }
+void APIENTRY glUniform3fv(GLint location, GLsizei count, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniform3fv(%d, %d, %s)", location, count, UniformValues(count, 3, value).c_str()); }
+void APIENTRY glUniform4fv(GLint location, GLsizei count, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniform4fv(%d, %d, %s)", location, count, UniformValues(count, 4, value).c_str()); }
+void APIENTRY glUniform1iv(GLint location, GLsizei count, const GLint* value) { STUB_CALL(); STUB_RECORD("glUniform1iv(%d, %d, %s)", location, count, UniformValues(count, 1, value).c_str()); }
+void APIENTRY glUniform2iv(GLint location, GLsizei count, const GLint* value) { STUB_CALL(); STUB_RECORD("glUniform2iv(%d, %d, %s)", location, count, UniformValues(count, 2, value).c_str()); }
+void APIENTRY glUniform3iv(GLint location, GLsizei count, const GLint* value) { STUB_CALL(); STUB_RECORD("glUniform3iv(%d, %d, %s)", location, count, UniformValues(count, 3, value).c_str()); }
+void APIENTRY glUniform4iv(GLint location, GLsizei count, const GLint* value) { STUB_CALL(); STUB_RECORD("glUniform4iv(%d, %d, %s)", location, count, UniformValues(count, 4, value).c_str()); }
+void APIENTRY glUniform1uiv(GLint location, GLsizei count, const GLuint* value) { STUB_CALL(); STUB_RECORD("glUniform1uiv(%d, %d, %s)", location, count, UniformValues(count, 1, value).c_str()); }
+void APIENTRY glUniform2uiv(GLint location, GLsizei count, const GLuint* value) { STUB_CALL(); STUB_RECORD("glUniform2uiv(%d, %d, %s)", location, count, UniformValues(count, 2, value).c_str()); }
+void APIENTRY glUniform3uiv(GLint location, GLsizei count, const GLuint* value) { STUB_CALL(); STUB_RECORD("glUniform3uiv(%d, %d, %s)", location, count, UniformValues(count, 3, value).c_str()); }
+void APIENTRY glUniform4uiv(GLint location, GLsizei count, const GLuint* value) { STUB_CALL(); STUB_RECORD("glUniform4uiv(%d, %d, %s)", location, count, UniformValues(count, 4, value).c_str()); }
+void APIENTRY glUniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix2fv(%d, %d, %s)", location, count, UniformValues(count, 4, value).c_str()); }
+void APIENTRY glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix3fv(%d, %d, %s)", location, count, UniformValues(count, 9, value).c_str()); }
+void APIENTRY glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix4fv(%d, %d, %s)", location, count, UniformValues(count, 16, value).c_str()); }
+void APIENTRY glUniformMatrix2x3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix2x3fv(%d, %d, %s)", location, count, UniformValues(count, 6, value).c_str()); }
+void APIENTRY glUniformMatrix2x4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix2x4fv(%d, %d, %s)", location, count, UniformValues(count, 8, value).c_str()); }
+void APIENTRY glUniformMatrix3x2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix3x2fv(%d, %d, %s)", location, count, UniformValues(count, 6, value).c_str()); }
+void APIENTRY glUniformMatrix3x4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix3x4fv(%d, %d, %s)", location, count, UniformValues(count, 12, value).c_str()); }
+void APIENTRY glUniformMatrix4x2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix4x2fv(%d, %d, %s)", location, count, UniformValues(count, 8, value).c_str()); }
+void APIENTRY glUniformMatrix4x3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { STUB_CALL(); STUB_RECORD("glUniformMatrix4x3fv(%d, %d, %s)", location, count, UniformValues(count, 12, value).c_str()); }
+
+// state, buffers, vertex arrays and syncs
+void APIENTRY glEnable(GLenum cap) { STUB_CALL(); STUB_RECORD("glEnable(%s)", EnumName(cap).c_str()); }
+void APIENTRY glDisable(GLenum cap) { STUB_CALL(); STUB_RECORD("glDisable(%s)", EnumName(cap).c_str()); }
+void APIENTRY glFlush(void) { STUB_CALL(); }
+void APIENTRY glActiveTexture(GLenum texture) { STUB_CALL(); STUB_RECORD("glActiveTexture(%s)", EnumName(texture).c_str()); }
+void APIENTRY glBindTexture(GLenum target, GLuint texture) { STUB_CALL(); STUB_RECORD("glBindTexture(%s, %u)", EnumName(target).c_str(), texture); }
+void APIENTRY glGetIntegerv(GLenum pname, GLint* params)
+{
+	STUB_CALL();
+	if (pname == GL_NUM_PROGRAM_BINARY_FORMATS)
+		*params = 1;
+	else if (pname == GL_UNIFORM_BUFFER_BINDING)
+		*params = (GLint)s_BufferBindings[GL_UNIFORM_BUFFER];
+	else
+		*params = 0;
+}
+const GLubyte* APIENTRY glGetString(GLenum name) { STUB_CALL(); return (const GLubyte*)"Stub"; }
+void APIENTRY glGenBuffers(GLsizei n, GLuint* buffers)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	for (GLsizei i = 0; i < n; ++i)
+		buffers[i] = s_NextName++;
+}
+void APIENTRY glDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	STUB_CALL();
+	for (GLsizei i = 0; i < n; ++i)
+		s_BufferStorage.erase(buffers[i]);
+}
+void APIENTRY glBindBuffer(GLenum target, GLuint buffer)
+{
+	STUB_CALL();
+	STUB_RECORD("glBindBuffer(%s, %u)", EnumName(target).c_str(), buffer);
+	s_BufferBindings[target] = buffer;
+}
+void APIENTRY glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	STUB_CALL();
+	s_BufferBindings[target] = buffer;
+	STUB_RECORD("glBindBufferRange(%s, %u, %u, %lld, %lld)", EnumName(target).c_str(), index, buffer, (long long)offset, (long long)size);
+}
+void APIENTRY glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) { STUB_CALL(); }
+void APIENTRY glBufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+	STUB_CALL();
+	std::vector<char>& theStorage = s_BufferStorage[s_BufferBindings[target]];
+	theStorage.assign((size_t)size, 0);
+	if (data != NULL)
+		memcpy(&theStorage[0], data, (size_t)size);
+}
+void APIENTRY glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	STUB_CALL();
+	STUB_RECORD("glBufferSubData(%s, %lld, %lld)", EnumName(target).c_str(), (long long)offset, (long long)size);
+}
+void* APIENTRY glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	STUB_CALL();
+	std::map<GLuint, std::vector<char> >::iterator theStorage = s_BufferStorage.find(s_BufferBindings[target]);
+	if (theStorage == s_BufferStorage.end() || (size_t)(offset + length) > theStorage->second.size())
+		return NULL;
+	return &theStorage->second[offset];
+}
+GLboolean APIENTRY glUnmapBuffer(GLenum target) { STUB_CALL(); return GL_TRUE; }
+void APIENTRY glGenVertexArrays(GLsizei n, GLuint* arrays)
+{
+	STUB_CALL();
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	for (GLsizei i = 0; i < n; ++i)
+		arrays[i] = s_NextName++;
+}
+void APIENTRY glDeleteVertexArrays(GLsizei n, const GLuint* arrays) { STUB_CALL(); }
+void APIENTRY glBindVertexArray(GLuint array) { STUB_CALL(); STUB_RECORD("glBindVertexArray(%u)", array); }
+void APIENTRY glEnableVertexAttribArray(GLuint index) { STUB_CALL(); STUB_RECORD("glEnableVertexAttribArray(%u)", index); }
+void APIENTRY glDisableVertexAttribArray(GLuint index) { STUB_CALL(); STUB_RECORD("glDisableVertexAttribArray(%u)", index); }
+void APIENTRY glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+{
+	STUB_CALL();
+	STUB_RECORD("glVertexAttribPointer(%u, %d, %d, %zu)", index, size, stride, (size_t)pointer);
+}
+void APIENTRY glVertexAttribDivisor(GLuint index, GLuint divisor) { STUB_CALL(); STUB_RECORD("glVertexAttribDivisor(%u, %u)", index, divisor); }
+GLsync APIENTRY glFenceSync(GLenum condition, GLbitfield flags)
+{
+	STUB_CALL();
+	GLuint theName;
+	{
+		std::lock_guard<std::mutex> theLock(s_Mutex);
+		theName = s_NextName++;
+		s_SyncTimeouts[theName] = s_SyncTimeoutCount;
+	}
+	STUB_RECORD("glFenceSync(%u)", theName);
+	return (GLsync)(size_t)theName;
+}
+GLenum APIENTRY glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	STUB_CALL();
+	STUB_RECORD("glClientWaitSync(%u, %u)", (GLuint)(size_t)sync, flags);
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	int& theTimeouts = s_SyncTimeouts[(GLuint)(size_t)sync];
+	if (theTimeouts == 0)
+		return GL_ALREADY_SIGNALED;
+	--theTimeouts;
+	return GL_TIMEOUT_EXPIRED;
+}
+void APIENTRY glDeleteSync(GLsync sync)
+{
+	STUB_CALL();
+	STUB_RECORD("glDeleteSync(%u)", (GLuint)(size_t)sync);
+	std::lock_guard<std::mutex> theLock(s_Mutex);
+	s_SyncTimeouts.erase((GLuint)(size_t)sync);
+}
+
+// draws, counted and recorded but not rasterized
+void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+	STUB_CALL();
+	STUB_RECORD("glDrawElements(%d, %zu)", count, (size_t)indices);
+}
+void APIENTRY glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount)
+{
+	STUB_CALL();
+	STUB_RECORD("glDrawElementsInstanced(%d, %zu, %d)", count, (size_t)indices, instancecount);
+}
+void APIENTRY glDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLuint baseinstance)
+{
+	STUB_CALL();
+	STUB_RECORD("glDrawElementsInstancedBaseInstance(%d, %zu, %d, %u)", count, (size_t)indices, instancecount, baseinstance);
+}
+void APIENTRY glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint basevertex)
+{
+	STUB_CALL();
+	STUB_RECORD("glDrawElementsBaseVertex(%d, %zu, %d)", count, (size_t)indices, basevertex);
+}
+void APIENTRY glMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride)
+{
+	STUB_CALL();
+	STUB_RECORD("glMultiDrawElementsIndirect(%zu, %d)", (size_t)indirect, drawcount);
+}
+
+// timer queries are not supported, see the GLEW flags
+void APIENTRY glGenQueries(GLsizei n, GLuint* ids) { STUB_CALL(); memset(ids, 0, n * sizeof(GLuint)); }
+void APIENTRY glDeleteQueries(GLsizei n, const GLuint* ids) { STUB_CALL(); }
+void APIENTRY glQueryCounter(GLuint id, GLenum target) { STUB_CALL(); }
+void APIENTRY glGetQueryiv(GLenum target, GLenum pname, GLint* params) { STUB_CALL(); *params = 0; }
+void APIENTRY glGetQueryObjectiv(GLuint id, GLenum pname, GLint* params) { STUB_CALL(); *params = 0; }
+void APIENTRY glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params) { STUB_CALL(); *params = 0; }
+
+} // extern "C"
@@ -0,0 +1,89 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef STUB_GL_H
+#define STUB_GL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Settings and counters of the stub GL implementation of tools/StubGL.cpp.
+ * Shader and program objects are kept in memory: a compile keeps the source,
+ * a link reflects the uniforms and attributes declared by the attached stages
+ * ("uniform <type> <name>;", "attribute <type> <name>;" and the vertex stage's
+ * "in <type> <name>;", the name optionally followed by "[<size>]"), and both
+ * spin for a configurable latency to stand for the driver's work. Variables
+ * take consecutive locations, one per array element. A stage with an "#error"
+ * line fails to compile, and its program to link. A program binary holds
+ * the reflected variables. Fences signal after a configurable number of waits.
+ * Everything else is a no-op; the binds, enables, program changes, uniform
+ * uploads, buffer updates and fences can be recorded as text to check a call stream.
+ */
+class CStubGL
+{
+public:
+	/// Time a glCompileShader/glLinkProgram takes, in seconds, 0 by default
+	static void SetCompileLatency(double inSeconds);
+	static void SetLinkLatency(double inSeconds);
+
+	/// Format of the program binaries from now on, the binaries of another format are rejected
+	static void SetBinaryFormat(unsigned int inFormat);
+
+	/// Number of glClientWaitSync calls each fence created from now on times out before it signals, 0 by default
+	static void SetSyncTimeoutCount(int inCount);
+
+	/// Number of GL calls made and of shader and program objects alive
+	static uint64_t GetCallCount();
+	static unsigned int GetShaderCount();
+	static unsigned int GetProgramCount();
+
+	/// Get the source of a shader object, its glShaderSource strings joined
+	static std::string GetShaderSource(unsigned int inShader);
+
+	/// Get the log of the last failed compile, e.g. "0:4(1): error: #error\n"
+	static std::string GetLastCompileLog();
+
+	/// Reset the call count
+	static void ResetCallCount();
+
+	/**
+	 * Record the state changing calls from now on, as text with the enum names,
+	 * e.g. "glBindBuffer(GL_ARRAY_BUFFER, 3)", and forget the calls recorded so far
+	 */
+	static void SetRecording(bool inIsRecording);
+
+	/// Get the calls recorded since recording started or was cleared
+	static std::vector<std::string> GetRecordedCalls();
+
+	/// Forget the calls recorded so far
+	static void ClearRecordedCalls();
+
+}; // end class CStubGL
+
+#endif
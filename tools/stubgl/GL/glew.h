@@ -0,0 +1,74 @@
+/**
+Copyright (c) 2012 - Luu Gia Thuy
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Stand-in for GLEW used by tools/ShaderBenchmark.cpp: the GL entry points are
+ * declared as plain functions, implemented by tools/StubGL.cpp, and the GLEW
+ * extension flags are variables the benchmark sets. Only the GL headers of the
+ * system are needed, no driver and no context.
+ */
+
+#pragma once
+
+#ifndef STUB_GLEW_H
+#define STUB_GLEW_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#define GLEW_OK 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int glewInit();
+
+/// Extension flags, all 0 unless set by the benchmark
+extern int GLEW_VERSION_3_3;
+extern int GLEW_ARB_base_instance;
+extern int GLEW_ARB_buffer_storage;
+extern int GLEW_ARB_draw_instanced;
+extern int GLEW_ARB_get_program_binary;
+extern int GLEW_ARB_instanced_arrays;
+extern int GLEW_ARB_multi_draw_indirect;
+extern int GLEW_ARB_shader_draw_parameters;
+extern int GLEW_ARB_shader_storage_buffer_object;
+extern int GLEW_ARB_timer_query;
+extern int GLEW_ARB_uniform_buffer_object;
+extern int GLEW_ARB_vertex_array_object;
+extern int GLEW_KHR_parallel_shader_compile;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif